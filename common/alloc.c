@@ -110,6 +110,7 @@ static int sysnum_SetInformationProcess = -1;
 uint num_mallocs;
 uint num_large_mallocs;
 uint num_frees;
+uint malloc_stripe_busy;
 #endif
 
 /* points at the per-malloc API to use */
@@ -2937,12 +2938,47 @@ event_post_call_entry_added(app_pc postcall)
  * insertions and deletions), so sticking with a hashtable!
  */
 #define ALLOC_TABLE_HASH_BITS 12
-static hashtable_t malloc_table;
+/* To avoid serializing every malloc and free in the app on a single lock,
+ * the table is split into stripes keyed by chunk address, each with its own
+ * table and lock.  Whole-table operations (malloc_lock(), malloc_iterate())
+ * acquire every stripe.  When alloc_ops.global_lock is set we use a single
+ * stripe, which keeps the old single-lock semantics the client relies on.
+ *
+ * To avoid deadlock, a thread only blocks on a stripe whose index is above
+ * that of every stripe it holds.  A nested acquisition of a lower stripe
+ * (e.g., looking up neighbors while reporting an invalid free) first
+ * try-locks it; if it is busy, the higher stripes are released and then
+ * re-acquired in order after it.  The whole-table lock likewise releases
+ * whatever stripes the thread holds and then acquires all of them in order.
+ * Thus a caller must not rely on an entry in a stripe it holds across a
+ * nested lookup or whole-table operation.  A caller that needs both, such as
+ * handle_free_pre() when it reports an error, should hold the whole-table
+ * lock throughout instead: nothing is released while it is held.
+ */
+#define MALLOC_STRIPE_BITS 4
+#define MALLOC_STRIPE_MAX (1 << MALLOC_STRIPE_BITS)
+/* Low address bits ignored when selecting a stripe */
+#define MALLOC_STRIPE_SHIFT 8
+typedef struct _malloc_stripe_t {
+    hashtable_t table;
+    void *lock;
+    thread_id_t owner;
+#ifdef WINDOWS
+    /* Inner dbgcrt entry in another stripe to remove once this one is
+     * released: see malloc_entry_remove().
+     */
+    app_pc remove_on_unlock;
+#endif
+} malloc_stripe_t;
+static malloc_stripe_t malloc_stripes[MALLOC_STRIPE_MAX];
+static uint num_malloc_stripes;
 /* we could switch to a full-fledged known-owner lock, or a recursive lock.
  * xref i#129.
  */
 #define THREAD_ID_INVALID ((thread_id_t)0) /* invalid thread id on Linux+Windows */
+/* Owner of the whole-table lock, and which stripes it held beforehand */
 static thread_id_t malloc_lock_owner = THREAD_ID_INVALID;
+static uint malloc_lock_prior;
 
 /* PR 525807: to handle malloc-based stacks we need an interval tree
  * for large mallocs.  Putting all mallocs in a tree instead of a table
@@ -2951,6 +2987,35 @@ static thread_id_t malloc_lock_owner = THREAD_ID_INVALID;
 static rb_tree_t *large_malloc_tree;
 static void *large_malloc_lock;
 
+/* Chunks announced by the app: see malloc_custom_add() */
+typedef struct _custom_chunk_t {
+    app_pc end;
+    uint client_flags;
+    void *client_data;
+} custom_chunk_t;
+
+#define CUSTOM_CHUNK_TABLE_HASH_BITS 8
+/* start => custom_chunk_t */
+static hashtable_t custom_chunk_table;
+/* Recursive since malloc_iterate() callbacks set client flags */
+static void *custom_chunk_lock;
+
+static void
+custom_chunk_to_info(app_pc start, custom_chunk_t *c, malloc_info_t *info OUT)
+{
+    memset(info, 0, sizeof(*info));
+    info->struct_size = sizeof(*info);
+    info->base = start;
+    info->request_size = c->end - start;
+    info->pad_size = info->request_size;
+    info->custom = true;
+    info->client_flags = c->client_flags;
+    info->client_data = c->client_data;
+}
+
+static void
+custom_chunk_exit(void);
+
 enum {
     MALLOC_VALID  = MALLOC_RESERVED_1,
     MALLOC_PRE_US = MALLOC_RESERVED_2,
@@ -3037,6 +3102,7 @@ malloc_entry_to_info(malloc_entry_t *e, malloc_info_t *info OUT)
         malloc_entry_redzone_size(e);
     info->pre_us = TEST(MALLOC_PRE_US, e->flags);
     info->has_redzone = TEST(MALLOC_HAS_REDZONE, e->flags);
+    info->custom = false;
     info->client_flags = e->flags & MALLOC_POSSIBLE_CLIENT_FLAGS;
     info->client_data = e->data;
 }
@@ -3101,6 +3167,10 @@ alloc_init(alloc_options_t *ops, size_t ops_size)
     if (alloc_ops.track_allocs) {
         large_malloc_tree = rb_tree_create(NULL);
         large_malloc_lock = dr_mutex_create();
+        hashtable_init_ex(&custom_chunk_table, CUSTOM_CHUNK_TABLE_HASH_BITS,
+                          HASH_INTPTR, false/*!str_dup*/, false/*!synch*/,
+                          NULL, NULL, NULL);
+        custom_chunk_lock = dr_recurlock_create();
     }
 
 #ifdef USE_DRSYMS
@@ -3146,10 +3216,17 @@ alloc_exit(void)
         alloc_replace_exit();
 
     if (alloc_ops.track_allocs) {
-        if (!alloc_ops.replace_malloc)
-            hashtable_delete_with_stats(&malloc_table, "malloc table");
+        if (!alloc_ops.replace_malloc) {
+            uint i;
+            for (i = 0; i < num_malloc_stripes; i++) {
+                hashtable_delete_with_stats(&malloc_stripes[i].table,
+                                            "malloc table stripe");
+                dr_mutex_destroy(malloc_stripes[i].lock);
+            }
+        }
         rb_tree_destroy(large_malloc_tree);
         dr_mutex_destroy(large_malloc_lock);
+        custom_chunk_exit();
 #ifdef USE_DRSYMS
         if (alloc_ops.cache_postcall) {
             dr_mutex_destroy(post_call_lock);
@@ -3746,31 +3823,208 @@ malloc_chunk_size_invalid_only(app_pc start)
 void *
 malloc_get_client_data(app_pc start)
 {
+    custom_chunk_t *c;
+    void *res = NULL;
+    if (custom_chunk_table.entries > 0) {
+        dr_recurlock_lock(custom_chunk_lock);
+        c = (custom_chunk_t *) hashtable_lookup(&custom_chunk_table, (void *)start);
+        if (c != NULL)
+            res = c->client_data;
+        dr_recurlock_unlock(custom_chunk_lock);
+        if (c != NULL)
+            return res;
+    }
     return malloc_interface.malloc_get_client_data(start);
 }
 
 uint
 malloc_get_client_flags(app_pc start)
 {
+    custom_chunk_t *c;
+    uint res = 0;
+    if (custom_chunk_table.entries > 0) {
+        dr_recurlock_lock(custom_chunk_lock);
+        c = (custom_chunk_t *) hashtable_lookup(&custom_chunk_table, (void *)start);
+        if (c != NULL)
+            res = c->client_flags;
+        dr_recurlock_unlock(custom_chunk_lock);
+        if (c != NULL)
+            return res;
+    }
     return malloc_interface.malloc_get_client_flags(start);
 }
 
+/* Returns false if start is not a custom chunk */
+static bool
+custom_chunk_change_flags(app_pc start, uint set, uint clear)
+{
+    custom_chunk_t *c;
+    if (custom_chunk_table.entries == 0)
+        return false;
+    dr_recurlock_lock(custom_chunk_lock);
+    c = (custom_chunk_t *) hashtable_lookup(&custom_chunk_table, (void *)start);
+    if (c != NULL) {
+        c->client_flags |= (set & MALLOC_POSSIBLE_CLIENT_FLAGS);
+        c->client_flags &= ~clear;
+    }
+    dr_recurlock_unlock(custom_chunk_lock);
+    return (c != NULL);
+}
+
 bool
 malloc_set_client_flag(app_pc start, uint client_flag)
 {
+    if (custom_chunk_change_flags(start, client_flag, 0))
+        return true;
     return malloc_interface.malloc_set_client_flag(start, client_flag);
 }
 
 bool
 malloc_clear_client_flag(app_pc start, uint client_flag)
 {
+    if (custom_chunk_change_flags(start, 0, client_flag))
+        return true;
     return malloc_interface.malloc_clear_client_flag(start, client_flag);
 }
 
+typedef struct _malloc_iter_data_t {
+    malloc_iter_cb_t cb;
+    void *iter_data;
+    bool stopped;
+} malloc_iter_data_t;
+
+static bool
+malloc_iterate_note_stop(malloc_info_t *info, void *iter_data)
+{
+    malloc_iter_data_t *data = (malloc_iter_data_t *) iter_data;
+    info->custom = false;
+    if (!data->cb(info, data->iter_data)) {
+        data->stopped = true;
+        return false;
+    }
+    return true;
+}
+
 void
 malloc_iterate(malloc_iter_cb_t cb, void *iter_data)
 {
-    malloc_interface.malloc_iterate(cb, iter_data);
+    malloc_iter_data_t data = {cb, iter_data, false};
+    uint i;
+    malloc_interface.malloc_iterate(malloc_iterate_note_stop, &data);
+    if (data.stopped || custom_chunk_table.entries == 0)
+        return;
+    /* The callback may set client flags, hence the recursive lock */
+    dr_recurlock_lock(custom_chunk_lock);
+    for (i = 0; i < HASHTABLE_SIZE(custom_chunk_table.table_bits); i++) {
+        hash_entry_t *he;
+        for (he = custom_chunk_table.table[i]; he != NULL; he = he->next) {
+            malloc_info_t info;
+            custom_chunk_to_info((app_pc)he->key, (custom_chunk_t *)he->payload,
+                                 &info);
+            if (!cb(&info, iter_data)) {
+                dr_recurlock_unlock(custom_chunk_lock);
+                return;
+            }
+        }
+    }
+    dr_recurlock_unlock(custom_chunk_lock);
+}
+
+/***************************************************************************
+ * Custom chunks
+ *
+ * Chunks that the app carves out of memory it obtained some other way, such as
+ * from its own pool allocator, and announces to us (e.g., via annotations).
+ * Neither malloc interface can hold a chunk that it did not allocate, so we
+ * keep them here and merge them in at the routing layer above.  They are
+ * reported as leaks with their own callstacks like any other chunk.
+ */
+
+void
+malloc_custom_add(app_pc start, app_pc end, dr_mcontext_t *mc, app_pc post_call)
+{
+    custom_chunk_t *c;
+    malloc_info_t info;
+    IF_DEBUG(bool new_entry;)
+    if (!alloc_ops.track_allocs)
+        return;
+    c = (custom_chunk_t *) global_alloc(sizeof(*c), HEAPSTAT_WRAP);
+    c->end = end;
+    c->client_flags = 0;
+    c->client_data = NULL;
+    custom_chunk_to_info(start, c, &info);
+    c->client_data = client_add_malloc_pre(&info, mc, post_call);
+    info.client_data = c->client_data;
+    dr_recurlock_lock(custom_chunk_lock);
+    IF_DEBUG(new_entry =)
+        hashtable_add(&custom_chunk_table, (void *)start, (void *)c);
+    dr_recurlock_unlock(custom_chunk_lock);
+    ASSERT(new_entry, "caller must remove an old chunk first");
+    LOG(2, "custom chunk "PFX"-"PFX"\n", start, end);
+    client_add_malloc_post(&info);
+}
+
+bool
+malloc_custom_remove(app_pc start)
+{
+    custom_chunk_t *c;
+    malloc_info_t info;
+    if (!alloc_ops.track_allocs)
+        return false;
+    dr_recurlock_lock(custom_chunk_lock);
+    c = (custom_chunk_t *) hashtable_lookup(&custom_chunk_table, (void *)start);
+    if (c != NULL)
+        hashtable_remove(&custom_chunk_table, (void *)start);
+    dr_recurlock_unlock(custom_chunk_lock);
+    if (c == NULL)
+        return false;
+    LOG(2, "removing custom chunk "PFX"-"PFX"\n", start, c->end);
+    custom_chunk_to_info(start, c, &info);
+    client_remove_malloc_pre(&info);
+    if (c->client_data != NULL)
+        client_malloc_data_free(c->client_data);
+    client_remove_malloc_post(&info);
+    global_free(c, sizeof(*c), HEAPSTAT_WRAP);
+    return true;
+}
+
+bool
+malloc_custom_resize(app_pc start, app_pc new_start, app_pc new_end)
+{
+    custom_chunk_t *c;
+    bool res = false;
+    if (!alloc_ops.track_allocs)
+        return false;
+    dr_recurlock_lock(custom_chunk_lock);
+    c = (custom_chunk_t *) hashtable_lookup(&custom_chunk_table, (void *)start);
+    if (c != NULL &&
+        (new_start == start ||
+         hashtable_lookup(&custom_chunk_table, (void *)new_start) == NULL)) {
+        /* keeps its callstack and flags */
+        hashtable_remove(&custom_chunk_table, (void *)start);
+        c->end = new_end;
+        hashtable_add(&custom_chunk_table, (void *)new_start, (void *)c);
+        res = true;
+    }
+    dr_recurlock_unlock(custom_chunk_lock);
+    return res;
+}
+
+static void
+custom_chunk_exit(void)
+{
+    uint i;
+    for (i = 0; i < HASHTABLE_SIZE(custom_chunk_table.table_bits); i++) {
+        hash_entry_t *he;
+        for (he = custom_chunk_table.table[i]; he != NULL; he = he->next) {
+            custom_chunk_t *c = (custom_chunk_t *) he->payload;
+            if (c->client_data != NULL)
+                client_malloc_data_free(c->client_data);
+            global_free(c, sizeof(*c), HEAPSTAT_WRAP);
+        }
+    }
+    hashtable_delete(&custom_chunk_table);
+    dr_recurlock_destroy(custom_chunk_lock);
 }
 
 /***************************************************************************
@@ -3781,45 +4035,190 @@ malloc_iterate(malloc_iter_cb_t cb, void *iter_data)
  * own or from within malloc_iterate(), so we need self-recursion support
  * of one level.  We do not need general recursion support.
  */
-static bool
-malloc_lock_held_by_self(void)
+static thread_id_t
+malloc_lock_self(void)
 {
-    /* reading this variable should be atomic */
     void *drcontext = dr_get_current_drcontext();
     if (drcontext == NULL) {
         ASSERT(false, "should always have dcontext w/ PR 536058");
-        return false;
+        return THREAD_ID_INVALID;
     }
-    return (dr_get_thread_id(drcontext) == malloc_lock_owner);
+    return dr_get_thread_id(drcontext);
+}
+
+static inline malloc_stripe_t *
+malloc_stripe(app_pc start)
+{
+    /* Multiplicative hash so the stripe is not correlated with the bucket
+     * selected by malloc_hash() within the stripe.
+     */
+    uint hash = (uint)((ptr_uint_t)start >> MALLOC_STRIPE_SHIFT) * 0x9e3779b1;
+    return &malloc_stripes[(hash >> (32 - MALLOC_STRIPE_BITS)) &
+                           (num_malloc_stripes - 1)];
+}
+
+/* reading the owner field should be atomic */
+static inline bool
+malloc_stripe_held_by(malloc_stripe_t *stripe, thread_id_t self)
+{
+    return (self != THREAD_ID_INVALID && stripe->owner == self);
+}
+
+/* Returns a bitmask of the stripes held by self */
+static uint
+malloc_stripes_held_by(thread_id_t self)
+{
+    uint i, held = 0;
+    for (i = 0; i < num_malloc_stripes; i++) {
+        if (malloc_stripe_held_by(&malloc_stripes[i], self))
+            held |= (1 << i);
+    }
+    return held;
+}
+
+static bool
+malloc_lock_held_by_self(void)
+{
+    return malloc_stripes_held_by(malloc_lock_self()) != 0;
+}
+
+/* Releases the stripes in the bitmask held, without processing any pending
+ * removal, for re-acquisition via malloc_stripes_acquire().
+ */
+static void
+malloc_stripes_release(uint held)
+{
+    uint i;
+    for (i = 0; i < num_malloc_stripes; i++) {
+        if (TEST(1 << i, held)) {
+            malloc_stripes[i].owner = THREAD_ID_INVALID;
+            dr_mutex_unlock(malloc_stripes[i].lock);
+        }
+    }
+}
+
+/* Blocks on the stripes in the bitmask want in index order.  The caller must
+ * hold no stripe above the lowest one in want.
+ */
+static void
+malloc_stripes_acquire(uint want, thread_id_t self)
+{
+    uint i;
+    for (i = 0; i < num_malloc_stripes; i++) {
+        if (TEST(1 << i, want)) {
+            dr_mutex_lock(malloc_stripes[i].lock);
+            malloc_stripes[i].owner = self;
+        }
+    }
+}
+
+/* Acquires stripe unless this thread already holds it, in which case
+ * *locked_by_me is set to false.  Blocks only in index order: see the top of
+ * this file.
+ */
+static void
+malloc_stripe_lock(malloc_stripe_t *stripe, OUT bool *locked_by_me)
+{
+    thread_id_t self = malloc_lock_self();
+    uint idx = (uint)(stripe - malloc_stripes);
+    uint above;
+    *locked_by_me = false;
+    if (malloc_stripe_held_by(stripe, self))
+        return;
+    above = malloc_stripes_held_by(self) & ~((1 << idx) - 1);
+    if (above == 0)
+        dr_mutex_lock(stripe->lock);
+    else if (!dr_mutex_trylock(stripe->lock)) {
+        STATS_INC(malloc_stripe_busy);
+        malloc_stripes_release(above);
+        dr_mutex_lock(stripe->lock);
+        malloc_stripes_acquire(above, self);
+    }
+    stripe->owner = self;
+    *locked_by_me = true;
+}
+
+#ifdef WINDOWS
+static void
+malloc_remove_libc_inner(app_pc start);
+#endif
+
+static void
+malloc_stripe_unlock(malloc_stripe_t *stripe, bool locked_by_me)
+{
+#ifdef WINDOWS
+    app_pc inner;
+#endif
+    if (!locked_by_me)
+        return;
+#ifdef WINDOWS
+    inner = stripe->remove_on_unlock;
+    stripe->remove_on_unlock = NULL;
+#endif
+    stripe->owner = THREAD_ID_INVALID;
+    dr_mutex_unlock(stripe->lock);
+#ifdef WINDOWS
+    if (inner != NULL)
+        malloc_remove_libc_inner(inner);
+#endif
+}
+
+/* Returns the stripe for start, to pass to malloc_unlock_if_locked_by_me() */
+static malloc_stripe_t *
+malloc_lock_if_not_held_by_me(app_pc start, OUT bool *locked_by_me)
+{
+    malloc_stripe_t *stripe = malloc_stripe(start);
+    malloc_stripe_lock(stripe, locked_by_me);
+    return stripe;
 }
 
+static void
+malloc_unlock_if_locked_by_me(malloc_stripe_t *stripe, bool by_me)
+{
+    malloc_stripe_unlock(stripe, by_me);
+}
+
+/* Acquires every stripe for whole-table operations */
 static void
 malloc_lock_internal(void)
 {
-    void *drcontext = dr_get_current_drcontext();
-    hashtable_lock(&malloc_table);
-    if (drcontext != NULL) /* paranoid even w/ PR 536058 */
-        malloc_lock_owner = dr_get_thread_id(drcontext);
+    thread_id_t self = malloc_lock_self();
+    uint prior = malloc_stripes_held_by(self);
+    /* Give up what we hold so we can block on every stripe in order.  The
+     * unlock keeps the prior stripes.
+     */
+    if (prior != 0) {
+        STATS_INC(malloc_stripe_busy);
+        malloc_stripes_release(prior);
+    }
+    malloc_stripes_acquire((1 << num_malloc_stripes) - 1, self);
+    malloc_lock_prior = prior;
+    malloc_lock_owner = self;
 }
 
 static void
 malloc_unlock_internal(void)
 {
+    uint i, prior = malloc_lock_prior;
     malloc_lock_owner = THREAD_ID_INVALID;
-    hashtable_unlock(&malloc_table);
+    for (i = num_malloc_stripes; i-- > 0; ) {
+        if (!TEST(1 << i, prior))
+            malloc_stripe_unlock(&malloc_stripes[i], true);
+    }
 }
 
 static bool
-malloc_lock_if_not_held_by_me(void)
+malloc_table_lock_if_not_held_by_me(void)
 {
-    if (malloc_lock_held_by_self())
+    thread_id_t self = malloc_lock_self();
+    if (self != THREAD_ID_INVALID && malloc_lock_owner == self)
         return false;
     malloc_lock_internal();
     return true;
 }
 
 static void
-malloc_unlock_if_locked_by_me(bool by_me)
+malloc_table_unlock_if_locked_by_me(bool by_me)
 {
     if (by_me)
         malloc_unlock_internal();
@@ -3830,13 +4229,15 @@ static void
 malloc_wrap__lock(void)
 {
     /* For external calls we can't store the result so we look up in unlock */
-    malloc_lock_if_not_held_by_me();
+    malloc_table_lock_if_not_held_by_me();
 }
 
 static void
 malloc_wrap__unlock(void)
 {
-    malloc_unlock_if_locked_by_me(malloc_lock_held_by_self());
+    thread_id_t self = malloc_lock_self();
+    malloc_table_unlock_if_locked_by_me(self != THREAD_ID_INVALID &&
+                                        malloc_lock_owner == self);
 }
 
 /* If a client needs the real (usable) end, for pre_us mallocs the client can't
@@ -3852,6 +4253,7 @@ malloc_add_common(app_pc start, app_pc end, app_pc real_end,
 {
     malloc_entry_t *e = (malloc_entry_t *) global_alloc(sizeof(*e), HEAPSTAT_WRAP);
     malloc_entry_t *old_e;
+    malloc_stripe_t *stripe;
     bool locked_by_me;
     malloc_info_t info;
     ASSERT((alloc_ops.redzone_size > 0 && TEST(MALLOC_PRE_US, flags)) ||
@@ -3870,7 +4272,7 @@ malloc_add_common(app_pc start, app_pc end, app_pc real_end,
     LOG(3, "%s: type=%x\n", __FUNCTION__, alloc_type);
     e->flags |= (client_flags & MALLOC_POSSIBLE_CLIENT_FLAGS);
     /* grab lock around client call and hashtable operations */
-    locked_by_me = malloc_lock_if_not_held_by_me();
+    stripe = malloc_lock_if_not_held_by_me(start, &locked_by_me);
 
     e->data = NULL;
     malloc_entry_to_info(e, &info);
@@ -3885,7 +4287,7 @@ malloc_add_common(app_pc start, app_pc end, app_pc real_end,
      * when the free succeeds, so a race can hit a conflict.
      * Update: we no longer do this but leaving code for now
      */
-    old_e = hashtable_add_replace(&malloc_table, (void *) start, (void *)e);
+    old_e = hashtable_add_replace(&stripe->table, (void *) start, (void *)e);
 
     if (!malloc_entry_is_native(e) && end - start >= LARGE_MALLOC_MIN_SIZE) {
         malloc_large_add(e->start, e->end - e->start);
@@ -3900,12 +4302,12 @@ malloc_add_common(app_pc start, app_pc end, app_pc real_end,
     if (!malloc_entry_is_native(e))
         STATS_INC(num_mallocs);
     if (num_mallocs % 10000 == 0) {
-        hashtable_cluster_stats(&malloc_table, "malloc table");
+        hashtable_cluster_stats(&stripe->table, "malloc table stripe");
         LOG(1, "malloc table stats after %u malloc calls\n", num_mallocs);
     }
 #endif
 
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
     if (old_e != NULL) {
         ASSERT(!TEST(MALLOC_VALID, old_e->flags), "internal error in malloc tracking");
         malloc_entry_free(old_e);
@@ -3924,11 +4326,13 @@ malloc_wrap__add(app_pc start, app_pc end, app_pc real_end,
                       client_flags, mc, post_call, 0);
 }
 
-/* up to caller to lock and unlock */
+/* up to caller to lock and unlock: stripe should be what
+ * malloc_lock_if_not_held_by_me() returned for start
+ */
 static malloc_entry_t *
-malloc_lookup(app_pc start)
+malloc_lookup(malloc_stripe_t *stripe, app_pc start)
 {
-    return hashtable_lookup(&malloc_table, (void *) start);
+    return hashtable_lookup(&stripe->table, (void *) start);
 }
 
 /* Note that this also frees the entry.  Caller should be holding lock. */
@@ -3937,6 +4341,7 @@ malloc_entry_remove(malloc_entry_t *e)
 {
     malloc_info_t info;
     bool native = malloc_entry_is_native(e);
+    malloc_stripe_t *stripe = malloc_stripe(e->start);
     ASSERT(e != NULL, "invalid arg");
     malloc_entry_to_info(e, &info);
     if (!native) {
@@ -3952,11 +4357,23 @@ malloc_entry_remove(malloc_entry_t *e)
      * a nop.
      */
     if (TEST(MALLOC_CONTAINS_LIBC_ALLOC, e->flags)) {
-        ASSERT(e->start + DBGCRT_PRE_REDZONE_SIZE < e->end, "invalid internal alloc");
-        hashtable_remove(&malloc_table, e->start + DBGCRT_PRE_REDZONE_SIZE);
+        app_pc inner = e->start + DBGCRT_PRE_REDZONE_SIZE;
+        malloc_stripe_t *inner_stripe = malloc_stripe(inner);
+        ASSERT(inner < e->end, "invalid internal alloc");
+        if (malloc_stripe_held_by(inner_stripe, malloc_lock_self()))
+            hashtable_remove(&inner_stripe->table, inner);
+        else {
+            /* Acquiring another stripe might release this one while we are in
+             * the middle of removing e, so we remove it once this one is
+             * released.  The inner alloc can't be re-used before the outer one
+             * is actually freed.
+             */
+            ASSERT(stripe->remove_on_unlock == NULL, "only one pending removal");
+            stripe->remove_on_unlock = inner;
+        }
     }
 #endif
-    if (hashtable_remove(&malloc_table, e->start)) {
+    if (hashtable_remove(&stripe->table, e->start)) {
 #ifdef STATISTICS
         if (!native)
             STATS_INC(num_frees);
@@ -3973,11 +4390,26 @@ static void
 malloc_remove(app_pc start)
 {
     malloc_entry_t *e;
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
-    e = malloc_lookup(start);
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
+    e = malloc_lookup(stripe, start);
     if (e != NULL)
         malloc_entry_remove(e);
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
+}
+
+/* Removes a fake inner dbgcrt entry (i#1072) after its outer entry's stripe
+ * has been released.
+ */
+static void
+malloc_remove_libc_inner(app_pc start)
+{
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
+    hashtable_remove(&stripe->table, start);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
 }
 #endif
 
@@ -4042,11 +4474,13 @@ static void
 malloc_set_valid(app_pc start, bool valid)
 {
     malloc_entry_t *e;
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
-    e = (malloc_entry_t *) hashtable_lookup(&malloc_table, (void *) start);
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
+    e = malloc_lookup(stripe, start);
     if (e != NULL)
         malloc_entry_set_valid(e, valid);
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
 }
 
 static bool
@@ -4088,12 +4522,14 @@ static uint
 malloc_alloc_type(byte *start)
 {
     malloc_entry_t *e;
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
     uint res = 0;
-    e = (malloc_entry_t *) hashtable_lookup(&malloc_table, (void *) start);
+    e = malloc_lookup(stripe, start);
     if (e != NULL)
         res = malloc_alloc_entry_type(e);
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
     return res;
 }
 
@@ -4102,11 +4538,13 @@ malloc_wrap__is_pre_us_ex(app_pc start, bool ok_if_invalid)
 {
     bool res = false;
     malloc_entry_t *e;
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
-    e = (malloc_entry_t *) hashtable_lookup(&malloc_table, (void *) start);
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
+    e = malloc_lookup(stripe, start);
     if (e != NULL)
         res = malloc_entry_is_pre_us(e, ok_if_invalid);
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
     return res;
 }
 
@@ -4141,10 +4579,12 @@ malloc_is_native(app_pc start, cls_alloc_t *pt, bool consider_being_freed)
 #ifdef WINDOWS
     bool res = false;
     malloc_entry_t *e;
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
-    e = (malloc_entry_t *) hashtable_lookup(&malloc_table, (void *) start);
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
+    e = malloc_lookup(stripe, start);
     res = malloc_entry_is_native_ex(e, start, pt, consider_being_freed);
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
     return res;
 #else
     /* optimization: currently nothing in the table */
@@ -4159,7 +4599,8 @@ malloc_is_native(app_pc start, cls_alloc_t *pt, bool consider_being_freed)
 static bool
 malloc_entry_exists_racy_nolock(app_pc start)
 {
-    malloc_entry_t *e = (malloc_entry_t *) hashtable_lookup(&malloc_table, (void *) start);
+    malloc_entry_t *e = (malloc_entry_t *)
+        hashtable_lookup(&malloc_stripe(start)->table, (void *) start);
     return (e != NULL && MALLOC_VISIBLE(e->flags));
 }
 #endif
@@ -4169,11 +4610,13 @@ malloc_wrap__end(app_pc start)
 {
     app_pc end = NULL;
     malloc_entry_t *e;
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
-    e = (malloc_entry_t *) hashtable_lookup(&malloc_table, (void *) start);
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
+    e = malloc_lookup(stripe, start);
     if (e != NULL && MALLOC_VISIBLE(e->flags))
         end = e->end;
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
     return end;
 }
 
@@ -4183,11 +4626,13 @@ malloc_wrap__size(app_pc start)
 {
     ssize_t sz = -1;
     malloc_entry_t *e;
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
-    e = (malloc_entry_t *) hashtable_lookup(&malloc_table, (void *) start);
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
+    e = malloc_lookup(stripe, start);
     if (e != NULL && MALLOC_VISIBLE(e->flags))
         sz = (e->end - start);
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
     return sz;
 }
 
@@ -4197,11 +4642,13 @@ malloc_wrap__size_invalid_only(app_pc start)
 {
     ssize_t sz = -1;
     malloc_entry_t *e;
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
-    e = (malloc_entry_t *) hashtable_lookup(&malloc_table, (void *) start);
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
+    e = malloc_lookup(stripe, start);
     if (e != NULL && !TEST(MALLOC_VALID, e->flags))
         sz = (e->end - start);
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
     return sz;
 }
 
@@ -4210,11 +4657,13 @@ malloc_wrap__get_client_data(app_pc start)
 {
     void *res = NULL;
     malloc_entry_t *e;
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
-    e = (malloc_entry_t *) hashtable_lookup(&malloc_table, (void *) start);
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
+    e = malloc_lookup(stripe, start);
     if (e != NULL)
         res = e->data;
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
     return res;
 }
 
@@ -4223,11 +4672,13 @@ malloc_wrap__get_client_flags(app_pc start)
 {
     uint res = 0;
     malloc_entry_t *e;
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
-    e = (malloc_entry_t *) hashtable_lookup(&malloc_table, (void *) start);
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
+    e = malloc_lookup(stripe, start);
     if (e != NULL)
         res = (e->flags & MALLOC_POSSIBLE_CLIENT_FLAGS);
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
     return res;
 }
 
@@ -4236,13 +4687,15 @@ malloc_wrap__set_client_flag(app_pc start, uint client_flag)
 {
     malloc_entry_t *e;
     bool found = false;
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
-    e = (malloc_entry_t *) hashtable_lookup(&malloc_table, (void *) start);
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
+    e = malloc_lookup(stripe, start);
     if (e != NULL) {
         e->flags |= (client_flag & MALLOC_POSSIBLE_CLIENT_FLAGS);
         found = true;
     }
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
     return found;
 }
 
@@ -4251,44 +4704,49 @@ malloc_wrap__clear_client_flag(app_pc start, uint client_flag)
 {
     malloc_entry_t *e;
     bool found = false;
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
-    e = (malloc_entry_t *) hashtable_lookup(&malloc_table, (void *) start);
+    bool locked_by_me;
+    malloc_stripe_t *stripe =
+        malloc_lock_if_not_held_by_me(start, &locked_by_me);
+    e = malloc_lookup(stripe, start);
     if (e != NULL) {
         e->flags &= ~(client_flag & MALLOC_POSSIBLE_CLIENT_FLAGS);
         found = true;
     }
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
     return found;
 }
 
 static void
 malloc_iterate_internal(bool include_native, malloc_iter_cb_t cb, void *iter_data)
 {
-    uint i;
+    uint i, j;
     /* we do support being called while malloc lock is held but caller should
      * be careful that table is in a consistent state (staleness does this)
      */
-    bool locked_by_me = malloc_lock_if_not_held_by_me();
+    bool locked_by_me = malloc_table_lock_if_not_held_by_me();
     malloc_info_t info;
-    for (i = 0; i < HASHTABLE_SIZE(malloc_table.table_bits); i++) {
-        hash_entry_t *he, *nxt;
-        for (he = malloc_table.table[i]; he != NULL; he = nxt) {
-            malloc_entry_t *e = (malloc_entry_t *) he->payload;
-            /* support malloc_remove() while iterating */
-            nxt = he->next;
-            if (MALLOC_VISIBLE(e->flags) &&
-                (include_native || !malloc_entry_is_native(e))) {
-                malloc_entry_to_info(e, &info);
-                if (include_native)
-                    info.client_flags = e->flags; /* all of them */
-                if (!cb(&info, iter_data)) {
-                    goto malloc_iterate_done;
+    for (j = 0; j < num_malloc_stripes; j++) {
+        hashtable_t *table = &malloc_stripes[j].table;
+        for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
+            hash_entry_t *he, *nxt;
+            for (he = table->table[i]; he != NULL; he = nxt) {
+                malloc_entry_t *e = (malloc_entry_t *) he->payload;
+                /* support malloc_remove() while iterating */
+                nxt = he->next;
+                if (MALLOC_VISIBLE(e->flags) &&
+                    (include_native || !malloc_entry_is_native(e))) {
+                    malloc_entry_to_info(e, &info);
+                    if (include_native)
+                        info.client_flags = e->flags; /* all of them */
+                    if (!cb(&info, iter_data)) {
+                        goto malloc_iterate_done;
+                    }
                 }
             }
         }
     }
  malloc_iterate_done:
-    malloc_unlock_if_locked_by_me(locked_by_me);
+    malloc_table_unlock_if_locked_by_me(locked_by_me);
 }
 
 static void
@@ -4337,15 +4795,26 @@ malloc_wrap_init(void)
 {
     if (alloc_ops.track_allocs) {
         hashtable_config_t hashconfig = {sizeof(hashconfig),};
-        hashtable_init_ex(&malloc_table, ALLOC_TABLE_HASH_BITS, HASH_INTPTR,
-                          false/*!str_dup*/, false/*!synch*/, malloc_entry_free,
-                          malloc_hash, NULL);
+        uint i, bits = ALLOC_TABLE_HASH_BITS;
+        /* The client wants to serialize with its own data via malloc_lock() */
+        if (alloc_ops.global_lock)
+            num_malloc_stripes = 1;
+        else {
+            num_malloc_stripes = MALLOC_STRIPE_MAX;
+            bits -= MALLOC_STRIPE_BITS;
+        }
         /* hash lookup can be a bottleneck so it's worth taking some extra space
          * to reduce the collision chains
          */
         hashconfig.resizable = true;
         hashconfig.resize_threshold = 50; /* default is 75 */
-        hashtable_configure(&malloc_table, &hashconfig);
+        for (i = 0; i < num_malloc_stripes; i++) {
+            hashtable_init_ex(&malloc_stripes[i].table, bits, HASH_INTPTR,
+                              false/*!str_dup*/, false/*!synch*/, malloc_entry_free,
+                              malloc_hash, NULL);
+            hashtable_configure(&malloc_stripes[i].table, &hashconfig);
+            malloc_stripes[i].lock = dr_mutex_create();
+        }
     }
 
     malloc_interface.malloc_lock = malloc_wrap__lock;
@@ -5402,6 +5871,8 @@ handle_free_pre(void *drcontext, cls_alloc_t *pt, void *wrapcxt,
     bool size_in_zone = (redzone_size(routine) > 0 && alloc_ops.size_in_redzone);
     size_t size = 0;
     malloc_entry_t *entry;
+    malloc_stripe_t *stripe;
+    bool locked_by_me, table_locked_by_me = false;
 
     base = (app_pc)arg;
     real_base = base;
@@ -5434,8 +5905,8 @@ handle_free_pre(void *drcontext, cls_alloc_t *pt, void *wrapcxt,
     /* We must have synchronized access to avoid races and ensure we report
      * an error on the 2nd free to the same base
      */
-    malloc_lock();
-    entry = malloc_lookup(base);
+    stripe = malloc_lock_if_not_held_by_me(base, &locked_by_me);
+    entry = malloc_lookup(stripe, base);
     if (entry != NULL &&
         (malloc_entry_is_native_ex(entry, base, pt, false)
 #ifdef WINDOWS
@@ -5447,9 +5918,22 @@ handle_free_pre(void *drcontext, cls_alloc_t *pt, void *wrapcxt,
 #endif
          )) {
         malloc_entry_remove(entry);
-        malloc_unlock();
+        malloc_unlock_if_locked_by_me(stripe, locked_by_me);
         return;
     }
+    if (entry == NULL ||
+        (pt->in_heap_routine == 1 &&
+         malloc_alloc_entry_type(entry) != malloc_allocator_type(routine))) {
+        /* We are about to report an error, which looks up other chunks and
+         * iterates the table.  Either can release our stripe (see the top of
+         * this file) and let another free of the same base in before we are
+         * done with it, so we hold the whole table for the rest of this free.
+         */
+        malloc_unlock_if_locked_by_me(stripe, locked_by_me);
+        locked_by_me = false;
+        table_locked_by_me = malloc_table_lock_if_not_held_by_me();
+        entry = malloc_lookup(stripe, base);
+    }
     if (pt->in_heap_routine == 1/*alread incremented, so outer*/) {
         /* N.B.: should be called even if not reporting mismatches as it also
          * records the outer layer (i#913)
@@ -5577,7 +6061,8 @@ handle_free_pre(void *drcontext, cls_alloc_t *pt, void *wrapcxt,
 
         malloc_entry_remove(entry);
     }
-    malloc_unlock();
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
+    malloc_table_unlock_if_locked_by_me(table_locked_by_me);
 
     set_handling_heap_layer(pt, base, size);
 #ifdef WINDOWS
@@ -6029,6 +6514,8 @@ handle_realloc_pre(void *drcontext, cls_alloc_t *pt, void *wrapcxt,
     size_t size = (size_t) drwrap_get_arg(wrapcxt, ARGNUM_REALLOC_SIZE(type));
     app_pc base = (app_pc) drwrap_get_arg(wrapcxt, ARGNUM_REALLOC_PTR(type));
     malloc_entry_t *entry;
+    malloc_stripe_t *stripe;
+    bool locked_by_me;
     if (base == NULL) {
         /* realloc(NULL, size) == malloc(size) (PR 416535) */
         /* call_site for call;jmp will be jmp, so retaddr better even if post-call */
@@ -6045,11 +6532,11 @@ handle_realloc_pre(void *drcontext, cls_alloc_t *pt, void *wrapcxt,
         LOG(2, "realloc-pre "PFX" new size %d\n", base, pt->realloc_replace_size);
         return;
     }
-    malloc_lock();
-    entry = malloc_lookup(base);
+    stripe = malloc_lock_if_not_held_by_me(base, &locked_by_me);
+    entry = malloc_lookup(stripe, base);
     if (entry != NULL && malloc_entry_is_native_ex(entry, base, pt, true)) {
         malloc_entry_remove(entry);
-        malloc_unlock();
+        malloc_unlock_if_locked_by_me(stripe, locked_by_me);
         return;
     }
 #ifdef WINDOWS
@@ -6059,7 +6546,7 @@ handle_realloc_pre(void *drcontext, cls_alloc_t *pt, void *wrapcxt,
 #endif
     if (check_recursive_same_sequence(drcontext, &pt, routine, pt->alloc_size,
                                       size - redzone_size(routine)*2)) {
-        malloc_unlock();
+        malloc_unlock_if_locked_by_me(stripe, locked_by_me);
         return;
     }
     set_handling_heap_layer(pt, base, size);
@@ -6071,7 +6558,7 @@ handle_realloc_pre(void *drcontext, cls_alloc_t *pt, void *wrapcxt,
     if (!check_valid_heap_block(entry == NULL, pt->alloc_base, pt, wrapcxt,
                                 routine->name, is_free_routine(type))) {
         pt->expect_lib_to_fail = true;
-        malloc_unlock();
+        malloc_unlock_if_locked_by_me(stripe, locked_by_me);
         return;
     }
     ASSERT(entry != NULL, "shouldn't get here: tangent or invalid checked above");
@@ -6122,7 +6609,7 @@ handle_realloc_pre(void *drcontext, cls_alloc_t *pt, void *wrapcxt,
         pt->alloc_base, pt->realloc_old_info.request_size, pt->alloc_size);
     if (alloc_ops.record_allocs && !invalidated)
         malloc_entry_set_valid(entry, false);
-    malloc_unlock();
+    malloc_unlock_if_locked_by_me(stripe, locked_by_me);
 }
 
 static void
@@ -77,6 +77,15 @@ typedef struct _alloc_options_t {
     bool shared_redzones;
     uint delay_frees;
     uint delay_frees_maxsz;
+    /* If non-zero, the main arena's delayed frees go through per-thread
+     * batches into a global quarantine sized as this percentage of the arena.
+     */
+    uint quarantine_pct;
+    uint quarantine_batch;
+    /* If non-zero, heap footprint metrics are dumped every this many allocs */
+    uint heap_metrics_freq;
+    /* mmap chunks of at least this size get a trailing guard page (0 disables) */
+    uint guard_page_min;
 
     bool skip_msvc_importers;
 
@@ -137,6 +146,7 @@ typedef struct {
     bool realloc;       /* only applies to malloc */
     uint client_flags;  /* does not apply to malloc/realloc where not set yet */
     void *client_data;  /* does not apply to malloc/realloc where not set yet */
+    bool custom;        /* announced via malloc_custom_add(): may lie inside a chunk */
 } malloc_info_t;
 
 typedef bool (*malloc_iter_cb_t)(malloc_info_t *info, void *iter_data);
@@ -154,6 +164,7 @@ extern uint wrap_post;
 extern uint num_mallocs;
 extern uint num_large_mallocs;
 extern uint num_frees;
+extern uint malloc_stripe_busy;
 #endif
 
 /* caller should call drmgr_init() and drwrap_init() */
@@ -231,6 +242,25 @@ malloc_clear_client_flag(app_pc start, uint client_flag);
 void
 malloc_iterate(malloc_iter_cb_t cb, void *iter_data);
 
+/* Adds [start, end) as a chunk that the app allocated on its own, e.g. from a
+ * custom pool.  It is passed to client_add_malloc_pre() for its client data,
+ * shows up in malloc_iterate(), and has client flags, but has no redzone and
+ * its shadow is up to the caller.  Any prior chunk at start must have been
+ * removed.
+ */
+void
+malloc_custom_add(app_pc start, app_pc end, dr_mcontext_t *mc, app_pc post_call);
+
+/* Returns false if start is not a chunk added by malloc_custom_add() */
+bool
+malloc_custom_remove(app_pc start);
+
+/* Moves a custom chunk's bounds, keeping its client data and flags.
+ * Returns false if start is not a custom chunk or new_start is taken.
+ */
+bool
+malloc_custom_resize(app_pc start, app_pc new_start, app_pc new_end);
+
 typedef size_t (*alloc_size_func_t)(void *);
 
 #ifdef UNIX
@@ -287,6 +317,16 @@ bool
 alloc_replace_overlaps_malloc(byte *start, byte *end,
                               malloc_info_t *info INOUT);
 
+/* Prints footprint and fragmentation metrics for each Heap to f */
+void
+alloc_replace_dump_metrics(file_t f);
+
+/* Returns whether addr is in a large chunk's guard page, in which case the page
+ * has been made accessible and can be treated as a regular redzone.
+ */
+bool
+alloc_replace_handle_guard_fault(byte *addr);
+
 /* Allocate application memory for clients.
  * This function can only be used with -replace_malloc and
  * does not work with malloc wrapping mode.
@@ -225,6 +225,11 @@ typedef struct _chunk_header_t {
 typedef struct _mmap_header_t {
     chunk_header_t *head;
     size_t map_size;
+    /* For -guard_page_min, the final page of the mapping, which stays
+     * inaccessible until the first fault on it.
+     */
+    byte *guard;
+    bool guard_armed;
 } mmap_header_t;
 
 /* To support pattern mode, which wants to fill the redzone with its pattern,
@@ -256,6 +261,39 @@ typedef struct _free_header_t {
     struct _free_header_t *next;
 } free_header_t;
 
+/* Footprint and fragmentation metrics for one Heap (a main arena plus its
+ * sub-arenas), kept up to date on every alloc and free under the arena lock
+ * so they can be dumped at any time without walking chunks.  Unlike the
+ * STATISTICS counters these are always maintained, to help tune
+ * -redzone_size and -delay_frees for memory footprint.
+ */
+typedef struct _arena_metrics_t {
+    size_t committed;         /* committed bytes across all sub-arenas */
+    size_t live_bytes;        /* alloc_size of live chunks carved from arenas */
+    uint live_chunks;
+    size_t free_bytes;        /* alloc_size of chunks on the free lists */
+    uint free_chunks;
+    size_t quarantined_bytes; /* main arena's share of the quarantine */
+    size_t mmap_bytes;        /* large chunks with their own mappings */
+    uint mmap_chunks;
+    uint allocs;              /* for -heap_metrics_freq */
+    uint bucket_chunks[NUM_FREE_LISTS];
+    /* The largest chunk in each bucket.  Taking out the largest one only marks
+     * the bucket stale, and arena_metrics_snapshot() walks it to recompute, so
+     * that the frees themselves never walk a free list.
+     */
+    heapsz_t bucket_max[NUM_FREE_LISTS];
+    bool bucket_max_stale[NUM_FREE_LISTS];
+} arena_metrics_t;
+
+/* What arena_metrics_print() needs, taken under the arena lock */
+typedef struct _arena_metrics_snap_t {
+    struct _arena_header_t *arena;
+    arena_metrics_t metrics;
+    size_t delayed_bytes;
+    uint delayed_chunks;
+} arena_metrics_snap_t;
+
 typedef struct _free_lists_t {
     /* Delayed frees are kept here for more fair delaying across sizes
      * than if we put them into the per-size lists.
@@ -270,6 +308,7 @@ typedef struct _free_lists_t {
      */
     free_header_t *front[NUM_FREE_LISTS];
     free_header_t *last[NUM_FREE_LISTS];
+    arena_metrics_t metrics;
 } free_lists_t;
 
 #ifdef LINUX
@@ -385,6 +424,15 @@ static hashtable_t pre_us_table;
  * that uses non-shared redzones and a header in between (so it looks
  * like wrapping, and like wrapping won't detect a bug that clobbers
  * the header prior to corruption and possible crash).
+ * When we do add the table, header_from_ptr() is on every malloc, free,
+ * and size query, so a hashtable_t with a single lock would serialize all
+ * app threads.  The plan is open addressing keyed on chunk start with
+ * lock-free lookups (publish the header before the key, and remove by
+ * writing a tombstone, never by moving other entries), with inserts and
+ * removes taking one of several locks picked by address, as the wrap-mode
+ * malloc table in alloc.c does.  Headers can't be freed while a reader may
+ * still hold them, so freed headers should go back to the free lists
+ * rather than to the global heap.
  */
 
 #ifdef STATISTICS
@@ -397,6 +445,8 @@ static uint num_coalesces;
 static uint num_dealloc;
 static uint dbgcrt_mismatch;
 static uint allocs_left_native;
+static uint num_guard_pages;
+static uint guard_page_faults;
 #endif
 
 #ifdef DEBUG
@@ -744,6 +794,32 @@ os_large_alloc_extend(byte *map, size_t cur_commit_size, size_t new_commit_size
 #endif
 }
 
+#ifdef LINUX
+/* Grows the mapping at map to new_size, in place if dest is NULL or else by
+ * moving it onto dest, which must be a mapping of new_size that this replaces.
+ * The contents move with the pages, with no copying.  Returns the new base, or
+ * NULL on failure.
+ */
+static byte *
+os_large_remap(byte *map, size_t cur_size, size_t new_size, byte *dest)
+{
+    byte *newmap;
+    ASSERT(ALIGNED(cur_size, PAGE_SIZE), "must align to at least page size");
+    ASSERT(ALIGNED(new_size, PAGE_SIZE), "must align to at least page size");
+    newmap = (byte *) dr_raw_mremap(map, cur_size, new_size,
+                                    dest == NULL ? 0 : (MREMAP_MAYMOVE | MREMAP_FIXED),
+                                    dest);
+    if ((ptr_int_t)newmap <= 0 && (ptr_int_t)newmap > -PAGE_SIZE) {
+        LOG(2, "%s "PFX" "PIFX" => "PIFX" FAILED\n", __FUNCTION__, map, cur_size,
+            new_size);
+        return NULL;
+    }
+    LOG(3, "%s "PFX" "PIFX" => "PFX" "PIFX"\n", __FUNCTION__, map, cur_size,
+        newmap, new_size);
+    return newmap;
+}
+#endif
+
 /* For Windows, map_size is ignored and the whole allocation is freed */
 static bool
 os_large_free(byte *map, size_t map_size)
@@ -950,6 +1026,7 @@ header_to_info(chunk_header_t *head, malloc_info_t *info, byte *pre_us_base,
     info->request_size = chunk_request_size(head);
     info->pad_size = head->alloc_size;
     info->has_redzone = !info->pre_us;
+    info->custom = false;
     info->zeroed = TEST(ALLOC_ZERO, flags);
     info->realloc = TEST(ALLOC_IS_REALLOC, flags);
     info->client_flags = head->flags & MALLOC_POSSIBLE_CLIENT_FLAGS;
@@ -1015,6 +1092,7 @@ arena_init(arena_header_t *arena, arena_header_t *parent)
     arena->magic = HEADER_MAGIC;
     arena->next_arena = NULL;
     arena->prev_free_sz = 0;
+    arena->free_list->metrics.committed += arena->commit_end - (byte *)arena;
     STATS_ADD(heap_capacity, (uint)(arena->commit_end - (byte *)arena));
     STATS_PEAK(heap_capacity);
     STATS_INC(num_arenas);
@@ -1088,6 +1166,7 @@ arena_extend(arena_header_t *arena, heapsz_t add_size)
         byte *new_brk = set_brk(cur_brk + aligned_add);
         if (new_brk >= cur_brk + add_size) {
             LOG(2, "\tincreased brk from "PFX" to "PFX"\n", cur_brk, new_brk);
+            arena->free_list->metrics.committed += new_brk - cur_brk;
             STATS_ADD(heap_capacity, (uint)(new_brk - cur_brk));
             STATS_PEAK(heap_capacity);
             cur_brk = new_brk;
@@ -1109,6 +1188,7 @@ arena_extend(arena_header_t *arena, heapsz_t add_size)
         if (os_large_alloc_extend((byte *)arena, cur_size, new_size
                                   _IF_WINDOWS(arena_page_prot(arena->flags)))) {
             LOG(2, "\textended arena to "PFX"-"PFX"\n", arena, (byte*)arena + new_size);
+            arena->free_list->metrics.committed += new_size - cur_size;
             STATS_ADD(heap_capacity, (uint)(new_size - cur_size));
             STATS_PEAK(heap_capacity);
             arena->commit_end = (byte *)arena + new_size;
@@ -1130,11 +1210,30 @@ arena_extend(arena_header_t *arena, heapsz_t add_size)
     return new_arena;
 }
 
+/* Delayed frees are the largest discretionary use of memory, so under tool
+ * memory pressure (-max_tool_memory) we cut their limits to a half at the
+ * soft limit and to a quarter at the hard limit.
+ */
+static size_t
+delay_limit(size_t limit)
+{
+    static tool_memory_level_t logged_level;
+    tool_memory_level_t level = tool_memory_pressure();
+    if (level == TOOL_MEMORY_OK)
+        return limit;
+    if (level > logged_level) {
+        logged_level = level; /* racy but only affects logging */
+        ELOGF(0, f_global, "Tool memory pressure: reducing delayed frees to 1/%d\n",
+              level == TOOL_MEMORY_HARD ? 4 : 2);
+    }
+    return limit >> (level == TOOL_MEMORY_HARD ? 2 : 1);
+}
+
 static inline bool
 arena_delayed_list_full(arena_header_t *arena)
 {
-    return (arena->free_list->delayed_chunks >= alloc_ops.delay_frees ||
-            arena->free_list->delayed_bytes >= alloc_ops.delay_frees_maxsz);
+    return (arena->free_list->delayed_chunks >= delay_limit(alloc_ops.delay_frees) ||
+            arena->free_list->delayed_bytes >= delay_limit(alloc_ops.delay_frees_maxsz));
 }
 
 static inline chunk_header_t *
@@ -1232,21 +1331,147 @@ bucket_index(chunk_header_t *head)
     return bucket;
 }
 
+static inline void
+metrics_add_free(arena_header_t *arena, chunk_header_t *head, uint bucket)
+{
+    arena_metrics_t *metrics = &arena->free_list->metrics;
+    metrics->free_bytes += head->alloc_size;
+    metrics->free_chunks++;
+    metrics->bucket_chunks[bucket]++;
+    /* A chunk at least as large as a stale bound is the largest for certain */
+    if (head->alloc_size >= metrics->bucket_max[bucket]) {
+        metrics->bucket_max[bucket] = head->alloc_size;
+        metrics->bucket_max_stale[bucket] = false;
+    }
+}
+
+static inline void
+metrics_remove_free(arena_header_t *arena, chunk_header_t *head, uint bucket)
+{
+    arena_metrics_t *metrics = &arena->free_list->metrics;
+    ASSERT(metrics->bucket_chunks[bucket] > 0 &&
+           metrics->free_bytes >= head->alloc_size, "free metrics off");
+    metrics->free_bytes -= head->alloc_size;
+    metrics->free_chunks--;
+    if (--metrics->bucket_chunks[bucket] == 0) {
+        metrics->bucket_max[bucket] = 0;
+        metrics->bucket_max_stale[bucket] = false;
+    } else if (head->alloc_size == metrics->bucket_max[bucket])
+        metrics->bucket_max_stale[bucket] = true;
+}
+
+static inline void
+metrics_add_live(arena_header_t *arena, chunk_header_t *head)
+{
+    arena_metrics_t *metrics = &arena->free_list->metrics;
+    if (TEST(CHUNK_MMAP, head->flags)) {
+        metrics->mmap_bytes += head->alloc_size;
+        metrics->mmap_chunks++;
+    } else {
+        metrics->live_bytes += head->alloc_size;
+        metrics->live_chunks++;
+    }
+}
+
+static inline void
+metrics_remove_live(arena_header_t *arena, chunk_header_t *head)
+{
+    arena_metrics_t *metrics = &arena->free_list->metrics;
+    if (TEST(CHUNK_MMAP, head->flags)) {
+        ASSERT(metrics->mmap_chunks > 0, "mmap metrics off");
+        metrics->mmap_bytes -= head->alloc_size;
+        metrics->mmap_chunks--;
+    } else {
+        ASSERT(metrics->live_chunks > 0, "live metrics off");
+        metrics->live_bytes -= head->alloc_size;
+        metrics->live_chunks--;
+    }
+}
+
+/* Copies the metrics for the Heap whose main arena is passed in, first
+ * recomputing the largest chunk of any stale bucket.  Caller must hold the
+ * arena lock.
+ */
+static void
+arena_metrics_snapshot(arena_header_t *arena, arena_metrics_snap_t *snap)
+{
+    arena_metrics_t *metrics = &arena->free_list->metrics;
+    uint bucket;
+    for (bucket = 0; bucket < NUM_FREE_LISTS; bucket++) {
+        if (metrics->bucket_max_stale[bucket]) {
+            free_header_t *cur;
+            metrics->bucket_max[bucket] = 0;
+            for (cur = arena->free_list->front[bucket]; cur != NULL; cur = cur->next) {
+                if (cur->head.alloc_size > metrics->bucket_max[bucket])
+                    metrics->bucket_max[bucket] = cur->head.alloc_size;
+            }
+            metrics->bucket_max_stale[bucket] = false;
+        }
+    }
+    snap->arena = arena;
+    snap->metrics = *metrics;
+    snap->delayed_bytes = arena->free_list->delayed_bytes;
+    snap->delayed_chunks = arena->free_list->delayed_chunks;
+}
+
+/* Prints a snapshot from arena_metrics_snapshot().  This should be called
+ * without the arena lock, as the file write can block.
+ */
+static void
+arena_metrics_print(file_t f, arena_metrics_snap_t *snap)
+{
+    arena_metrics_t *metrics = &snap->metrics;
+    size_t used = metrics->live_bytes + metrics->free_bytes + snap->delayed_bytes +
+        metrics->quarantined_bytes;
+    heapsz_t largest = 0;
+    uint bucket;
+    for (bucket = NUM_FREE_LISTS; bucket > 0; bucket--) {
+        if (metrics->bucket_chunks[bucket - 1] > 0) {
+            largest = metrics->bucket_max[bucket - 1];
+            break;
+        }
+    }
+    dr_fprintf(f, "Heap metrics for arena "PFX":\n", snap->arena);
+    dr_fprintf(f, "  committed:       "UINT64_FORMAT_STRING" bytes\n",
+               (uint64)metrics->committed);
+    dr_fprintf(f, "  live:            "UINT64_FORMAT_STRING" bytes in %u chunks\n",
+               (uint64)metrics->live_bytes, metrics->live_chunks);
+    dr_fprintf(f, "  free:            "UINT64_FORMAT_STRING" bytes in %u chunks\n",
+               (uint64)metrics->free_bytes, metrics->free_chunks);
+    dr_fprintf(f, "  delayed:         "UINT64_FORMAT_STRING" bytes in %u chunks\n",
+               (uint64)snap->delayed_bytes, snap->delayed_chunks);
+    dr_fprintf(f, "  quarantined:     "UINT64_FORMAT_STRING" bytes\n",
+               (uint64)metrics->quarantined_bytes);
+    /* Headers, redzones, and the not-yet-carved tail of each arena */
+    dr_fprintf(f, "  overhead+unused: "UINT64_FORMAT_STRING" bytes\n",
+               (uint64)(metrics->committed > used ? metrics->committed - used : 0));
+    dr_fprintf(f, "  largest free:    %u bytes\n", largest);
+    dr_fprintf(f, "  large mmaps:     "UINT64_FORMAT_STRING" bytes in %u chunks\n",
+               (uint64)metrics->mmap_bytes, metrics->mmap_chunks);
+    dr_fprintf(f, "  free list buckets:\n");
+    for (bucket = 0; bucket < NUM_FREE_LISTS; bucket++) {
+        if (metrics->bucket_chunks[bucket] == 0)
+            continue;
+        dr_fprintf(f, "    >= %5u: %8u chunks, largest %u\n",
+                   free_list_sizes[bucket], metrics->bucket_chunks[bucket],
+                   metrics->bucket_max[bucket]);
+    }
+}
+
 /* Pass UINT_MAX if the bucket is not known */
 static void
 remove_from_free_list(arena_header_t *arena, free_header_t *target, uint bucket)
 {
+    if (bucket == UINT_MAX)
+        bucket = bucket_index(&target->head);
+    metrics_remove_free(arena, &target->head, bucket);
     if (target->head.u.prev == NULL) {
-        if (bucket == UINT_MAX)
-            bucket = bucket_index(&target->head);
         ASSERT(target == arena->free_list->front[bucket], "free list corrupted");
         arena->free_list->front[bucket] = target->next;
     } else {
         target->head.u.prev->next = target->next;
     }
     if (target->next == NULL) {
-        if (bucket == UINT_MAX)
-            bucket = bucket_index(&target->head);
         ASSERT(target == arena->free_list->last[bucket], "free list corrupted");
         arena->free_list->last[bucket] = target->head.u.prev;
     } else {
@@ -1259,6 +1484,7 @@ add_to_free_list(arena_header_t *arena, chunk_header_t *head)
 {
     free_header_t *cur = (free_header_t *) head;
     uint bucket = bucket_index(head);
+    metrics_add_free(arena, head, bucket);
     cur->next = NULL;
     if (arena->free_list->last[bucket] == NULL) {
         ASSERT(arena->free_list->front[bucket] == NULL, "inconsistent free list");
@@ -1293,6 +1519,7 @@ consider_giving_back_memory(arena_header_t *arena, chunk_header_t *tofree)
                 if (new_brk <= cur_brk) {
                     LOG(2, "shrinking brk "PFX"-"PFX" to "PFX"-"PFX"\n",
                         pre_us_brk, cur_brk, pre_us_brk, new_brk);
+                    arena->free_list->metrics.committed -= cur_brk - new_brk;
                     STATS_ADD(heap_capacity, (int)(new_brk - cur_brk));
                     STATS_INC(num_dealloc);
                     heap_region_remove(new_brk, cur_brk, NULL);
@@ -1320,6 +1547,7 @@ consider_giving_back_memory(arena_header_t *arena, chunk_header_t *tofree)
                 } else {
                     LOG(2, "de-allocating arena "PFX"-"PFX"\n", sub, sub->reserve_end);
                     prev->next_arena = sub->next_arena;
+                    arena->free_list->metrics.committed -= sub->commit_end - (byte *)sub;
                     STATS_ADD(heap_capacity, -(int)(sub->commit_end - (byte *)sub));
                     STATS_INC(num_dealloc);
                     STATS_DEC(num_arenas);
@@ -1414,25 +1642,14 @@ coalesce_adjacent_frees(arena_header_t *arena, free_header_t *cur)
     return consider_giving_back_memory(arena, tofree);
 }
 
-static bool
-shift_from_delay_list_to_free_list(arena_header_t *arena)
+/* Moves a chunk that is no longer delayed, and no longer on any delay list,
+ * to the regular free lists.
+ */
+static void
+recycle_delayed_chunk(arena_header_t *arena, free_header_t *cur)
 {
-    free_header_t *cur = arena->free_list->delay_front;
-    if (cur == NULL)
-        return false;
     LOG(3, "%s: shifting "PFX" to regular free list\n", __FUNCTION__, cur);
     cur->head.flags &= ~CHUNK_DELAY_FREE;
-    arena->free_list->delay_front = cur->next;
-    if (cur == arena->free_list->delay_last)
-        arena->free_list->delay_last = NULL;
-    ASSERT(arena->free_list->delayed_chunks > 0, "delay counter off");
-    arena->free_list->delayed_chunks--;
-    ASSERT(arena->free_list->delayed_bytes >= cur->head.alloc_size,
-           "delay bytes counter off");
-    arena->free_list->delayed_bytes -= cur->head.alloc_size;
-    LOG(3, "%s: updated delayed chunks=%d, bytes="PIFX"\n", __FUNCTION__,
-        arena->free_list->delayed_chunks, arena->free_list->delayed_bytes);
-
     /* We coalesce here, rather than on initial free, b/c only now
      * can we throw away the user_data
      */
@@ -1447,6 +1664,25 @@ shift_from_delay_list_to_free_list(arena_header_t *arena)
                    "missing prev free pointer");
         });
     }
+}
+
+static bool
+shift_from_delay_list_to_free_list(arena_header_t *arena)
+{
+    free_header_t *cur = arena->free_list->delay_front;
+    if (cur == NULL)
+        return false;
+    arena->free_list->delay_front = cur->next;
+    if (cur == arena->free_list->delay_last)
+        arena->free_list->delay_last = NULL;
+    ASSERT(arena->free_list->delayed_chunks > 0, "delay counter off");
+    arena->free_list->delayed_chunks--;
+    ASSERT(arena->free_list->delayed_bytes >= cur->head.alloc_size,
+           "delay bytes counter off");
+    arena->free_list->delayed_bytes -= cur->head.alloc_size;
+    LOG(3, "%s: updated delayed chunks=%d, bytes="PIFX"\n", __FUNCTION__,
+        arena->free_list->delayed_chunks, arena->free_list->delayed_bytes);
+    recycle_delayed_chunk(arena, cur);
     return true;
 }
 
@@ -1478,6 +1714,235 @@ add_to_delay_list(arena_header_t *arena, chunk_header_t *head)
     }
 }
 
+/***************************************************************************
+ * Quarantine for delayed frees of the main arena (-quarantine_pct).
+ *
+ * Rather than each free going onto the per-arena FIFO with its chunk-count
+ * threshold, frees from cur_arena are first collected into per-thread
+ * batches, outside of the arena lock, and then appended a whole batch at a
+ * time to a global FIFO whose threshold is a byte budget sized relative to
+ * the arena's footprint.  When the FIFO exceeds its budget we recycle its
+ * oldest frees down to 7/8 of the budget in one go, amortizing the
+ * coalescing and free list work across many frees.  Like the regular delay
+ * list, the lists are linked through the free header's next field, and
+ * quarantined chunks are marked CHUNK_DELAY_FREE so they are never coalesced
+ * or reused.
+ */
+
+typedef struct _quarantine_list_t {
+    free_header_t *front;
+    free_header_t *last;
+    uint chunks;
+    size_t bytes;
+} quarantine_list_t;
+
+static int tls_idx_quarantine = -1;
+/* Protects quarantine_ring.  Acquired after the arena lock. */
+static void *quarantine_lock;
+static quarantine_list_t quarantine_ring;
+/* The budget as of the last trim.  Computing it needs the arena lock, so we
+ * only take that lock once the ring exceeds this value.
+ */
+static size_t quarantine_budget_hint;
+
+#ifdef STATISTICS
+static uint quarantine_batches;
+static uint quarantine_recycled;
+static size_t quarantine_peak_bytes;
+#endif
+
+static inline bool
+quarantine_enabled(arena_header_t *arena)
+{
+    return (alloc_ops.quarantine_pct > 0 && arena == cur_arena &&
+            tls_idx_quarantine > -1);
+}
+
+/* Moves all of src to the end of dst, leaving src empty */
+static void
+quarantine_list_splice(quarantine_list_t *dst, quarantine_list_t *src)
+{
+    if (src->front == NULL)
+        return;
+    if (dst->last == NULL)
+        dst->front = src->front;
+    else
+        dst->last->next = src->front;
+    dst->last = src->last;
+    dst->chunks += src->chunks;
+    dst->bytes += src->bytes;
+    memset(src, 0, sizeof(*src));
+}
+
+/* Detaches the oldest entries of the ring until it holds at most max_bytes.
+ * Caller must hold quarantine_lock.
+ */
+static void
+quarantine_ring_trim(size_t max_bytes, quarantine_list_t *expired OUT)
+{
+    free_header_t *cur;
+    memset(expired, 0, sizeof(*expired));
+    while (quarantine_ring.front != NULL && quarantine_ring.bytes > max_bytes) {
+        cur = quarantine_ring.front;
+        quarantine_ring.front = cur->next;
+        quarantine_ring.chunks--;
+        quarantine_ring.bytes -= cur->head.alloc_size;
+        cur->next = NULL;
+        if (expired->last == NULL)
+            expired->front = cur;
+        else
+            expired->last->next = cur;
+        expired->last = cur;
+        expired->chunks++;
+        expired->bytes += cur->head.alloc_size;
+    }
+    if (quarantine_ring.front == NULL)
+        quarantine_ring.last = NULL;
+}
+
+/* Caller must hold the arena lock */
+static void
+quarantine_recycle(arena_header_t *arena, quarantine_list_t *expired)
+{
+    free_header_t *cur, *next;
+    LOG(2, "%s: recycling %u chunks, "PIFX" bytes\n", __FUNCTION__,
+        expired->chunks, expired->bytes);
+    STATS_ADD(quarantine_recycled, expired->chunks);
+    arena->free_list->metrics.quarantined_bytes -= expired->bytes;
+    for (cur = expired->front; cur != NULL; cur = next) {
+        next = cur->next;
+        recycle_delayed_chunk(arena, cur);
+    }
+}
+
+/* The budget is a percentage of the bytes committed for the arena, but never
+ * less than -delay_frees_maxsz, before any reduction for tool memory pressure.
+ */
+static size_t
+quarantine_budget(arena_header_t *arena)
+{
+    arena_header_t *sub;
+    size_t footprint = 0;
+    for (sub = arena; sub != NULL; sub = sub->next_arena)
+        footprint += sub->commit_end - (byte *)sub;
+    return delay_limit(MAX(alloc_ops.delay_frees_maxsz,
+                           footprint / 100 * alloc_ops.quarantine_pct));
+}
+
+/* Marks head as quarantined.  Returns false if it should go on the regular
+ * delay list instead.  Caller must hold the arena lock.
+ */
+static bool
+quarantine_claim(void *drcontext, arena_header_t *arena, chunk_header_t *head)
+{
+    if (drmgr_get_tls_field(drcontext, tls_idx_quarantine) == NULL) {
+        /* Thread init/exit corner case */
+        return false;
+    }
+    head->flags |= CHUNK_DELAY_FREE;
+    arena->free_list->metrics.quarantined_bytes += head->alloc_size;
+    return true;
+}
+
+/* Recycles the oldest frees in the ring if it exceeds the budget */
+static void
+quarantine_trim(void *drcontext, arena_header_t *arena)
+{
+    quarantine_list_t expired;
+    size_t budget;
+    arena_lock(drcontext, arena, true);
+    budget = quarantine_budget(arena);
+    quarantine_budget_hint = budget;
+    dr_mutex_lock(quarantine_lock);
+    if (quarantine_ring.bytes > budget)
+        quarantine_ring_trim(budget - budget / 8, &expired);
+    else
+        memset(&expired, 0, sizeof(expired));
+    LOG(3, "%s: ring has %u chunks, "PIFX" bytes; budget "PIFX"\n", __FUNCTION__,
+        quarantine_ring.chunks, quarantine_ring.bytes, budget);
+    dr_mutex_unlock(quarantine_lock);
+    quarantine_recycle(arena, &expired);
+    arena_unlock(drcontext, arena, true);
+}
+
+/* Adds head, already claimed by quarantine_claim(), to this thread's batch.
+ * Only a full batch takes quarantine_lock, and only a full batch that pushes
+ * the ring over its budget takes the arena lock.  Caller should not hold the
+ * arena lock.
+ */
+static void
+quarantine_add(void *drcontext, arena_header_t *arena, chunk_header_t *head)
+{
+    quarantine_list_t *batch = (quarantine_list_t *)
+        drmgr_get_tls_field(drcontext, tls_idx_quarantine);
+    free_header_t *cur = (free_header_t *) head;
+    bool over_budget;
+    ASSERT(batch != NULL && TEST(CHUNK_DELAY_FREE, head->flags),
+           "chunk not claimed for quarantine");
+    cur->next = NULL;
+    if (batch->last == NULL)
+        batch->front = cur;
+    else
+        batch->last->next = cur;
+    batch->last = cur;
+    batch->chunks++;
+    batch->bytes += head->alloc_size;
+    if (batch->chunks < alloc_ops.quarantine_batch)
+        return;
+
+    dr_mutex_lock(quarantine_lock);
+    quarantine_list_splice(&quarantine_ring, batch);
+    STATS_INC(quarantine_batches);
+#ifdef STATISTICS
+    if (quarantine_ring.bytes > quarantine_peak_bytes)
+        quarantine_peak_bytes = quarantine_ring.bytes;
+#endif
+    over_budget = (quarantine_ring.bytes > quarantine_budget_hint);
+    dr_mutex_unlock(quarantine_lock);
+    if (over_budget)
+        quarantine_trim(drcontext, arena);
+}
+
+/* Gives up the entire ring, for when the arena is out of space (i#1829).
+ * Caller must hold the arena lock.
+ */
+static void
+quarantine_drain(arena_header_t *arena)
+{
+    quarantine_list_t expired;
+    quarantine_budget_hint = quarantine_budget(arena);
+    dr_mutex_lock(quarantine_lock);
+    quarantine_ring_trim(0, &expired);
+    dr_mutex_unlock(quarantine_lock);
+    quarantine_recycle(arena, &expired);
+}
+
+static void
+quarantine_thread_init(void *drcontext)
+{
+    quarantine_list_t *batch = (quarantine_list_t *)
+        thread_alloc(drcontext, sizeof(*batch), HEAPSTAT_WRAP);
+    memset(batch, 0, sizeof(*batch));
+    drmgr_set_tls_field(drcontext, tls_idx_quarantine, batch);
+}
+
+static void
+quarantine_thread_exit(void *drcontext)
+{
+    quarantine_list_t *batch = (quarantine_list_t *)
+        drmgr_get_tls_field(drcontext, tls_idx_quarantine);
+    if (batch == NULL)
+        return;
+    /* Hand off the partial batch.  We leave any recycling to the next full
+     * batch.
+     */
+    dr_mutex_lock(quarantine_lock);
+    quarantine_list_splice(&quarantine_ring, batch);
+    dr_mutex_unlock(quarantine_lock);
+    drmgr_set_tls_field(drcontext, tls_idx_quarantine, NULL);
+    thread_free(drcontext, batch, sizeof(*batch), HEAPSTAT_WRAP);
+}
+
 static chunk_header_t *
 search_free_list_bucket(arena_header_t *arena, heapsz_t aligned_size, uint bucket)
 {
@@ -1592,6 +2057,7 @@ find_free_list_entry(arena_header_t *arena, heapsz_t request_size, heapsz_t alig
             /* guaranteed to be big enough so take from front */
             ASSERT(aligned_size <= free_list_sizes[bucket], "logic error");
             head = (chunk_header_t *) arena->free_list->front[bucket];
+            metrics_remove_free(arena, head, bucket);
             arena->free_list->front[bucket] = arena->free_list->front[bucket]->next;
             if (head == (chunk_header_t *) arena->free_list->last[bucket])
                 arena->free_list->last[bucket] = arena->free_list->front[bucket];
@@ -1669,6 +2135,9 @@ replace_alloc_common(arena_header_t *arena, size_t request_size, size_t alignmen
     heapsz_t aligned_size;
     byte *res = NULL;
     chunk_header_t *head = NULL;
+    arena_header_t *main_arena = arena;
+    arena_metrics_snap_t metrics_snap;
+    bool dump_metrics = false;
     ASSERT((alloc_type & ~(ALLOCATOR_TYPE_FLAGS)) == 0, "invalid type flags");
 
     if (request_size > UINT_MAX ||
@@ -1711,11 +2180,15 @@ replace_alloc_common(arena_header_t *arena, size_t request_size, size_t alignmen
      */
     if (aligned_size + header_size >= CHUNK_MIN_MMAP) {
         mmap_header_t *mhead;
+        bool guard = (alloc_ops.guard_page_min > 0 &&
+                      request_size >= alloc_ops.guard_page_min);
         size_t map_size = (size_t)
             ALIGN_FORWARD(aligned_size + sizeof(mmap_header_t) +
-                          alloc_ops.redzone_size*2 + header_beyond_redzone, PAGE_SIZE);
+                          alloc_ops.redzone_size*2 + header_beyond_redzone, PAGE_SIZE) +
+            (guard ? PAGE_SIZE : 0);
         byte *map = os_large_alloc(map_size _IF_WINDOWS(map_size)
                                    _IF_WINDOWS(arena_page_prot(arena->flags)));
+        byte *map_end;
         size_t dist_to_map;
         ASSERT(map_size >= aligned_size, "overflow should have been caught");
         LOG(2, "\tlarge alloc %d => mmap @"PFX"\n", request_size, map);
@@ -1726,13 +2199,31 @@ replace_alloc_common(arena_header_t *arena, size_t request_size, size_t alignmen
         ASSERT(!alloc_ops.external_headers, "NYI");
         mhead = (mmap_header_t *) map;
         mhead->map_size = map_size;
-        head = (chunk_header_t *)
-            ((byte *)map + sizeof(mmap_header_t) + alloc_ops.redzone_size +
-             header_beyond_redzone - redzone_beyond_header - header_size);
-        res = ptr_from_header(head);
-        if (!ALIGNED(res, alignment)) {
-            res = (byte *) ALIGN_FORWARD(res, alignment);
+        mhead->guard = NULL;
+        mhead->guard_armed = false;
+        map_end = map + map_size;
+        if (guard && dr_memory_protect(map_end - PAGE_SIZE, PAGE_SIZE,
+                                       DR_MEMPROT_NONE)) {
+            /* Push the chunk and its trailing redzone up against the guard page
+             * so that an overflow that skips over the redzone faults.
+             */
+            mhead->guard = map_end - PAGE_SIZE;
+            mhead->guard_armed = true;
+            map_end = mhead->guard;
+            res = (byte *)
+                ALIGN_BACKWARD(map_end - alloc_ops.redzone_size -
+                               ALIGN_FORWARD(request_size, CHUNK_ALIGNMENT), alignment);
             head = header_from_ptr(res);
+            STATS_INC(num_guard_pages);
+        } else {
+            head = (chunk_header_t *)
+                ((byte *)map + sizeof(mmap_header_t) + alloc_ops.redzone_size +
+                 header_beyond_redzone - redzone_beyond_header - header_size);
+            res = ptr_from_header(head);
+            if (!ALIGNED(res, alignment)) {
+                res = (byte *) ALIGN_FORWARD(res, alignment);
+                head = header_from_ptr(res);
+            }
         }
         dist_to_map = (byte *)head - map;
         if (dist_to_map > USHRT_MAX) {
@@ -1744,7 +2235,7 @@ replace_alloc_common(arena_header_t *arena, size_t request_size, size_t alignmen
         mhead->head = head;
         head->flags |= CHUNK_MMAP;
         head->magic = HEADER_MAGIC;
-        head->alloc_size = (map + map_size - alloc_ops.redzone_size - res);
+        head->alloc_size = (map_end - alloc_ops.redzone_size - res);
         heap_region_add(map, map + map_size, HEAP_MMAP, mc);
     } else {
         /* look for free list entry */
@@ -1785,7 +2276,11 @@ replace_alloc_common(arena_header_t *arena, size_t request_size, size_t alignmen
              * list for a singleton that's large enough.
              */
             arena = last_arena;
-            while (arena->free_list->delayed_bytes >= aligned_size) {
+            if (quarantine_enabled(main_arena)) {
+                quarantine_drain(main_arena);
+                head = find_free_list_entry(arena, request_size, aligned_size);
+            }
+            while (head == NULL && arena->free_list->delayed_bytes >= aligned_size) {
                 if (!shift_from_delay_list_to_free_list(arena))
                     break;
                 head = find_free_list_entry(arena, request_size, aligned_size);
@@ -1857,6 +2352,13 @@ replace_alloc_common(arena_header_t *arena, size_t request_size, size_t alignmen
 
     ASSERT(head->alloc_size >= request_size, "chunk too small");
 
+    metrics_add_live(main_arena, head);
+    if (alloc_ops.heap_metrics_freq > 0 &&
+        ++main_arena->free_list->metrics.allocs % alloc_ops.heap_metrics_freq == 0) {
+        arena_metrics_snapshot(main_arena, &metrics_snap);
+        dump_metrics = true;
+    }
+
     notify_client_alloc(drcontext, (byte *)res, head, flags, mc, caller);
 
     if (chunk_request_size(head) >= LARGE_MALLOC_MIN_SIZE)
@@ -1867,6 +2369,9 @@ replace_alloc_common(arena_header_t *arena, size_t request_size, size_t alignmen
  replace_alloc_common_done:
     arena_unlock(drcontext, arena, TEST(ALLOC_SYNCHRONIZE, flags));
 
+    if (dump_metrics)
+        arena_metrics_print(f_global, &metrics_snap);
+
     return res;
 }
 
@@ -1934,6 +2439,7 @@ replace_free_common(arena_header_t *arena, void *ptr, alloc_flags_t flags,
 {
     chunk_header_t *head = header_from_ptr(ptr);
     malloc_info_t info;
+    bool quarantined = false;
 
     if (!is_live_alloc(ptr, arena, head)) { /* including NULL */
         /* w/o early inject, or w/ delayed instru, there are allocs in place
@@ -2055,10 +2561,16 @@ replace_free_common(arena_header_t *arena, void *ptr, alloc_flags_t flags,
         !TEST(CHUNK_PRE_US, head->flags))
         malloc_large_remove(ptr);
 
+    if (!TEST(CHUNK_PRE_US, head->flags))
+        metrics_remove_live(arena, head);
+
     if (!TESTANY(CHUNK_MMAP | CHUNK_PRE_US, head->flags)) {
         LOG(2, "\treplace_free_common "PFX" == request=%d, alloc=%d, arena="PFX"\n",
             ptr, chunk_request_size(head), head->alloc_size, arena);
-        add_to_delay_list(arena, head);
+        if (quarantine_enabled(arena) && quarantine_claim(drcontext, arena, head))
+            quarantined = true;
+        else
+            add_to_delay_list(arena, head);
         /* At this point head may be invalid to de-ref, if coalesced or freed (this
          * will only happen if -delay_frees is 0)
          */
@@ -2077,6 +2589,9 @@ replace_free_common(arena_header_t *arena, void *ptr, alloc_flags_t flags,
     STATS_INC(num_frees);
 
     arena_unlock(drcontext, arena, TEST(ALLOC_SYNCHRONIZE, flags));
+    /* The claimed chunk is CHUNK_DELAY_FREE so no one else touches it */
+    if (quarantined)
+        quarantine_add(drcontext, arena, head);
     return true;
 }
 
@@ -2086,6 +2601,88 @@ replace_free_common(arena_header_t *arena, void *ptr, alloc_flags_t flags,
                            (void *)(ptr_uint_t)(size), (void *)(ptr_uint_t)(flags), \
                            dc, mc, caller, (void *)(ptr_uint_t)(type))
 
+#ifdef LINUX
+/* Grows a CHUNK_MMAP chunk to hold size bytes by remapping its mapping rather
+ * than allocating, copying, and freeing.  Returns the new pointer, which differs
+ * from ptr if the mapping moved, or NULL on failure.  If it moved, the clients
+ * have been told of the removal of old_info, while the old range was still
+ * mapped, and the new chunk is marked CHUNK_SKIP_ITER: the caller must clear
+ * that and issue the add.  Caller must hold the arena lock.
+ */
+static byte *
+remap_mmap_chunk(byte *ptr, chunk_header_t *head, size_t size, bool may_move,
+                 malloc_info_t *old_info, dr_mcontext_t *mc, app_pc caller)
+{
+    byte *map = (byte *)head - head->u.unfree.prev_size_shr;
+    mmap_header_t *mhead = (mmap_header_t *) map;
+    size_t map_size = mhead->map_size;
+    size_t ptr_offs = ptr - map;
+    size_t old_request_size = chunk_request_size(head);
+    size_t new_map_size;
+    byte *newmap, *res, *dest;
+    ASSERT(mhead->head == head, "mmap header corrupted");
+    /* Growing would leave the guard page in the middle of the chunk */
+    if (mhead->guard != NULL)
+        return NULL;
+    new_map_size = (size_t)
+        ALIGN_FORWARD(ptr_offs + ALIGN_FORWARD(size, CHUNK_ALIGNMENT) +
+                      alloc_ops.redzone_size, PAGE_SIZE);
+    if (new_map_size <= map_size /* overflow */ ||
+        new_map_size - alloc_ops.redzone_size - ptr_offs - size > REQUEST_DIFF_MAX)
+        return NULL;
+    newmap = os_large_remap(map, map_size, new_map_size, NULL);
+    if (newmap == NULL) {
+        if (!may_move)
+            return NULL;
+        /* We map the destination first so that the move cannot fail once the
+         * clients have been told the old chunk is gone.
+         */
+        dest = os_large_alloc(new_map_size);
+        if (dest == NULL)
+            return NULL;
+        /* Clients that key their data on the base need the same remove that the
+         * malloc-and-free path issues, and they may look at the old range.
+         */
+        client_remove_malloc_pre(old_info);
+        if (head->user_data != NULL)
+            client_malloc_data_free(head->user_data);
+        head->user_data = NULL;
+        head->flags |= CHUNK_SKIP_ITER;
+        client_remove_malloc_post(old_info);
+        newmap = os_large_remap(map, map_size, new_map_size, dest);
+        if (newmap == NULL) {
+            /* Undo the remove: the caller's fallback path issues its own */
+            os_large_free(dest, new_map_size);
+            head->flags &= ~CHUNK_SKIP_ITER;
+            notify_client_alloc(NULL, ptr, head, ALLOC_INVOKE_CLIENT_DATA, mc, caller);
+            return NULL;
+        }
+        ASSERT(newmap == dest, "MREMAP_FIXED did not honor the destination");
+    }
+    /* The headers moved with the pages: only the sizes and pointers change.
+     * Like the alloc code, the trailing redzone runs to the end of the mapping.
+     */
+    res = newmap + ptr_offs;
+    head = header_from_ptr(res);
+    mhead = (mmap_header_t *) newmap;
+    mhead->map_size = new_map_size;
+    mhead->head = head;
+    head->alloc_size = new_map_size - alloc_ops.redzone_size - ptr_offs;
+    head->u.unfree.request_diff = head->alloc_size - size;
+    if (old_request_size >= LARGE_MALLOC_MIN_SIZE)
+        malloc_large_remove(ptr);
+    if (size >= LARGE_MALLOC_MIN_SIZE)
+        malloc_large_add(res, size);
+    if (newmap == map)
+        heap_region_adjust(map, map + new_map_size);
+    else {
+        heap_region_remove(map, map + map_size, mc);
+        heap_region_add(newmap, newmap + new_map_size, HEAP_MMAP, mc);
+    }
+    return res;
+}
+#endif
+
 /* If invoked from an outer drwrap_replace_native() layer, this should be invoked
  * via ONDSTACK_REPLACE_REALLOC_COMMON().
  */
@@ -2156,12 +2753,35 @@ replace_realloc_common(arena_header_t *arena, byte *ptr, size_t size,
         res = ptr;
         header_to_info(head, &new_info, NULL, flags | ALLOC_IS_REALLOC);
         client_handle_realloc(drcontext, &old_info, &new_info, false, mc);
+#ifdef LINUX
+    } else if (TEST(CHUNK_MMAP, head->flags) && size > head->alloc_size &&
+               (res = remap_mmap_chunk(ptr, head, size, !TEST(ALLOC_IN_PLACE_ONLY, flags),
+                                       &old_info, mc, caller)) != NULL) {
+        /* Growing a large alloc: the kernel moves the pages for us, so we only
+         * need to update the shadow, which client_handle_realloc() does in bulk.
+         */
+        LOG(2, "\t%s: mremap realloc from %d to %d bytes => "PFX"\n", __FUNCTION__,
+            old_info.request_size, size, res);
+        if (TEST(ALLOC_ZERO, flags))
+            memset(res + old_info.request_size, 0, size - old_info.request_size);
+        head = header_from_ptr(res);
+        arena->free_list->metrics.mmap_bytes += head->alloc_size - old_info.pad_size;
+        header_to_info(head, &new_info, NULL, flags | ALLOC_IS_REALLOC);
+        if (res != ptr) {
+            /* remap_mmap_chunk() issued the remove before moving */
+            head->flags &= ~CHUNK_SKIP_ITER;
+            notify_client_alloc(drcontext, res, head,
+                                flags | ALLOC_IS_REALLOC | ALLOC_INVOKE_CLIENT_DATA,
+                                mc, caller);
+        }
+        client_handle_realloc(drcontext, &old_info, &new_info, true/*was mmap*/, mc);
+#endif
     } else if (!TEST(ALLOC_IN_PLACE_ONLY, flags) || head->alloc_size >= size) {
         size_t old_request_size = chunk_request_size(head);
         bool was_mmap = TEST(CHUNK_MMAP, head->flags);
         LOG(2, "\t%s: malloc-and-free realloc from %d to %d bytes\n", __FUNCTION__,
             old_request_size, size);
-        /* XXX: use mremap for mmapped alloc! */
+        /* XXX: grow mmapped allocs in place on Windows and Mac too */
         /* XXX: if final chunk in arena, extend in-place */
         res = (void *) replace_alloc_common(arena, size, 0,
                                             sub_flags | ALLOC_IS_REALLOC /*no client*/,
@@ -2530,6 +3150,62 @@ alloc_replace_overlaps_malloc(byte *start, byte *end,
     return alloc_replace_overlaps_region(start, end, info, 0, CHUNK_FREED);
 }
 
+/* For -guard_page_min: if addr is in the guard page of a large chunk, makes the
+ * page accessible and fills it as a redzone, so that re-executing the faulting
+ * instruction lets the regular shadow or pattern checks report the access.
+ */
+bool
+alloc_replace_handle_guard_fault(byte *addr)
+{
+    byte *start;
+    uint flags;
+    mmap_header_t *mhead;
+    if (alloc_ops.guard_page_min == 0 ||
+        !heap_region_bounds(addr, &start, NULL, &flags) || !TEST(HEAP_MMAP, flags))
+        return false;
+    mhead = (mmap_header_t *) start;
+    if (mhead->guard == NULL || addr < mhead->guard || addr >= mhead->guard + PAGE_SIZE)
+        return false;
+    /* A racing thread may have disarmed it already, in which case a retry works */
+    if (mhead->guard_armed) {
+        mhead->guard_armed = false;
+        LOG(2, "%s: disarming guard page "PFX" for access to "PFX"\n", __FUNCTION__,
+            mhead->guard, addr);
+        if (!dr_memory_protect(mhead->guard, PAGE_SIZE,
+                               DR_MEMPROT_READ | DR_MEMPROT_WRITE)) {
+            ASSERT(false, "failed to disarm guard page");
+            return false;
+        }
+        client_new_redzone(mhead->guard, PAGE_SIZE);
+        STATS_INC(guard_page_faults);
+    }
+    return true;
+}
+
+static bool
+dump_metrics_iter(byte *start, byte *end, uint flags
+                  _IF_WINDOWS(HANDLE heap), void *iter_data)
+{
+    if (TEST(HEAP_ARENA, flags) && !TEST(HEAP_PRE_US, flags)) {
+        arena_header_t *arena = (arena_header_t *) start;
+        /* sub-arenas share their main arena's free lists and metrics */
+        if (TEST(ARENA_MAIN, arena->flags)) {
+            arena_metrics_snap_t snap;
+            iterator_lock(arena, false/*!in_alloc*/);
+            arena_metrics_snapshot(arena, &snap);
+            iterator_unlock(arena, false/*!in_alloc*/);
+            arena_metrics_print((file_t)(ptr_int_t) iter_data, &snap);
+        }
+    }
+    return true;
+}
+
+void
+alloc_replace_dump_metrics(file_t f)
+{
+    heap_region_iterate(dump_metrics_iter, (void *)(ptr_int_t) f);
+}
+
 /***************************************************************************
  * app-facing interface
  */
@@ -5291,6 +5967,15 @@ alloc_replace_init(void)
 
     hashtable_init(&pre_us_table, PRE_US_TABLE_HASH_BITS, HASH_INTPTR, false/*!strdup*/);
 
+    if (alloc_ops.quarantine_pct > 0) {
+        quarantine_lock = dr_mutex_create();
+        tls_idx_quarantine = drmgr_register_tls_field();
+        ASSERT(tls_idx_quarantine > -1, "unable to reserve TLS field");
+        if (!drmgr_register_thread_init_event(quarantine_thread_init) ||
+            !drmgr_register_thread_exit_event(quarantine_thread_exit))
+            ASSERT(false, "drmgr registration failed");
+    }
+
 #ifdef WINDOWS
     if (alloc_ops.global_lock)
         global_lock = dr_recurlock_create();
@@ -5403,8 +6088,24 @@ alloc_replace_exit(void)
     LOG(1, "  deallocs:           %9d\n", num_dealloc);
     LOG(1, "  dbgcrt mismatches:  %9d\n", dbgcrt_mismatch);
     LOG(1, "  allocs left native: %9d\n", allocs_left_native);
+    LOG(1, "  guard pages:        %9d\n", num_guard_pages);
+    LOG(1, "  guard page faults:  %9d\n", guard_page_faults);
+    LOG(1, "  quarantine batches: %9d\n", quarantine_batches);
+    LOG(1, "  quarantine recycled:%9d\n", quarantine_recycled);
+    LOG(1, "  quarantine peak:    %9d\n", (uint)quarantine_peak_bytes);
 #endif
 
+    if (alloc_ops.heap_metrics_freq > 0)
+        alloc_replace_dump_metrics(f_global);
+
+    if (alloc_ops.quarantine_pct > 0) {
+        drmgr_unregister_thread_init_event(quarantine_thread_init);
+        drmgr_unregister_thread_exit_event(quarantine_thread_exit);
+        drmgr_unregister_tls_field(tls_idx_quarantine);
+        tls_idx_quarantine = -1;
+        dr_mutex_destroy(quarantine_lock);
+    }
+
     /* On Win10 at process exit, RtlLockHeap is called but the private
      * RtlUnlockProcessHeapOnProcessTerminate does the unlock and so
      * we don't see it.  This exiting thread should be the one who owns the lock.
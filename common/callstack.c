@@ -159,6 +159,11 @@ typedef struct _modname_info_t {
     bool abort_fp_walk;
     /* i#1310: support user data */
     void *user_data;
+#ifdef WINDOWS
+    /* For matching pdbs when symbolizing offline */
+    uint checksum;
+    uint timestamp;
+#endif
 } modname_info_t;
 
 /* When the number of modules hits the max for our 8-bit index we
@@ -192,6 +197,8 @@ struct _packed_callstack_t {
     bool first_is_retaddr:1;
     /* whether first frame is a syscall (invariant: later frames never are) */
     bool first_is_syscall:1;
+    /* whether deliberately recorded with fewer frames than its peers */
+    bool truncated:1;
     union {
         packed_frame_t *packed;
         full_frame_t *full;
@@ -926,7 +933,7 @@ address_to_frame(symbolized_frame_t *frame OUT, packed_callstack_t *pcs OUT,
             dr_snprintf(frame->modoffs, MAX_PFX_LEN, PIFX, pc - mod_start);
             NULL_TERMINATE_BUFFER(frame->modoffs);
 #ifdef USE_DRSYMS
-            if (name_info->path != NULL) {
+            if (name_info->path != NULL && !ops.defer_symbols) {
                 lookup_func_and_line(frame, name_info,
                                      pc - mod_start - (sub1_sym ? 1 : 0));
             }
@@ -2082,6 +2089,20 @@ packed_callstack_first_frame_retaddr(packed_callstack_t *pcs)
     pcs->first_is_retaddr = true;
 }
 
+void
+packed_callstack_mark_truncated(packed_callstack_t *pcs)
+{
+    pcs->truncated = true;
+}
+
+app_pc
+packed_callstack_first_pc(packed_callstack_t *pcs)
+{
+    if (pcs->num_frames == 0 || pcs->first_is_syscall)
+        return NULL;
+    return PCS_FRAME_LOC(pcs, 0).addr;
+}
+
 /* Returns false if a syscall.  If returns true, also fills in the OUT params. */
 static bool
 packed_callstack_frame_modinfo(packed_callstack_t *pcs, uint frame,
@@ -2184,8 +2205,10 @@ packed_frame_to_symbolized(packed_callstack_t *pcs IN, symbolized_frame_t *frame
              * for symbol lookup so we still display a valid instr addr.
              * We assume first frame is not a retaddr.
              */
-            lookup_func_and_line(frame, info,
-                                 (idx == 0 && !pcs->first_is_retaddr) ? offs : offs-1);
+            if (!ops.defer_symbols) {
+                lookup_func_and_line(frame, info, (idx == 0 && !pcs->first_is_retaddr) ?
+                                     offs : offs-1);
+            }
 #endif
         } else {
             ASSERT(!frame->is_module, "frame not initialized");
@@ -2325,6 +2348,7 @@ packed_callstack_clone(packed_callstack_t *src)
     dst->is_packed = src->is_packed;
     dst->first_is_retaddr = src->first_is_retaddr;
     dst->first_is_syscall = src->first_is_syscall;
+    dst->truncated = src->truncated;
     if (dst->is_packed) {
         dst->frames.packed = (packed_frame_t *)
             global_alloc(sizeof(*dst->frames.packed) * src->num_frames,
@@ -2377,6 +2401,9 @@ packed_callstack_cmp(packed_callstack_t *pcs1, packed_callstack_t *pcs2)
         return false;
     if (pcs1->num_frames != pcs2->num_frames)
         return false;
+    /* a short stack must not stand in for a full one that happens to match */
+    if (pcs1->truncated != pcs2->truncated)
+        return false;
     if (!pcs1->first_is_syscall && !pcs2->first_is_syscall &&
         ((pcs1->is_packed && pcs2->is_packed) ||
          (!pcs1->is_packed && !pcs2->is_packed))) {
@@ -2589,6 +2616,15 @@ symbolized_callstack_frame_file(const symbolized_callstack_t *scs, uint frame)
     return scs->frames[frame].fname;
 }
 
+uint64
+symbolized_callstack_frame_line(const symbolized_callstack_t *scs, uint frame)
+{
+    ASSERT(scs != NULL, "invalid args");
+    if (scs->num_frames <= frame)
+        return 0;
+    return scs->frames[frame].line;
+}
+
 void *
 symbolized_callstack_frame_data(const symbolized_callstack_t *scs, uint frame)
 {
@@ -2644,6 +2680,10 @@ add_new_module(void *drcontext, const module_data_t *info)
         if (ops.module_load != NULL)
             name_info->user_data = ops.module_load(name_info->path, name, info->start);
         name_info->warned_no_syms = false;
+#ifdef WINDOWS
+        name_info->checksum = info->checksum;
+        name_info->timestamp = info->timestamp;
+#endif
         hashtable_add(&modname_table, (void*)name_info->path, (void*)name_info);
         /* We need an entry for every 16M of module size */
         sz = info->end - info->start;
@@ -2857,6 +2897,27 @@ callstack_module_unload(void *drcontext, const module_data_t *info)
     dr_mutex_unlock(modtree_lock);
 }
 
+void
+callstack_module_list_print(file_t f)
+{
+    uint i;
+    /* We never remove from modname_table so this includes unloaded modules */
+    hashtable_lock(&modname_table);
+    for (i = 0; i < HASHTABLE_SIZE(modname_table.table_bits); i++) {
+        hash_entry_t *he;
+        for (he = modname_table.table[i]; he != NULL; he = he->next) {
+            modname_info_t *info = (modname_info_t *) he->payload;
+#ifdef WINDOWS
+            dr_fprintf(f, "modid: %d checksum: 0x%08x timestamp: 0x%08x %s"NL,
+                       info->id, info->checksum, info->timestamp, info->path);
+#else
+            dr_fprintf(f, "modid: %d %s"NL, info->id, info->path);
+#endif
+        }
+    }
+    hashtable_unlock(&modname_table);
+}
+
 static bool
 module_lookup(byte *pc, app_pc *start OUT, size_t *size OUT, modname_info_t **name)
 {
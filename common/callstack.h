@@ -171,7 +171,7 @@ enum {
 
 /* Options for how to display callstacks.
  * N.B.: postprocess.pl has a duplicate copy (once we have linux online syms
- * that will go away), as does optionsx.h, so keep them in sync
+ * that will go away), as do optionsx.h and symquery.c, so keep them in sync
  */
 enum {
     PRINT_FRAME_NUMBERS        = 0x0001,
@@ -266,6 +266,11 @@ typedef struct _callstack_options_t {
     void (*module_unload)(const char * /*module path*/,
                           void * /*user data returned by module_load()*/);
 
+    /* Skip symbol lookup when printing callstacks, leaving it to an offline tool
+     * that uses callstack_module_list_print() and PRINT_MODULE_ID.
+     */
+    bool defer_symbols;
+
     /* Add new options here */
 } callstack_options_t;
 
@@ -306,6 +311,14 @@ packed_callstack_record(packed_callstack_t **pcs_out/*out*/, dr_mcontext_t *mc,
 void
 packed_callstack_first_frame_retaddr(packed_callstack_t *pcs);
 
+/* A truncated callstack never compares equal to one that is not */
+void
+packed_callstack_mark_truncated(packed_callstack_t *pcs);
+
+/* Returns NULL if the first frame is a syscall */
+app_pc
+packed_callstack_first_pc(packed_callstack_t *pcs);
+
 void
 packed_callstack_print(packed_callstack_t *pcs, uint num_frames,
                        char *buf, size_t bufsz, size_t *sofar, const char *prefix);
@@ -360,6 +373,12 @@ callstack_module_load(void *drcontext, const module_data_t *info, bool loaded);
 void
 callstack_module_unload(void *drcontext, const module_data_t *info);
 
+/* Prints the unique id and path of every module seen so far, one per line,
+ * for mapping the ids printed by PRINT_MODULE_ID back to files.
+ */
+void
+callstack_module_list_print(file_t f);
+
 bool
 is_in_module(byte *pc);
 
@@ -440,6 +459,9 @@ symbolized_callstack_frame_func(const symbolized_callstack_t *scs, uint frame);
 char *
 symbolized_callstack_frame_file(const symbolized_callstack_t *scs, uint frame);
 
+uint64
+symbolized_callstack_frame_line(const symbolized_callstack_t *scs, uint frame);
+
 /* Returns the data stored for this frame's module by callstack_options_t.module_load */
 void *
 symbolized_callstack_frame_data(const symbolized_callstack_t *scs, uint frame);
@@ -0,0 +1,73 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/***************************************************************************
+ * error_types.h: Dr. Memory error types and their suppression names, shared
+ * by the client's report.c and by symquery -r, which applies suppressions to
+ * results whose symbols were deferred.
+ */
+
+#ifndef _ERROR_TYPES_H_
+#define _ERROR_TYPES_H_ 1
+
+enum {
+    ERROR_UNADDRESSABLE,
+    ERROR_UNDEFINED,
+    ERROR_INVALID_HEAP_ARG,
+#ifdef WINDOWS
+    ERROR_GDI_USAGE,
+    ERROR_HANDLE_LEAK,
+#endif
+    ERROR_WARNING,
+    ERROR_LEAK,
+    ERROR_POSSIBLE_LEAK,
+    ERROR_REACHABLE_LEAK,
+    ERROR_MAX_LEAK = ERROR_REACHABLE_LEAK,
+    ERROR_MAX_VAL,
+};
+
+static inline bool
+type_is_leak(uint type)
+{
+    return (type >= ERROR_LEAK && type <= ERROR_MAX_LEAK);
+}
+
+/* The error type names that start both error reports and suppressions */
+static const char *const suppress_name[] = {
+    "UNADDRESSABLE ACCESS",
+    "UNINITIALIZED READ",
+    "INVALID HEAP ARGUMENT",
+#ifdef WINDOWS
+    "GDI USAGE ERROR",
+    "HANDLE LEAK",
+#endif
+    "WARNING",
+    "LEAK",
+    "POSSIBLE LEAK",
+    "REACHABLE LEAK",
+};
+
+/* A suppression type may also be given as "Dr.Memory:<type>", which is what
+ * the legacy Valgrind format uses in place of "Memcheck:<type>".
+ */
+#define DRMEM_VALGRIND_TOOLNAME "Dr.Memory"
+
+#endif /* _ERROR_TYPES_H_ */
@@ -1084,6 +1084,87 @@ heap_dump_stats(file_t f)
 }
 #endif /* STATISTICS */
 
+/* We count in units so a 32-bit counter covers budgets well beyond 4GB.
+ * Each request is rounded up, which roughly matches DR's own heap rounding.
+ */
+#define TOOL_MEMORY_UNIT_SHIFT 4
+#define TOOL_MEMORY_UNITS(size) \
+    ((int)(ALIGN_FORWARD(size, 1 << TOOL_MEMORY_UNIT_SHIFT) >> TOOL_MEMORY_UNIT_SHIFT))
+
+static int tool_memory_soft_units; /* 0 means no budget */
+static int tool_memory_hard_units;
+static volatile int tool_memory_units;
+static volatile int tool_memory_level;
+
+void
+tool_memory_budget_init(uint budget_mb)
+{
+    uint64 units = (uint64)budget_mb << (20 - TOOL_MEMORY_UNIT_SHIFT);
+    if (units > INT_MAX)
+        units = INT_MAX;
+    tool_memory_hard_units = (int) units;
+    tool_memory_soft_units = (int) (units - units / 4);
+}
+
+tool_memory_level_t
+tool_memory_pressure(void)
+{
+    return (tool_memory_level_t) tool_memory_level;
+}
+
+/* There is no hysteresis: once raised, a level stays raised even if usage
+ * drops back below its limit.  The memory freed by degrading (truncated
+ * callstacks, fewer delayed frees) is what brought usage down, so lowering
+ * the level would just regrow it.
+ */
+static void
+tool_memory_raise_level(tool_memory_level_t level, int units)
+{
+    /* Racy, but the level only goes up so at worst we log twice */
+    if (tool_memory_level >= level)
+        return;
+    tool_memory_level = level;
+    ELOGF(0, f_global, "Tool memory at %u KB has reached the %s limit of %u KB: "
+          "degrading precision to save memory\n",
+          units >> (10 - TOOL_MEMORY_UNIT_SHIFT),
+          level == TOOL_MEMORY_HARD ? "hard" : "soft",
+          (level == TOOL_MEMORY_HARD ? tool_memory_hard_units :
+           tool_memory_soft_units) >> (10 - TOOL_MEMORY_UNIT_SHIFT));
+}
+
+static inline void
+tool_memory_inc(size_t size)
+{
+    int units;
+    if (tool_memory_soft_units == 0)
+        return;
+    units = atomic_add32_return_sum(&tool_memory_units, TOOL_MEMORY_UNITS(size));
+    if (units >= tool_memory_soft_units && tool_memory_level < TOOL_MEMORY_HARD) {
+        tool_memory_raise_level(units >= tool_memory_hard_units ?
+                                TOOL_MEMORY_HARD : TOOL_MEMORY_SOFT, units);
+    }
+}
+
+static inline void
+tool_memory_dec(size_t size)
+{
+    if (tool_memory_soft_units == 0)
+        return;
+    ATOMIC_ADD32(tool_memory_units, -TOOL_MEMORY_UNITS(size));
+}
+
+void
+tool_memory_external_alloc(size_t size)
+{
+    tool_memory_inc(size);
+}
+
+void
+tool_memory_external_free(size_t size)
+{
+    tool_memory_dec(size);
+}
+
 #undef dr_global_alloc
 #undef dr_global_free
 #undef dr_thread_alloc
@@ -1097,6 +1178,7 @@ global_alloc(size_t size, heapstat_t type)
 #ifdef STATISTICS
     heap_usage_inc(type, size);
 #endif
+    tool_memory_inc(size);
     /* Note that the recursive lock inside DR is a perf hit for
      * malloc-intensive apps: we're already holding the malloc_lock,
      * so could use own heap alloc, or add option to DR to not use
@@ -1111,6 +1193,7 @@ global_free(void *p, size_t size, heapstat_t type)
 #ifdef STATISTICS
     heap_usage_dec(type, size);
 #endif
+    tool_memory_dec(size);
     dr_global_free(p, size);
 }
 
@@ -1120,6 +1203,7 @@ thread_alloc(void *drcontext, size_t size, heapstat_t type)
 #ifdef STATISTICS
     heap_usage_inc(type, size);
 #endif
+    tool_memory_inc(size);
     return dr_thread_alloc(drcontext, size);
 }
 
@@ -1129,6 +1213,7 @@ thread_free(void *drcontext, void *p, size_t size, heapstat_t type)
 #ifdef STATISTICS
     heap_usage_dec(type, size);
 #endif
+    tool_memory_dec(size);
     dr_thread_free(drcontext, p, size);
 }
 
@@ -1138,6 +1223,7 @@ nonheap_alloc(size_t size, uint prot, heapstat_t type)
 #ifdef STATISTICS
     heap_usage_inc(type, size);
 #endif
+    tool_memory_inc(size);
     return dr_nonheap_alloc(size, prot);
 }
 
@@ -1147,6 +1233,7 @@ nonheap_free(void *p, size_t size, heapstat_t type)
 #ifdef STATISTICS
     heap_usage_dec(type, size);
 #endif
+    tool_memory_dec(size);
     dr_nonheap_free(p, size);
 }
 
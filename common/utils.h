@@ -666,6 +666,7 @@ extern int tls_idx_util;
 #  define ATOMIC_DEC32(x) __asm__ __volatile__("lock decl %0" : "=m" (x) : : "memory")
 #  define ATOMIC_ADD32(x, val) \
     __asm__ __volatile__("lock addl %1, %0" : "=m" (x) : "r" (val) : "memory")
+#  define MEMORY_BARRIER() __asm__ __volatile__("mfence" : : : "memory")
 
 static inline int
 atomic_add32_return_sum(volatile int *x, int val)
@@ -720,6 +721,7 @@ atomic_add32_return_sum(volatile int *x, int val)
        : "=Q" (*x), "=m" (result)                           \
        : "r"  (val)                                         \
        : "cc", "memory", "r2", "r3")
+#  define MEMORY_BARRIER() __asm__ __volatile__("dmb" : : : "memory")
 
 static inline int
 atomic_add32_return_sum(volatile int *x, int val)
@@ -733,6 +735,7 @@ atomic_add32_return_sum(volatile int *x, int val)
 # define ATOMIC_INC32(x) _InterlockedIncrement((volatile LONG *)&(x))
 # define ATOMIC_DEC32(x) _InterlockedDecrement((volatile LONG *)&(x))
 # define ATOMIC_ADD32(x, val) _InterlockedExchangeAdd((volatile LONG *)&(x), val)
+# define MEMORY_BARRIER() MemoryBarrier()
 
 static inline int
 atomic_add32_return_sum(volatile int *x, int val)
@@ -997,6 +1000,33 @@ nonheap_free(void *p, size_t size, heapstat_t type);
 void
 heap_dump_stats(file_t f);
 
+/* Tool memory budget: usage summed over all heapstat_t categories is
+ * compared against a budget, and crossing its soft (3/4) and hard limits
+ * raises the pressure level.  The level never drops back down: components
+ * consult it to trade precision for memory.
+ */
+typedef enum {
+    TOOL_MEMORY_OK,
+    TOOL_MEMORY_SOFT,
+    TOOL_MEMORY_HARD,
+} tool_memory_level_t;
+
+/* Pass 0 for no budget */
+void
+tool_memory_budget_init(uint budget_mb);
+
+tool_memory_level_t
+tool_memory_pressure(void);
+
+/* For tool memory that does not come from the allocation routines below,
+ * such as shadow memory that Umbra maps itself.
+ */
+void
+tool_memory_external_alloc(size_t size);
+
+void
+tool_memory_external_free(size_t size);
+
 #define dr_global_alloc DO_NOT_USE_use_global_alloc
 #define dr_global_free  DO_NOT_USE_use_global_free
 #define dr_thread_alloc DO_NOT_USE_use_thread_alloc
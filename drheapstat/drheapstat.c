@@ -35,6 +35,7 @@
 #include "callstack.h"
 #include "crypto.h"
 #include "staleness.h"
+#include "stream.h"
 #include "../drmemory/leak.h"
 #include "../drmemory/stack.h"
 #include "../drmemory/shadow.h"
@@ -89,6 +90,11 @@ static uint timer_real;
 uint64 timestamp_last_snapshot;
 
 static volatile bool sideline_exit;
+/* The sideline thread runs the timers and sends -stream snapshots */
+#define SIDELINE_NEEDED() \
+    (options.time_clock || options.staleness || options.stream[0] != '\0')
+/* How often the sideline thread wakes up when there is no timer to wait on */
+#define SIDELINE_SLEEP_MS 500
 /* FIXME i#297: DR synchs + terminates our sideline thread prior to
  * calling our exit event so we have no chance to clean up its memory.
  * DR then asserts about leaks.  Using a targeted solution for now.
@@ -134,6 +140,7 @@ dump_statistics(void);
 uint alloc_stack_count;
 static uint peaks_detected;
 static uint peaks_skipped;
+static uint allocs_sampled;
 #endif
 
 /* PR 465174: share allocation site callstacks.
@@ -153,12 +160,19 @@ static hashtable_t alloc_md5_table;
  * TLS and CLS
  */
 
+/* State for choosing which allocations to sample for -sample_bytes */
+typedef struct _sampler_t {
+    int64 bytes_until_sample;
+    uint rand_state;
+} sampler_t;
+
 typedef struct _tls_heapstat_t {
     char *errbuf; /* buffer for atomic writes */
     size_t errbufsz;
 # ifdef UNIX
     int64 filepos; /* f_callstack file position */
 # endif
+    sampler_t sampler;
 } tls_heapstat_t;
 
 /* XXX: share w/ syscall_os.h */
@@ -169,6 +183,147 @@ typedef struct _tls_heapstat_t {
 #endif
 
 static int tls_idx_heapstat = -1;
+/* For allocations before a thread's data is set up, such as the heap walk */
+static sampler_t early_sampler;
+
+/***************************************************************************
+ * ALLOCATION SAMPLING
+ *
+ * For -sample_bytes we record the callstack of one allocation per
+ * -sample_bytes bytes allocated on average, with exponentially distributed
+ * gaps between samples so the chance of sampling an allocation of size s is
+ * 1-e^(-s/sample_bytes) regardless of what was allocated before it.  Each
+ * sampled allocation's usage is scaled by the inverse of that probability.
+ * The scale depends only on the size, so a free subtracts exactly what its
+ * malloc added.  This is all integer math: we avoid floating-point in the
+ * allocation path.
+ */
+
+/* 2^(-2^-i) for i=1..16, as 0.32 fixed point */
+static const uint exp2_neg_frac[] = {
+    0xb504f334, 0xd744fccb, 0xeac0c6e8, 0xf5257d15,
+    0xfa83b2db, 0xfd3e0c0d, 0xfe9e115c, 0xff4ecb59,
+    0xffa75652, 0xffd3a752, 0xffe9d2b3, 0xfff4e91c,
+    0xfffa747f, 0xfffd3a3b, 0xfffe9d1d, 0xffff4e8e,
+};
+
+#define LN2_16_16   45426 /* ln(2) as 16.16 fixed point */
+#define LOG2E_16_16 94548 /* log2(e) as 16.16 fixed point */
+
+static uint
+sample_random(sampler_t *s)
+{
+    /* xorshift32: plenty for spacing out samples */
+    uint x = s->rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s->rand_state = x;
+    return x;
+}
+
+/* Returns log2(x) for x > 0 as 16.16 fixed point */
+static uint
+log2_fixed(uint x)
+{
+    uint msb = 0, i, res;
+    uint64 m;
+    while ((x >> msb) > 1)
+        msb++;
+    res = msb << 16;
+    /* normalize to [1,2) as 2.30 fixed point, then square repeatedly: each
+     * time the square reaches 2 the next fractional bit is 1
+     */
+    m = (msb > 30) ? (x >> (msb - 30)) : ((uint64)x << (30 - msb));
+    for (i = 0; i < 16; i++) {
+        m = (m * m) >> 30;
+        if (m >= (2ULL << 30)) {
+            m >>= 1;
+            res |= 1 << (15 - i);
+        }
+    }
+    return res;
+}
+
+/* Returns the number of bytes to allocate before the next sample */
+static int64
+sample_next_gap(sampler_t *s)
+{
+    /* -ln(u)*sample_bytes for u uniform in (0,1], via -log2(u)*ln(2) */
+    uint u = sample_random(s);
+    uint64 neg_log2 = (32 << 16) - log2_fixed(u);
+    uint64 gap = (((uint64)options.sample_bytes * neg_log2) >> 16) * LN2_16_16 >> 16;
+    return (int64)gap + 1;
+}
+
+/* Returns 1/(1-e^(-size/sample_bytes)) as 16.16 fixed point */
+static uint64
+sample_scale(size_t size)
+{
+    uint64 z, frac, e = 0xffffffff;
+    uint i;
+    if (size == 0)
+        return 1 << 16; /* only sampled at a gap boundary */
+    if (size < options.sample_bytes / 64) {
+        /* 1/x + 1/2 is within x/12 of the scale */
+        return (((uint64)options.sample_bytes << 16) / size) + (1 << 15);
+    }
+    /* e^(-x) = 2^(-x*log2(e)) */
+    z = (uint64)size * LOG2E_16_16 / options.sample_bytes;
+    if ((z >> 16) >= 32)
+        return 1 << 16;
+    frac = z & 0xffff;
+    for (i = 0; i < 16; i++) {
+        if (TEST(1 << (15 - i), frac))
+            e = (e * exp2_neg_frac[i]) >> 32;
+    }
+    e >>= (z >> 16);
+    /* scale = 1/(1-e) */
+    return ((uint64)1 << 48) / ((1ULL << 32) - e);
+}
+
+/* Returns val scaled by a 16.16 fixed point scale, rounded away from 0 so
+ * that a free's negative value is exactly the negation of its malloc's
+ */
+static int
+sample_scale_value(int val, uint64 scale)
+{
+    int64 res = (int64)val * (int64)scale;
+    if (res >= 0)
+        return (int)((res + (1 << 15)) >> 16);
+    else
+        return -(int)((-res + (1 << 15)) >> 16);
+}
+
+/* Returns whether to record the callstack of a new allocation.
+ * Caller must hold malloc_lock(), which protects the sampler used before
+ * a thread's data is set up.
+ */
+static bool
+sample_allocation(void *drcontext, size_t size)
+{
+    sampler_t *s = &early_sampler;
+    if (drcontext != NULL) {
+        tls_heapstat_t *pt = (tls_heapstat_t *)
+            drmgr_get_tls_field(drcontext, tls_idx_heapstat);
+        if (pt != NULL)
+            s = &pt->sampler;
+    }
+    s->bytes_until_sample -= (int64)size;
+    if (s->bytes_until_sample > 0)
+        return false;
+    s->bytes_until_sample = sample_next_gap(s);
+    STATS_INC(allocs_sampled);
+    return true;
+}
+
+static void
+sampler_init(sampler_t *s, uint seed)
+{
+    /* xorshift32 must not start at 0 */
+    s->rand_state = (seed == 0) ? 0x2545f491 : seed;
+    s->bytes_until_sample = sample_next_gap(s);
+}
 
 /***************************************************************************
  * OPTIONS
@@ -238,7 +393,7 @@ drheap_options_init(const char *opstr)
 static uint snap_idx;
 static uint snap_fills;
 
-/* We keep a linked list of these structs per snapshot.
+/* We keep a linked list of these structs for the live snapshot.
  * One struct per callstack that has non-zero usage in that snapshot.
  * This can save a lot of memory versus arrays when there are
  * many callstacks and few are present in all snapshots.
@@ -248,12 +403,31 @@ typedef struct _heap_used_t {
     /* FIXME: 64-bit? */
     uint instances;
     uint bytes_asked_for;
-    ushort extra_usable;   /* beyond bytes_asked_for */
-    ushort extra_occupied; /* beyond bytes_asked_for + extra_usable */
+    uint extra_usable;     /* beyond bytes_asked_for */
+    uint extra_occupied;   /* beyond bytes_asked_for + extra_usable */
     struct _heap_used_t *next;
     per_callstack_t *callstack;
 } heap_used_t;
 
+/* Per-callstack usage of a snapshot that is no longer live, as parallel
+ * arrays sorted by callstack id: 20 bytes per callstack versus a heap_used_t
+ * plus its heap header.  A retained snapshot only holds the callstacks whose
+ * usage changed since the next-older retained snapshot, with 0 instances for
+ * usage that went away, so most callstacks cost nothing in most snapshots.
+ * The usage at a snapshot is the combination of it and every older one.
+ * The peak snapshot instead holds the full usage.
+ */
+typedef struct _snap_usage_t {
+    uint num_entries;
+    uint *cstack_id;
+    uint *instances;
+    uint *bytes_asked_for;
+    uint *extra_usable;
+    uint *extra_occupied;
+} snap_usage_t;
+
+#define SNAP_USAGE_ENTRY_SIZE (5*sizeof(uint))
+
 /* Arrays of snapshots.  Not using a heap_used_t b/c we need larger counters. */
 typedef struct _per_snapshot_t {
     uint64 stamp;
@@ -261,8 +435,10 @@ typedef struct _per_snapshot_t {
     uint64 tot_bytes_asked_for;
     uint64 tot_bytes_usable;
     uint64 tot_bytes_occupied;
-    /* Linked list of non-zero usage per callstack */
+    /* Linked list of non-zero usage per callstack: only for the live snapshot */
     heap_used_t *used;
+    /* Changed usage per callstack: only for retained and peak snapshots */
+    snap_usage_t usage;
     /* Staleness data: array with one entry per live malloc */
     stale_snap_allocs_t *stale;
 } per_snapshot_t;
@@ -297,8 +473,21 @@ struct _per_callstack_t {
     heap_used_t *used;
     /* for node removal w/o keeping a prev per heap_used_t per snapshot */
     heap_used_t *prev_used;
+    /* Whether usage changed since the live snapshot began, and if so the
+     * next such callstack.
+     */
+    bool changed;
+    struct _per_callstack_t *next_changed;
 };
 
+/* Callstacks whose usage changed since the live snapshot began.  Protected
+ * by snapshot_lock.
+ */
+static per_callstack_t *changed_list;
+static uint num_changed;
+/* Set when the next retained snapshot has no older one to be relative to */
+static bool snap_usage_need_full;
+
 static uint num_callstacks;
 static uint snapshot_count;
 static uint nudge_count;
@@ -313,8 +502,10 @@ static inline per_callstack_t *
 get_cstack_from_alloc_data(void *client_data)
 {
     /* We store either per_callstack_t or stale_per_alloc_t in the
-     * client_data slot in each malloc
+     * client_data slot in each malloc, or NULL if not sampled
      */
+    if (client_data == NULL)
+        return NULL;
     if (options.staleness)
         return ((stale_per_alloc_t *)client_data)->cstack;
     else
@@ -390,9 +581,189 @@ unit_name(void)
     return "<error>";
 }
 
-/* Up to caller to synchronize */
+/***************************************************************************
+ * Retained snapshot usage
+ */
+
+static void
+snap_usage_alloc(snap_usage_t *usage OUT, uint num)
+{
+    memset(usage, 0, sizeof(*usage));
+    usage->num_entries = num;
+    if (num == 0)
+        return;
+    /* One allocation for all the columns */
+    usage->cstack_id = (uint *)
+        global_alloc(num * SNAP_USAGE_ENTRY_SIZE, HEAPSTAT_SNAPSHOT);
+    usage->instances = usage->cstack_id + num;
+    usage->bytes_asked_for = usage->instances + num;
+    usage->extra_usable = usage->bytes_asked_for + num;
+    usage->extra_occupied = usage->extra_usable + num;
+}
+
+static void
+snap_usage_free(snap_usage_t *usage)
+{
+    if (usage->num_entries > 0) {
+        global_free(usage->cstack_id, usage->num_entries * SNAP_USAGE_ENTRY_SIZE,
+                    HEAPSTAT_SNAPSHOT);
+    }
+    memset(usage, 0, sizeof(*usage));
+}
+
+/* Sets dst to older overridden by newer, which must both be sorted by
+ * callstack id.  If drop_unused, entries with no instances are left out, as
+ * they are only needed to cancel out usage in an older snapshot.
+ */
+static void
+snap_usage_merge(snap_usage_t *dst OUT, snap_usage_t *older, snap_usage_t *newer,
+                 bool drop_unused)
+{
+    uint pass, o, n, d = 0;
+    for (pass = 0; pass < 2; pass++) {
+        if (pass == 1)
+            snap_usage_alloc(dst, d);
+        o = 0;
+        n = 0;
+        d = 0;
+        while (o < older->num_entries || n < newer->num_entries) {
+            snap_usage_t *from;
+            uint i;
+            if (n >= newer->num_entries ||
+                (o < older->num_entries &&
+                 older->cstack_id[o] < newer->cstack_id[n])) {
+                from = older;
+                i = o++;
+            } else {
+                if (o < older->num_entries &&
+                    older->cstack_id[o] == newer->cstack_id[n])
+                    o++;
+                from = newer;
+                i = n++;
+            }
+            if (drop_unused && from->instances[i] == 0)
+                continue;
+            if (pass == 1) {
+                dst->cstack_id[d] = from->cstack_id[i];
+                dst->instances[d] = from->instances[i];
+                dst->bytes_asked_for[d] = from->bytes_asked_for[i];
+                dst->extra_usable[d] = from->extra_usable[i];
+                dst->extra_occupied[d] = from->extra_occupied[i];
+            }
+            d++;
+        }
+    }
+}
+
+static void
+sift_down_by_id(per_callstack_t **pers, uint root, uint num)
+{
+    while (2*root + 1 < num) {
+        uint child = 2*root + 1;
+        per_callstack_t *tmp;
+        if (child + 1 < num && pers[child + 1]->id > pers[child]->id)
+            child++;
+        if (pers[root]->id >= pers[child]->id)
+            return;
+        tmp = pers[root];
+        pers[root] = pers[child];
+        pers[child] = tmp;
+        root = child;
+    }
+}
+
+/* Heapsort, as we have no qsort and want no recursion on app stacks */
+static void
+sort_callstacks_by_id(per_callstack_t **pers, uint num)
+{
+    uint i;
+    for (i = num / 2; i > 0; i--)
+        sift_down_by_id(pers, i - 1, num);
+    for (i = num; i > 1; i--) {
+        per_callstack_t *tmp = pers[0];
+        pers[0] = pers[i - 1];
+        pers[i - 1] = tmp;
+        sift_down_by_id(pers, 0, i - 1);
+    }
+}
+
+/* Records the current usage of each of pers, which is freed */
+static void
+snap_usage_from_callstacks(snap_usage_t *usage OUT, per_callstack_t **pers, uint num)
+{
+    uint i;
+    sort_callstacks_by_id(pers, num);
+    snap_usage_alloc(usage, num);
+    for (i = 0; i < num; i++) {
+        heap_used_t *u = pers[i]->used;
+        usage->cstack_id[i] = pers[i]->id;
+        usage->instances[i] = (u == NULL) ? 0 : u->instances;
+        usage->bytes_asked_for[i] = (u == NULL) ? 0 : u->bytes_asked_for;
+        usage->extra_usable[i] = (u == NULL) ? 0 : u->extra_usable;
+        usage->extra_occupied[i] = (u == NULL) ? 0 : u->extra_occupied;
+    }
+    if (num > 0)
+        global_free(pers, num * sizeof(*pers), HEAPSTAT_SNAPSHOT);
+}
+
+/* Records the full usage in the live list */
+static void
+snap_usage_from_list(snap_usage_t *usage OUT, heap_used_t *list)
+{
+    per_callstack_t **pers = NULL;
+    heap_used_t *u;
+    uint num = 0, i = 0;
+    for (u = list; u != NULL; u = u->next)
+        num++;
+    if (num > 0) {
+        pers = (per_callstack_t **)
+            global_alloc(num * sizeof(*pers), HEAPSTAT_SNAPSHOT);
+    }
+    for (u = list; u != NULL; u = u->next)
+        pers[i++] = u->callstack;
+    snap_usage_from_callstacks(usage, pers, num);
+}
+
+/* Caller must hold snapshot_lock.
+ * Records in snap, the live snapshot until now, what changed since the
+ * next-older retained snapshot.
+ */
+static void
+snapshot_retain(per_snapshot_t *snap)
+{
+    per_callstack_t *per, *next;
+    ASSERT(snap->usage.num_entries == 0, "live snapshot should have no usage");
+    if (snap_usage_need_full) {
+        snap_usage_from_list(&snap->usage, snap->used);
+        snap_usage_need_full = false;
+    } else {
+        per_callstack_t **pers = NULL;
+        uint i = 0;
+        if (num_changed > 0) {
+            pers = (per_callstack_t **)
+                global_alloc(num_changed * sizeof(*pers), HEAPSTAT_SNAPSHOT);
+        }
+        for (per = changed_list; per != NULL; per = per->next_changed)
+            pers[i++] = per;
+        ASSERT(i == num_changed, "changed list count mismatch");
+        snap_usage_from_callstacks(&snap->usage, pers, num_changed);
+    }
+    for (per = changed_list; per != NULL; per = next) {
+        next = per->next_changed;
+        per->changed = false;
+        per->next_changed = NULL;
+    }
+    changed_list = NULL;
+    num_changed = 0;
+    LOG(2, "retained snapshot stamp=%"INT64_FORMAT"u with %u callstacks\n",
+        snap->stamp, snap->usage.num_entries);
+}
+
+/* Up to caller to synchronize.
+ * For a retained snapshot, usage is its full usage; NULL means snap is live.
+ */
 static void
-dump_snapshot(per_snapshot_t *snap, int idx/*-1 means peak*/)
+dump_snapshot(per_snapshot_t *snap, int idx/*-1 means peak*/, snap_usage_t *usage)
 {
     heap_used_t *u;
     size_t sofar = 0;
@@ -409,13 +780,26 @@ dump_snapshot(per_snapshot_t *snap, int idx/*-1 means peak*/)
                snap->tot_mallocs, snap->tot_bytes_asked_for,
                snap->tot_bytes_usable, snap->tot_bytes_occupied);
 
-    for (u = snap->used; u != NULL; u = u->next) {
-        if (u->bytes_asked_for + u->extra_usable > 0) {
-            /* PR 551841: buffer snapshot output else performance is bad. */
-            BUFFERED_WRITE(f_snapshot, snaps_log_buf, SNAPSHOT_LOG_BUF_SIZE,
-                           sofar, len, "%u,%u,%u,%u,%u\n",
-                           u->callstack->id, u->instances, u->bytes_asked_for,
-                           u->extra_usable, u->extra_occupied);
+    if (usage == NULL) {
+        for (u = snap->used; u != NULL; u = u->next) {
+            if (u->bytes_asked_for + u->extra_usable > 0) {
+                /* PR 551841: buffer snapshot output else performance is bad. */
+                BUFFERED_WRITE(f_snapshot, snaps_log_buf, SNAPSHOT_LOG_BUF_SIZE,
+                               sofar, len, "%u,%u,%u,%u,%u\n",
+                               u->callstack->id, u->instances, u->bytes_asked_for,
+                               u->extra_usable, u->extra_occupied);
+            }
+        }
+    } else {
+        uint i;
+        for (i = 0; i < usage->num_entries; i++) {
+            if (usage->bytes_asked_for[i] + usage->extra_usable[i] > 0) {
+                BUFFERED_WRITE(f_snapshot, snaps_log_buf, SNAPSHOT_LOG_BUF_SIZE,
+                               sofar, len, "%u,%u,%u,%u,%u\n",
+                               usage->cstack_id[i], usage->instances[i],
+                               usage->bytes_asked_for[i], usage->extra_usable[i],
+                               usage->extra_occupied[i]);
+            }
         }
     }
     FLUSH_BUFFER(f_snapshot, snaps_log_buf, sofar);
@@ -453,6 +837,7 @@ free_snapshot(per_snapshot_t *snap)
         global_free(u, sizeof(*u), HEAPSTAT_SNAPSHOT);
     }
     snap->used = NULL;
+    snap_usage_free(&snap->usage);
     if (options.staleness && snap->stale != NULL) {
         staleness_free_snapshot(snap->stale);
         snap->stale = NULL;
@@ -460,58 +845,56 @@ free_snapshot(per_snapshot_t *snap)
 }
 
 /* Caller must hold snapshot_lock.
- * Calls free_snapshot on dst first.
- * If new_live is true, dst is the new "live" in-progress snapshot
- * whose list is where callstack table entries point.
+ * Frees dst and then copies src's stamp and totals to it.
  */
 static void
-copy_snapshot(per_snapshot_t *dst, per_snapshot_t *src, bool new_live)
+copy_snapshot_totals(per_snapshot_t *dst, per_snapshot_t *src)
 {
-    heap_used_t *u, *nxt_u, *prev_u;
-    int i;
-    /* Replace the existing list at dst with a clone of
-     * src, and update the callstack table pointers.  First
-     * we clear the callstack table pointers in case pointing to
-     * entries not in the new list.
-     */
     ASSERT(src != dst, "cannot copy to self");
-
     free_snapshot(dst);
-
     memcpy(dst, src, sizeof(*dst));
-    if (options.staleness) {
-        /* We fill this in at snapshot time */
-        dst->stale = NULL;
-    }
-
-    hashtable_lock(&alloc_stack_table);
-    if (new_live) {
-        for (i = 0; i < HASHTABLE_SIZE(alloc_stack_table.table_bits); i++) {
-            hash_entry_t *he;
-            for (he = alloc_stack_table.table[i]; he != NULL; he = he->next) {
-                per_callstack_t *per = (per_callstack_t *) he->payload;
-                per->used = NULL;
-                per->prev_used = NULL;
-            }
-        }
-    }
+    dst->used = NULL;
+    memset(&dst->usage, 0, sizeof(dst->usage));
+    /* We fill in staleness at snapshot time */
+    dst->stale = NULL;
+}
 
-    prev_u = NULL;
-    for (u = src->used; u != NULL; u = u->next) {
-        nxt_u = (heap_used_t *) global_alloc(sizeof(*nxt_u), HEAPSTAT_SNAPSHOT);
-        memcpy(nxt_u, u, sizeof(*nxt_u));
-        if (prev_u == NULL)
-            dst->used = nxt_u;
-        else
-            prev_u->next = nxt_u;
-        if (new_live) {
-            nxt_u->callstack->used = nxt_u;
-            nxt_u->callstack->prev_used = prev_u;
-        }
-        nxt_u->next = NULL;
-        prev_u = nxt_u;
+/* Caller must hold snapshot_lock.
+ * Makes the live list at src the live list of dst.  The callstack table
+ * entries point at its nodes, so it cannot be copied.
+ */
+static void
+move_live_snapshot(per_snapshot_t *dst, per_snapshot_t *src)
+{
+    copy_snapshot_totals(dst, src);
+    dst->used = src->used;
+    src->used = NULL;
+}
+
+/* Caller must hold snapshot_lock.
+ * Frees the retained snapshot at idx after folding its changes into the
+ * next-newer retained snapshot, which thus still has the same usage.
+ */
+static void
+drop_snapshot(uint idx)
+{
+    uint i, newer = options.snapshots;
+    bool is_oldest = true;
+    for (i = 0; i < options.snapshots; i++) {
+        if (i == idx || snaps[i].stamp == 0)
+            continue;
+        if (snaps[i].stamp < snaps[idx].stamp)
+            is_oldest = false;
+        else if (newer == options.snapshots || snaps[i].stamp < snaps[newer].stamp)
+            newer = i;
+    }
+    if (newer < options.snapshots) {
+        snap_usage_t merged;
+        snap_usage_merge(&merged, &snaps[idx].usage, &snaps[newer].usage, is_oldest);
+        snap_usage_free(&snaps[newer].usage);
+        snaps[newer].usage = merged;
     }
-    hashtable_unlock(&alloc_stack_table);
+    free_snapshot(&snaps[idx]);
 }
 
 static bool
@@ -546,9 +929,10 @@ check_for_peak(void)
                                        options.peak_threshold)) {
             STATS_INC(peaks_detected);
             allocfree_last_peak = allocfree_cur;
-            copy_snapshot(&snap_peak, &snaps[snap_idx], false/*isolated copy*/);
+            copy_snapshot_totals(&snap_peak, &snaps[snap_idx]);
+            snap_usage_from_list(&snap_peak.usage, snaps[snap_idx].used);
             if (options.staleness) {
-                /* copy_snapshot called free_snapshot which freed this */
+                /* copy_snapshot_totals called free_snapshot which freed this */
                 ASSERT(snap_peak.stale == NULL, "invalid staleness data");
                 snap_peak.stale = staleness_take_snapshot(stamp);
             }
@@ -562,6 +946,95 @@ check_for_peak(void)
     }
 }
 
+/* Adds a change in usage to callstack per in the live snapshot.
+ * Caller must hold snapshot_lock.
+ */
+static void
+apply_usage_change(per_callstack_t *per, int instances, int asked_for,
+                   int extra_usable, int extra_occupied)
+{
+    if (!options.dump && !per->changed) {
+        per->changed = true;
+        per->next_changed = changed_list;
+        changed_list = per;
+        num_changed++;
+    }
+    if (asked_for+extra_usable > 0) {
+        if (per->used == NULL) {
+            per->used = (heap_used_t *)
+                global_alloc(sizeof(*per->used), HEAPSTAT_SNAPSHOT);
+            memset(per->used, 0, sizeof(*per->used));
+            per->used->callstack = per;
+            per->used->next = snaps[snap_idx].used;
+            if (snaps[snap_idx].used != NULL) {
+                ASSERT(snaps[snap_idx].used->callstack->prev_used == NULL,
+                       "prev_used should already be null");
+                snaps[snap_idx].used->callstack->prev_used = per->used;
+            }
+            ASSERT(per->prev_used == NULL, "prev_used should already be null");
+            snaps[snap_idx].used = per->used;
+        }
+    } else {
+        ASSERT(per->used != NULL, "alloc must exist");
+        ASSERT(per->used->instances >= 0, "alloc count must be >= 0");
+    }
+    per->used->instances += instances;
+    per->used->bytes_asked_for += asked_for;
+    per->used->extra_usable += extra_usable;
+    per->used->extra_occupied += extra_occupied;
+    LOG(2, "callstack id %u => %ux, %uB, +%uB, +%uB\n", per->id,
+        per->used->instances, per->used->bytes_asked_for,
+        per->used->extra_usable, per->used->extra_occupied);
+    if (per->used->instances == 0) {
+        /* remove the node to save memory since may not re-alloc */
+        ASSERT(per->used->bytes_asked_for == 0, "no malloc => no bytes!");
+        if (per->used->next != NULL)
+            per->used->next->callstack->prev_used = per->prev_used;
+        if (per->prev_used == NULL) {
+            ASSERT(per->used == snaps[snap_idx].used, "prev node error");
+            snaps[snap_idx].used = per->used->next;
+        } else {
+            per->prev_used->next = per->used->next;
+        }
+        global_free(per->used, sizeof(*per->used), HEAPSTAT_SNAPSHOT);
+        per->used = NULL;
+        per->prev_used = NULL;
+    }
+}
+
+/* Hands the live snapshot to the -stream consumer, if one is connected.
+ * Caller must hold snapshot_lock.
+ */
+static void
+stream_live_snapshot(per_snapshot_t *snap)
+{
+    heap_used_t *u;
+    uint num = 0;
+    stream_usage_t *entry;
+    stream_snapshot_t info;
+    if (options.stream[0] == '\0' || !stream_is_connected())
+        return;
+    for (u = snap->used; u != NULL; u = u->next)
+        num++;
+    entry = stream_snapshot_begin(num);
+    if (entry == NULL)
+        return;
+    for (u = snap->used; u != NULL; u = u->next, entry++) {
+        entry->cstack_id = u->callstack->id;
+        entry->instances = u->instances;
+        entry->bytes_asked_for = u->bytes_asked_for;
+        entry->extra_usable = u->extra_usable;
+        entry->extra_occupied = u->extra_occupied;
+    }
+    info.stamp = snap->stamp;
+    info.tot_mallocs = snap->tot_mallocs;
+    info.tot_bytes_asked_for = snap->tot_bytes_asked_for;
+    info.tot_bytes_usable = snap->tot_bytes_usable;
+    info.tot_bytes_occupied = snap->tot_bytes_occupied;
+    info.num_entries = num;
+    stream_snapshot_end(&info);
+}
+
 /* Caller must hold malloc_lock() */
 static void
 take_snapshot(void)
@@ -585,14 +1058,17 @@ take_snapshot(void)
     }
     if (options.dump) {
         snaps[snap_idx].stamp += options.dump_freq;
-        dump_snapshot(&snaps[snap_idx], snap_idx);
+        stream_live_snapshot(&snaps[snap_idx]);
+        dump_snapshot(&snaps[snap_idx], snap_idx, NULL);
     } else {
         stamp += options.dump_freq;
         snaps[snap_idx].stamp = stamp;
+        stream_live_snapshot(&snaps[snap_idx]);
         prev_idx = snap_idx;
         LOG(2, "take_snapshot @idx=%u stamp=%"INT64_FORMAT"u\n", prev_idx, stamp);
         /* Check for peak on every snapshot (PR 476018) */
         check_for_peak();
+        snapshot_retain(&snaps[prev_idx]);
         /* Find the next one we should overwrite.  Keep those aligned
          * w/ current dump_freq.
          */
@@ -609,71 +1085,54 @@ take_snapshot(void)
         } while (snaps[snap_idx].stamp > 0 &&
                  (snaps[snap_idx].stamp % options.dump_freq) == 0);
 
-        /* Replace the existing list at snap_idx with a clone of prev_idx */
-        copy_snapshot(&snaps[snap_idx], &snaps[prev_idx], true/*live copy*/);
+        if (snaps[snap_idx].stamp > 0)
+            drop_snapshot(snap_idx);
+        move_live_snapshot(&snaps[snap_idx], &snaps[prev_idx]);
     }
     dr_mutex_unlock(snapshot_lock);
 }
 
 /* Called from pre-alloc-hashtable-change events.
- * Updates the current snapshot and callstack usage.
+ * Records the change in the current snapshot and callstack usage.
+ * per is NULL for an allocation not sampled for -sample_bytes, which only
+ * affects the snapshot totals.
+ * Caller must hold malloc_lock().
  */
 static void
 account_for_bytes_pre(per_callstack_t *per, int asked_for,
                       int extra_usable, int extra_occupied, bool realloc)
 {
+    int instances = 0;
+    if (asked_for+extra_usable > 0) {
+        if (!realloc)
+            instances = 1;
+    } else {
+        ASSERT(asked_for+extra_usable < 0, "cannot have 0-sized usable space");
+        if (!realloc)
+            instances = -1;
+    }
     /* must be synched w/ take_snapshot().  the malloc lock is always acquired
      * before the snapshot lock.
      */
     dr_mutex_lock(snapshot_lock);
-    if (asked_for+extra_usable > 0) {
-        if (per->used == NULL) {
-            per->used = (heap_used_t *)
-                global_alloc(sizeof(*per->used), HEAPSTAT_SNAPSHOT);
-            memset(per->used, 0, sizeof(*per->used));
-            per->used->callstack = per;
-            per->used->next = snaps[snap_idx].used;
-            if (snaps[snap_idx].used != NULL) {
-                ASSERT(snaps[snap_idx].used->callstack->prev_used == NULL,
-                       "prev_used should already be null");
-                snaps[snap_idx].used->callstack->prev_used = per->used;
-            }
-            ASSERT(per->prev_used == NULL, "prev_used should already be null");
-            snaps[snap_idx].used = per->used;
-        }
-        if (!realloc)
-            per->used->instances++;
+    if (per != NULL && options.sample_bytes > 0) {
+        /* The totals are exact, but a sample's callstack is credited with
+         * the usage it stands for.
+         */
+        uint64 scale = sample_scale(asked_for < 0 ? -asked_for : asked_for);
+        ASSERT(!realloc, "in-place realloc must be split for sampling");
+        apply_usage_change(per, sample_scale_value(instances, scale),
+                           sample_scale_value(asked_for, scale),
+                           sample_scale_value(extra_usable, scale),
+                           sample_scale_value(extra_occupied, scale));
+    } else if (per != NULL)
+        apply_usage_change(per, instances, asked_for, extra_usable, extra_occupied);
+    if (asked_for+extra_usable > 0)
         snaps[snap_idx].tot_mallocs++;
-    } else {
-        ASSERT(asked_for+extra_usable < 0, "cannot have 0-sized usable space");
-        ASSERT(per->used != NULL, "alloc must exist");
-        ASSERT(per->used->instances >= 0, "alloc count must be >= 0");
+    else {
         ASSERT(snaps[snap_idx].tot_mallocs >= 0, "alloc count must be >= 0");
-        if (!realloc)
-            per->used->instances--;
         snaps[snap_idx].tot_mallocs--;
     }
-    per->used->bytes_asked_for += asked_for;
-    per->used->extra_usable += extra_usable;
-    per->used->extra_occupied += extra_occupied;
-    LOG(2, "callstack id %u => %ux, %uB, +%uB, +%uB\n", per->id,
-        per->used->instances, per->used->bytes_asked_for,
-        per->used->extra_usable, per->used->extra_occupied);
-    if (per->used->instances == 0) {
-        /* remove the node to save memory since may not re-alloc */
-        ASSERT(per->used->bytes_asked_for == 0, "no malloc => no bytes!");
-        if (per->used->next != NULL)
-            per->used->next->callstack->prev_used = per->prev_used;
-        if (per->prev_used == NULL) {
-            ASSERT(per->used == snaps[snap_idx].used, "prev node error");
-            snaps[snap_idx].used = per->used->next;
-        } else {
-            per->prev_used->next = per->used->next;
-        }
-        global_free(per->used, sizeof(*per->used), HEAPSTAT_SNAPSHOT);
-        per->used = NULL;
-        per->prev_used = NULL;
-    }
     snaps[snap_idx].tot_bytes_asked_for += asked_for;
     snaps[snap_idx].tot_bytes_usable += asked_for + extra_usable;
     snaps[snap_idx].tot_bytes_occupied += asked_for + extra_usable + extra_occupied;
@@ -741,6 +1200,13 @@ client_add_malloc_pre(malloc_info_t *info, dr_mcontext_t *mc, app_pc post_call)
 #ifdef STATISTICS
     static uint malloc_count;
 #endif
+    if (options.sample_bytes > 0 && info->client_data == NULL &&
+        !sample_allocation(drcontext, info->request_size)) {
+        /* Skip the callstack walk: only the totals are updated */
+        account_for_bytes_pre(NULL, info->request_size, info->pad_size, HEADER_SIZE,
+                              false);
+        return NULL;
+    }
     get_buffer(drcontext, &buf, &bufsz);
     if (info->client_data != NULL) {
         per = get_cstack_from_alloc_data(info->client_data);
@@ -865,15 +1331,41 @@ snapshot_init(void)
     memset(snaps, 0, options.snapshots*sizeof(*snaps));
 }
 
+/* Caller must hold snapshot_lock.
+ * Dumps the retained snapshots oldest first, combining each one's changes
+ * with those before it to get its full usage.
+ */
+static void
+dump_retained_snapshots(void)
+{
+    uint *order = (uint *)
+        global_alloc(options.snapshots * sizeof(*order), HEAPSTAT_SNAPSHOT);
+    uint num = 0, i, j;
+    snap_usage_t usage, next;
+    for (i = 0; i < options.snapshots; i++) {
+        if (i == snap_idx || snaps[i].stamp == 0)
+            continue;
+        for (j = num; j > 0 && snaps[order[j - 1]].stamp > snaps[i].stamp; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+        num++;
+    }
+    memset(&usage, 0, sizeof(usage));
+    for (i = 0; i < num; i++) {
+        snap_usage_merge(&next, &usage, &snaps[order[i]].usage, true);
+        snap_usage_free(&usage);
+        usage = next;
+        dump_snapshot(&snaps[order[i]], order[i], &usage);
+    }
+    snap_usage_free(&usage);
+    global_free(order, options.snapshots * sizeof(*order), HEAPSTAT_SNAPSHOT);
+}
+
 /* Caller must hold malloc lock */
 static void
 snapshot_dump_all(void)
 {
-    uint i;
     dr_mutex_lock(snapshot_lock);
-    /* These should be sorted by stamp, but simpler to have the vis tool
-     * sort them.
-     */
     /* We do dump the partially-full current snapshot (PR 548013) */
     if (options.time_clock) {
         uint64 diff = ((dr_get_milliseconds() - timestamp_last_snapshot)
@@ -887,17 +1379,9 @@ snapshot_dump_all(void)
         snaps[snap_idx].stamp = stamp + (options.dump_freq - instr_count);
     /* Check for peak on every snapshot (PR 476018) */
     check_for_peak();
-    dump_snapshot(&snap_peak, -1);
-    if (snap_fills == 0) {
-        for (i = 0; i <= snap_idx; i++) {
-            dump_snapshot(&snaps[i], i);
-        }
-    } else {
-        /* FIXME: sort by stamp */
-        for (i = 0; i < options.snapshots; i++) {
-            dump_snapshot(&snaps[i], i);
-        }
-    }
+    dump_snapshot(&snap_peak, -1, &snap_peak.usage);
+    dump_retained_snapshots();
+    dump_snapshot(&snaps[snap_idx], snap_idx, NULL);
     dr_mutex_unlock(snapshot_lock);
 }
 
@@ -941,7 +1425,21 @@ client_handle_realloc(void *drcontext, malloc_info_t *old_info, malloc_info_t *n
             check_for_peak();
             dr_mutex_unlock(snapshot_lock);
         }
-        account_for_bytes_pre(per, delta_req, delta_pad, delta_head, true/*realloc*/);
+        if (per != NULL && options.sample_bytes > 0) {
+            /* The sample's scale depends on its size, so rather than adding
+             * the difference we replace the old usage with the new.
+             */
+            account_for_bytes_pre(per, -(ssize_t)old_info->request_size,
+                                  -(ssize_t)old_info->pad_size,
+                                  -(ssize_t)(HEADER_SIZE), false);
+            account_for_bytes_pre(per, new_info->request_size, new_info->pad_size,
+                                  HEADER_SIZE, false);
+        } else {
+            /* For an unsampled alloc per is NULL and the growth only reaches
+             * the totals: the sampler never sees it (documented bias).
+             */
+            account_for_bytes_pre(per, delta_req, delta_pad, delta_head, true/*realloc*/);
+        }
         account_for_bytes_post(delta_req, delta_pad, 0);
     }
 
@@ -1110,6 +1608,9 @@ client_found_leak(app_pc start, app_pc end, size_t indirect_bytes,
     ASSERT(options.check_leaks, "leak checking error");
     if (pre_us && options.ignore_early_leaks)
         return;
+    /* With -sample_bytes we only have callstacks for the sampled leaks */
+    if (per == NULL)
+        return;
     if (reachable) {
         if (count_reachable)
             ATOMIC_INC32(reachable_leak_count);
@@ -1452,6 +1953,12 @@ dump_statistics(void)
     dr_fprintf(f_global, "app heap regions: %8u\n", heap_regions);
     dr_fprintf(f_global, "peaks detected: %8u, skipped: %8u\n",
                peaks_detected, peaks_skipped);
+    if (options.sample_bytes > 0)
+        dr_fprintf(f_global, "allocations sampled: %8u\n", allocs_sampled);
+    if (options.stream[0] != '\0') {
+        dr_fprintf(f_global, "stream snapshots sent: %8u, dropped: %8u\n",
+                   stream_snapshots_sent, stream_snapshots_dropped);
+    }
     if (options.staleness) {
         dr_fprintf(f_global, "staleness: needs large: %7u, needs ext: %7u\n",
                    stale_needs_large, stale_small_needs_ext);
@@ -1638,10 +2145,12 @@ reset_to_time_zero(bool keep_offs)
 
     /* take current data and make it the cur val of to-be-snapshot 0 */
     if (snap_idx != 0)
-        copy_snapshot(&snaps[0], &snaps[snap_idx], true/*live copy*/);
+        move_live_snapshot(&snaps[0], &snaps[snap_idx]);
     for (i = 1; i < options.snapshots; i++)
         free_snapshot(&snaps[i]);
     memset(&snaps[1], 0, (options.snapshots-1)*sizeof(*snaps));
+    /* snapshot 0 has no older one to hold only its changes against */
+    snap_usage_need_full = true;
 
     if (keep_offs)
         stamp_offs = stamp;
@@ -1756,17 +2265,23 @@ sideline_run(void *arg)
     }
     if (options.staleness)
         timer_stale = options.stale_granularity;
-    reset_clock_timer();
-    ASSERT(options.time_clock || options.staleness, "thread should not be running");
+    if (options.time_clock || options.staleness)
+        reset_clock_timer();
+    ASSERT(SIDELINE_NEEDED(), "thread should not be running");
     LOG(1, "sideline thread "TIDFMT" running\n", dr_get_thread_id(drcontext));
     while (!sideline_exit) {
 #ifdef WINDOWS
-        dr_sleep(timer_real);
-        /* FIXME: check wall-clock time and normalize to get closer to real time */
-        event_timer(drcontext, NULL);
+        if (options.time_clock || options.staleness) {
+            dr_sleep(timer_real);
+            /* FIXME: check wall-clock time and normalize to get closer to real time */
+            event_timer(drcontext, NULL);
+        } else
+            dr_sleep(SIDELINE_SLEEP_MS);
 #else
-        dr_sleep(500);
+        dr_sleep(SIDELINE_SLEEP_MS);
 #endif
+        if (options.stream[0] != '\0')
+            stream_send_pending();
     }
 #ifdef UNIX
     dr_set_itimer(ITIMER_REAL, 0, event_timer);
@@ -1786,6 +2301,9 @@ event_fork(void *drcontext)
     /* we assume no lock is needed since only one thread post-fork */
     static char buf[4096];
 
+    if (options.stream[0] != '\0')
+        stream_fork_init();
+
     close_file(f_global);
     close_file(f_callstack);
     close_file(f_snapshot);
@@ -2063,6 +2581,9 @@ event_thread_init(void *drcontext)
     pt->errbufsz = MAX_ERROR_INITIAL_LINES + max_callstack_size();
     pt->errbuf = (char *) thread_alloc(drcontext, pt->errbufsz, HEAPSTAT_MISC);
 
+    if (options.sample_bytes > 0)
+        sampler_init(&pt->sampler, dr_get_thread_id(drcontext));
+
     LOGPT(2, PT_GET(drcontext), "in event_thread_init()\n");
     callstack_thread_init(drcontext);
     if (options.check_leaks || options.staleness)
@@ -2102,7 +2623,7 @@ event_exit(void)
 {
     LOGF(2, f_global, "in event_exit\n");
 
-    if (options.time_clock || options.staleness) {
+    if (SIDELINE_NEEDED()) {
         sideline_exit = true;
         if (options.thread_logs) {
             /* i#297: sideline_run never gets a chance to clean up so we do it */
@@ -2111,6 +2632,8 @@ event_exit(void)
         }
     }
     snapshot_exit();
+    if (options.stream[0] != '\0')
+        stream_exit();
     if (options.check_leaks) {
         check_reachability(true/*at_exit*/);
         leak_exit();
@@ -2251,6 +2774,18 @@ dr_init(client_id_t client_id)
 #endif
 
     snapshot_init();
+    if (options.sample_bytes > 0) {
+        sampler_init(&early_sampler, dr_get_process_id());
+        dr_fprintf(f_global, "sampling one allocation per %u bytes\n",
+                   options.sample_bytes);
+    }
+    if (options.stream[0] != '\0') {
+        char callstack_log[MAXIMUM_PATH];
+        dr_snprintf(callstack_log, BUFFER_SIZE_ELEMENTS(callstack_log),
+                    "%s%ccallstack.log", logsubdir, DIRSEP);
+        NULL_TERMINATE_BUFFER(callstack_log);
+        stream_init(options.stream, callstack_log);
+    }
 
     callstack_ops.global_max_frames = options.callstack_max_frames;
     callstack_ops.stack_swap_threshold = 0x10000;
@@ -2331,7 +2866,7 @@ dr_init(client_id_t client_id)
 
     if (options.time_clock)
         timestamp_last_snapshot = dr_get_milliseconds();
-    if (options.time_clock || options.staleness) {
+    if (SIDELINE_NEEDED()) {
         if (!dr_create_client_thread(sideline_run, NULL)) {
             ASSERT(false, "unable to create thread");
         }
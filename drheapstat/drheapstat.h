@@ -40,6 +40,8 @@ extern uint num_mallocs;
 extern uint num_frees;
 extern uint alloc_stack_count;
 extern uint heap_regions;
+extern uint stream_snapshots_sent;
+extern uint stream_snapshots_dropped;
 #endif /* STATISTICS */
 
 #ifdef UNIX
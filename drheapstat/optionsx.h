@@ -122,6 +122,12 @@ OPTION_CLIENT(client, dump_freq, uint, 1, 0, UINT_MAX,
 OPTION_CLIENT(client, peak_threshold, uint, 5, 0, 99,
               "Accuracy of peak snapshot, in percentage from the true peak.",
               "A new peak snapshot will only be taken if it is more than this percentage different from the existing peak snapshot in any of total size, number of allocations and frees, and timestamp.  Lowering this number can reduce performance but will also increase accuracy.")
+OPTION_CLIENT(client, sample_bytes, uint, 0, 0, 1 << 30,
+              "Record callstacks for one allocation per this many bytes (0=all)",
+              "If non-zero, rather than recording the callstack of every allocation, only an average of one allocation per this many bytes allocated is sampled, with randomly varying gaps.  Each sampled allocation's usage is scaled up to estimate the usage of all allocations from its callstack, while the total usage in each snapshot remains exact.  Whether an allocation is sampled is decided only when it is allocated: the bytes added by an in-place realloc of an allocation that was not sampled are counted in the totals but never reach the sampler, so the estimates for callstacks whose allocations mostly grow in place are biased low.  Walking callstacks is the main cost of Dr. Heapstat, so a value such as 524288 allows profiling large workloads at low overhead.  This option disables -staleness, which needs data on every allocation, and -check_leaks by default; if -check_leaks is requested, only leaks of sampled allocations are listed.")
+OPTION_CLIENT_STRING(client, stream, "",
+                     "Publish each snapshot live to this socket or pipe",
+                     "If non-empty, each snapshot is sent as it is taken, along with the definitions of the callstacks it refers to, to a consumer listening on this path: a Unix domain socket on Linux or a named pipe path on Windows.  The heapwatch tool is such a consumer, printing the callstacks whose usage grew the most.  Snapshots are sent by a separate thread: if the consumer falls behind, intermediate snapshots are dropped rather than slowing down the application.  Until a consumer is listening the connection is retried periodically.")
 
 OPTION_CLIENT_BOOL(client, staleness, true,
                    "Record staleness data for each allocation",
@@ -132,6 +138,9 @@ OPTION_CLIENT(client, stale_granularity, uint, 1000, 0, UINT_MAX,
 OPTION_CLIENT_BOOL(client, stale_ignore_sp, true,
                    "Ignore memory references off the stack",
                    "Do not track staleness of memory references that use only the stack pointer.  If your application allocates stacks in the heap, or uses the stack pointer register for purposes other than to point at the stack, then you should disable this option.  Disabling this option will decrease the performance of the Dr. Heapstat.")
+OPTION_CLIENT(client, stale_line_size, uint, 8, 8, 4096,
+              "Size in bytes of the unit in which staleness accesses are recorded",
+              "Memory accesses are recorded per aligned unit of this many bytes, which must be a power of 2.  The default of 8 attributes each access to just the allocation it touched.  A larger value, such as 64 for a cache line or 4096 for a page, records one unit per access instead, which reduces the instrumentation of each memory reference to a mask and a single unconditional store.  Allocations sharing a unit are all considered accessed when any one of them is, so the staleness of small allocations becomes approximate.")
 OPTION_CLIENT_BOOL(internal/*undocumented perf option*/, stale_blind_store, false,
                    "Disables checking before storing to shadow mem",
                    "Disables checking before storing to shadow mem")
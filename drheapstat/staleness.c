@@ -47,10 +47,17 @@
  * allocate for heap we can afford the more efficient 1 shadow byte to hold our
  * 1 bit (so no bitwise operations needed).  So we have 1 shadow byte per 8 app
  * bytes.
+ *
+ * For -stale_line_size larger than 8 we keep the same map but record each
+ * access only in the first shadow byte of its aligned line, so the
+ * instrumentation is a mask plus a single store.  The sweep then treats an
+ * allocation as accessed if any line it overlaps was touched.
  */
 #define SHADOW_GRANULARITY 8
 #define SHADOW_MAP_SCALE   UMBRA_MAP_SCALE_DOWN_8X
 
+#define STALE_LINES_ARE_COARSE() (options.stale_line_size > SHADOW_GRANULARITY)
+
 #define SHADOW_DEFAULT_VALUE      1
 #define SHADOW_DEFAULT_VALUE_SIZE 1
 
@@ -217,6 +224,12 @@ shadow_gen_translation_addr(void *drcontext, instrlist_t *bb, instr_t *inst,
 #endif
     ASSERT(umbra_num_scratch_regs_for_translation(&num_regs) == DRMF_SUCCESS &&
            num_regs <= 1, "not enough scratch registers");
+    if (STALE_LINES_ARE_COARSE()) {
+        /* map every address in a line to the line's first shadow byte */
+        PRE(bb, inst,
+            INSTR_CREATE_and(drcontext, opnd_create_reg(addr_reg),
+                             OPND_CREATE_INT32(~(int)(options.stale_line_size - 1))));
+    }
     umbra_insert_app_to_shadow(drcontext, umbra_map, bb, inst, addr_reg,
                                &scratch_reg, 1);
 }
@@ -225,10 +238,12 @@ shadow_gen_translation_addr(void *drcontext, instrlist_t *bb, instr_t *inst,
  * INSTRUMENTATION
  */
 
-/* Called by slow_path() after initial decode.  Expected to free inst. */
+/* Called by slow_path() after initial decode.  Expected to free inst if
+ * free_inst is set (it is not set when inst is owned by the decode cache).
+ */
 bool
 slow_path_for_staleness(void *drcontext, dr_mcontext_t *mc, instr_t *inst,
-                        app_loc_t *loc)
+                        app_loc_t *loc, bool free_inst)
 {
     opnd_t opnd;
     int opc, i, num_srcs, num_dsts;
@@ -254,7 +269,8 @@ slow_path_for_staleness(void *drcontext, dr_mcontext_t *mc, instr_t *inst,
         }
     }
 
-    instr_free(drcontext, inst);
+    if (free_inst)
+        instr_free(drcontext, inst);
     /* we're not sharing xl8 so no need to call slow_path_xl8_sharing */
 
     return true;
@@ -272,9 +288,9 @@ handle_mem_ref(uint flags, app_loc_t *loc, byte *addr, size_t sz, dr_mcontext_t
     if (TEST(MEMREF_CHECK_ADDRESSABLE, flags))
         return true;
     /* We ignore MEMREF_MOVS, etc.: we don't propagate anything */
-    for (ptr = (byte *) ALIGN_BACKWARD(addr, SHADOW_GRANULARITY);
-         ptr < (byte *) ALIGN_FORWARD(addr + sz, SHADOW_GRANULARITY);
-         ptr += SHADOW_GRANULARITY) {
+    for (ptr = (byte *) ALIGN_BACKWARD(addr, options.stale_line_size);
+         ptr < (byte *) ALIGN_FORWARD(addr + sz, options.stale_line_size);
+         ptr += options.stale_line_size) {
         shadow_set_byte(ptr, 1);
     }
     return true;
@@ -412,23 +428,53 @@ staleness_free_per_alloc(stale_per_alloc_t *spa)
 /* The basic algorithm is to have each read/write set the shadow metadata,
  * and the periodic sweep then sets the timestamp if an alloc's metadata
  * is set and subsequently clears the metadata.
+ * With coarse lines the line at either end of an alloc can be shared with a
+ * neighbor, so clearing those two is deferred to a second pass once every
+ * alloc has looked at them.  Lines entirely inside the alloc are cleared right
+ * away so that accesses to them during the rest of the sweep are not lost.
  */
 static bool
 alloc_itercb_sweep(malloc_info_t *info, void *iter_data)
 {
     /* we don't care much about synch: ok to not be perfectly accurate */
     /* FIXME: ignore pre_us? option-controlled? */
+    byte *start = (byte *) ALIGN_BACKWARD(info->base, options.stale_line_size);
     byte *end = info->base + info->request_size;
-    if (shadow_val_in_range(info->base, end, 1)) {
+    if (shadow_val_in_range(start, end, 1)) {
         stale_per_alloc_t *spa = (stale_per_alloc_t *) info->client_data;
         uint64 stamp = *((uint64 *)iter_data);
         LOG(3, "\t"PFX"-"PFX" was accessed @%"INT64_FORMAT"u\\n", info->base, end, stamp);
         spa->last_access = stamp;
-        shadow_set_range(info->base, end, 0);
+        if (!STALE_LINES_ARE_COARSE())
+            shadow_set_range(start, end, 0);
+        else {
+            byte *inner_start = (byte *)
+                ALIGN_FORWARD(info->base, options.stale_line_size);
+            byte *inner_end = (byte *) ALIGN_BACKWARD(end, options.stale_line_size);
+            if (inner_start < inner_end)
+                shadow_set_range(inner_start, inner_end, 0);
+        }
     }
     return true;
 }
 
+static bool
+alloc_itercb_sweep_clear(malloc_info_t *info, void *iter_data)
+{
+    byte *end = info->base + info->request_size;
+    byte *first = (byte *) ALIGN_BACKWARD(info->base, options.stale_line_size);
+    byte *last;
+    if (end == info->base)
+        return true;
+    last = (byte *) ALIGN_BACKWARD(end - 1, options.stale_line_size);
+    if (first != info->base)
+        shadow_set_range(first, first + options.stale_line_size, 0);
+    /* unless it is the partial first line we just cleared */
+    if (!ALIGNED(end, options.stale_line_size) && (last != first || first == info->base))
+        shadow_set_range(last, last + options.stale_line_size, 0);
+    return true;
+}
+
 void
 staleness_sweep(uint64 stamp)
 {
@@ -442,6 +488,8 @@ staleness_sweep(uint64 stamp)
     ASSERT(options.staleness, "should not get here");
     LOG(2, "\nSTALENESS SWEEP @%"INT64_FORMAT"u\n", stamp);
     malloc_iterate(alloc_itercb_sweep, (void *) iter_data);
+    if (STALE_LINES_ARE_COARSE())
+        malloc_iterate(alloc_itercb_sweep_clear, NULL);
     global_free(iter_data, sizeof(*iter_data), HEAPSTAT_STALENESS);
 }
 
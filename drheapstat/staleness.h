@@ -42,7 +42,7 @@ shadow_reinstate_specials_in_range(byte * start, byte * end);
 
 bool
 slow_path_for_staleness(void *drcontext, dr_mcontext_t *mc, instr_t *inst,
-                        app_loc_t *loc);
+                        app_loc_t *loc, bool free_inst);
 
 bool
 instr_uses_memory_we_track(instr_t *inst);
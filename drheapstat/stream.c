@@ -0,0 +1,407 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* stream.c
+ *
+ * Live publishing of snapshots for -stream.  Application threads taking a
+ * snapshot serialize it into a buffer that replaces any snapshot not yet
+ * sent; only the sideline thread talks to the consumer, so a slow or absent
+ * consumer costs dropped snapshots rather than application stalls.
+ * Callstack definitions cannot be dropped, so rather than queueing them in
+ * memory we forward callstack.log as it grows, which also lets a consumer
+ * that connects late see every callstack.
+ */
+
+#include "dr_api.h"
+#include "drheapstat.h"
+#include "utils.h"
+#include "stream.h"
+#ifdef UNIX
+# include "asm_utils.h"
+# include "sysnum_linux.h"
+# include <errno.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+#endif
+
+/* Size of the buffer for forwarding callstack.log */
+#define STREAM_DEFS_BUF_SIZE (64*1024)
+/* Snapshot buffers grow in these increments to avoid reallocating often */
+#define STREAM_SNAP_BUF_ALIGN (16*1024)
+
+typedef struct _stream_buf_t {
+    byte *buf;
+    size_t size;
+    size_t len; /* 0 if empty */
+} stream_buf_t;
+
+static char stream_path[MAXIMUM_PATH];
+static char callstack_path[MAXIMUM_PATH];
+
+/* Protects the rotation of the snapshot buffers below */
+static void *stream_lock;
+/* Written by application threads under stream_lock */
+static stream_buf_t *buf_fill;
+/* The latest snapshot not yet sent, swapped under stream_lock */
+static stream_buf_t *buf_pending;
+/* Only accessed by the sideline thread */
+static stream_buf_t *buf_sending;
+static stream_buf_t bufs[3];
+static uint dropped;
+
+/* The rest is only accessed by the sideline thread, except for
+ * stream_connected, which is read racily to avoid serializing snapshots
+ * nobody will see.
+ */
+static volatile bool stream_connected;
+static bool stream_disabled;
+static file_t stream_fd = INVALID_FILE;
+static file_t f_defs = INVALID_FILE;
+static char *defs_buf;
+static size_t defs_len;
+
+#ifdef STATISTICS
+uint stream_snapshots_sent;
+uint stream_snapshots_dropped;
+#endif
+
+/***************************************************************************
+ * Transport: a Unix domain socket on Linux and a named pipe on Windows
+ */
+
+#ifdef UNIX
+/* We make raw system calls as DR has no socket API.  32-bit x86 kernels
+ * only provide these through socketcall().
+ */
+# if defined(X86) && !defined(X64)
+/* socketcall() call numbers from linux/net.h */
+#  define SOCKETCALL_SOCKET  1
+#  define SOCKETCALL_CONNECT 3
+#  define SOCKETCALL_SENDTO  11
+# endif
+
+static ptr_int_t
+sys_socket(int domain, int type, int protocol)
+{
+# if defined(X86) && !defined(X64)
+    ptr_uint_t args[3] = { domain, type, protocol };
+    return raw_syscall(SYS_socketcall, 2, SOCKETCALL_SOCKET, args);
+# else
+    return raw_syscall(__NR_socket, 3, domain, type, protocol);
+# endif
+}
+
+static ptr_int_t
+sys_connect(int fd, struct sockaddr *addr, uint addrlen)
+{
+# if defined(X86) && !defined(X64)
+    ptr_uint_t args[3] = { fd, (ptr_uint_t)addr, addrlen };
+    return raw_syscall(SYS_socketcall, 2, SOCKETCALL_CONNECT, args);
+# else
+    return raw_syscall(__NR_connect, 3, fd, addr, addrlen);
+# endif
+}
+
+static ptr_int_t
+sys_send(int fd, const void *buf, size_t len)
+{
+    /* MSG_NOSIGNAL: a departed consumer must not SIGPIPE the app */
+# if defined(X86) && !defined(X64)
+    ptr_uint_t args[6] = { fd, (ptr_uint_t)buf, len, MSG_NOSIGNAL, 0, 0 };
+    return raw_syscall(SYS_socketcall, 2, SOCKETCALL_SENDTO, args);
+# else
+    return raw_syscall(__NR_sendto, 6, fd, buf, len, MSG_NOSIGNAL, NULL, 0);
+# endif
+}
+#endif
+
+static bool
+transport_open(void)
+{
+#ifdef UNIX
+    struct sockaddr_un addr;
+    ptr_int_t fd = sys_socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG(1, "stream: socket failed %d\n", (int)fd);
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    dr_snprintf(addr.sun_path, BUFFER_SIZE_ELEMENTS(addr.sun_path), "%s", stream_path);
+    NULL_TERMINATE_BUFFER(addr.sun_path);
+    if (sys_connect((int)fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        raw_syscall(SYS_close, 1, fd);
+        return false;
+    }
+    /* Move the socket out of the app's fd space so the app cannot close or
+     * dup2 over it, and so DR tracks it like the rest of our files.
+     */
+    stream_fd = dr_dup_file_handle((file_t)fd);
+    raw_syscall(SYS_close, 1, fd);
+    if (stream_fd == INVALID_FILE) {
+        LOG(1, "stream: failed to dup socket into DR's fd range\n");
+        return false;
+    }
+#else
+    /* The consumer creates the pipe, so we open the client end */
+    stream_fd = dr_open_file(stream_path, DR_FILE_WRITE_APPEND);
+    if (stream_fd == INVALID_FILE)
+        return false;
+#endif
+    return true;
+}
+
+static void
+transport_close(void)
+{
+    if (stream_fd != INVALID_FILE) {
+        dr_close_file(stream_fd);
+        stream_fd = INVALID_FILE;
+    }
+}
+
+static bool
+transport_write(const void *buf, size_t len)
+{
+    const byte *cur = (const byte *) buf;
+    while (len > 0) {
+#ifdef UNIX
+        ptr_int_t res = sys_send((int)stream_fd, cur, len);
+        if (res == -EINTR)
+            continue;
+#else
+        ssize_t res = dr_write_file(stream_fd, cur, len);
+#endif
+        if (res <= 0) {
+            LOG(1, "stream: write failed %d: consumer gone\n", (int)res);
+            return false;
+        }
+        cur += res;
+        len -= res;
+    }
+    return true;
+}
+
+/***************************************************************************
+ * Sideline thread
+ */
+
+static bool
+stream_write_frame(uint type, const void *payload, size_t size)
+{
+    stream_frame_header_t hdr;
+    hdr.type = type;
+    hdr.size = (uint) size;
+    return (transport_write(&hdr, sizeof(hdr)) &&
+            transport_write(payload, size));
+}
+
+static void
+stream_disconnect(void)
+{
+    stream_connected = false;
+    transport_close();
+    if (f_defs != INVALID_FILE) {
+        dr_close_file(f_defs);
+        f_defs = INVALID_FILE;
+    }
+}
+
+static bool
+stream_connect(void)
+{
+    stream_hello_t hello;
+    if (!transport_open())
+        return false;
+    /* A new consumer needs every callstack from the start */
+    f_defs = dr_open_file(callstack_path, DR_FILE_READ);
+    if (f_defs == INVALID_FILE) {
+        LOG(1, "stream: unable to open %s\n", callstack_path);
+        transport_close();
+        return false;
+    }
+    defs_len = 0;
+    hello.version = STREAM_VERSION;
+    hello.pid = (uint) dr_get_process_id();
+    if (!stream_write_frame(STREAM_FRAME_HELLO, &hello, sizeof(hello))) {
+        stream_disconnect();
+        return false;
+    }
+    LOG(1, "stream: connected to %s\n", stream_path);
+    stream_connected = true;
+    return true;
+}
+
+/* Forwards the complete lines appended to callstack.log since the last call */
+static bool
+stream_send_callstacks(void)
+{
+    ssize_t got;
+    while ((got = dr_read_file(f_defs, defs_buf + defs_len,
+                               STREAM_DEFS_BUF_SIZE - defs_len)) > 0) {
+        size_t end;
+        defs_len += got;
+        for (end = defs_len; end > 0 && defs_buf[end - 1] != '\n'; end--)
+            ; /* nothing */
+        if (end == 0) {
+            if (defs_len < STREAM_DEFS_BUF_SIZE)
+                continue;
+            /* a line longer than the whole buffer: send it in pieces */
+            end = defs_len;
+        }
+        if (!stream_write_frame(STREAM_FRAME_CALLSTACKS, defs_buf, end))
+            return false;
+        memmove(defs_buf, defs_buf + end, defs_len - end);
+        defs_len -= end;
+    }
+    return true;
+}
+
+void
+stream_send_pending(void)
+{
+    stream_buf_t *tmp;
+    if (stream_disabled)
+        return;
+    if (!stream_connected && !stream_connect())
+        return;
+    /* Take the snapshot before reading callstack.log: every callstack it
+     * refers to was written there before it was taken.
+     */
+    dr_mutex_lock(stream_lock);
+    tmp = buf_sending;
+    buf_sending = buf_pending;
+    buf_pending = tmp;
+    buf_pending->len = 0;
+    if (buf_sending->len > 0) {
+        ((stream_snapshot_t *)(buf_sending->buf + sizeof(stream_frame_header_t)))
+            ->dropped = dropped;
+        dropped = 0;
+    }
+    dr_mutex_unlock(stream_lock);
+
+    if (!stream_send_callstacks()) {
+        stream_disconnect();
+        return;
+    }
+    if (buf_sending->len > 0) {
+        if (!transport_write(buf_sending->buf, buf_sending->len)) {
+            stream_disconnect();
+            return;
+        }
+        STATS_INC(stream_snapshots_sent);
+        buf_sending->len = 0;
+    }
+}
+
+/***************************************************************************
+ * Application threads
+ */
+
+bool
+stream_is_connected(void)
+{
+    return stream_connected;
+}
+
+stream_usage_t *
+stream_snapshot_begin(uint num_entries)
+{
+    size_t need = sizeof(stream_frame_header_t) + sizeof(stream_snapshot_t) +
+        num_entries * sizeof(stream_usage_t);
+    if (!stream_connected)
+        return NULL;
+    dr_mutex_lock(stream_lock);
+    if (buf_fill->size < need) {
+        if (buf_fill->buf != NULL)
+            global_free(buf_fill->buf, buf_fill->size, HEAPSTAT_SNAPSHOT);
+        buf_fill->size = ALIGN_FORWARD(need, STREAM_SNAP_BUF_ALIGN);
+        buf_fill->buf = (byte *) global_alloc(buf_fill->size, HEAPSTAT_SNAPSHOT);
+    }
+    buf_fill->len = need;
+    return (stream_usage_t *)
+        (buf_fill->buf + sizeof(stream_frame_header_t) + sizeof(stream_snapshot_t));
+}
+
+void
+stream_snapshot_end(stream_snapshot_t *info)
+{
+    stream_frame_header_t *hdr = (stream_frame_header_t *) buf_fill->buf;
+    stream_buf_t *tmp;
+    hdr->type = STREAM_FRAME_SNAPSHOT;
+    hdr->size = (uint)(buf_fill->len - sizeof(*hdr));
+    info->dropped = 0; /* filled in when sent */
+    memcpy(buf_fill->buf + sizeof(*hdr), info, sizeof(*info));
+    if (buf_pending->len > 0) {
+        /* the consumer has not kept up: drop the older snapshot */
+        dropped++;
+        STATS_INC(stream_snapshots_dropped);
+    }
+    tmp = buf_pending;
+    buf_pending = buf_fill;
+    buf_fill = tmp;
+    buf_fill->len = 0;
+    dr_mutex_unlock(stream_lock);
+}
+
+/***************************************************************************
+ * Init and exit
+ */
+
+void
+stream_init(const char *path, const char *callstack_log)
+{
+    dr_snprintf(stream_path, BUFFER_SIZE_ELEMENTS(stream_path), "%s", path);
+    NULL_TERMINATE_BUFFER(stream_path);
+    dr_snprintf(callstack_path, BUFFER_SIZE_ELEMENTS(callstack_path), "%s",
+                callstack_log);
+    NULL_TERMINATE_BUFFER(callstack_path);
+    stream_lock = dr_mutex_create();
+    memset(bufs, 0, sizeof(bufs));
+    buf_fill = &bufs[0];
+    buf_pending = &bufs[1];
+    buf_sending = &bufs[2];
+    defs_buf = (char *) global_alloc(STREAM_DEFS_BUF_SIZE, HEAPSTAT_MISC);
+}
+
+void
+stream_fork_init(void)
+{
+    /* The sideline thread does not survive the fork.  The socket is shared
+     * with the parent, which keeps sending on it, so we just let go of it.
+     */
+    stream_disabled = true;
+    stream_disconnect();
+}
+
+void
+stream_exit(void)
+{
+    uint i;
+    /* DR has already terminated the sideline thread (i#297) */
+    stream_disconnect();
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(bufs); i++) {
+        if (bufs[i].buf != NULL)
+            global_free(bufs[i].buf, bufs[i].size, HEAPSTAT_SNAPSHOT);
+    }
+    global_free(defs_buf, STREAM_DEFS_BUF_SIZE, HEAPSTAT_MISC);
+    dr_mutex_destroy(stream_lock);
+}
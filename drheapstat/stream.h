@@ -0,0 +1,119 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _STREAM_H_
+#define _STREAM_H_ 1
+
+/* stream.h: header file for stream.c, which publishes snapshots live to an
+ * external consumer for -stream
+ */
+
+/***************************************************************************
+ * Wire format, in native byte order.  Each frame is a stream_frame_header_t
+ * followed by size bytes of payload.  Keep in sync with tools/heapwatch.c.
+ */
+
+#define STREAM_VERSION 2
+
+enum {
+    /* stream_hello_t: always the first frame of a connection */
+    STREAM_FRAME_HELLO      = 1,
+    /* Complete lines of callstack.log text, which define the callstack
+     * ids.  Every callstack referenced by a snapshot frame has been
+     * defined by an earlier callstacks frame.
+     */
+    STREAM_FRAME_CALLSTACKS = 2,
+    /* stream_snapshot_t followed by num_entries stream_usage_t */
+    STREAM_FRAME_SNAPSHOT   = 3,
+};
+
+typedef struct _stream_frame_header_t {
+    uint type;
+    uint size;
+} stream_frame_header_t;
+
+typedef struct _stream_hello_t {
+    uint version;
+    uint pid;
+} stream_hello_t;
+
+typedef struct _stream_snapshot_t {
+    uint64 stamp;
+    uint64 tot_mallocs;
+    uint64 tot_bytes_asked_for;
+    uint64 tot_bytes_usable;
+    uint64 tot_bytes_occupied;
+    uint num_entries;
+    /* Snapshots taken since the previous one sent that the consumer
+     * was too slow to receive
+     */
+    uint dropped;
+} stream_snapshot_t;
+
+/* Non-zero usage of one callstack */
+typedef struct _stream_usage_t {
+    uint cstack_id;
+    uint instances;
+    uint bytes_asked_for;
+    uint extra_usable;
+    uint extra_occupied;
+} stream_usage_t;
+
+/***************************************************************************
+ * Interface
+ */
+
+/* path is the Unix domain socket or named pipe the consumer listens on.
+ * callstack_log is the path of callstack.log, which is forwarded as-is.
+ */
+void
+stream_init(const char *path, const char *callstack_log);
+
+void
+stream_exit(void);
+
+/* Called in the child: there is no sideline thread to send anything */
+void
+stream_fork_init(void);
+
+bool
+stream_is_connected(void);
+
+/* Returns an array of num_entries to fill in for a new snapshot, or NULL if
+ * no consumer is connected.  A non-NULL return must be followed by
+ * stream_snapshot_end().  The snapshot replaces any not yet sent, so the
+ * caller never waits on the consumer.
+ */
+stream_usage_t *
+stream_snapshot_begin(uint num_entries);
+
+/* All fields but dropped must be filled in */
+void
+stream_snapshot_end(stream_snapshot_t *info);
+
+/* Called periodically from the sideline thread: connects to the consumer if
+ * not yet connected and sends any new callstacks and the latest snapshot.
+ * May block on the consumer.
+ */
+void
+stream_send_pending(void);
+
+#endif /* _STREAM_H_ */
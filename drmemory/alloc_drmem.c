@@ -200,6 +200,10 @@ alloc_drmem_init(void)
     alloc_ops.shared_redzones = (options.pattern == 0);
     alloc_ops.delay_frees = options.delay_frees;
     alloc_ops.delay_frees_maxsz = options.delay_frees_maxsz;
+    alloc_ops.quarantine_pct = options.quarantine_pct;
+    alloc_ops.quarantine_batch = options.quarantine_batch;
+    alloc_ops.heap_metrics_freq = options.heap_metrics_freq;
+    alloc_ops.guard_page_min = options.guard_page_min;
 #ifdef WINDOWS
     alloc_ops.skip_msvc_importers = options.skip_msvc_importers;
 #endif
@@ -215,6 +219,10 @@ alloc_drmem_init(void)
                       alloc_callstack_free,
                       (uint (*)(void*)) packed_callstack_hash,
                       (bool (*)(void*, void*)) packed_callstack_cmp);
+    if (options.max_tool_memory > 0) {
+        hashtable_init(&hot_site_table, HOT_SITE_TABLE_HASH_BITS, HASH_INTPTR,
+                       false/*!str_dup*/);
+    }
 
 #ifdef UNIX
     mmap_tree = rb_tree_create(NULL);
@@ -254,6 +262,8 @@ alloc_drmem_exit(void)
     leak_exit();
     alloc_exit(); /* must be before deleting alloc_stack_table */
     hashtable_delete_with_stats(&alloc_stack_table, "alloc stack table");
+    if (options.max_tool_memory > 0)
+        hashtable_delete(&hot_site_table);
 #ifdef UNIX
     rb_tree_destroy(mmap_tree);
     dr_mutex_destroy(mmap_tree_lock);
@@ -397,6 +407,41 @@ client_malloc_data_free(void *data)
     shared_callstack_free(pcs);
 }
 
+/* Under tool memory pressure, callstacks from sites that are not hot are cut
+ * to this many frames, so cold sites stop adding large entries while hot sites
+ * keep their full callstacks.
+ */
+#define COLD_CALLSTACK_MAX_FRAMES 3
+
+/* Top frames of the callstacks in alloc_stack_table when tool memory pressure
+ * was first seen.  These are the hot sites.  We decide from the site alone
+ * whether to truncate so that each callstack is walked only once.
+ */
+#define HOT_SITE_TABLE_HASH_BITS 8
+static hashtable_t hot_site_table;
+static volatile bool hot_sites_recorded;
+
+static void
+record_hot_sites(void)
+{
+    uint i;
+    hashtable_lock(&alloc_stack_table);
+    if (!hot_sites_recorded) {
+        for (i = 0; i < HASHTABLE_SIZE(alloc_stack_table.table_bits); i++) {
+            hash_entry_t *he;
+            for (he = alloc_stack_table.table[i]; he != NULL; he = he->next) {
+                app_pc pc = packed_callstack_first_pc((packed_callstack_t *)he->key);
+                if (pc != NULL)
+                    hashtable_add(&hot_site_table, (void *)pc, (void *)pc);
+            }
+        }
+        LOG(1, "tool memory pressure: %u hot allocation sites\n",
+            hot_site_table.entries);
+        hot_sites_recorded = true;
+    }
+    hashtable_unlock(&alloc_stack_table);
+}
+
 /* Be sure to pass the same max_frames for all callstacks that we want
  * a comparison to.  Currently we use a separate one for malloc vs
  * free, but we expect them to never match anyway.
@@ -420,9 +465,28 @@ get_shared_callstack(packed_callstack_t *existing_data, dr_mcontext_t *mc,
         pcs = (packed_callstack_t *) existing_data;
     else {
         app_loc_t loc;
+        bool truncate = false;
         pc_to_loc(&loc, post_call);
+        if (tool_memory_pressure() != TOOL_MEMORY_OK &&
+            max_frames > COLD_CALLSTACK_MAX_FRAMES) {
+            if (!hot_sites_recorded)
+                record_hot_sites();
+            if (hashtable_lookup(&hot_site_table, (void *)post_call) == NULL) {
+                DO_ONCE({
+                    ELOGF(0, f_global, "Tool memory pressure: truncating "
+                          "callstacks for new allocation sites\n");
+                });
+                max_frames = COLD_CALLSTACK_MAX_FRAMES;
+                truncate = true;
+            }
+        }
         packed_callstack_record(&pcs, mc, &loc, max_frames);
-        /* our malloc and free callstacks use post-call as the top frame when wrapping */
+        /* keep these apart from full callstacks with the same top frames */
+        if (truncate)
+            packed_callstack_mark_truncated(pcs);
+        /* our malloc and free callstacks use post-call as the top frame when
+         * wrapping
+         */
         if (!options.replace_malloc)
             packed_callstack_first_frame_retaddr(pcs);
     }
@@ -29,6 +29,12 @@
  * - i#61: Implement AmIRunningUnderDrMemory() or RunningUnderValgrind().
  * - i#311: Annotate which part of the subprogram is running, for mapping
  *   allocation sites to test cases.
+ *
+ * DR only dispatches a fixed set of Valgrind requests, which does not include
+ * the mempool family, so we provide our own annotations with the same
+ * semantics as Valgrind's CREATE_MEMPOOL, MEMPOOL_ALLOC, MEMPOOL_FREE,
+ * MEMPOOL_TRIM, DESTROY_MEMPOOL, MALLOCLIKE_BLOCK, and FREELIKE_BLOCK: see
+ * annotations_public.h.
  */
 
 #include "dr_api.h"
@@ -39,8 +45,11 @@
 #include "shadow.h"
 #include "options.h"
 #ifdef TOOL_DR_MEMORY
+# include "alloc.h"
 # include "alloc_drmem.h"
 # include "memlayout.h"
+# include "redblack.h"
+# include "hashtable.h"
 #else
 extern void check_reachability(bool at_exit);
 #endif
@@ -85,6 +94,350 @@ void handle_dump_memory_layout(void)
 }
 #endif
 
+#if defined(TOOL_DR_MEMORY) && !defined(ARM)
+/***************************************************************************
+ * Custom memory pools
+ *
+ * An app allocator that carves chunks out of a larger malloc looks like one
+ * big chunk to us.  These annotations let it tell us about each chunk so we
+ * mark it undefined (or defined, for a zeroing pool) when handed out and
+ * unaddressable, with its redzones, when returned.  Annotation calls are
+ * rare next to memory references, so a single lock suffices.
+ */
+
+typedef struct _mempool_t {
+    app_pc handle;
+    size_t redzone;
+    bool is_zeroed;
+    /* chunk start and size; the client field holds the chunk's redzone size */
+    rb_tree_t *chunks;
+} mempool_t;
+
+#define MEMPOOL_TABLE_HASH_BITS 6
+/* pool handle => mempool_t */
+static hashtable_t mempool_table;
+/* MALLOCLIKE_BLOCK chunks, which belong to no pool */
+static mempool_t malloclike_pool;
+static void *mempool_lock;
+
+static void
+mempool_free(void *p)
+{
+    mempool_t *pool = (mempool_t *) p;
+    rb_tree_destroy(pool->chunks);
+    global_free(pool, sizeof(*pool), HEAPSTAT_MISC);
+}
+
+static void
+mempool_mark_alloc(app_pc start, size_t size, size_t redzone, bool is_zeroed)
+{
+    LOG(2, "%s: "PFX"-"PFX" rz="PIFX"\n", __FUNCTION__, start, start + size, redzone);
+    if (!options.shadowing)
+        return;
+    if (redzone > 0) {
+        shadow_set_range(start - redzone, start, SHADOW_UNADDRESSABLE);
+        shadow_set_range(start + size, start + size + redzone, SHADOW_UNADDRESSABLE);
+    }
+    shadow_set_range(start, start + size,
+                     (is_zeroed || !options.check_uninitialized) ?
+                     SHADOW_DEFINED : SHADOW_UNDEFINED);
+}
+
+static void
+mempool_mark_free(app_pc start, app_pc end)
+{
+    LOG(2, "%s: "PFX"-"PFX"\n", __FUNCTION__, start, end);
+    if (options.shadowing)
+        shadow_set_range(start, end, SHADOW_UNADDRESSABLE);
+}
+
+/* Returns the annotation's call site */
+static app_pc
+mempool_get_mcontext(dr_mcontext_t *mc OUT)
+{
+    void *drcontext = dr_get_current_drcontext();
+    mc->size = sizeof(*mc);
+    mc->flags = DR_MC_CONTROL | DR_MC_INTEGER;
+    dr_get_mcontext(drcontext, mc);
+    return (app_pc) dr_read_saved_reg(drcontext, SPILL_SLOT_2);
+}
+
+/* Caller must not hold mempool_lock */
+static void
+mempool_report_invalid(app_pc target, const char *routine, bool is_free)
+{
+    dr_mcontext_t mc;
+    app_pc pc = mempool_get_mcontext(&mc);
+    client_invalid_heap_arg(pc, target, &mc, routine, is_free);
+}
+
+/* Caller must hold mempool_lock.  Returns false if the new chunk overlapped
+ * existing ones, which are freed first.
+ */
+static bool
+mempool_chunk_add(mempool_t *pool, app_pc start, size_t size, size_t redzone,
+                  bool is_zeroed)
+{
+    rb_node_t *node;
+    dr_mcontext_t mc;
+    app_pc pc;
+    bool ok = true;
+    /* The app re-used memory without telling us it was freed: free the stale
+     * chunks so they are not reported as leaks, and have the caller report
+     * the bad call.
+     */
+    while ((node = rb_insert(pool->chunks, start, size, (void *)redzone)) != NULL) {
+        byte *base;
+        size_t old_size;
+        rb_node_fields(node, &base, &old_size, NULL);
+        LOG(1, "%s: "PFX"-"PFX" overlaps existing chunk "PFX"-"PFX"\n", __FUNCTION__,
+            start, start + size, base, base + old_size);
+        rb_delete(pool->chunks, node);
+        mempool_mark_free(base, base + old_size);
+        malloc_custom_remove(base);
+        ok = false;
+    }
+    mempool_mark_alloc(start, size, redzone, is_zeroed);
+    pc = mempool_get_mcontext(&mc);
+    malloc_custom_add(start, start + size, &mc, pc);
+    return ok;
+}
+
+/* Caller must hold mempool_lock.  Returns false if start is not a chunk. */
+static bool
+mempool_chunk_remove(mempool_t *pool, app_pc start)
+{
+    byte *base;
+    size_t size;
+    rb_node_t *node = rb_find(pool->chunks, start);
+    if (node == NULL)
+        return false;
+    rb_node_fields(node, &base, &size, NULL);
+    rb_delete(pool->chunks, node);
+    mempool_mark_free(base, base + size);
+    malloc_custom_remove(base);
+    return true;
+}
+
+static bool
+mempool_chunk_free_cb(rb_node_t *node, void *iter_data)
+{
+    byte *base;
+    size_t size;
+    rb_node_fields(node, &base, &size, NULL);
+    mempool_mark_free(base, base + size);
+    malloc_custom_remove(base);
+    return true;
+}
+
+typedef struct _mempool_trim_t {
+    app_pc start, end;
+    /* chunks that need to be trimmed or removed */
+    uint num;
+    uint capacity;
+    app_pc *bases;
+} mempool_trim_t;
+
+static bool
+mempool_trim_cb(rb_node_t *node, void *iter_data)
+{
+    mempool_trim_t *trim = (mempool_trim_t *) iter_data;
+    byte *base;
+    size_t size;
+    rb_node_fields(node, &base, &size, NULL);
+    if (base >= trim->start && base + size <= trim->end)
+        return true; /* entirely kept */
+    if (trim->bases != NULL) {
+        ASSERT(trim->num < trim->capacity, "chunk count changed under lock");
+        trim->bases[trim->num] = base;
+    }
+    trim->num++;
+    return true;
+}
+
+static void
+handle_create_mempool(app_pc handle, size_t redzone, char is_zeroed)
+{
+    mempool_t *pool;
+    LOG(2, "%s: pool="PFX" rz="PIFX" zeroed=%d\n", __FUNCTION__, handle, redzone,
+        is_zeroed);
+    dr_mutex_lock(mempool_lock);
+    pool = (mempool_t *) hashtable_lookup(&mempool_table, (void *)handle);
+    if (pool != NULL) {
+        LOG(1, "WARNING: pool "PFX" created twice: keeping old chunks\n", handle);
+    } else {
+        pool = (mempool_t *) global_alloc(sizeof(*pool), HEAPSTAT_MISC);
+        pool->handle = handle;
+        pool->redzone = redzone;
+        pool->is_zeroed = (is_zeroed != 0);
+        pool->chunks = rb_tree_create(NULL);
+        hashtable_add(&mempool_table, (void *)handle, (void *)pool);
+    }
+    dr_mutex_unlock(mempool_lock);
+}
+
+static void
+handle_destroy_mempool(app_pc handle)
+{
+    mempool_t *pool;
+    LOG(2, "%s: pool="PFX"\n", __FUNCTION__, handle);
+    dr_mutex_lock(mempool_lock);
+    pool = (mempool_t *) hashtable_lookup(&mempool_table, (void *)handle);
+    if (pool != NULL) {
+        rb_iterate(pool->chunks, mempool_chunk_free_cb, NULL);
+        hashtable_remove(&mempool_table, (void *)handle); /* frees pool */
+    }
+    dr_mutex_unlock(mempool_lock);
+    if (pool == NULL)
+        mempool_report_invalid(handle, "drmemory_destroy_mempool", true/*free*/);
+}
+
+static void
+handle_mempool_alloc(app_pc handle, app_pc start, size_t size)
+{
+    mempool_t *pool;
+    bool ok = false;
+    dr_mutex_lock(mempool_lock);
+    pool = (mempool_t *) hashtable_lookup(&mempool_table, (void *)handle);
+    if (pool != NULL)
+        ok = mempool_chunk_add(pool, start, size, pool->redzone, pool->is_zeroed);
+    dr_mutex_unlock(mempool_lock);
+    if (pool == NULL)
+        mempool_report_invalid(handle, "drmemory_mempool_alloc", false/*!free*/);
+    else if (!ok)
+        mempool_report_invalid(start, "drmemory_mempool_alloc", false/*!free*/);
+}
+
+static void
+handle_mempool_free(app_pc handle, app_pc start)
+{
+    mempool_t *pool;
+    bool found = false;
+    dr_mutex_lock(mempool_lock);
+    pool = (mempool_t *) hashtable_lookup(&mempool_table, (void *)handle);
+    if (pool != NULL)
+        found = mempool_chunk_remove(pool, start);
+    dr_mutex_unlock(mempool_lock);
+    if (!found)
+        mempool_report_invalid(start, "drmemory_mempool_free", true/*free*/);
+}
+
+/* Like Valgrind, chunks entirely outside [start, start+size) are freed and
+ * chunks straddling a boundary are cut down to the part inside.
+ */
+static void
+handle_mempool_trim(app_pc handle, app_pc start, size_t size)
+{
+    mempool_t *pool;
+    mempool_trim_t trim = {start, start + size, 0, 0, NULL};
+    uint i;
+    dr_mutex_lock(mempool_lock);
+    pool = (mempool_t *) hashtable_lookup(&mempool_table, (void *)handle);
+    if (pool != NULL) {
+        /* We can't modify the tree while iterating so we collect first */
+        rb_iterate(pool->chunks, mempool_trim_cb, &trim);
+        if (trim.num > 0) {
+            trim.capacity = trim.num;
+            trim.num = 0;
+            trim.bases = (app_pc *)
+                global_alloc(trim.capacity * sizeof(*trim.bases), HEAPSTAT_MISC);
+            rb_iterate(pool->chunks, mempool_trim_cb, &trim);
+        }
+        for (i = 0; i < trim.num; i++) {
+            rb_node_t *node = rb_find(pool->chunks, trim.bases[i]);
+            byte *base, *keep_start, *keep_end;
+            size_t chunk_size;
+            void *redzone;
+            rb_node_fields(node, &base, &chunk_size, &redzone);
+            rb_delete(pool->chunks, node);
+            keep_start = MAX(base, trim.start);
+            keep_end = MIN(base + chunk_size, trim.end);
+            if (keep_start >= keep_end) {
+                mempool_mark_free(base, base + chunk_size);
+                malloc_custom_remove(base);
+            } else {
+                mempool_mark_free(base, keep_start);
+                mempool_mark_free(keep_end, base + chunk_size);
+                rb_insert(pool->chunks, keep_start, keep_end - keep_start, redzone);
+                malloc_custom_resize(base, keep_start, keep_end);
+            }
+        }
+        if (trim.bases != NULL)
+            global_free(trim.bases, trim.capacity * sizeof(*trim.bases), HEAPSTAT_MISC);
+    }
+    dr_mutex_unlock(mempool_lock);
+    if (pool == NULL)
+        mempool_report_invalid(handle, "drmemory_mempool_trim", false/*!free*/);
+}
+
+static void
+handle_malloclike_block(app_pc start, size_t size, size_t redzone, char is_zeroed)
+{
+    bool ok;
+    dr_mutex_lock(mempool_lock);
+    ok = mempool_chunk_add(&malloclike_pool, start, size, redzone, is_zeroed != 0);
+    dr_mutex_unlock(mempool_lock);
+    if (!ok)
+        mempool_report_invalid(start, "drmemory_malloclike_block", false/*!free*/);
+}
+
+static void
+handle_freelike_block(app_pc start, size_t redzone)
+{
+    bool found;
+    dr_mutex_lock(mempool_lock);
+    found = mempool_chunk_remove(&malloclike_pool, start);
+    dr_mutex_unlock(mempool_lock);
+    if (!found)
+        mempool_report_invalid(start, "drmemory_freelike_block", true/*free*/);
+}
+
+typedef struct _mempool_annotation_t {
+    const char *name;
+    void *callee;
+    uint num_args;
+} mempool_annotation_t;
+
+static const mempool_annotation_t mempool_annotations[] = {
+    {"drmemory_create_mempool",  (void *) handle_create_mempool,   3},
+    {"drmemory_destroy_mempool", (void *) handle_destroy_mempool,  1},
+    {"drmemory_mempool_alloc",   (void *) handle_mempool_alloc,    3},
+    {"drmemory_mempool_free",    (void *) handle_mempool_free,     2},
+    {"drmemory_mempool_trim",    (void *) handle_mempool_trim,     3},
+    {"drmemory_malloclike_block", (void *) handle_malloclike_block, 4},
+    {"drmemory_freelike_block",  (void *) handle_freelike_block,   2},
+};
+
+static void
+mempool_init(void)
+{
+    uint i;
+    mempool_lock = dr_mutex_create();
+    hashtable_init_ex(&mempool_table, MEMPOOL_TABLE_HASH_BITS, HASH_INTPTR,
+                      false/*!str_dup*/, false/*!synch: mempool_lock*/,
+                      mempool_free, NULL, NULL);
+    malloclike_pool.chunks = rb_tree_create(NULL);
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(mempool_annotations); i++) {
+        const mempool_annotation_t *a = &mempool_annotations[i];
+        if (!dr_annotation_register_call(a->name, a->callee, false, a->num_args,
+                                         DR_ANNOTATION_CALL_TYPE_FASTCALL)) {
+            NOTIFY_ERROR("ERROR: Failed to register annotations"NL);
+            dr_abort();
+        }
+        /* for error reports */
+        dr_annotation_pass_pc(a->name);
+    }
+}
+
+static void
+mempool_exit(void)
+{
+    hashtable_delete(&mempool_table);
+    rb_tree_destroy(malloclike_pool.chunks);
+    dr_mutex_destroy(mempool_lock);
+}
+#endif /* TOOL_DR_MEMORY && !ARM */
+
 void
 annotate_init(void)
 {
@@ -108,9 +461,16 @@ annotate_init(void)
     }
     dr_annotation_pass_pc(dumpmem_name);
 #endif
+
+#if defined(TOOL_DR_MEMORY) && !defined(ARM)
+    mempool_init();
+#endif
 }
 
 void
 annotate_exit(void)
 {
+#if defined(TOOL_DR_MEMORY) && !defined(ARM)
+    mempool_exit();
+#endif
 }
@@ -22,3 +22,14 @@
 #include "dr_annotations.h"
 
 DR_DEFINE_ANNOTATION(void, drmemory_dump_memory_layout, (void),)
+DR_DEFINE_ANNOTATION(void, drmemory_create_mempool,
+                     (void *pool, size_t rz_bytes, char is_zeroed),)
+DR_DEFINE_ANNOTATION(void, drmemory_destroy_mempool, (void *pool),)
+DR_DEFINE_ANNOTATION(void, drmemory_mempool_alloc,
+                     (void *pool, void *addr, size_t size),)
+DR_DEFINE_ANNOTATION(void, drmemory_mempool_free, (void *pool, void *addr),)
+DR_DEFINE_ANNOTATION(void, drmemory_mempool_trim,
+                     (void *pool, void *addr, size_t size),)
+DR_DEFINE_ANNOTATION(void, drmemory_malloclike_block,
+                     (void *addr, size_t size, size_t rz_bytes, char is_zeroed),)
+DR_DEFINE_ANNOTATION(void, drmemory_freelike_block, (void *addr, size_t rz_bytes),)
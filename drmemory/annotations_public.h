@@ -32,11 +32,49 @@
 #define DRMEMORY_ANNOTATE_DUMP_MEMORY_LAYOUT() \
     DR_ANNOTATION(drmemory_dump_memory_layout)
 
+/* Custom allocator annotations, with the same semantics as Valgrind's
+ * VALGRIND_CREATE_MEMPOOL and related requests.  A chunk handed out by a pool
+ * is uninitialized (unless the pool is_zeroed) and the rz_bytes on each side
+ * of it are unaddressable; a chunk returned to the pool is unaddressable.
+ * Live chunks are tracked like heap allocations: they carry an allocation
+ * callstack and are reported as leaks if unreachable at exit, while the pool
+ * superblock containing them is exempt from leak reports.
+ */
+#define DRMEMORY_ANNOTATE_CREATE_MEMPOOL(pool, rz_bytes, is_zeroed) \
+    DR_ANNOTATION(drmemory_create_mempool, (void *)(pool), (size_t)(rz_bytes), \
+                  (char)(is_zeroed))
+#define DRMEMORY_ANNOTATE_DESTROY_MEMPOOL(pool) \
+    DR_ANNOTATION(drmemory_destroy_mempool, (void *)(pool))
+#define DRMEMORY_ANNOTATE_MEMPOOL_ALLOC(pool, addr, size) \
+    DR_ANNOTATION(drmemory_mempool_alloc, (void *)(pool), (void *)(addr), \
+                  (size_t)(size))
+#define DRMEMORY_ANNOTATE_MEMPOOL_FREE(pool, addr) \
+    DR_ANNOTATION(drmemory_mempool_free, (void *)(pool), (void *)(addr))
+#define DRMEMORY_ANNOTATE_MEMPOOL_TRIM(pool, addr, size) \
+    DR_ANNOTATION(drmemory_mempool_trim, (void *)(pool), (void *)(addr), \
+                  (size_t)(size))
+#define DRMEMORY_ANNOTATE_MALLOCLIKE_BLOCK(addr, size, rz_bytes, is_zeroed) \
+    DR_ANNOTATION(drmemory_malloclike_block, (void *)(addr), (size_t)(size), \
+                  (size_t)(rz_bytes), (char)(is_zeroed))
+#define DRMEMORY_ANNOTATE_FREELIKE_BLOCK(addr, rz_bytes) \
+    DR_ANNOTATION(drmemory_freelike_block, (void *)(addr), (size_t)(rz_bytes))
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 DR_DECLARE_ANNOTATION(void, drmemory_dump_memory_layout, (void));
+DR_DECLARE_ANNOTATION(void, drmemory_create_mempool,
+                      (void *pool, size_t rz_bytes, char is_zeroed));
+DR_DECLARE_ANNOTATION(void, drmemory_destroy_mempool, (void *pool));
+DR_DECLARE_ANNOTATION(void, drmemory_mempool_alloc,
+                      (void *pool, void *addr, size_t size));
+DR_DECLARE_ANNOTATION(void, drmemory_mempool_free, (void *pool, void *addr));
+DR_DECLARE_ANNOTATION(void, drmemory_mempool_trim,
+                      (void *pool, void *addr, size_t size));
+DR_DECLARE_ANNOTATION(void, drmemory_malloclike_block,
+                      (void *addr, size_t size, size_t rz_bytes, char is_zeroed));
+DR_DECLARE_ANNOTATION(void, drmemory_freelike_block, (void *addr, size_t rz_bytes));
 
 #ifdef __cplusplus
 }
@@ -91,6 +91,8 @@ file_t f_results = INVALID_FILE;
 file_t f_missing_symbols;
 file_t f_suppress;
 file_t f_potential;
+file_t f_results_json = INVALID_FILE;
+file_t f_modules = INVALID_FILE;
 #endif
 static uint num_threads;
 
@@ -220,6 +222,9 @@ dump_statistics(void)
     dr_fprintf(f_global, "adjust_esp:%10u slow; %10u fast\n", adjust_esp_executions,
                adjust_esp_fastpath);
     dr_fprintf(f_global, "slow_path invocations: %10u\n", slowpath_executions);
+    dr_fprintf(f_global, "slow_path decode cache: %10u hits, %10u misses, "
+               "%10u flushes\n", decode_cache_hits, decode_cache_misses,
+               decode_cache_flushes);
 #ifdef X86
     dr_fprintf(f_global, "med_path invocations: %10u, fast movs: %10u, fast cmps: %10u\n",
                medpath_executions, movs4_med_fast, cmps1_med_fast);
@@ -268,6 +273,7 @@ dump_statistics(void)
                num_slowpath_faults);
     dr_fprintf(f_global, "app mallocs: %8u, frees: %8u, large mallocs: %6u\n",
                num_mallocs, num_frees, num_large_mallocs);
+    dr_fprintf(f_global, "malloc table stripe contention: %6u\n", malloc_stripe_busy);
     dr_fprintf(f_global, "unique malloc stacks: %8u\n", alloc_stack_count);
     callstack_dump_statistics(f_global);
 #ifdef USE_DRSYMS
@@ -283,6 +289,15 @@ dump_statistics(void)
     dr_fprintf(f_global, "delayed free bytes: %8u\n", delayed_free_bytes);
     dr_fprintf(f_global, "app heap regions: %8u\n", heap_regions);
     dr_fprintf(f_global, "addr checks elided: %8u\n", addressable_checks_elided);
+    dr_fprintf(f_global, "redundant memref checks elided: %8u\n",
+               redundant_checks_elided);
+    dr_fprintf(f_global, "hoisted loop refs: %8u, range calls: %8u, proven: %8u, "
+               "declined: %8u\n", hoisted_loop_refs, hoist_range_calls,
+               hoist_range_proven, hoist_range_declined);
+    dr_fprintf(f_global, "adaptive bbs unaddr-only: %7u, full: %8u, upgrades: %6u\n",
+               adaptive_bbs_unaddr_only, adaptive_bbs_full, adaptive_upgrades);
+    dr_fprintf(f_global, "bulk mem/str calls: %8u, declined: %8u\n",
+               replace_bulk_fast, replace_bulk_declined);
     dr_fprintf(f_global, "aflags saved at top: %8u\n", aflags_saved_at_top);
     dr_fprintf(f_global, "xl8 sharing: %8u shared, %6u not:conflict, %6u not:disp-sz\n",
                xl8_shared, xl8_not_shared_reg_conflict, xl8_not_shared_disp_too_big);
@@ -509,6 +524,10 @@ event_exit(void)
     close_file(f_missing_symbols);
     close_file(f_suppress);
     close_file(f_potential);
+    if (f_results_json != INVALID_FILE)
+        close_file(f_results_json);
+    if (f_modules != INVALID_FILE)
+        close_file(f_modules);
 #endif
     dr_fprintf(f_global, "LOG END\n");
     close_file(f_global);
@@ -1537,6 +1556,10 @@ create_global_logfile(void)
         f_suppress = open_logfile("suppress.txt", false, -1);
         f_potential = open_logfile(RESULTS_POTENTIAL_FNAME, false, -1);
         print_version(f_potential, true);
+        if (options.results_json)
+            f_results_json = open_logfile(RESULTS_JSON_FNAME, false, -1);
+        if (options.defer_symbols)
+            f_modules = open_logfile(MODULES_FNAME, false, -1);
     }
 #else
     /* PR 453867: we need to tell postprocess.pl when to fork a new copy.
@@ -1616,6 +1639,8 @@ nudge_leak_scan(void *drcontext)
     dump_statistics();
 #endif
     STATS_INC(num_nudges);
+    if (options.replace_malloc)
+        alloc_replace_dump_metrics(f_global);
     if (options.perturb_only)
         return;
 #ifdef WINDOWS
@@ -1719,7 +1744,7 @@ event_module_load(void *drcontext, const module_data_t *info, bool loaded)
 #endif
 #ifdef USE_DRSYMS
 # ifdef WINDOWS
-    if (options.preload_symbols) {
+    if (options.preload_symbols && !options.defer_symbols) {
         /* i#723: We can't load symbols for modules with dbghelp during shutdown
          * on Vista, so we pre-load everything.  This wastes memory and is
          * fragile since drsyms doesn't promise to cache pdbs forever, but for
@@ -1742,6 +1767,8 @@ event_module_load(void *drcontext, const module_data_t *info, bool loaded)
     if (options.perturb_only)
         perturb_module_load(drcontext, info, loaded);
     slowpath_module_load(drcontext, info, loaded);
+    if (options.adaptive_uninit)
+        fastpath_adaptive_module_load(info);
     leak_module_load(drcontext, info, loaded);
 #ifdef USE_DRSYMS
     /* Free resources.  Many modules will never need symbol queries again b/c
@@ -1762,6 +1789,8 @@ event_module_unload(void *drcontext, const module_data_t *info)
         dr_module_preferred_name(info), info->start, info->end);
     leak_module_unload(drcontext, info);
     slowpath_module_unload(drcontext, info);
+    if (options.adaptive_uninit)
+        fastpath_adaptive_module_unload(info);
     if (!options.perturb_only)
         callstack_module_unload(drcontext, info);
     if (INSTRUMENT_MEMREFS())
@@ -1865,6 +1894,7 @@ dr_init(client_id_t id)
     opstr = dr_get_options(client_id);
     ASSERT(opstr != NULL, "error obtaining option string");
     drmem_options_init(opstr);
+    tool_memory_budget_init(options.max_tool_memory);
 
     drmgr_init(); /* must be before utils_init and any other tls/cls uses */
     tls_idx_drmem = drmgr_register_tls_field();
@@ -74,6 +74,8 @@ extern char logsubdir[MAXIMUM_PATH];
 
 #define RESULTS_FNAME "results.txt"
 #define RESULTS_POTENTIAL_FNAME "potential_errors.txt"
+#define RESULTS_JSON_FNAME "results.jsonl"
+#define MODULES_FNAME "modules.txt"
 #define POTENTIAL_PREFIX        "potential"
 #define POTENTIAL_PREFIX_CAP    "Potential"
 #define POTENTIAL_PREFIX_ALLCAP "POTENTIAL"
@@ -83,6 +85,8 @@ extern file_t f_results;
 extern file_t f_suppress;
 extern file_t f_missing_symbols;
 extern file_t f_potential;
+extern file_t f_results_json;
+extern file_t f_modules;
 #else
 extern file_t f_fork;
 #endif
@@ -32,8 +32,10 @@
 #include "shadow.h"
 #include "stack.h"
 #ifdef TOOL_DR_MEMORY
+# include "alloc.h"
 # include "alloc_drmem.h"
 # include "report.h"
+# include "heap.h"
 #endif
 #include "pattern.h"
 
@@ -136,6 +138,650 @@ slow_path_xl8_sharing(app_loc_t *loc, size_t inst_sz, opnd_t memop, dr_mcontext_
      */
 }
 
+#ifdef TOOL_DR_MEMORY
+/***************************************************************************
+ * Redundant check elimination
+ *
+ * In addressability-only shadow mode the fastpath for a memory reference does
+ * nothing but check addressability.  Within a bb, addressability only changes
+ * via calls, syscalls, and interrupts (which all end the bb) or via our own
+ * meta code, so once [base+index*scale+disp] has been checked, a later
+ * reference through the same unmodified registers that falls inside a checked
+ * range needs no check of its own.  Ranges checked through the same registers
+ * are merged when they overlap or abut, so a run of adjacent narrow field
+ * accesses also covers a later wider access to the same span.
+ *
+ * We do not elide in full mode, where the fastpath also propagates
+ * definedness for every access.
+ */
+
+/* Larger refs (xsave, etc.) are rare and are not worth tracking */
+#define MAX_ELIDE_REF_SIZE 64
+
+static inline bool
+elide_redundant_checks_enabled(bb_info_t *bi)
+{
+    return (options.elide_redundant_checks && options.shadowing &&
+            !options.check_uninitialized &&
+            /* heap routines use nop-if-unaddr checks whose outcome does not
+             * tell us anything about addressability
+             */
+            !bi->check_ignore_unaddr && !bi->is_repstr_to_loop);
+}
+
+/* Returns whether opnd is a candidate for elision and if so fills in the
+ * base register and the byte range it references.
+ */
+static bool
+elide_candidate_ref(opnd_t opnd, reg_id_t *base OUT, checked_range_t *range OUT)
+{
+    uint sz;
+    if (!opnd_is_near_base_disp(opnd))
+        return false;
+    *base = opnd_get_base(opnd);
+    if (*base == DR_REG_NULL || !reg_is_gpr(*base) || !reg_is_pointer_sized(*base))
+        return false;
+    range->index = opnd_get_index(opnd);
+    if (range->index != DR_REG_NULL &&
+        (!reg_is_gpr(range->index) || !reg_is_pointer_sized(range->index)))
+        return false;
+    sz = opnd_size_in_bytes(opnd_get_size(opnd));
+    if (sz == 0 || sz > MAX_ELIDE_REF_SIZE)
+        return false;
+    range->scale = (byte) opnd_get_scale(opnd);
+    range->lo = opnd_get_disp(opnd);
+    range->hi = range->lo + sz;
+    return true;
+}
+
+static bool
+elide_instr_is_candidate(instr_t *inst)
+{
+    uint opc = instr_get_opcode(inst);
+    return (IF_X86(opc != OP_lea && !opc_is_stringop(opc) &&)
+            !instr_is_predicated(inst));
+}
+
+static bool
+checked_range_covers(checked_reg_info_t *info, checked_range_t *range)
+{
+    uint i;
+    for (i = 0; i < info->num_ranges; i++) {
+        checked_range_t *r = &info->range[i];
+        if (r->index == range->index && r->scale == range->scale &&
+            range->lo >= r->lo && range->hi <= r->hi)
+            return true;
+    }
+    return false;
+}
+
+static void
+checked_range_add(checked_reg_info_t *info, checked_range_t *range)
+{
+    uint i;
+    for (i = 0; i < info->num_ranges; i++) {
+        checked_range_t *r = &info->range[i];
+        if (r->index == range->index && r->scale == range->scale &&
+            range->lo <= r->hi && range->hi >= r->lo) {
+            /* overlapping or adjacent: merge */
+            r->lo = MIN(r->lo, range->lo);
+            r->hi = MAX(r->hi, range->hi);
+            return;
+        }
+    }
+    if (info->num_ranges == MAX_CHECKED_RANGES_PER_REG) {
+        /* evict the oldest */
+        memmove(&info->range[0], &info->range[1],
+                (MAX_CHECKED_RANGES_PER_REG - 1) * sizeof(info->range[0]));
+        info->num_ranges--;
+    }
+    info->range[info->num_ranges++] = *range;
+}
+
+/* Returns whether every checked memory reference of inst is covered by an
+ * earlier check in the same bb.
+ */
+bool
+fastpath_check_is_redundant(bb_info_t *bi, instr_t *inst)
+{
+    int i;
+    bool found = false;
+    reg_id_t base;
+    checked_range_t range;
+    if (!elide_redundant_checks_enabled(bi) || !elide_instr_is_candidate(inst))
+        return false;
+    for (i = 0; i < instr_num_srcs(inst) + instr_num_dsts(inst); i++) {
+        opnd_t opnd = (i < instr_num_srcs(inst)) ? instr_get_src(inst, i) :
+            instr_get_dst(inst, i - instr_num_srcs(inst));
+        if (!opnd_uses_nonignorable_memory(opnd))
+            continue;
+        if (!elide_candidate_ref(opnd, &base, &range) ||
+            !checked_range_covers(&bi->checked[base - REG_START], &range))
+            return false;
+        found = true;
+    }
+    return found;
+}
+
+/* Records the memory references of inst, which was just instrumented with
+ * addressability checks.
+ */
+void
+fastpath_note_checked(bb_info_t *bi, instr_t *inst)
+{
+    int i;
+    reg_id_t base;
+    checked_range_t range;
+    if (!elide_redundant_checks_enabled(bi) || !elide_instr_is_candidate(inst))
+        return;
+    for (i = 0; i < instr_num_srcs(inst) + instr_num_dsts(inst); i++) {
+        opnd_t opnd = (i < instr_num_srcs(inst)) ? instr_get_src(inst, i) :
+            instr_get_dst(inst, i - instr_num_srcs(inst));
+        if (opnd_uses_nonignorable_memory(opnd) &&
+            elide_candidate_ref(opnd, &base, &range))
+            checked_range_add(&bi->checked[base - REG_START], &range);
+    }
+}
+
+/* Returns whether inst may raise the stack pointer */
+static bool
+instr_may_raise_xsp(instr_t *inst)
+{
+    if (!instr_writes_to_reg(inst, DR_REG_XSP, DR_QUERY_INCLUDE_ALL))
+        return false;
+#ifdef X86
+    switch (instr_get_opcode(inst)) {
+    case OP_push:
+    case OP_push_imm:
+    case OP_pushf:
+    case OP_pusha:
+        return false;
+    }
+#endif
+    return true;
+}
+
+/* Invalidates checked ranges whose registers are written by inst.  Must be
+ * called on every instr in the bb, after any instrumentation of it.
+ */
+void
+fastpath_update_checked_regs(bb_info_t *bi, instr_t *inst)
+{
+    int i;
+    uint j;
+    if (!elide_redundant_checks_enabled(bi) || instr_is_label(inst))
+        return;
+    if (!instr_is_app(inst) || instr_is_cti(inst) || instr_is_syscall(inst) ||
+        instr_is_interrupt(inst) ||
+        /* Raising esp makes the stack below it unaddressable.  A range
+         * checked via ebp, or via any other reg pointing into the stack,
+         * may now be below esp, and we cannot tell which regs those are.
+         */
+        instr_may_raise_xsp(inst)) {
+        /* meta code (e.g., annotations) can change addressability */
+        memset(bi->checked, 0, sizeof(bi->checked));
+        return;
+    }
+    for (i = 0; i < NUM_LIVENESS_REGS; i++) {
+        checked_reg_info_t *info = &bi->checked[i];
+        if (info->num_ranges == 0)
+            continue;
+        if (instr_writes_to_reg(inst, REG_START + i, DR_QUERY_INCLUDE_ALL)) {
+            info->num_ranges = 0;
+            continue;
+        }
+        for (j = 0; j < info->num_ranges; ) {
+            if (info->range[j].index != DR_REG_NULL &&
+                instr_writes_to_reg(inst, info->range[j].index, DR_QUERY_INCLUDE_ALL))
+                info->range[j] = info->range[--info->num_ranges];
+            else
+                j++;
+        }
+    }
+}
+
+/***************************************************************************
+ * Loop check hoisting
+ *
+ * The arch-specific code recognizes strided memory references in single-bb
+ * loops (fastpath_analyze_loop()) and has the fastpath skip the shadow
+ * lookup when the address is inside a per-thread range already proven
+ * addressable.  On a miss it calls fastpath_hoist_loop_range(), which
+ * proves a range covering the rest of the loop.  Only heap memory is
+ * covered, as the stack changes addressability via inline code that cannot
+ * invalidate the cached ranges: see shadow_hoist_ranges_invalidate().  A
+ * site that cannot use a range declines its slot for a while, and tries
+ * again after SHADOW_HOIST_DECLINE_RETRY misses, as its next run of the loop
+ * may be longer or may be over heap memory.
+ */
+
+/* Largest range we prove in one call, so that a huge trip count does not
+ * have us walking shadow memory the loop may never reach.
+ */
+#define HOIST_MAX_RANGE (64*1024)
+/* A site whose loop has fewer iterations left than this gives up */
+#define HOIST_MIN_ITERS 8
+
+/* Flags for fastpath_hoist_loop_range() */
+#define HOIST_FLAGS(slot, memsz, rel, is_signed, step_first) \
+    ((slot) | ((memsz) << 4) | ((rel) << 12) | \
+     ((is_signed) ? 0x10000 : 0) | ((step_first) ? 0x20000 : 0))
+#define HOIST_FLAGS_SLOT(flags)       ((flags) & 0xf)
+#define HOIST_FLAGS_MEMSZ(flags)      (((flags) >> 4) & 0xff)
+#define HOIST_FLAGS_REL(flags)        (((flags) >> 12) & 0xf)
+#define HOIST_FLAGS_SIGNED(flags)     TEST(0x10000, flags)
+#define HOIST_FLAGS_STEP_FIRST(flags) TEST(0x20000, flags)
+
+static bool
+hoist_relation_holds(ptr_uint_t cur, ptr_uint_t bound, uint rel, bool is_signed)
+{
+    switch (rel) {
+    case HOIST_REL_LT:
+        return is_signed ? ((ptr_int_t)cur < (ptr_int_t)bound) : (cur < bound);
+    case HOIST_REL_LE:
+        return is_signed ? ((ptr_int_t)cur <= (ptr_int_t)bound) : (cur <= bound);
+    case HOIST_REL_GT:
+        return is_signed ? ((ptr_int_t)cur > (ptr_int_t)bound) : (cur > bound);
+    case HOIST_REL_GE:
+        return is_signed ? ((ptr_int_t)cur >= (ptr_int_t)bound) : (cur >= bound);
+    default:
+        return cur != bound;
+    }
+}
+
+/* Returns how many more iterations a loop that is about to compare cur to
+ * bound will execute, or -1 if we cannot tell.
+ */
+static ptr_int_t
+hoist_remaining_iters(ptr_uint_t cur, ptr_uint_t bound, int step, uint rel,
+                      bool is_signed)
+{
+    ptr_uint_t ustep = (step > 0) ? step : -step;
+    ptr_uint_t dist;
+    bool up = (step > 0);
+    if (rel == HOIST_REL_NE) {
+        dist = up ? bound - cur : cur - bound;
+        /* if we would step over the bound the loop only ends on overflow */
+        if (dist % ustep != 0)
+            return -1;
+        return (ptr_int_t)(dist / ustep);
+    }
+    if (!hoist_relation_holds(cur, bound, rel, is_signed))
+        return 0;
+    /* stepping away from the bound: the loop only ends on overflow */
+    if (up != (rel == HOIST_REL_LT || rel == HOIST_REL_LE))
+        return -1;
+    dist = up ? bound - cur : cur - bound;
+    if (rel == HOIST_REL_LT || rel == HOIST_REL_GT)
+        return (ptr_int_t)((dist + ustep - 1) / ustep);
+    return (ptr_int_t)(dist / ustep + 1);
+}
+
+/* Narrows [*lo, *hi) to the addressable bytes at its start (if forward) or
+ * end (if !forward), where the current access lies.
+ */
+static void
+hoist_addressable_part(app_pc *lo, app_pc *hi, bool forward)
+{
+    app_pc pc = *lo, bad_start, bad_end;
+    uint bad_state;
+    while (pc < *hi) {
+        /* with no uninit checking any other value is addressable */
+        if (shadow_check_range(pc, *hi - pc, SHADOW_DEFINED, &bad_start, &bad_end,
+                               &bad_state))
+            break;
+        if (bad_state == SHADOW_UNADDRESSABLE) {
+            if (forward) {
+                *hi = bad_start;
+                break;
+            }
+            *lo = MIN(bad_end, *hi);
+        }
+        pc = bad_end;
+    }
+}
+
+/* Clean call invoked when a hoisted loop reference misses its cached range */
+static void
+fastpath_hoist_loop_range(app_pc addr, ptr_uint_t ivar, ptr_uint_t bound, int step,
+                          int stride, uint flags, app_pc site)
+{
+    uint slot = HOIST_FLAGS_SLOT(flags);
+    uint memsz = HOIST_FLAGS_MEMSZ(flags);
+    uint epoch;
+    ptr_uint_t cur = ivar + (HOIST_FLAGS_STEP_FIRST(flags) ? 0 : step);
+    ptr_int_t iters;
+    ptr_uint_t ustride = (stride > 0) ? stride : -stride;
+    app_pc lo, hi;
+    STATS_INC(hoist_range_calls);
+    iters = hoist_remaining_iters(cur, bound, step, HOIST_FLAGS_REL(flags),
+                                  HOIST_FLAGS_SIGNED(flags));
+    if (iters >= 0 && (ptr_uint_t)iters > HOIST_MAX_RANGE / ustride)
+        iters = HOIST_MAX_RANGE / ustride;
+    if (iters < HOIST_MIN_ITERS) {
+        LOG(3, "hoisted loop ref "PFX": %d iters left, giving up\n",
+            site, (int)iters);
+        STATS_INC(hoist_range_declined);
+        shadow_hoist_range_decline(slot, (uint)(ptr_uint_t)site);
+        return;
+    }
+    if (stride > 0) {
+        lo = addr;
+        hi = addr + iters * ustride + memsz;
+    } else {
+        lo = addr - iters * ustride;
+        hi = addr + memsz;
+    }
+    if (lo > addr || hi < addr || !is_entirely_in_heap_region(lo, hi)) {
+        LOG(3, "hoisted loop ref "PFX": "PFX"-"PFX" not in heap, giving up\n",
+            site, lo, hi);
+        STATS_INC(hoist_range_declined);
+        shadow_hoist_range_decline(slot, (uint)(ptr_uint_t)site);
+        return;
+    }
+    /* must come before we look at any shadow */
+    epoch = shadow_hoist_epoch(lo, hi);
+    hoist_addressable_part(&lo, &hi, stride > 0);
+    if (hi - lo < (ptr_int_t)memsz)
+        return;
+    LOG(3, "hoisted loop ref "PFX": proved "PFX"-"PFX"\n", site, lo, hi);
+    STATS_INC(hoist_range_proven);
+    shadow_hoist_range_set(slot, lo, hi, epoch);
+}
+
+loop_hoist_info_t *
+fastpath_hoisted_ref(bb_info_t *bi, instr_t *inst)
+{
+    uint i;
+    app_pc pc = instr_get_app_pc(inst);
+    /* check_ignore_unaddr can be set after the analysis */
+    if (bi->check_ignore_unaddr)
+        return NULL;
+    for (i = 0; i < bi->num_hoisted; i++) {
+        if (bi->hoisted[i].pc == pc)
+            return &bi->hoisted[i];
+    }
+    return NULL;
+}
+
+void
+fastpath_insert_hoist_call(void *drcontext, instrlist_t *bb, instr_t *inst,
+                           loop_hoist_info_t *hoist, reg_id_t addr_reg, uint memsz)
+{
+    opnd_t bound = opnd_is_reg(hoist->bound) ? hoist->bound :
+        OPND_CREATE_INTPTR(opnd_get_immed_int(hoist->bound));
+    dr_insert_clean_call(drcontext, bb, inst, (void *) fastpath_hoist_loop_range,
+                         false, 7, opnd_create_reg(addr_reg),
+                         opnd_create_reg(hoist->ivar), bound,
+                         OPND_CREATE_INT32(hoist->step),
+                         OPND_CREATE_INT32(hoist->stride),
+                         OPND_CREATE_INT32(HOIST_FLAGS(hoist->slot, memsz, hoist->rel,
+                                                       hoist->is_signed,
+                                                       hoist->step_first)),
+                         OPND_CREATE_INTPTR(hoist->pc));
+}
+
+/***************************************************************************
+ * Adaptive definedness tiers (-adaptive_uninit)
+ *
+ * A bb starts out in an unaddressability-only tier: like a module on
+ * -check_uninit_blacklist, its memory references are checked for
+ * addressability and its dsts are marked defined, with no definedness checks
+ * of registers or eflags and no propagation.  The one definedness check kept
+ * is on the memory source of a load, which bails to the slowpath when the
+ * loaded data is not fully defined.  An instr that sees undefined data in the
+ * slowpath is recorded here and flushed, and from then on every bb containing
+ * it is built with full propagation.  The recorded instrs can be saved to
+ * -adaptive_profile so that a later run starts them out in the full tier.
+ *
+ * Undefined values that reach a register in a full-tier bb are treated as
+ * defined once they flow into a bb that is still unaddressability-only, so
+ * errors on such paths are not reported until that bb loads undefined memory
+ * itself.
+ */
+
+#define ADAPTIVE_HASH_BITS 10
+/* app pcs of instrs whose bbs get full propagation.  Uses external synch, as
+ * we walk it and update it as one operation on module events.
+ */
+static hashtable_t adaptive_table;
+static uint adaptive_num_flushes;
+
+/* Profile entries for modules that are not currently loaded */
+typedef struct _adaptive_pending_t {
+    char *modname;
+    uint offs;
+    struct _adaptive_pending_t *next;
+} adaptive_pending_t;
+
+/* protected by the adaptive_table lock */
+static adaptive_pending_t *adaptive_pending;
+
+/* caller should hold adaptive_table lock */
+static void
+adaptive_pending_add(const char *modname, uint offs)
+{
+    adaptive_pending_t *entry = (adaptive_pending_t *)
+        global_alloc(sizeof(*entry), HEAPSTAT_MISC);
+    entry->modname = drmem_strdup(modname, HEAPSTAT_MISC);
+    entry->offs = offs;
+    entry->next = adaptive_pending;
+    adaptive_pending = entry;
+}
+
+static void
+adaptive_pending_free(adaptive_pending_t *entry)
+{
+    global_free(entry->modname, strlen(entry->modname) + 1, HEAPSTAT_MISC);
+    global_free(entry, sizeof(*entry), HEAPSTAT_MISC);
+}
+
+/* The profile has one "module+0xoffset" line per instr */
+static void
+adaptive_profile_read(void)
+{
+    const char *line, *eol, *next_line, *eof;
+    uint64 map_size;
+    size_t actual_size;
+    void *map = NULL;
+    file_t f = dr_open_file(options.adaptive_profile, DR_FILE_READ);
+    if (f == INVALID_FILE) {
+        LOG(1, "no adaptive profile at %s\n", options.adaptive_profile);
+        return;
+    }
+    if (dr_file_size(f, &map_size) && map_size > 0) {
+        actual_size = (size_t) map_size;
+        map = dr_map_file(f, &actual_size, 0, NULL, DR_MEMPROT_READ, 0);
+    }
+    if (map == NULL || actual_size < map_size) {
+        if (map != NULL)
+            dr_unmap_file(map, actual_size);
+        dr_close_file(f);
+        return;
+    }
+    eof = ((char *) map) + map_size;
+    for (line = (char *) map; line < eof; line = next_line) {
+        /* the mapped file is not null-terminated so we parse a copy */
+        char buf[MAXIMUM_PATH];
+        char *plus;
+        uint offs;
+        next_line = find_next_line(line, eof, &line, &eol, true);
+        if (line == eol || line[0] == '#')
+            continue;
+        if (eol - line >= BUFFER_SIZE_ELEMENTS(buf)) {
+            LOG(1, "adaptive profile line too long\n");
+            continue;
+        }
+        memcpy(buf, line, eol - line);
+        buf[eol - line] = '\0';
+        plus = strrchr(buf, '+');
+        if (plus == NULL || plus == buf || dr_sscanf(plus + 1, "0x%x", &offs) != 1) {
+            LOG(1, "malformed adaptive profile line \"%s\"\n", buf);
+            continue;
+        }
+        *plus = '\0';
+        adaptive_pending_add(buf, offs);
+    }
+    dr_unmap_file(map, actual_size);
+    dr_close_file(f);
+}
+
+static void
+adaptive_profile_write(void)
+{
+    uint i;
+    adaptive_pending_t *entry;
+    file_t f = dr_open_file(options.adaptive_profile, DR_FILE_WRITE_OVERWRITE);
+    if (f == INVALID_FILE) {
+        NOTIFY_ERROR("Unable to write adaptive profile %s"NL, options.adaptive_profile);
+        return;
+    }
+    hashtable_lock(&adaptive_table);
+    for (i = 0; i < HASHTABLE_SIZE(adaptive_table.table_bits); i++) {
+        hash_entry_t *he;
+        for (he = adaptive_table.table[i]; he != NULL; he = he->next) {
+            app_pc pc = (app_pc) he->key;
+            module_data_t *data = dr_lookup_module(pc);
+            if (data != NULL) {
+                const char *modname = dr_module_preferred_name(data);
+                if (modname != NULL) {
+                    dr_fprintf(f, "%s+0x%x\n", modname,
+                               (uint)(pc - data->start));
+                }
+                dr_free_module_data(data);
+            }
+        }
+    }
+    for (entry = adaptive_pending; entry != NULL; entry = entry->next)
+        dr_fprintf(f, "%s+0x%x\n", entry->modname, entry->offs);
+    hashtable_unlock(&adaptive_table);
+    dr_close_file(f);
+}
+
+void
+fastpath_adaptive_init(void)
+{
+    hashtable_init_ex(&adaptive_table, ADAPTIVE_HASH_BITS, HASH_INTPTR, false/*!strdup*/,
+                      false/*!synch*/, NULL, NULL, NULL);
+    if (options.adaptive_profile[0] != '\0')
+        adaptive_profile_read();
+}
+
+void
+fastpath_adaptive_exit(void)
+{
+    adaptive_pending_t *entry, *next;
+    if (options.adaptive_profile[0] != '\0')
+        adaptive_profile_write();
+    LOG(1, "adaptive: %u instrs upgraded, %u flushes\n",
+        adaptive_table.entries, adaptive_num_flushes);
+    for (entry = adaptive_pending; entry != NULL; entry = next) {
+        next = entry->next;
+        adaptive_pending_free(entry);
+    }
+    adaptive_pending = NULL;
+    hashtable_delete_with_stats(&adaptive_table, "adaptive");
+}
+
+void
+fastpath_adaptive_module_load(const module_data_t *info)
+{
+    adaptive_pending_t *entry, *prev = NULL, *next;
+    const char *modname = dr_module_preferred_name(info);
+    if (modname == NULL)
+        return;
+    hashtable_lock(&adaptive_table);
+    for (entry = adaptive_pending; entry != NULL; entry = next) {
+        next = entry->next;
+        if (strcmp(entry->modname, modname) == 0 &&
+            info->start + entry->offs < info->end) {
+            LOG(2, "adaptive: profile upgrades "PFX" in %s\n",
+                info->start + entry->offs, modname);
+            hashtable_add(&adaptive_table, info->start + entry->offs, (void *)1);
+            if (prev == NULL)
+                adaptive_pending = next;
+            else
+                prev->next = next;
+            adaptive_pending_free(entry);
+        } else
+            prev = entry;
+    }
+    hashtable_unlock(&adaptive_table);
+}
+
+void
+fastpath_adaptive_module_unload(const module_data_t *info)
+{
+    const char *modname = dr_module_preferred_name(info);
+    hashtable_lock(&adaptive_table);
+    if (options.adaptive_profile[0] != '\0' && modname != NULL) {
+        /* keep the entries for the profile */
+        uint i;
+        for (i = 0; i < HASHTABLE_SIZE(adaptive_table.table_bits); i++) {
+            hash_entry_t *he;
+            for (he = adaptive_table.table[i]; he != NULL; he = he->next) {
+                app_pc pc = (app_pc) he->key;
+                if (pc >= info->start && pc < info->end)
+                    adaptive_pending_add(modname, (uint)(pc - info->start));
+            }
+        }
+    }
+    /* the same addresses may hold unrelated code later */
+    hashtable_remove_range(&adaptive_table, info->start, info->end);
+    hashtable_unlock(&adaptive_table);
+}
+
+/* Returns whether bb can use the unaddressability-only tier */
+bool
+fastpath_adaptive_unaddr_only(instrlist_t *bb)
+{
+    instr_t *inst;
+    bool unaddr_only = true;
+    if (adaptive_table.entries == 0)
+        return true;
+    hashtable_lock(&adaptive_table);
+    for (inst = instrlist_first_app(bb); inst != NULL; inst = instr_get_next_app(inst)) {
+        if (hashtable_lookup(&adaptive_table, instr_get_app_pc(inst)) != NULL) {
+            unaddr_only = false;
+            break;
+        }
+    }
+    hashtable_unlock(&adaptive_table);
+    return unaddr_only;
+}
+
+/* Called by the slowpath when an instr saw undefined data.  The instr may
+ * already be in a full-tier bb, in which case the extra flush is wasted but
+ * happens only once per instr.
+ */
+void
+slow_path_adaptive_upgrade(app_loc_t *loc)
+{
+    app_pc pc;
+    bool added;
+    ASSERT(loc != NULL && loc->type == APP_LOC_PC, "invalid param");
+    pc = loc_to_pc(loc);
+    if (pc == NULL)
+        return;
+    hashtable_lock(&adaptive_table);
+    added = hashtable_add(&adaptive_table, pc, (void *)1);
+    hashtable_unlock(&adaptive_table);
+    if (!added)
+        return; /* already upgraded, perhaps by another thread */
+    STATS_INC(adaptive_upgrades);
+    /* Past the limit we still record, so that bbs built later use the full
+     * tier, but we no longer flush: code already built stays
+     * unaddressability-only.
+     */
+    if (adaptive_num_flushes < options.adaptive_max_flushes) {
+        ATOMIC_INC32(adaptive_num_flushes);
+        LOG(2, "adaptive: upgrading "PFX"\n", pc);
+        /* See the comments in slow_path_xl8_sharing() on the flush type */
+        dr_unlink_flush_region(pc, 1);
+    }
+}
+#endif /* TOOL_DR_MEMORY */
+
 /***************************************************************************
  * Fault handling
  */
@@ -312,6 +958,54 @@ handle_possible_write_to_read_only(void *drcontext,
     return res;
 }
 
+/* -guard_page_min: returns whether target is in a large chunk's guard page, in
+ * which case the page has been disarmed and the access can be re-executed.
+ * The inline shadow check has already reported the access unless -sample_rate
+ * left the bb unchecked, in which case we report it here as
+ * pattern_handle_segv_fault() does.
+ */
+static bool
+handle_guard_page_fault(void *drcontext, byte *target, dr_mcontext_t *raw_mc,
+                        dr_mcontext_t *mc, void *tag)
+{
+    bb_saved_info_t *save;
+    bool checked;
+    instr_t inst;
+    app_pc addr;
+    bool is_write;
+    uint pos;
+    int memopidx;
+    app_loc_t loc;
+    size_t size;
+    if (!alloc_replace_handle_guard_fault(target))
+        return false;
+    hashtable_lock(&bb_table);
+    save = (bb_saved_info_t *) hashtable_lookup(&bb_table, tag);
+    checked = (save != NULL && !save->sample_skip);
+    hashtable_unlock(&bb_table);
+    if (checked)
+        return true;
+    instr_init(drcontext, &inst);
+    if (safe_decode(drcontext, raw_mc->pc, &inst, NULL)) {
+        for (memopidx = 0;
+             instr_compute_address_ex_pos(&inst, mc, memopidx,
+                                          &addr, &is_write, &pos);
+             memopidx++) {
+            size = opnd_size_in_bytes(opnd_get_size(is_write ?
+                                                    instr_get_dst(&inst, pos) :
+                                                    instr_get_src(&inst, pos)));
+            if (target < addr || target >= addr + size)
+                continue;
+            pc_to_loc(&loc, mc->pc);
+            report_unaddressable_access(&loc, addr, size,
+                                        is_write ? DR_MEMPROT_WRITE : DR_MEMPROT_READ,
+                                        addr, addr + size, mc);
+        }
+    }
+    instr_free(drcontext, &inst);
+    return true;
+}
+
 #endif /* TOOL_DR_MEMORY */
 
 /* PR 448701: we fault if we write to a special block */
@@ -336,6 +1030,11 @@ event_signal_instrument(void *drcontext, dr_siginfo_t *info)
                    handle_zeroing_fault(drcontext, target, info->raw_mcontext,
                                         info->mcontext)) {
             return DR_SIGNAL_SUPPRESS;
+        } else if (options.shadowing && options.replace_malloc &&
+                   handle_guard_page_fault(drcontext, target, info->raw_mcontext,
+                                           info->mcontext,
+                                           info->fault_fragment_info.tag)) {
+            return DR_SIGNAL_SUPPRESS;
         } else if (options.shadowing &&
                    is_in_special_shadow_block(target)) {
             ASSERT(info->raw_mcontext_valid, "raw mc should always be valid for SEGV");
@@ -402,6 +1101,11 @@ event_exception_instrument(void *drcontext, dr_exception_t *excpt)
             handle_zeroing_fault(drcontext, target, excpt->raw_mcontext,
                                  excpt->mcontext)) {
             return false;
+        } else if (options.shadowing && options.replace_malloc &&
+                   handle_guard_page_fault(drcontext, target, excpt->raw_mcontext,
+                                           excpt->mcontext,
+                                           excpt->fault_fragment_info.tag)) {
+            return false;
         } else if (options.shadowing &&
                    excpt->record->ExceptionInformation[0] == 1 /* write */ &&
                    is_in_special_shadow_block(target)) {
@@ -28,6 +28,7 @@
 #define _FASTPATH_H_ 1
 
 #include "callstack.h" /* app_loc_t */
+#include "shadow.h" /* SHADOW_HOIST_SLOTS */
 
 /* reg liveness */
 enum {
@@ -71,6 +72,31 @@ typedef struct _opnd_info_t {
 
 #define MAX_FASTPATH_SRCS 3
 #define MAX_FASTPATH_DSTS 2
+
+/* relation of the induction register to the bound that keeps a loop going */
+enum {
+    HOIST_REL_LT,
+    HOIST_REL_LE,
+    HOIST_REL_GT,
+    HOIST_REL_GE,
+    HOIST_REL_NE,
+};
+
+/* data structure for hoist_loop_checks optimization: a memory reference in a
+ * single-bb loop that walks memory with a constant stride.
+ */
+typedef struct _loop_hoist_info_t {
+    app_pc pc;       /* app pc of the memory reference */
+    uint slot;       /* TLS slot holding the proven range */
+    reg_id_t ivar;   /* induction register */
+    opnd_t bound;    /* loop-invariant register or immed ivar is compared to */
+    int step;        /* change in ivar per iteration */
+    int stride;      /* change in the referenced address per iteration */
+    byte rel;        /* relation of ivar to bound that keeps the loop going */
+    bool is_signed;  /* whether that relation is a signed comparison */
+    bool step_first; /* whether ivar is stepped before the reference */
+} loop_hoist_info_t;
+
 typedef struct _fastpath_info_t {
     bb_info_t *bb;
 
@@ -134,6 +160,8 @@ typedef struct _fastpath_info_t {
     opnd_t slow_store_dst;
     instr_t *slow_jmp;
     int num_to_propagate;
+    /* filled in by the caller: non-NULL if the check is hoisted out of a loop */
+    loop_hoist_info_t *hoist;
 } fastpath_info_t;
 
 /* data structure for pattern_opt_elide_overlap optimization */
@@ -160,6 +188,24 @@ typedef struct _elide_reg_cover_info_t {
     elide_ref_check_info_t right;
 } elide_reg_cover_info_t;
 
+/* data structure for elide_redundant_checks optimization: a range of
+ * [base + index*scale + lo, base + index*scale + hi) that has already had
+ * its addressability checked in this bb.
+ */
+#define MAX_CHECKED_RANGES_PER_REG 3
+typedef struct _checked_range_t {
+    reg_id_t index;
+    byte scale;
+    int lo;
+    int hi;
+} checked_range_t;
+
+/* Checked ranges for memory references via a particular base reg */
+typedef struct _checked_reg_info_t {
+    uint num_ranges;
+    checked_range_t range[MAX_CHECKED_RANGES_PER_REG];
+} checked_reg_info_t;
+
 /* Share inter-instruction info across whole bb */
 struct _bb_info_t {
     /* whole-bb spilling (PR 489221) */
@@ -214,6 +260,17 @@ struct _bb_info_t {
     uint share_xl8_max_diff;
     /* possible check coverage for memory references via reg */
     elide_reg_cover_info_t reg_cover[NUM_LIVENESS_REGS];
+    /* addressability already checked for memory references via reg */
+    checked_reg_info_t checked[NUM_LIVENESS_REGS];
+    /* strided memory references whose checks are hoisted out of the loop */
+    uint num_hoisted;
+    loop_hoist_info_t hoisted[SHADOW_HOIST_SLOTS];
+    /* -sample_rate: memory references in this bb are not checked */
+    bool sample_skip;
+    /* -adaptive_uninit: check addressability only and mark dsts defined */
+    bool adaptive_unaddr_only;
+    uint sample_refs_checked;
+    uint sample_refs_skipped;
 };
 
 #define SHARING_XL8_ADDR_BI(bi) (!opnd_is_null(bi->shared_memop))
@@ -233,6 +290,10 @@ typedef struct _bb_saved_info_t {
      * XXX DRi#772: could add flush callback and avoid this save
      */
     bool pattern_4byte_check_only:1;
+    /* whether -sample_rate left this bb unchecked, which changes across flushes */
+    bool sample_skip:1;
+    /* -adaptive_uninit tier, which changes as instrs are upgraded */
+    bool adaptive_unaddr_only:1;
     /* we store the size and assume bbs are contiguous so we can free (i#260) */
     ushort bb_size;
     app_pc first_restore_pc; /* first pc that need restore state */
@@ -288,6 +349,46 @@ fastpath_bottom_of_bb(void *drcontext, void *tag, instrlist_t *bb,
 void
 slow_path_xl8_sharing(app_loc_t *loc, size_t inst_sz, opnd_t memop, dr_mcontext_t *mc);
 
+/* Redundant addressability check elimination (-elide_redundant_checks) */
+bool
+fastpath_check_is_redundant(bb_info_t *bi, instr_t *inst);
+
+void
+fastpath_note_checked(bb_info_t *bi, instr_t *inst);
+
+void
+fastpath_update_checked_regs(bb_info_t *bi, instr_t *inst);
+
+/* Loop check hoisting (-hoist_loop_checks) */
+void
+fastpath_analyze_loop(void *drcontext, void *tag, instrlist_t *bb, bb_info_t *bi);
+
+loop_hoist_info_t *
+fastpath_hoisted_ref(bb_info_t *bi, instr_t *inst);
+
+void
+fastpath_insert_hoist_call(void *drcontext, instrlist_t *bb, instr_t *inst,
+                           loop_hoist_info_t *hoist, reg_id_t addr_reg, uint memsz);
+
+/* Adaptive definedness tiers (-adaptive_uninit) */
+void
+fastpath_adaptive_init(void);
+
+void
+fastpath_adaptive_exit(void);
+
+void
+fastpath_adaptive_module_load(const module_data_t *info);
+
+void
+fastpath_adaptive_module_unload(const module_data_t *info);
+
+bool
+fastpath_adaptive_unaddr_only(instrlist_t *bb);
+
+void
+slow_path_adaptive_upgrade(app_loc_t *loc);
+
 /***************************************************************************
  * For stack.c: perhaps should move stack.c's fastpath code here and avoid
  * exporting these?
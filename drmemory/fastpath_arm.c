@@ -63,6 +63,15 @@ instrument_fastpath(void *drcontext, instrlist_t *bb, instr_t *inst,
      */
 }
 
+#ifdef TOOL_DR_MEMORY
+void
+fastpath_analyze_loop(void *drcontext, void *tag, instrlist_t *bb, bb_info_t *bi)
+{
+    /* FIXME i#1726: NYI: no loop check hoisting */
+    bi->num_hoisted = 0;
+}
+#endif
+
 /***************************************************************************
  * Fault handling
  */
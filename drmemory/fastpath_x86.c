@@ -772,6 +772,13 @@ adjust_opnds_for_fastpath(instr_t *inst, fastpath_info_t *mi)
 
     if (!mi->check_definedness) /* sometimes set in instr_ok_for_instrument_fastpath */
         mi->check_definedness = instr_check_definedness(inst);
+#ifdef TOOL_DR_MEMORY
+    /* -adaptive_uninit: nothing is propagated, and a load's undefined memory
+     * source goes to the slowpath
+     */
+    if (mi->bb->adaptive_unaddr_only)
+        mi->check_definedness = true;
+#endif
 
     if (opnd_is_reg(mi->src[0].app))
         mi->src_reg = opnd_get_reg(mi->src[0].app);
@@ -2988,6 +2995,301 @@ insert_lea_preserve_reg(void *drcontext, instrlist_t *bb, instr_t *inst,
         insert_lea(drcontext, bb, inst, memop, mi->reg3.reg, mi->reg2.reg);
 }
 
+#ifdef TOOL_DR_MEMORY
+/***************************************************************************
+ * Loop check hoisting
+ *
+ * A bb that ends in a conditional branch back to its own start, right after
+ * comparing an induction register against a loop-invariant bound, is a loop
+ * whose remaining trip count we can compute from register values.  The
+ * induction register must be stepped by a constant exactly once in the bb.
+ * A memory reference that uses it as its base or index, with any other
+ * addressing register invariant, then walks memory with a constant stride.
+ * For such a reference we compare the address against a per-thread range
+ * that a clean call proved addressable for the rest of the loop, and only
+ * do the regular check on a miss: see fastpath_hoist_loop_range().
+ */
+
+/* Larger refs (xsave, etc.) are rare and are not worth hoisting */
+#define MAX_HOIST_REF_SIZE 64
+
+static inline bool
+hoist_reg_ok(reg_id_t reg)
+{
+    return (reg_is_gpr(reg) && reg_is_pointer_sized(reg) && reg != DR_REG_XSP);
+}
+
+static bool
+hoist_reg_written(instrlist_t *bb, reg_id_t reg)
+{
+    instr_t *inst;
+    for (inst = instrlist_first_app(bb); inst != NULL; inst = instr_get_next_app(inst)) {
+        if (instr_writes_to_reg(inst, reg, DR_QUERY_INCLUDE_ALL))
+            return true;
+    }
+    return false;
+}
+
+/* Returns the constant by which inst changes reg, or 0 if it is not a simple step */
+static int
+hoist_step_amount(instr_t *inst, reg_id_t reg)
+{
+    uint opc = instr_get_opcode(inst);
+    opnd_t src;
+    if (instr_num_dsts(inst) == 0 || !opnd_is_reg(instr_get_dst(inst, 0)) ||
+        opnd_get_reg(instr_get_dst(inst, 0)) != reg)
+        return 0;
+    if (opc == OP_inc)
+        return 1;
+    if (opc == OP_dec)
+        return -1;
+    src = instr_get_src(inst, 0);
+    if ((opc == OP_add || opc == OP_sub) && opnd_is_immed_int(src)) {
+        /* immeds are at most 32 bits */
+        int imm = (int) opnd_get_immed_int(src);
+        return (opc == OP_add) ? imm : -imm;
+    }
+    if (opc == OP_lea && opnd_get_base(src) == reg &&
+        opnd_get_index(src) == DR_REG_NULL)
+        return opnd_get_disp(src);
+    return 0;
+}
+
+/* Returns the sole instr in bb that writes reg if it steps reg by a constant */
+static instr_t *
+hoist_find_step(instrlist_t *bb, reg_id_t reg, int *step OUT)
+{
+    instr_t *inst, *found = NULL;
+    for (inst = instrlist_first_app(bb); inst != NULL; inst = instr_get_next_app(inst)) {
+        if (!instr_writes_to_reg(inst, reg, DR_QUERY_INCLUDE_ALL))
+            continue;
+        if (found != NULL)
+            return NULL;
+        *step = hoist_step_amount(inst, reg);
+        if (*step == 0)
+            return NULL;
+        found = inst;
+    }
+    return found;
+}
+
+/* Maps the loop branch to the relation between the 1st and 2nd cmp operands
+ * under which the loop keeps going.
+ */
+static bool
+hoist_jcc_relation(uint opc, byte *rel OUT, bool *is_signed OUT)
+{
+    if (opc >= OP_jo_short && opc <= OP_jnle_short)
+        opc = opc - OP_jo_short + OP_jo;
+    *is_signed = (opc == OP_jl || opc == OP_jle || opc == OP_jnle || opc == OP_jnl);
+    switch (opc) {
+    case OP_jb:
+    case OP_jl:   *rel = HOIST_REL_LT; break;
+    case OP_jbe:
+    case OP_jle:  *rel = HOIST_REL_LE; break;
+    case OP_jnbe:
+    case OP_jnle: *rel = HOIST_REL_GT; break;
+    case OP_jnb:
+    case OP_jnl:  *rel = HOIST_REL_GE; break;
+    case OP_jnz:  *rel = HOIST_REL_NE; break;
+    default: return false;
+    }
+    return true;
+}
+
+static byte
+hoist_swap_relation(byte rel)
+{
+    switch (rel) {
+    case HOIST_REL_LT: return HOIST_REL_GT;
+    case HOIST_REL_LE: return HOIST_REL_GE;
+    case HOIST_REL_GT: return HOIST_REL_LT;
+    case HOIST_REL_GE: return HOIST_REL_LE;
+    default: return rel;
+    }
+}
+
+/* Returns whether inst has a single memory reference that strides with
+ * loop->ivar and if so fills in loop->stride.
+ */
+static bool
+hoist_candidate_ref(instrlist_t *bb, instr_t *inst, loop_hoist_info_t *loop)
+{
+    uint opc = instr_get_opcode(inst);
+    opnd_t memop = opnd_create_null();
+    reg_id_t base, index, other;
+    uint sz;
+    int i, num_mem = 0;
+    if (opc == OP_lea || opc_is_stringop(opc) || instr_is_predicated(inst))
+        return false;
+    for (i = 0; i < instr_num_srcs(inst) + instr_num_dsts(inst); i++) {
+        opnd_t opnd = (i < instr_num_srcs(inst)) ? instr_get_src(inst, i) :
+            instr_get_dst(inst, i - instr_num_srcs(inst));
+        if (opnd_uses_nonignorable_memory(opnd)) {
+            /* a read-modify-write lists the same opnd as src and dst */
+            if (num_mem > 0 && opnd_same(opnd, memop))
+                continue;
+            memop = opnd;
+            num_mem++;
+        }
+    }
+    if (num_mem != 1 || !opnd_is_near_base_disp(memop))
+        return false;
+    sz = opnd_size_in_bytes(opnd_get_size(memop));
+    if (sz == 0 || sz > MAX_HOIST_REF_SIZE)
+        return false;
+    base = opnd_get_base(memop);
+    index = opnd_get_index(memop);
+    if (base == loop->ivar && index != loop->ivar) {
+        other = index;
+        loop->stride = loop->step;
+    } else if (index == loop->ivar && base != loop->ivar) {
+        other = base;
+        loop->stride = loop->step * opnd_get_scale(memop);
+    } else
+        return false;
+    return (other == DR_REG_NULL ||
+            (hoist_reg_ok(other) && !hoist_reg_written(bb, other)));
+}
+
+void
+fastpath_analyze_loop(void *drcontext, void *tag, instrlist_t *bb, bb_info_t *bi)
+{
+    instr_t *cbr, *cmp, *inst, *step_instr = NULL;
+    loop_hoist_info_t loop;
+    bool stepped = false;
+    int i;
+    bi->num_hoisted = 0;
+    if (!options.hoist_loop_checks || !options.shadowing ||
+        options.check_uninitialized || bi->check_ignore_unaddr ||
+        bi->is_repstr_to_loop)
+        return;
+    cbr = instrlist_last_app_instr(bb);
+    if (cbr == NULL || !instr_is_cbr(cbr) || !opnd_is_pc(instr_get_target(cbr)) ||
+        opnd_get_pc(instr_get_target(cbr)) != dr_fragment_app_pc(tag))
+        return;
+    cmp = instr_get_prev_app_instr(cbr);
+    memset(&loop, 0, sizeof(loop));
+    if (cmp == NULL || instr_get_opcode(cmp) != OP_cmp ||
+        !hoist_jcc_relation(instr_get_opcode(cbr), &loop.rel, &loop.is_signed))
+        return;
+    for (i = 0; i < 2 && step_instr == NULL; i++) {
+        opnd_t ivar = instr_get_src(cmp, i);
+        opnd_t bound = instr_get_src(cmp, 1 - i);
+        if (!opnd_is_reg(ivar) || !hoist_reg_ok(opnd_get_reg(ivar)))
+            continue;
+        if (opnd_is_reg(bound)) {
+            if (!hoist_reg_ok(opnd_get_reg(bound)) ||
+                hoist_reg_written(bb, opnd_get_reg(bound)))
+                continue;
+        } else if (!opnd_is_immed_int(bound))
+            continue;
+        step_instr = hoist_find_step(bb, opnd_get_reg(ivar), &loop.step);
+        if (step_instr != NULL) {
+            loop.ivar = opnd_get_reg(ivar);
+            loop.bound = bound;
+            if (i == 1)
+                loop.rel = hoist_swap_relation(loop.rel);
+        }
+    }
+    if (step_instr == NULL)
+        return;
+    for (inst = instrlist_first_app(bb);
+         inst != cmp && bi->num_hoisted < SHADOW_HOIST_SLOTS;
+         inst = instr_get_next_app(inst)) {
+        if (inst == step_instr) {
+            stepped = true;
+            continue;
+        }
+        if (!hoist_candidate_ref(bb, inst, &loop))
+            continue;
+        loop.pc = instr_get_app_pc(inst);
+        loop.slot = bi->num_hoisted;
+        loop.step_first = stepped;
+        bi->hoisted[bi->num_hoisted++] = loop;
+        STATS_INC(hoisted_loop_refs);
+        DOLOG(3, {
+            LOG(3, "hoisting loop check for "PFX": ivar=%s step=%d stride=%d\n",
+                loop.pc, get_register_name(loop.ivar), loop.step, loop.stride);
+        });
+    }
+}
+
+/* Returns whether reg's app value is not in reg at this point in mi's fastpath */
+static bool
+hoist_reg_clobbered(fastpath_info_t *mi, reg_id_t reg)
+{
+    return (reg == mi->reg1.reg || reg == mi->reg2.reg || reg == mi->reg3.reg ||
+            reg == mi->bb->reg1.reg || reg == mi->bb->reg2.reg ||
+            /* may hold the aflags */
+            reg == DR_REG_XAX);
+}
+
+static bool
+hoist_usable(fastpath_info_t *mi, bool share_addr)
+{
+    loop_hoist_info_t *hoist = mi->hoist;
+    return ((mi->load || mi->store) && !mi->use_shared && !share_addr &&
+            !mi->pushpop && !mi->mem2mem && !mi->load2x &&
+            !hoist_reg_clobbered(mi, hoist->ivar) &&
+            (!opnd_is_reg(hoist->bound) ||
+             !hoist_reg_clobbered(mi, opnd_get_reg(hoist->bound))));
+}
+
+/* Compares the address in mi->reg1 against the range proven addressable for
+ * this hoisted loop reference and jumps to skip on a hit.  The range only
+ * counts while no memory has become unaddressable since it was proven, which
+ * we tell by comparing its epoch to the global one.  On a miss, unless this
+ * site recently gave up on its slot, we call out to prove a range for the
+ * rest of the loop, and then fall through to the regular check.
+ */
+static void
+insert_hoisted_loop_check(void *drcontext, instrlist_t *bb, instr_t *inst,
+                          fastpath_info_t *mi, instr_t *skip)
+{
+    loop_hoist_info_t *hoist = mi->hoist;
+    instr_t *miss = INSTR_CREATE_label(drcontext);
+    instr_t *check = INSTR_CREATE_label(drcontext);
+    instr_t *call = INSTR_CREATE_label(drcontext);
+    mark_scratch_reg_used(drcontext, bb, mi->bb, &mi->reg2);
+    mark_eflags_used(drcontext, bb, mi->bb);
+    PRE(bb, inst,
+        INSTR_CREATE_lea(drcontext, opnd_create_reg(mi->reg2.reg),
+                         opnd_create_base_disp(mi->reg1.reg, DR_REG_NULL, 0,
+                                               mi->memsz, OPSZ_lea)));
+    PRE(bb, inst,
+        INSTR_CREATE_cmp(drcontext, opnd_create_reg(mi->reg2.reg),
+                         opnd_create_shadow_hoist_slot(hoist->slot, SHADOW_HOIST_HI)));
+    PRE(bb, inst, INSTR_CREATE_jcc(drcontext, OP_jnbe, opnd_create_instr(miss)));
+    PRE(bb, inst,
+        INSTR_CREATE_cmp(drcontext, opnd_create_reg(mi->reg1.reg),
+                         opnd_create_shadow_hoist_slot(hoist->slot, SHADOW_HOIST_LO)));
+    PRE(bb, inst, INSTR_CREATE_jcc(drcontext, OP_jb, opnd_create_instr(miss)));
+    PRE(bb, inst,
+        INSTR_CREATE_mov_ld(drcontext, opnd_create_reg(reg_ptrsz_to_32(mi->reg2.reg)),
+                            opnd_create_shadow_hoist_epoch()));
+    PRE(bb, inst,
+        INSTR_CREATE_cmp(drcontext, opnd_create_reg(reg_ptrsz_to_32(mi->reg2.reg)),
+                         opnd_create_shadow_hoist_slot(hoist->slot, SHADOW_HOIST_EPOCH)));
+    PRE(bb, inst, INSTR_CREATE_jcc(drcontext, OP_je, opnd_create_instr(skip)));
+    PRE(bb, inst, miss);
+    PRE(bb, inst,
+        INSTR_CREATE_cmp(drcontext,
+                         opnd_create_shadow_hoist_slot(hoist->slot, SHADOW_HOIST_SITE),
+                         OPND_CREATE_INT32((int)(ptr_uint_t)hoist->pc)));
+    PRE(bb, inst, INSTR_CREATE_jcc(drcontext, OP_jne, opnd_create_instr(call)));
+    /* a declined site retries once its countdown runs out */
+    PRE(bb, inst,
+        INSTR_CREATE_sub(drcontext,
+                         opnd_create_shadow_hoist_slot(hoist->slot, SHADOW_HOIST_RETRY),
+                         OPND_CREATE_INT8(1)));
+    PRE(bb, inst, INSTR_CREATE_jcc(drcontext, OP_jnz, opnd_create_instr(check)));
+    PRE(bb, inst, call);
+    fastpath_insert_hoist_call(drcontext, bb, inst, hoist, mi->reg1.reg, mi->memsz);
+    PRE(bb, inst, check);
+}
+#endif /* TOOL_DR_MEMORY */
+
 /* Fast path for "normal" instructions with a single memory
  * reference using 4-byte addressing registers.
  * Also handles mem2mem in certain cases.
@@ -3030,6 +3332,8 @@ instrument_fastpath(void *drcontext, instrlist_t *bb, instr_t *inst,
     opnd_t heap_unaddr_shadow = opnd_create_null();
     instr_t *marker1, *marker2;
     bool mark_defined;
+    /* -adaptive_uninit: check only the memory source of a mark_defined load */
+    bool check_memsrc_only = false;
 #endif
     bool save_aflags;
 #ifdef TOOL_DR_MEMORY
@@ -3190,6 +3494,15 @@ instrument_fastpath(void *drcontext, instrlist_t *bb, instr_t *inst,
     if (mark_defined) {
         mi->num_to_propagate = 0;
     }
+    /* -adaptive_uninit: an unaddressability-only bb treats everything as
+     * defined, except that undefined data loaded from memory goes to the
+     * slowpath so that the bb is upgraded.
+     */
+    if (mi->bb->adaptive_unaddr_only) {
+        mark_defined = true;
+        mi->num_to_propagate = 0;
+        check_memsrc_only = mi->load && opnd_is_memory_reference(mi->src[0].app);
+    }
 
     DOLOG(3, {
         LOG(3, "fastpath: ");
@@ -3244,6 +3557,11 @@ instrument_fastpath(void *drcontext, instrlist_t *bb, instr_t *inst,
     if (check_ignore_unaddr && (mi->load || mi->store)) {
         LOG(4, "in heap routine: adding nop-if-mem-unaddr checks\n");
     }
+#ifdef TOOL_DR_MEMORY
+    /* nop-if-unaddr checks tell us nothing about addressability */
+    if (check_ignore_unaddr)
+        mi->hoist = NULL;
+#endif
 
     /* leave a marker so we can insert spills once we know whether we need them */
     PRE(bb, inst, spill_location);
@@ -3347,7 +3665,7 @@ instrument_fastpath(void *drcontext, instrlist_t *bb, instr_t *inst,
 
 #ifdef TOOL_DR_MEMORY
     /* Check definedness of eflags if we don't have room to propagate (PR 425622) */
-    if (mi->check_eflags_defined &&
+    if (mi->check_eflags_defined && !mi->bb->adaptive_unaddr_only &&
         TESTANY(EFLAGS_READ_6, instr_get_eflags(inst, DR_QUERY_DEFAULT))) {
         /* we always write the full byte to make this cmp easy */
         PRE(bb, inst,
@@ -3380,7 +3698,7 @@ instrument_fastpath(void *drcontext, instrlist_t *bb, instr_t *inst,
     }
 
 #ifdef TOOL_DR_MEMORY
-    if (options.check_uninitialized) {
+    if (options.check_uninitialized && !mi->bb->adaptive_unaddr_only) {
         /* check definedness of addressing registers.
          * for pushpop this also suffices to cover the read+write of esp
          * (and thus we don't need to propagate definedness for esp, reducing
@@ -3520,7 +3838,8 @@ instrument_fastpath(void *drcontext, instrlist_t *bb, instr_t *inst,
      */
     mi->zero_rest_of_offs =
         ((mi->load || mi->store) && !mi->load2x/*don't have free reg for offs*/ &&
-         ((mi->memsz < 4 && !mark_defined && mi->check_definedness) ||
+         ((mi->memsz < 4 && (!mark_defined || check_memsrc_only) &&
+           mi->check_definedness) ||
           /* PR 503782: we use the offs for table lookup for loads
            * PR 574918: also for stores
            */
@@ -3538,6 +3857,9 @@ instrument_fastpath(void *drcontext, instrlist_t *bb, instr_t *inst,
         need_value = options.check_uninitialized &&
             mi->load && !mi->pushpop && !share_addr;
 
+        if (mi->hoist != NULL && hoist_usable(mi, share_addr))
+            insert_hoisted_loop_check(drcontext, bb, inst, mi, fastpath_restore);
+
         /* PR 493257: share shadow translation across multiple instrs */
         if (!mi->use_shared) {
             bool check_alignment =
@@ -3750,7 +4072,7 @@ instrument_fastpath(void *drcontext, instrlist_t *bb, instr_t *inst,
     }
     marker1 = instr_get_next(marker2);
     if (!opnd_is_null(mi->src[0].app) && !opnd_is_null(mi->src[0].shadow) &&
-        !mark_defined &&
+        (!mark_defined || check_memsrc_only) &&
         /* Special case: we treat cmovcc like a cmp for checking the flags,
          * but we still want to propagate the src normally to the dest if
          * the condition is triggered (i#1456).
@@ -3788,13 +4110,16 @@ instrument_fastpath(void *drcontext, instrlist_t *bb, instr_t *inst,
             if (mi->load)
                 checked_memsrc = true;
         }
-        mi->num_to_propagate--;
-        mi->src[0] = mi->src[1]; /* copy shadow and app */
-        mi->src[1] = mi->src[2]; /* copy shadow and app */
-        mi->src[2].shadow = opnd_create_null();
+        if (!mark_defined) {
+            mi->num_to_propagate--;
+            mi->src[0] = mi->src[1]; /* copy shadow and app */
+            mi->src[1] = mi->src[2]; /* copy shadow and app */
+            mi->src[2].shadow = opnd_create_null();
+        }
     }
     marker1 = instr_get_next(marker2); /* may as well check first */
-    if (opc == OP_cmpxchg8b && options.check_uninitialized) {
+    if (opc == OP_cmpxchg8b && options.check_uninitialized &&
+        !mi->bb->adaptive_unaddr_only) {
         /* we keep on fastpath by hardcoding the 4th & 5th sources */
         opnd_t op4 = instr_get_src(inst, 3);
         opnd_t op5 = instr_get_src(inst, 4);
@@ -86,6 +86,21 @@ typedef struct _stringop_entry_t {
  * and DR doesn't provide it at initial thread init (i#117).
  */
 bool first_bb = true;
+
+/* -sample_rate: each bb is either fully checked or left nearly native, decided
+ * at instrumentation time by hashing its tag with the current sample epoch.
+ * Every -sample_period ms we advance the epoch and flush the cache so that a
+ * different set of bbs gets checked.  We use flushing rather than a per-thread
+ * countdown selecting between two copies of each bb, as the latter would need a
+ * check, and thus an aflags spill, at the top of every bb, which costs about as
+ * much as the addressability checks do in the light modes.
+ */
+static uint sample_epoch;
+static uint64 sample_epoch_start;
+static void *sample_lock; /* protects the fields below */
+static uint sample_rotations;
+static uint64 sample_refs_checked;
+static uint64 sample_refs_skipped;
 #endif
 
 #ifdef TOOL_DR_MEMORY
@@ -137,6 +152,12 @@ instrument_fragment_delete(void *drcontext/*may be NULL*/, void *tag)
     }
     hashtable_unlock(&bb_table);
 
+    if (bb_size > 0) {
+        /* The app code may have changed, or its module may be going away */
+        app_pc start = dr_fragment_app_pc(tag);
+        slowpath_decode_cache_invalidate(start, start + bb_size);
+    }
+
     if (options.shadowing && bb_size > 0) {
         /* i#260: remove xl8_sharing_table entries.  We can't
          * decode forward (not always safe) and query every app pc, so we store the
@@ -257,6 +278,7 @@ instrument_init(void)
         return;
 
     instru_tls_init();
+    slowpath_init();
 
     if (options.shadowing) {
         gencode_init();
@@ -264,6 +286,10 @@ instrument_init(void)
                        false/*!strdup*/);
         hashtable_init(&ignore_unaddr_table, IGNORE_UNADDR_HASH_BITS, HASH_INTPTR,
                        false/*!strdup*/);
+#ifdef TOOL_DR_MEMORY
+        if (options.adaptive_uninit)
+            fastpath_adaptive_init();
+#endif
     }
     hashtable_init_ex(&bb_table, BB_HASH_BITS, HASH_INTPTR, false/*!strdup*/,
                       false/*!synch*/, bb_table_free_entry, NULL, NULL);
@@ -279,6 +305,10 @@ instrument_init(void)
 #ifdef TOOL_DR_MEMORY
     if (INSTRUMENT_MEMREFS())
         replace_init();
+    if (options.sample_rate < 100) {
+        sample_lock = dr_mutex_create();
+        sample_epoch_start = dr_get_milliseconds();
+    }
 #endif
 }
 
@@ -295,6 +325,10 @@ instrument_exit(void)
     if (options.shadowing) {
         hashtable_delete_with_stats(&xl8_sharing_table, "xl8_sharing");
         hashtable_delete_with_stats(&ignore_unaddr_table, "ignore_unaddr");
+#ifdef TOOL_DR_MEMORY
+        if (options.adaptive_uninit)
+            fastpath_adaptive_exit();
+#endif
     }
     hashtable_delete_with_stats(&bb_table, "bb_table");
 #ifdef X86
@@ -305,7 +339,15 @@ instrument_exit(void)
 #ifdef TOOL_DR_MEMORY
     if (INSTRUMENT_MEMREFS())
         replace_exit();
+    if (sample_lock != NULL) {
+        LOG(1, "sampling: %u rotations, "UINT64_FORMAT_STRING" refs checked, "
+            UINT64_FORMAT_STRING" refs skipped\n", sample_rotations,
+            sample_refs_checked, sample_refs_skipped);
+        dr_mutex_destroy(sample_lock);
+        sample_lock = NULL;
+    }
 #endif
+    slowpath_exit();
     instru_tls_exit();
 }
 
@@ -315,6 +357,7 @@ instrument_thread_init(void *drcontext)
     if (!INSTRUMENT_MEMREFS())
         return;
     instru_tls_thread_init(drcontext);
+    slowpath_thread_init(drcontext);
 }
 
 void
@@ -322,9 +365,62 @@ instrument_thread_exit(void *drcontext)
 {
     if (!INSTRUMENT_MEMREFS())
         return;
+    slowpath_thread_exit(drcontext);
     instru_tls_thread_exit(drcontext);
 }
 
+#ifdef TOOL_DR_MEMORY
+static bool
+sample_skip_bb(void *tag)
+{
+    /* multiplicative hash so that each epoch picks an unrelated set of bbs */
+    uint hash = ((uint)(ptr_uint_t)tag ^ (sample_epoch * 0x9e3779b9)) * 0x9e3779b1;
+    return (hash >> 16) % 100 >= options.sample_rate;
+}
+
+static void
+sample_account_bb(bb_info_t *bi)
+{
+    dr_mutex_lock(sample_lock);
+    sample_refs_checked += bi->sample_refs_checked;
+    sample_refs_skipped += bi->sample_refs_skipped;
+    dr_mutex_unlock(sample_lock);
+}
+
+/* Called from a syscall event or a clean call, where a flush may be requested */
+void
+instrument_sample_maybe_rotate(void)
+{
+    uint64 now;
+    if (sample_lock == NULL || options.sample_period == 0)
+        return;
+    now = dr_get_milliseconds();
+    if (now - sample_epoch_start < options.sample_period)
+        return;
+    /* avoid a flush storm from several threads noticing at once */
+    if (!dr_mutex_trylock(sample_lock))
+        return;
+    if (now - sample_epoch_start >= options.sample_period) {
+        sample_epoch_start = now;
+        sample_epoch++;
+        sample_rotations++;
+        LOG(1, "sampling: switching to epoch %u\n", sample_epoch);
+        dr_delay_flush_region(0, (size_t)-1, 0, NULL);
+    }
+    dr_mutex_unlock(sample_lock);
+}
+
+/* Counts are per instrumented instance of a memory reference, not per
+ * execution.  We read without the lock as this is only used for reporting.
+ */
+void
+instrument_sample_coverage(uint64 *checked OUT, uint64 *skipped OUT)
+{
+    *checked = sample_refs_checked;
+    *skipped = sample_refs_skipped;
+}
+#endif
+
 size_t
 instrument_persist_ro_size(void *drcontext, void *perscxt)
 {
@@ -1050,6 +1146,8 @@ instru_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
              */
             bi->pattern_4byte_check_only = save->pattern_4byte_check_only;
             IF_DEBUG(bi->pattern_4byte_check_field_set = true);
+            bi->sample_skip = save->sample_skip;
+            bi->adaptive_unaddr_only = save->adaptive_unaddr_only;
             bi->share_xl8_max_diff = save->share_xl8_max_diff;
             hashtable_unlock(&bb_table);
         } else {
@@ -1069,6 +1167,18 @@ instru_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
             /* i#826: share_xl8_max_diff changes over time, so save it. */
             bi->share_xl8_max_diff = options.share_xl8_max_diff;
 #ifdef TOOL_DR_MEMORY
+            if (options.sample_rate < 100) {
+                bi->sample_skip = sample_skip_bb(tag);
+                LOG(3, "sampling: bb "PFX" is %s\n", tag,
+                    bi->sample_skip ? "skipped" : "checked");
+            }
+            if (options.adaptive_uninit) {
+                bi->adaptive_unaddr_only = fastpath_adaptive_unaddr_only(bb);
+                if (bi->adaptive_unaddr_only)
+                    STATS_INC(adaptive_bbs_unaddr_only);
+                else
+                    STATS_INC(adaptive_bbs_full);
+            }
             if (options.check_memset_unaddr &&
                 in_replace_memset(dr_fragment_app_pc(tag))) {
                 /* since memset is later called by heap routines, add in-heap checks
@@ -1083,6 +1193,12 @@ instru_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
         }
     }
 
+#ifdef TOOL_DR_MEMORY
+    /* must come after bi->check_ignore_unaddr is set */
+    if (INSTRUMENT_MEMREFS() && !bi->sample_skip)
+        fastpath_analyze_loop(drcontext, tag, bb, bi);
+#endif
+
     bi->first_instr = true;
 #ifdef WINDOWS
     if (options.zero_retaddr)
@@ -1162,6 +1278,11 @@ instru_event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *ins
         }
     }
 
+#ifdef TOOL_DR_MEMORY
+    if (bi->first_instr && options.shadowing)
+        replace_instrument_bulk(drcontext, bb, inst, pc);
+#endif
+
     if (INSTRUMENT_MEMREFS()) {
         /* We want to spill AFTER any clean call in case it changes mcontext */
         /* XXX: examine this: how make it more in spirit of drmgr? */
@@ -1250,7 +1371,16 @@ instru_event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *ins
         instr_is_jcc(inst))
         goto instru_event_bb_insert_done;
 
-    if (options.pattern != 0) {
+    if (options.sample_rate < 100 && has_mem) {
+        if (bi->sample_skip)
+            bi->sample_refs_skipped++;
+        else
+            bi->sample_refs_checked++;
+    }
+
+    if (bi->sample_skip) {
+        /* -sample_rate: no checks, but keep the stack shadowing below */
+    } else if (options.pattern != 0) {
         if (!(bi->is_repstr_to_loop && options.pattern_opt_repstr)) {
             /* aggressive optimization of repstr for pattern mode will
              * be handled separately in pattern_instrument_repstr
@@ -1259,7 +1389,13 @@ instru_event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *ins
         }
     } else if (options.shadowing &&
                (options.check_uninitialized || has_noignorable_mem)) {
-        if (instr_ok_for_instrument_fastpath(inst, &mi, bi)) {
+        if (fastpath_check_is_redundant(bi, inst)) {
+            LOG(3, "eliding redundant check "PFX"\n", pc);
+            STATS_INC(redundant_checks_elided);
+        } else if (instr_ok_for_instrument_fastpath(inst, &mi, bi)) {
+#ifdef TOOL_DR_MEMORY
+            mi.hoist = fastpath_hoisted_ref(bi, inst);
+#endif
             instrument_fastpath(drcontext, bb, inst, &mi, bi->check_ignore_unaddr);
             used_fastpath = true;
             bi->added_instru = true;
@@ -1279,6 +1415,7 @@ instru_event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *ins
             /* for whole-bb slowpath does interact w/ global regs */
             bi->added_instru = whole_bb_spills_enabled();
         }
+        fastpath_note_checked(bi, inst);
     }
     /* do esp adjust last, for ret immed; leave wants it the
      * other way but we compensate in adjust_memop() */
@@ -1322,6 +1459,8 @@ instru_event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *ins
  instru_event_bb_insert_done:
     if (bi->first_instr && instr_is_app(inst))
         bi->first_instr = false;
+    if (options.shadowing)
+        fastpath_update_checked_regs(bi, inst);
     if (!used_fastpath && options.shadowing) {
         /* i#1870: sanity check in case we bail out of instrumenting the next instr
          * when we're sharing.
@@ -1350,9 +1489,12 @@ instru_event_bb_instru2instru(void *drcontext, void *tag, instrlist_t *bb,
 #ifdef TOOL_DR_MEMORY
 # ifdef X86
     if (options.pattern != 0 && options.pattern_opt_repstr &&
-        bi->is_repstr_to_loop)
+        bi->is_repstr_to_loop && !bi->sample_skip)
         pattern_instrument_repstr(drcontext, bb, bi, translating);
 # endif
+    if (options.sample_rate < 100 && !translating && !for_trace &&
+        INSTRUMENT_MEMREFS())
+        sample_account_bb(bi);
 #endif
 
     if (INSTRUMENT_MEMREFS()) {
@@ -57,6 +57,14 @@ instrument_resurrect_ro(void *drcontext, void *perscxt, byte **map INOUT);
 void
 bb_save_add_entry(app_pc key, bb_saved_info_t *save);
 
+#ifdef TOOL_DR_MEMORY
+void
+instrument_sample_maybe_rotate(void);
+
+void
+instrument_sample_coverage(uint64 *checked OUT, uint64 *skipped OUT);
+#endif
+
 void
 instru_insert_mov_pc(void *drcontext, instrlist_t *bb, instr_t *inst,
                      opnd_t dst, opnd_t pc_opnd);
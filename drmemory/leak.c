@@ -1273,15 +1273,38 @@ static bool
 malloc_iterate_build_tree_cb(malloc_info_t *info, void *iter_data)
 {
     rb_tree_t *alloc_tree = (rb_tree_t *) iter_data;
-    IF_DEBUG(rb_node_t *node;)
+    rb_node_t *node;
     ASSERT(alloc_tree != NULL, "invalid iteration data");
     /* We use NULL for client b/c we only need unreach_entry_t for the
      * leaks, a small fraction (for most apps!) of the total and thus
      * best allocated lazily
      */
-    IF_DEBUG(node = )
-        rb_insert(alloc_tree, info->base, info->request_size, NULL);
-    ASSERT(node == NULL, "mallocs should not overlap");
+    while ((node = rb_insert(alloc_tree, info->base, info->request_size, NULL))
+           != NULL) {
+        /* Chunks the app announced (e.g., from a custom pool) sit inside the
+         * regular chunk they were carved from.  Like Valgrind, we consider
+         * the inner chunks and ignore the outer one for leaks.
+         */
+        byte *base;
+        size_t size;
+        rb_node_fields(node, &base, &size, NULL);
+        if (info->custom && base <= info->base &&
+            base + size >= info->base + info->request_size) {
+            LOG(3, "ignoring "PFX"-"PFX" which holds custom chunk "PFX"\n",
+                base, base + size, info->base);
+            malloc_set_client_flag(base, MALLOC_IGNORE_LEAK);
+            rb_delete(alloc_tree, node);
+        } else if (!info->custom && info->base <= base &&
+                   info->base + info->request_size >= base + size) {
+            LOG(3, "ignoring "PFX"-"PFX" which holds custom chunk "PFX"\n",
+                info->base, info->base + info->request_size, base);
+            malloc_set_client_flag(info->base, MALLOC_IGNORE_LEAK);
+            break;
+        } else {
+            ASSERT(false, "mallocs should not overlap");
+            break;
+        }
+    }
     return true;
 }
 
@@ -486,6 +486,20 @@ options_init(const char *opstr)
 
     if ((options.snapshots & (~(options.snapshots-1))) != options.snapshots)
         usage_error("-snapshots must be power of 2", "");
+    if (!IS_POWER_OF_2(options.stale_line_size))
+        usage_error("-stale_line_size must be power of 2", "");
+    /* With coarse units many references share each shadow byte, which is
+     * thus nearly always in cache: a blind store beats a compare and branch.
+     */
+    if (options.stale_line_size > 8 && !option_specified.stale_blind_store)
+        options.stale_blind_store = true;
+    if (options.sample_bytes > 0) {
+        if (option_specified.staleness && options.staleness)
+            usage_error("-staleness is not compatible with -sample_bytes", "");
+        options.staleness = false;
+        if (!option_specified.check_leaks)
+            options.check_leaks = false;
+    }
 #else
     if (options.light) {
         options.check_uninitialized = false;
@@ -623,6 +637,35 @@ options_init(const char *opstr)
         options.check_stack_access = true;
         options.check_alignment = true;
     }
+    if (options.check_uninitialized || !options.shadowing) {
+        /* hoisted loop checks only cover addressability */
+        options.hoist_loop_checks = false;
+    }
+    if (options.quarantine_pct > 0 && !options.replace_malloc)
+        usage_error("-quarantine_pct requires -replace_malloc", "");
+    if (options.heap_metrics_freq > 0 && !options.replace_malloc)
+        usage_error("-heap_metrics_freq requires -replace_malloc", "");
+    if (options.dup_fastpath_frames > options.callstack_max_frames)
+        usage_error("-dup_fastpath_frames cannot exceed -callstack_max_frames", "");
+    if (options.guard_page_min > 0 && !options.replace_malloc)
+        usage_error("-guard_page_min requires -replace_malloc", "");
+    if (options.guard_page_min > 0 && options.pattern == 0 && options.sample_rate == 100) {
+        /* Every access is already checked against the shadow, where the guard
+         * page is unaddressable, so a real one would only add overhead.
+         */
+        usage_error("-guard_page_min only valid w/ pattern mode or -sample_rate "
+                    "below 100", "");
+    }
+    if (options.adaptive_uninit && !CHECK_UNINITS())
+        usage_error("-adaptive_uninit only valid w/ -check_uninitialized", "");
+    if (options.sample_rate < 100) {
+        if (CHECK_UNINITS()) {
+            usage_error("-sample_rate only valid w/ -no_check_uninitialized or "
+                        "pattern mode", "");
+        }
+        if (options.persist_code)
+            usage_error("-sample_rate cannot be used with -persist_code", "");
+    }
 # ifdef WINDOWS
     if (options.visual_studio) {
         /* Allow earlier options to override by checking all for whether specified.
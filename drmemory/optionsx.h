@@ -168,6 +168,9 @@ OPTION_CLIENT_BOOL(client, quiet, false,
 OPTION_CLIENT_BOOL(client, results_to_stderr, true,
                    "Print error reports to stderr in addition to results.txt",
                    "Print error reports to stderr in addition to results.txt, interleaving them with the application output.  The output will be prefixed by ~~Dr.M~~ for the main thread and by the thread id for other threads.  This interleaving can make it easier to see which part of an application run raised an error.")
+OPTION_CLIENT_BOOL(client, results_json, false,
+                   "Also write results as JSON lines to results.jsonl",
+                   "In addition to results.txt, write each reported error and leak, the final duplicate count of each error, each suppression used, and a final summary as one JSON object per line to results.jsonl in the log directory, for consumption by scripts.  Each object has a \"record\" field giving its kind, and errors are identified by the same ids as in results.txt.  The file is written by a separate thread so that application threads do not wait on file I/O.")
 OPTION_CLIENT(client, prefix_style, uint, 0, 0, 2,
               "Adjust the default output per-line prefix",
               "For -results_to_stderr, controls the per-line prefix:@@<ul>"
@@ -441,6 +444,12 @@ OPTION_CLIENT_BOOL(drmemscope, report_write_to_read_only, true,
 OPTION_CLIENT_BOOL(drmemscope, show_duplicates, false,
                    "Print details on each duplicate error",
                    "Print details on each duplicate error rather than only showing unique error details")
+OPTION_CLIENT_SCOPE(drmemscope, dup_fastpath_frames, uint, 0, 0, 4096,
+                    "Frames used to recognize duplicate errors early (0 disables)",
+                    "If non-zero, once an error has been seen a second time, later instances with the same type and the same top this-many callstack frames (including the error location itself) are recognized as duplicates of it from a short callstack walk, skipping the full callstack walk and the error table lookup.  Such instances only increment the duplicate and suppression counts.  This greatly speeds up applications that hit the same error in a hot loop, at the risk of attributing an error to an earlier one whose callstack differs only beyond these frames.  Must not be larger than -callstack_max_frames.  Ignored with -show_duplicates.  See also -dup_fastpath_revalidate.")
+OPTION_CLIENT_SCOPE(drmemscope, dup_fastpath_revalidate, uint, 0, 0, UINT_MAX,
+                    "Re-check every Nth early duplicate with a full callstack (0 never does)",
+                    "When -dup_fastpath_frames is on, every this-many instances recognized early as duplicates of a prior error are instead run through the full callstack walk and error table lookup.  If that finds a different error, the top frames are shared by distinct errors and are no longer used for early recognition.  This limits how long a misattribution from too few -dup_fastpath_frames can persist.")
 #ifdef USE_DRSYMS
 OPTION_CLIENT_BOOL(drmemscope, batch, false,
                    "Do not invoke notepad at the end",
@@ -460,6 +469,9 @@ OPTION_CLIENT(client, symcache_minsize, uint, 1000, 0, UINT_MAX,
 OPTION_CLIENT_BOOL(drmemscope, use_symcache_postcall, true,
                    "Cache post-call sites to speed up future runs",
                    "Cache post-call sites to speed up future runs.  Requires -use_symcache to be true.")
+OPTION_CLIENT_BOOL(drmemscope, defer_symbols, false,
+                   "Leave callstack symbolization to symquery -r after exit",
+                   "Do not look up symbols for callstacks while the application runs or at exit.  Each frame in results.txt is printed as a module and offset with a module id, and the ids are listed in modules.txt in the log directory.  Running 'symquery -r <logdir>' afterward rewrites results.txt with symbols.  This takes symbol loading, which is often the bulk of the time spent at exit reporting leaks, off of the application's exit path.  Since function names are unknown while running, only suppressions that use module and offset frames (<mod+0x1234>) apply at runtime.  symquery -r applies the rest, including the default suppressions and legacy Valgrind-format ones, once frames have names: it removes the errors they match from the files and lists them at the end of each, and warns about any suppression it cannot parse.  The counts in the summary still include those errors.  symquery -r also applies -callstack_truncate_below, but not the other -callstack_* options that need symbols, such as -callstack_srcfile_hide.")
 # ifdef WINDOWS
 OPTION_CLIENT_BOOL(drmemscope, preload_symbols, false,
                    "Preload debug symbols on module load",
@@ -482,6 +494,21 @@ OPTION_CLIENT_SCOPE(drmemscope, delay_frees, uint, 2000, 0, UINT_MAX,
 OPTION_CLIENT_SCOPE(drmemscope, delay_frees_maxsz, uint, 20000000, 0, UINT_MAX,
                     "Maximum size of frees to delay before committing",
                     "Maximum size of frees to delay before committing.  The larger this number, the greater the likelihood that "TOOLNAME" will identify use-after-free errors.  However, the larger this number, the more memory will be used.  This value is separate for each set of allocation routines and each Windows Heap.")
+OPTION_CLIENT_SCOPE(drmemscope, quarantine_pct, uint, 0, 0, 100,
+                    "Size delayed frees as a percentage of the heap (0 disables)",
+                    "If non-zero, and -replace_malloc is on, frees from the default heap are delayed in a single process-wide quarantine whose size is this percentage of the heap's committed memory, rather than in a queue limited by -delay_frees.  -delay_frees_maxsz still sets a minimum size for the quarantine.  Frees are handed to the quarantine in per-thread batches of -quarantine_batch, and the oldest frees are recycled in batches as well, which keeps lock contention low while widening the window in which use-after-free errors are detected.")
+OPTION_CLIENT_SCOPE(drmemscope, quarantine_batch, uint, 32, 1, 4096,
+                    "Number of frees per thread handed to the quarantine at once",
+                    "With -quarantine_pct, the number of frees each thread collects before handing them to the process-wide quarantine at once.")
+OPTION_CLIENT_SCOPE(drmemscope, max_tool_memory, uint, 0, 0, UINT_MAX,
+                    "Budget in MB for "TOOLNAME"'s own memory (0 disables)",
+                    "If non-zero, "TOOLNAME" tracks the memory it allocates for its own use, such as callstacks, hashtables, stored errors, and shadow memory, against this budget in megabytes.  Once usage reaches three quarters of the budget, delayed frees are cut to half of -delay_frees and -delay_frees_maxsz (or of the -quarantine_pct size), and allocation sites with no live allocations at that point record only their top few frames from then on.  At the full budget, delayed frees are cut to a quarter and callstacks of newly seen errors are truncated as well.  These reductions are permanent for the rest of the run, even if usage drops back below a limit, and each one is noted in the global log file.  Precision is lost, but the process is less likely to exhaust a memory limit.  Delayed frees are only reduced with -replace_malloc.")
+OPTION_CLIENT_SCOPE(drmemscope, heap_metrics_freq, uint, 0, 0, UINT_MAX,
+                    "Dump heap footprint metrics every N allocations (0 disables)",
+                    "If non-zero, and -replace_malloc is on, the committed, live, free, delayed, and quarantined bytes of each heap, along with a histogram of free chunk sizes and the largest free chunk, are written to the global log file every time this many allocations have been made from a heap, and again at exit.  These metrics are also written on every nudge regardless of this option.  They are meant to help tune -redzone_size, -delay_frees, and -quarantine_pct for memory footprint.")
+OPTION_CLIENT_SCOPE(drmemscope, guard_page_min, uint, 0, 0, UINT_MAX,
+                    "Place an inaccessible guard page after heap allocations of at least this size (0 disables)",
+                    "If non-zero, and -replace_malloc is on, each heap allocation of at least this many bytes that is large enough to be given its own memory mapping is placed at the end of that mapping, just before an inaccessible guard page, with its trailing redzone in between.  An overflow that skips past the redzone then faults on the guard page instead of silently landing in unrelated memory.  The first such fault reports the access as an error and turns the guard page into an ordinary redzone.  Underflows remain covered by the leading redzone only.  This option is only valid in pattern mode or with -sample_rate below 100, where some accesses go unchecked: otherwise every access is already checked against the shadow memory and the option is rejected.")
 OPTION_CLIENT_BOOL(drmemscope, delay_frees_stack, true,
                    "Record callstacks on free to use when reporting use-after-free",
                    "Record callstacks on free to use when reporting use-after-free or other errors that overlap with freed objects.  There is a slight performance hit incurred by this feature for malloc-intensive applications.  The callstack size is controlled by -free_max_frames.")
@@ -593,6 +620,18 @@ OPTION_CLIENT_SCOPE(drmemscope, pattern, uint, IF_ARM_ELSE(DEFAULT_PATTERN, 0),
                     0, USHRT_MAX,
                     "Enables pattern mode. A non-zero 2-byte value must be provided",
                     "Use sentinels to detect accesses on unaddressable regions around allocated heap objects.  When this option is enabled, checks for uninitialized read errors will be disabled.  The value passed as the pattern must be a non-zero 2-byte value.")
+OPTION_CLIENT_BOOL(drmemscope, adaptive_uninit, false,
+                   "Start blocks with cheaper uninitialized-read checks, upgrading on demand",
+                   "Reduces the cost of -check_uninitialized for code that never touches uninitialized data.  Each basic block starts out checking only for unaddressable accesses and marking everything it writes defined, as for a module on -check_uninit_blacklist, except that a load of memory that is not fully defined is handed to the slow path.  The first time an instruction encounters uninitialized data in the slow path, the blocks containing that instruction are flushed and re-instrumented with full definedness propagation.  Uninitialized values that are already in registers when they reach a block that has not been upgraded are treated as defined there, so some uninitialized reads can go unreported.  See also -adaptive_profile.  This option is only valid with -check_uninitialized.")
+OPTION_CLIENT_STRING(drmemscope, adaptive_profile, "",
+                     "File recording which instructions -adaptive_uninit upgraded",
+                     "When -adaptive_uninit is on and this names a file, instructions listed in the file start out with full definedness propagation, and on exit the file is overwritten with every instruction upgraded in this run together with those read from the file.  Entries are module-relative so the file can be re-used across runs.  When several processes share the file the last one to exit wins.")
+OPTION_CLIENT_SCOPE(drmemscope, sample_rate, uint, 100, 0, 100,
+                    "Percentage of basic blocks whose memory references are checked",
+                    "When set below 100, enables a sampling mode meant for long-running monitoring where full checking is too expensive.  Only this percentage of basic blocks, chosen pseudo-randomly, have their memory references checked; the rest run with nearly no instrumentation.  Every -sample_period milliseconds the code cache is flushed and a different set of blocks is chosen, so that over time all code is covered.  Detection of unaddressable accesses thus becomes probabilistic.  The fraction of memory references that were checked is reported in the summary.  This option is only supported with -light, -unaddr_only, -no_check_uninitialized, or pattern mode, and cannot be combined with -persist_code.")
+OPTION_CLIENT_SCOPE(drmemscope, sample_period, uint, 2000, 0, UINT_MAX,
+                    "Milliseconds between changes of the sampled set for -sample_rate",
+                    "When -sample_rate is below 100, the set of sampled basic blocks is re-chosen no more often than every this many milliseconds.  The change is made at the next system call or slow path entry after the period elapses, and requires a flush of the code cache.  A value of 0 keeps the initial set for the whole run.")
 OPTION_CLIENT_BOOL(drmemscope, persist_code, false,
                    "Cache instrumented code to speed up future runs (light mode only)",
                    "Cache instrumented code to speed up future runs.  For short-running applications, this can provide a performance boost.  It may not be worth enabling for long-running applications.  Currently, this option is only supported with -light or -no_check_uninitialized.  It also currently fails to re-use randomized libraries on Windows, resulting in less of a performance boost for applications that use many libraries with ASLR enabled.")
@@ -808,6 +847,9 @@ OPTION_CLIENT_BOOL(internal, esp_fastpath, IF_X64_ELSE(false, true),
 OPTION_CLIENT_BOOL(internal, shared_slowpath, true,
                    "Enable shared slowpath calling code",
                    "Enable shared slowpath calling code")
+OPTION_CLIENT_BOOL(internal, slowpath_decode_cache, true,
+                   "Cache decoded instrs for the slowpath",
+                   "Keep a per-thread cache of the app instrs decoded by the slowpath, along with their instr-only operand analysis, to avoid re-decoding in hot loops that cannot use the fastpath.")
 OPTION_CLIENT_BOOL(internal, loads_use_table, true,
                    "Use a table lookup to stay on fastpath",
                    "Use a table lookup to check load addressability and stay on fastpath more often")
@@ -853,6 +895,12 @@ OPTION_CLIENT_STRING(internal, libc_addrs, "",
                       */
                      "Addresses of statically-included libc routines for replacement.",
                      "Addresses of statically-included libc routines for replacement.  Must be a comma-separated list of hex addresses with 0x prefixes,  in this order: memset, memcpy, memchr, strchr, strrchr, strlen, strcmp, strncmp, strcpy, strncpy, strcat, strncat")
+OPTION_CLIENT_BOOL(internal, replace_bulk_str, true,
+                   "Perform replaced str* calls natively when fully defined",
+                   "Calls to the replacement strlen, strnlen, strchr, strrchr, strcmp, strncmp, and strstr routines first consult the shadow memory of their strings one aligned 16-byte block at a time, examining individual bytes only in blocks that are not entirely defined.  If every byte the routine would read is defined, the call is performed natively rather than by running the instrumented loop.  Otherwise, or if any argument is not fully defined, the instrumented loop runs and reports errors as before.  A call that has to run the loop, or whose string is shorter than -replace_bulk_min, makes the next several calls on that thread run the loop without consulting the shadow.")
+OPTION_CLIENT(internal, replace_bulk_min, uint, 256, 0, UINT_MAX,
+              "Minimum size of a replaced mem* call to perform in bulk (0 disables)",
+              "Calls to the replacement memset, memcpy, and memmove routines of at least this many bytes whose memory is entirely addressable are performed natively with a single bulk shadow update, rather than by running the instrumented loops.  Calls that touch unaddressable memory, or whose arguments are not fully defined, still run the instrumented loops so errors are reported as before.  Smaller calls are filtered out inline without leaving the code cache.  0 disables this.")
 OPTION_CLIENT_BOOL(internal, check_push, true,
                    "Check that pushes are writing to unaddressable memory",
                    "Check that pushes are writing to unaddressable memory")
@@ -876,6 +924,15 @@ OPTION_CLIENT(internal, share_xl8_max_diff, uint, 2048, 0, SHADOW_REDZONE_SIZE*4
 OPTION_CLIENT(internal, share_xl8_max_flushes, uint, 64, 0, UINT_MAX,
               "How many flushes before abandoning sharing altogether",
               "How many flushes before abandoning sharing altogether")
+OPTION_CLIENT_BOOL(internal, elide_redundant_checks, true,
+                   "Elide addressability checks already performed in the same bb",
+                   "In -no_check_uninitialized shadow mode, skip the addressability check for a memory reference whose bytes were already checked earlier in the same basic block through the same unmodified base and index registers.  Adjacent or overlapping checked ranges are merged.  A bad access that was already reported is then not reported again from a later instruction in that block.")
+OPTION_CLIENT_BOOL(internal, hoist_loop_checks, true,
+                   "Hoist addressability checks out of simple single-block loops",
+                   "In -no_check_uninitialized shadow mode, for a basic block that loops back to itself while stepping an induction register by a constant and comparing it against an invariant bound, check the addressability of the whole region that a strided memory reference through that register will touch in the remaining iterations once, and skip the per-iteration shadow lookup while the reference stays inside it.  Only heap memory is covered.  References whose loop bounds cannot be determined keep their regular per-access checks.")
+OPTION_CLIENT(internal, adaptive_max_flushes, uint, 256, 0, UINT_MAX,
+              "Maximum number of flushes to upgrade instrs for -adaptive_uninit",
+              "Each upgrade of an instruction by -adaptive_uninit flushes its code, which can discard a whole module's worth of code.  Past this many flushes, upgrades only take effect for newly built blocks.")
 OPTION_CLIENT_BOOL(internal, check_memset_unaddr, true,
                    "Check for in-heap unaddr in memset",
                    "Check for in-heap unaddr in memset")
@@ -1094,6 +1094,20 @@ pattern_handle_segv_fault(void *drcontext, dr_mcontext_t *raw_mc,
              instr_compute_address_ex_pos(&inst, mc, memopidx,
                                           &addr, &is_write, &pos);
              memopidx++) {
+            opnd = is_write ? instr_get_dst(&inst, pos) : instr_get_src(&inst, pos);
+            size = opnd_size_in_bytes(opnd_get_size(opnd));
+            if (options.replace_malloc &&
+                (alloc_replace_handle_guard_fault(addr) ||
+                 alloc_replace_handle_guard_fault(addr + size - 1))) {
+                /* An unchecked access hit a large chunk's guard page */
+                pc_to_loc(&loc, mc->pc);
+                report_unaddressable_access(&loc, addr, size,
+                                            is_write ? DR_MEMPROT_WRITE :
+                                            DR_MEMPROT_READ,
+                                            addr, addr + size, mc);
+                ours = true;
+                continue;
+            }
             if (dr_query_memory_ex(addr, &info)) {
                 if (info.type == DR_MEMTYPE_FREE) {
                     opnd = is_write ?
@@ -1146,6 +1160,19 @@ pattern_handle_segv_fault(void *drcontext, dr_mcontext_t *raw_mc,
         ASSERT(ok, "failed to restore guard page");
     }
 #endif
+    if (options.replace_malloc) {
+        /* If the check itself hit a large chunk's guard page, disarm it and
+         * re-execute the check, which will then see the pattern and report.
+         */
+        opnd_t mem = instr_get_src(&inst, 0);
+        byte *addr = opnd_compute_address(mem, raw_mc);
+        if (alloc_replace_handle_guard_fault(addr) ||
+            alloc_replace_handle_guard_fault
+            (addr + opnd_size_in_bytes(opnd_get_size(mem)) - 1)) {
+            ours = true;
+            goto handle_light_mode_segv_fault_done;
+        }
+    }
     /* skip pattern check code */
 #ifdef X86
     LOG(2, "pattern check cmp fault@"PFX" => skip to "PFX"\n",
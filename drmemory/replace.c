@@ -36,6 +36,9 @@
 #include "heap.h"
 #include "drmemory.h"
 #include "shadow.h"
+#include "slowpath.h"
+#include "stack.h"
+#include "spill.h"
 #ifdef USE_DRSYMS
 # include "drsymcache.h"
 #endif
@@ -138,6 +141,29 @@ static size_t replace_routine_size;
 static int index_memcpy;
 static int index_memmove;
 
+/* Entry points of the replacement routines we can handle in bulk */
+typedef enum {
+    BULK_MEMSET,
+    BULK_MEMCPY,
+    BULK_MEMMOVE,
+    BULK_STRLEN, /* first str* routine */
+    BULK_STRNLEN,
+    BULK_STRCHR,
+    BULK_STRRCHR,
+    BULK_STRCMP,
+    BULK_STRNCMP,
+    BULK_STRSTR,
+    BULK_NUM,
+} bulk_routine_t;
+static app_pc bulk_entry[BULK_NUM];
+/* How many pointer-sized args each routine takes */
+static const byte bulk_num_args[BULK_NUM] = { 3, 3, 3, 1, 2, 2, 2, 2, 3, 2 };
+/* Which arg bounds how many bytes each routine touches, or -1 if unbounded */
+static const int bulk_size_arg[BULK_NUM] = { 2, 2, 2, -1, 1, -1, -1, -1, 2, -1 };
+/* Raw tls slot holding the per-thread str* backoff countdown */
+static reg_id_t bulk_tls_seg;
+static uint bulk_tls_offs;
+
 #ifdef USE_DRSYMS
 /* for passing data to sym enum callback */
 typedef struct _sym_enum_data_t {
@@ -905,6 +931,23 @@ replace_init(void)
             ALIGN_FORWARD(get_function_entry((app_pc)replace_final_routine), PAGE_SIZE) -
             PAGE_START(get_function_entry((app_pc)replace_memset));
 
+        if (options.shadowing && options.replace_bulk_min > 0) {
+            bulk_entry[BULK_MEMSET] = get_function_entry((app_pc)replace_memset);
+            bulk_entry[BULK_MEMCPY] = get_function_entry((app_pc)replace_memcpy);
+            bulk_entry[BULK_MEMMOVE] = get_function_entry((app_pc)replace_memmove);
+        }
+        if (options.shadowing && options.replace_bulk_str) {
+            bulk_entry[BULK_STRLEN] = get_function_entry((app_pc)replace_strlen);
+            bulk_entry[BULK_STRNLEN] = get_function_entry((app_pc)replace_strnlen);
+            bulk_entry[BULK_STRCHR] = get_function_entry((app_pc)replace_strchr);
+            bulk_entry[BULK_STRRCHR] = get_function_entry((app_pc)replace_strrchr);
+            bulk_entry[BULK_STRCMP] = get_function_entry((app_pc)replace_strcmp);
+            bulk_entry[BULK_STRNCMP] = get_function_entry((app_pc)replace_strncmp);
+            bulk_entry[BULK_STRSTR] = get_function_entry((app_pc)replace_strstr);
+            if (!dr_raw_tls_calloc(&bulk_tls_seg, &bulk_tls_offs, 1, 0))
+                ASSERT(false, "fatal error: unable to reserve tls slot");
+        }
+
         /* PR 485412: we support passing in addresses of libc routines to
          * be replaced if statically included in the executable and if
          * we have no symbols available
@@ -944,6 +987,8 @@ replace_init(void)
 void
 replace_exit(void)
 {
+    if (bulk_entry[BULK_STRLEN] != NULL)
+        dr_raw_tls_cfree(bulk_tls_offs, 1);
 #ifdef USE_DRSYMS
     if (options.replace_libc) {
         hashtable_delete(&replace_name_table);
@@ -1514,3 +1559,361 @@ in_replace_memset(app_pc pc)
     }
     return (pc >= (app_pc)memset_entry && pc < (app_pc)memcpy_entry);
 }
+
+/***************************************************************************
+ * Bulk handling of mem* and str* calls
+ *
+ * Our replacement routines are simple loops that we instrument like any
+ * other app code, so a large memcpy or a long strlen costs one shadow check
+ * per byte or word.  At the entry of the hottest of them we insert a clean
+ * call that consults the shadow memory for the whole operation up front.
+ * If that shows the loop would not raise any error, the clean call performs
+ * the operation natively, updates the shadow memory in bulk if it writes,
+ * and redirects to the return address.  Otherwise it returns and lets the
+ * instrumented loop run, which reports the first bad byte just as it
+ * always has.
+ */
+
+/* Granularity at which we consult the shadow of a string: shadow_check_range()
+ * handles an aligned 16-byte block with a single shadow load.
+ */
+#define BULK_STR_CHUNK 16
+
+/* A routine whose size arg is below -replace_bulk_min skips the clean call
+ * inline.  The routines with no size arg instead share a per-thread
+ * countdown in raw TLS: after the clean call sees a string shorter than
+ * -replace_bulk_min, or has to decline, the next BULK_STR_BACKOFF calls skip
+ * it.  The countdown is decremented inline and the clean call is made once it
+ * goes negative.
+ */
+#define BULK_STR_BACKOFF 64
+
+#ifdef X86
+# ifdef X64
+#  ifdef WINDOWS
+static const reg_id_t bulk_arg_regs[] = { DR_REG_XCX, DR_REG_XDX, DR_REG_R8 };
+#  else
+static const reg_id_t bulk_arg_regs[] = { DR_REG_XDI, DR_REG_XSI, DR_REG_XDX };
+#  endif
+# endif
+
+/* The i-th pointer-sized argument at the entry of a cdecl routine */
+static opnd_t
+bulk_arg_opnd(uint i)
+{
+# ifdef X64
+    ASSERT(i < BUFFER_SIZE_ELEMENTS(bulk_arg_regs), "invalid arg index");
+    return opnd_create_reg(bulk_arg_regs[i]);
+# else
+    return OPND_CREATE_MEMPTR(DR_REG_XSP, (i + 1) * sizeof(reg_t));
+# endif
+}
+
+static void
+bulk_str_set_backoff(int count)
+{
+    *(int *)(get_own_seg_base() + bulk_tls_offs) = count;
+}
+#endif
+
+/* Returns whether [start, start+size) contains only fully-addressable
+ * byte-level shadow values.
+ */
+static bool
+bulk_range_addressable(app_pc start, size_t size)
+{
+    app_pc pc = start, bad_start, bad_end;
+    uint bad_state;
+    while (pc < start + size) {
+        if (shadow_check_range(pc, start + size - pc, SHADOW_DEFINED,
+                               &bad_start, &bad_end, &bad_state))
+            return true;
+        if (bad_state != SHADOW_UNDEFINED)
+            return false;
+        pc = bad_end;
+    }
+    return true;
+}
+
+/* Walks the string at str, up to max bytes, checking that every byte up to
+ * and including its terminating NUL (or up to max) is defined.  Aligned
+ * chunks whose shadow is entirely defined are scanned natively; only mixed
+ * chunks are examined a byte at a time, which is where the string ends in
+ * the middle of a chunk followed by unaddressable or undefined bytes.  We
+ * never read app memory beyond the NUL whose shadow is not defined.
+ * Returns false if some byte the replacement routine would read is not
+ * defined; else returns true and the length (bounded by max) in *len.
+ */
+static bool
+bulk_strlen_defined(const char *str, size_t max, OUT size_t *len)
+{
+    umbra_shadow_memory_info_t info;
+    const char *s = str, *end, *chunk_end, *nul;
+    if (str + max < str)
+        max = (const char *)POINTER_MAX - str;
+    end = str + max;
+    umbra_shadow_memory_info_init(&info);
+    while (s < end) {
+        chunk_end = (const char *) ALIGN_BACKWARD(s, BULK_STR_CHUNK) + BULK_STR_CHUNK;
+        if (chunk_end > end || chunk_end < s)
+            chunk_end = end;
+        if (shadow_check_range((app_pc)ALIGN_BACKWARD(s, BULK_STR_CHUNK),
+                               BULK_STR_CHUNK, SHADOW_DEFINED, NULL, NULL, NULL)) {
+            nul = (const char *) memchr(s, '\0', chunk_end - s);
+            if (nul != NULL) {
+                *len = nul - str;
+                return true;
+            }
+            s = chunk_end;
+        } else {
+            for (; s < chunk_end; s++) {
+                if (shadow_get_byte(&info, (app_pc)s) != SHADOW_DEFINED)
+                    return false;
+                if (*s == '\0') {
+                    *len = s - str;
+                    return true;
+                }
+            }
+        }
+    }
+    *len = max;
+    return true;
+}
+
+/* Performs a mem* routine natively if it touches only addressable memory.
+ * We do not need to check definedness: copying undefined bytes is not an
+ * error, and the copy carries the source shadow along.
+ */
+static bool
+bulk_mem(bulk_routine_t which, byte *dst, reg_t arg1, size_t size)
+{
+    byte *src = (byte *) arg1;
+    if (size < options.replace_bulk_min || dst + size < dst)
+        return false;
+    if (!bulk_range_addressable(dst, size))
+        return false;
+    if (which == BULK_MEMSET) {
+        memset(dst, (int) arg1, size);
+        shadow_set_range(dst, dst + size, SHADOW_DEFINED);
+    } else {
+        /* We leave overlapping copies to the loop so that a fault partway
+         * through leaves the source intact for the re-execution.
+         */
+        if (src + size < src || (src < dst + size && dst < src + size) ||
+            !bulk_range_addressable(src, size))
+            return false;
+        memcpy(dst, src, size);
+        shadow_copy_range(src, dst, size);
+    }
+    LOG(3, "%s: "PFX" <- "PFX" "PIFX" bytes\n", __FUNCTION__, dst, src, size);
+    return true;
+}
+
+/* Performs a read-only str* routine natively if every byte it could read is
+ * defined.  We then simply call our own replacement routine natively, which
+ * guarantees identical results.
+ */
+static bool
+bulk_str(bulk_routine_t which, reg_t arg0, reg_t arg1, reg_t arg2, OUT reg_t *res,
+         OUT size_t *len)
+{
+    const char *s1 = (const char *) arg0;
+    const char *s2 = (const char *) arg1;
+    size_t len1, len2;
+    switch (which) {
+    case BULK_STRLEN:
+        if (!bulk_strlen_defined(s1, POINTER_MAX, &len1))
+            return false;
+        *res = (reg_t) len1;
+        break;
+    case BULK_STRNLEN:
+        if (!bulk_strlen_defined(s1, (size_t)arg1, &len1))
+            return false;
+        *res = (reg_t) len1;
+        break;
+    case BULK_STRCHR:
+        if (!bulk_strlen_defined(s1, POINTER_MAX, &len1))
+            return false;
+        *res = (reg_t) replace_strchr(s1, (int)arg1);
+        break;
+    case BULK_STRRCHR:
+        if (!bulk_strlen_defined(s1, POINTER_MAX, &len1))
+            return false;
+        *res = (reg_t) replace_strrchr(s1, (int)arg1);
+        break;
+    case BULK_STRCMP:
+        /* The loop stops at the first NUL in either string */
+        if (!bulk_strlen_defined(s1, POINTER_MAX, &len1) ||
+            !bulk_strlen_defined(s2, len1 + 1, &len2))
+            return false;
+        *res = (reg_t) replace_strcmp(s1, s2);
+        break;
+    case BULK_STRNCMP:
+        if (!bulk_strlen_defined(s1, (size_t)arg2, &len1) ||
+            !bulk_strlen_defined(s2, MIN(len1 + 1, (size_t)arg2), &len2))
+            return false;
+        *res = (reg_t) replace_strncmp(s1, s2, (size_t)arg2);
+        break;
+    case BULK_STRSTR:
+        if (!bulk_strlen_defined(s1, POINTER_MAX, &len1) ||
+            !bulk_strlen_defined(s2, POINTER_MAX, &len2))
+            return false;
+        *res = (reg_t) replace_strstr(s1, s2);
+        break;
+    default:
+        ASSERT(false, "invalid bulk str routine");
+        return false;
+    }
+    *len = len1;
+    LOG(3, "%s: routine %d on "PFX" => "PIFX"\n", __FUNCTION__, which, s1, *res);
+    return true;
+}
+
+#ifdef X86
+/* Reads the i-th pointer-sized argument at the entry of a cdecl routine */
+static bool
+bulk_get_arg(dr_mcontext_t *mc, uint i, reg_t *arg)
+{
+# ifdef X64
+    ASSERT(i < BUFFER_SIZE_ELEMENTS(bulk_arg_regs), "invalid arg index");
+    *arg = reg_get_value(bulk_arg_regs[i], mc);
+    return true;
+# else
+    return safe_read((void *)(mc->xsp + (i + 1) * sizeof(reg_t)), sizeof(*arg), arg);
+# endif
+}
+
+/* Returns whether the first num_args args are fully defined.  The loop
+ * would report an undefined size or pointer, and an undefined memset value
+ * has to reach the dst shadow, so we leave those calls to the loop.
+ */
+static bool
+bulk_args_defined(dr_mcontext_t *mc, uint num_args)
+{
+    uint i;
+    if (!options.check_uninitialized)
+        return true;
+    for (i = 0; i < num_args; i++) {
+# ifdef X64
+        if (get_shadow_register(bulk_arg_regs[i]) != SHADOW_PTRSZ_DEFINED)
+            return false;
+# else
+        if (!shadow_check_range((app_pc)mc->xsp + (i + 1) * sizeof(reg_t),
+                                sizeof(reg_t), SHADOW_DEFINED, NULL, NULL, NULL))
+            return false;
+# endif
+    }
+    return true;
+}
+#endif
+
+static void
+replace_bulk_call(bulk_routine_t which)
+{
+#ifdef X86
+    void *drcontext = dr_get_current_drcontext();
+    dr_mcontext_t mc;
+    reg_t arg0, arg1, arg2, res = 0;
+    app_pc retaddr;
+    size_t len = 0;
+    bool ok = false;
+
+    /* We only need the full context, with the xmm regs, if we redirect */
+    mc.size = sizeof(mc);
+    mc.flags = DR_MC_INTEGER | DR_MC_CONTROL;
+    dr_get_mcontext(drcontext, &mc);
+    if (!bulk_get_arg(&mc, 0, &arg0) || !bulk_get_arg(&mc, 1, &arg1) ||
+        !bulk_get_arg(&mc, 2, &arg2) ||
+        !safe_read((void *)mc.xsp, sizeof(retaddr), &retaddr))
+        return;
+    if (bulk_args_defined(&mc, bulk_num_args[which])) {
+        /* A fault despite addressable shadow leaves it to the loop, which
+         * re-does any stores we made.
+         */
+        DR_TRY_EXCEPT(drcontext, {
+            if (which < BULK_STRLEN) {
+                ok = bulk_mem(which, (byte *)arg0, arg1, (size_t)arg2);
+                res = arg0;
+            } else
+                ok = bulk_str(which, arg0, arg1, arg2, &res, &len);
+        }, { /* EXCEPT */
+            ok = false;
+        });
+    }
+    if (which >= BULK_STRLEN && bulk_size_arg[which] < 0) {
+        bulk_str_set_backoff((ok && len >= options.replace_bulk_min) ?
+                             0 : BULK_STR_BACKOFF);
+    }
+    if (!ok) {
+        STATS_INC(replace_bulk_declined);
+        return;
+    }
+    STATS_INC(replace_bulk_fast);
+    mc.flags = DR_MC_ALL;
+    dr_get_mcontext(drcontext, &mc);
+
+    /* Emulate the return, including the stack adjustment of the ret
+     * (see handle_esp_adjust()).
+     */
+    if (options.check_uninitialized || options.check_stack_bounds) {
+        app_pc sp = (app_pc)mc.xsp - BEYOND_TOS_REDZONE_SIZE;
+        shadow_set_range(sp, sp + sizeof(void*), SHADOW_UNADDRESSABLE);
+        if (BEYOND_TOS_REDZONE_SIZE > 0) {
+            sp = (app_pc)mc.xsp + sizeof(void*);
+            shadow_set_range(sp - BEYOND_TOS_REDZONE_SIZE, sp, SHADOW_UNDEFINED);
+        }
+    }
+    if (options.check_uninitialized)
+        register_shadow_set_ptrsz(DR_REG_XAX, SHADOW_PTRSZ_DEFINED);
+    mc.xax = res;
+    mc.xsp += sizeof(void*);
+    mc.pc = retaddr;
+    dr_redirect_execution(&mc);
+    ASSERT(false, "should not reach here");
+#else
+    /* XXX: NYI on ARM, where we'd need to handle the ISA mode of lr */
+#endif
+}
+
+void
+replace_instrument_bulk(void *drcontext, instrlist_t *bb, instr_t *inst, app_pc pc)
+{
+    int i;
+    if (!options.replace_libc)
+        return;
+    for (i = 0; i < BULK_NUM; i++) {
+        if (bulk_entry[i] != NULL && pc == bulk_entry[i]) {
+            instr_t *skip = INSTR_CREATE_label(drcontext);
+            LOG(3, "adding bulk mem/str clean call @"PFX"\n", pc);
+#ifdef X86
+            /* We are at the entry of our own routine, where the calling
+             * convention leaves the arithmetic flags dead, so we need not
+             * preserve them.
+             */
+            if (bulk_size_arg[i] >= 0) {
+                if (options.replace_bulk_min > 0) {
+                    PRE(bb, inst,
+                        INSTR_CREATE_cmp(drcontext, bulk_arg_opnd(bulk_size_arg[i]),
+                                         OPND_CREATE_INT32
+                                         ((int)MIN(options.replace_bulk_min, INT_MAX))));
+                    PRE(bb, inst,
+                        INSTR_CREATE_jcc(drcontext, OP_jb, opnd_create_instr(skip)));
+                }
+            } else {
+                PRE(bb, inst,
+                    INSTR_CREATE_sub(drcontext,
+                                     opnd_create_far_base_disp_ex
+                                     (bulk_tls_seg, REG_NULL, REG_NULL, 1,
+                                      bulk_tls_offs, OPSZ_4, false, true, false),
+                                     OPND_CREATE_INT8(1)));
+                PRE(bb, inst,
+                    INSTR_CREATE_jcc(drcontext, OP_jns, opnd_create_instr(skip)));
+            }
+#endif
+            dr_insert_clean_call(drcontext, bb, inst, (void *)replace_bulk_call,
+                                 false, 1, OPND_CREATE_INT32(i));
+            PRE(bb, inst, skip);
+            break;
+        }
+    }
+}
@@ -45,4 +45,10 @@ in_replace_routine(app_pc pc);
 bool
 in_replace_memset(app_pc pc);
 
+/* Inserts the bulk handling at the entry of our memset, memcpy, memmove,
+ * and read-only str* replacements, if pc is one of them.
+ */
+void
+replace_instrument_bulk(void *drcontext, instrlist_t *bb, instr_t *inst, app_pc pc);
+
 #endif /* _REPLACE_H_ */
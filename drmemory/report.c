@@ -35,9 +35,11 @@
 #include "alloc.h"
 #include "report.h"
 #include "callstack.h"
+#include "error_types.h"
 #include "heap.h"
 #include "alloc_drmem.h"
 #include "fuzzer.h"
+#include "instru.h"
 #ifdef UNIX
 # include <errno.h>
 #endif
@@ -92,28 +94,7 @@ enum {
 
 #define ERROR_SET(potential) ((potential) ? ERROR_POTENTIAL : ERROR_NORMAL)
 
-enum {
-    ERROR_UNADDRESSABLE,
-    ERROR_UNDEFINED,
-    ERROR_INVALID_HEAP_ARG,
-#ifdef WINDOWS
-    ERROR_GDI_USAGE,
-    ERROR_HANDLE_LEAK,
-#endif
-    ERROR_WARNING,
-    ERROR_LEAK,
-    ERROR_POSSIBLE_LEAK,
-    ERROR_REACHABLE_LEAK,
-    ERROR_MAX_LEAK = ERROR_REACHABLE_LEAK,
-    ERROR_MAX_VAL,
-};
-
-static inline bool
-type_is_leak(uint type)
-{
-    return (type >= ERROR_LEAK && type <= ERROR_MAX_LEAK);
-}
-
+/* Summary names, indexed by the error_types.h types */
 static const char *const error_name[] = {
     "unaddressable access(es)",
     "uninitialized access(es)",
@@ -128,20 +109,6 @@ static const char *const error_name[] = {
     "still-reachable allocation(s)",
 };
 
-static const char *const suppress_name[] = {
-    "UNADDRESSABLE ACCESS",
-    "UNINITIALIZED READ",
-    "INVALID HEAP ARGUMENT",
-#ifdef WINDOWS
-    "GDI USAGE ERROR",
-    "HANDLE LEAK",
-#endif
-    "WARNING",
-    "LEAK",
-    "POSSIBLE LEAK",
-    "REACHABLE LEAK",
-};
-
 #ifdef WINDOWS
 /* When updating, change the -dump_at_error_mask docs as well */
 static const uint error_mask[] = {
@@ -157,8 +124,6 @@ static const uint error_mask[] = {
 };
 #endif
 
-#define DRMEM_VALGRIND_TOOLNAME "Dr.Memory"
-
 /* The error_lock protects these as well as error_table */
 static uint num_unique[ERROR_SET_NUM][ERROR_MAX_VAL];
 static uint num_total[ERROR_SET_NUM][ERROR_MAX_VAL];
@@ -259,6 +224,9 @@ typedef struct _error_callstack_t {
     size_t bytes_leaked;
 } error_callstack_t;
 
+/* Callstack depth for errors first seen at the -max_tool_memory hard limit */
+#define PRESSURE_ERROR_MAX_FRAMES 6
+
 #define ERROR_HASH_BITS 8
 hashtable_t error_table;
 /* We need an outer lock to synchronize stored_error_t data access.
@@ -318,6 +286,45 @@ stored_error_cmp(stored_error_t *err1, stored_error_t *err2)
     return (packed_callstack_cmp(err1->pcs, err2->pcs));
 }
 
+/* For -dup_fastpath_frames we map an error type plus the top few frames of a
+ * callstack to the stored error that they were found to duplicate, so that
+ * further instances can skip the full callstack walk.
+ * Protected by error_lock.
+ */
+typedef struct _dup_cache_entry_t {
+    uint errtype;
+    packed_callstack_t *pcs; /* only -dup_fastpath_frames frames */
+    uint hits;
+    /* NULL once these frames have been found in two different errors */
+    stored_error_t *err;
+} dup_cache_entry_t;
+
+#define DUP_CACHE_HASH_BITS 8
+static hashtable_t dup_cache;
+static uint num_dup_fastpath_hits;
+
+static void
+dup_cache_entry_free(dup_cache_entry_t *entry)
+{
+    IF_DEBUG(uint ref = )
+        packed_callstack_free(entry->pcs);
+    ASSERT(ref == 0, "invalid ref count");
+    global_free(entry, sizeof(*entry), HEAPSTAT_REPORT);
+}
+
+static uint
+dup_cache_entry_hash(dup_cache_entry_t *entry)
+{
+    return packed_callstack_hash(entry->pcs) ^ entry->errtype;
+}
+
+static bool
+dup_cache_entry_cmp(dup_cache_entry_t *entry1, dup_cache_entry_t *entry2)
+{
+    return (entry1->errtype == entry2->errtype &&
+            packed_callstack_cmp(entry1->pcs, entry2->pcs));
+}
+
 /* We use a different prefix for the callstack, for Visual Studio (i#800) */
 static const char *info_cstack_pfx;
 static const char *aux_cstack_pfx;
@@ -340,6 +347,17 @@ report_delayed_thread(thread_id_t tid);
 static void
 report_main_thread(void);
 
+#ifdef USE_DRSYMS
+static void
+results_json_init(void);
+
+static void
+results_json_fork_init(void);
+
+static void
+results_json_exit(void);
+#endif
+
 static void
 print_error_to_buffer(char *buf, size_t bufsz, error_toprint_t *etp,
                       stored_error_t *err, error_callstack_t *ecs,
@@ -363,6 +381,9 @@ typedef struct _suppress_frame_t {
     char *modname;
     char *modoffs; /* string b/c we allow wildcards in it */
     char *func;
+    /* Whether modname and func have no wildcards, so matching is a plain compare */
+    bool modname_literal;
+    bool func_literal;
     struct _suppress_frame_t *next;
 } suppress_frame_t;
 
@@ -385,6 +406,10 @@ struct _suppress_spec_t {
      * list.
      */
     struct _suppress_spec_t *next;
+    /* Chain within this spec's supp_func_index or supp_mod_index bucket, or
+     * within supp_unindexed.  Like supp_list, each chain is in decreasing num order.
+     */
+    struct _suppress_spec_t *index_next;
 };
 
 /* We suppress error type separately (PR 507837) */
@@ -392,6 +417,21 @@ static suppress_spec_t *supp_list[ERROR_MAX_VAL];
 static uint supp_num[ERROR_MAX_VAL];
 static bool have_module_wildcard;
 
+/* To avoid comparing an error against every suppression of its type, each
+ * suppression is also indexed by its first frame: by function name if that is a
+ * literal, else by module name if that is a literal.  Suppressions whose first
+ * frame is "...", "*", or fully wildcarded go on supp_unindexed.  Only the
+ * buckets for the error's top frame plus supp_unindexed need to be considered,
+ * and merging them by num visits candidates in supp_list order, so the first
+ * match is the same as a full walk of supp_list would find.
+ */
+#define SUPP_INDEX_HASH_BITS 8
+static hashtable_t supp_func_index[ERROR_MAX_VAL];
+static hashtable_t supp_mod_index[ERROR_MAX_VAL];
+static suppress_spec_t *supp_unindexed[ERROR_MAX_VAL];
+/* The unindexed list plus the func and mod buckets for the top two frames */
+#define SUPP_MAX_CANDIDATE_LISTS 5
+
 #ifdef USE_DRSYMS
 static void *suppress_file_lock;
 #endif
@@ -463,6 +503,7 @@ suppress_spec_create(int type, bool is_default)
     spec->frames = NULL;
     spec->last_frame = NULL;
     spec->next = NULL;
+    spec->index_next = NULL;
     return spec;
 }
 
@@ -534,6 +575,33 @@ is_module_wildcard(suppress_spec_t *spec)
             spec->frames[0].func[1] == '\0');
 }
 
+static void
+suppress_spec_index(suppress_spec_t *spec)
+{
+    suppress_frame_t *top = spec->frames;
+    hashtable_t *table = NULL;
+    const char *key = NULL;
+    /* A top frame for replace_* may be skipped when matching (i#1189) */
+    if (top->is_ellipsis || top->is_star ||
+        (top->func != NULL &&
+         text_matches_pattern(top->func, "replace_*", false/*consider case*/))) {
+        table = NULL;
+    } else if (top->func_literal) {
+        table = &supp_func_index[spec->type];
+        key = top->func;
+    } else if (top->is_module && top->modname_literal) {
+        table = &supp_mod_index[spec->type];
+        key = top->modname;
+    }
+    if (table == NULL) {
+        spec->index_next = supp_unindexed[spec->type];
+        supp_unindexed[spec->type] = spec;
+    } else {
+        spec->index_next = (suppress_spec_t *) hashtable_lookup(table, (void *)key);
+        hashtable_add_replace(table, (void *)key, spec);
+    }
+}
+
 static suppress_spec_t *
 suppress_spec_finish(suppress_spec_t *spec,
                      const char *orig_start,
@@ -555,6 +623,7 @@ suppress_spec_finish(suppress_spec_t *spec,
     spec->next = supp_list[spec->type];
     supp_list[spec->type] = spec;
     supp_num[spec->type]++;
+    suppress_spec_index(spec);
     num_suppressions++;
     if (is_module_wildcard(spec)) {
         have_module_wildcard = true;
@@ -677,7 +746,16 @@ suppress_spec_prefix_line(suppress_spec_t *spec, const char *cstack_start,
     return false;
 }
 
-/* Returns whether to keep the suppression, based on this frame */
+static bool
+pattern_is_literal(const char *pattern)
+{
+    return (pattern != NULL && strchr(pattern, '*') == NULL &&
+            strchr(pattern, '?') == NULL);
+}
+
+/* Returns whether to keep the suppression, based on this frame.
+ * N.B.: symquery -r parses suppressions the same way, so keep it in sync.
+ */
 static bool
 suppress_spec_add_frame(suppress_spec_t *spec, const char *cstack_start,
                         const char *line_in, size_t line_len, int brace_line)
@@ -792,6 +870,9 @@ suppress_spec_add_frame(suppress_spec_t *spec, const char *cstack_start,
          suppress_frame_print(LOGFILE_LOOKUP(), frame, "  added suppression frame");
      });
 
+    frame->modname_literal = pattern_is_literal(frame->modname);
+    frame->func_literal = pattern_is_literal(frame->func);
+
     /* insert */
     if (spec->last_frame != NULL)
         spec->last_frame->next = frame;
@@ -997,10 +1078,36 @@ frame_matches_modname(const error_callstack_t *ecs, uint idx,
 {
     ASSERT(supp != NULL && supp->is_module && supp->modname != NULL,
            "Must have a suppression with a modname!");
+    if (supp->modname_literal) {
+        const char *modname = symbolized_callstack_frame_modname(&ecs->scs, idx);
+        return (FILESYS_CASELESS ? strcasecmp(modname, supp->modname) :
+                strcmp(modname, supp->modname)) == 0;
+    }
     return text_matches_pattern(symbolized_callstack_frame_modname(&ecs->scs, idx),
                                 supp->modname, FILESYS_CASELESS);
 }
 
+static bool
+frame_matches_func(const char *func, const suppress_frame_t *supp)
+{
+    if (supp->func_literal)
+        return strcmp(func, supp->func) == 0;
+    return text_matches_pattern(func, supp->func, false/*consider case*/);
+}
+
+/* Whether the error frame is replace_*, which we skip to match suppressions
+ * created while wrapping (i#1189).
+ */
+static bool
+error_frame_is_replace(const error_callstack_t *ecs, uint idx)
+{
+    return (options.replace_malloc &&
+            text_matches_pattern(symbolized_callstack_frame_func(&ecs->scs, idx),
+                                 "replace_*", false/*consider case*/) &&
+            text_matches_pattern(symbolized_callstack_frame_modname(&ecs->scs, idx),
+                                 DRMEMORY_LIBNAME, FILESYS_CASELESS));
+}
+
 static bool
 top_frame_matches_suppression_frame(const error_callstack_t *ecs,
                                     uint idx,
@@ -1028,8 +1135,8 @@ top_frame_matches_suppression_frame(const error_callstack_t *ecs,
 
     if (!supp->is_module) {
         return (!symbolized_callstack_frame_is_module(&ecs->scs, idx) &&
-                text_matches_pattern(symbolized_callstack_frame_func(&ecs->scs, idx),
-                                     supp->func, false/*consider case*/));
+                frame_matches_func(symbolized_callstack_frame_func(&ecs->scs, idx),
+                                   supp));
     }
 
     if (supp->func == NULL) {
@@ -1054,10 +1161,11 @@ top_frame_matches_suppression_frame(const error_callstack_t *ecs,
             symbolized_callstack_frame_modname(&ecs->scs, idx),
             symbolized_callstack_frame_func(&ecs->scs, idx));
         return (frame_matches_modname(ecs, idx, supp) &&
-                text_matches_pattern(func, supp->func, false/*consider case*/));
+                frame_matches_func(func, supp));
     }
 }
 
+/* N.B.: symquery -r has a copy for deferred symbols, so keep it in sync */
 static bool
 stack_matches_suppression(const error_callstack_t *ecs, const suppress_spec_t *spec)
 {
@@ -1101,11 +1209,7 @@ stack_matches_suppression(const error_callstack_t *ecs, const suppress_spec_t *s
              */
             scs_last_ellipsis++;
             i = scs_last_ellipsis - 1; /* counteract for's ++ */
-        } else if (i == 0 && options.replace_malloc &&
-                   text_matches_pattern(symbolized_callstack_frame_func(&ecs->scs, i),
-                                        "replace_*", false/*consider case*/) &&
-                   text_matches_pattern(symbolized_callstack_frame_modname(&ecs->scs, i),
-                                        DRMEMORY_LIBNAME, FILESYS_CASELESS)) {
+        } else if (i == 0 && error_frame_is_replace(ecs, i)) {
             /* To support swapping between wrapping and replacing, we ignore
              * mismatches of replacing's top replace_ frame (i#1189).
              */
@@ -1130,13 +1234,55 @@ stack_matches_suppression(const error_callstack_t *ecs, const suppress_spec_t *s
     return (supp == NULL);
 }
 
+/* Adds the index buckets that suppressions matching starting at frame idx must
+ * be in.
+ */
+static void
+add_suppression_candidates(uint type, error_callstack_t *ecs, uint idx,
+                           suppress_spec_t **lists, uint *num_lists INOUT)
+{
+    const char *func;
+    if (idx >= ecs->scs.num_frames)
+        return;
+    func = symbolized_callstack_frame_func(&ecs->scs, idx);
+    if (func != NULL) {
+        lists[(*num_lists)++] = (suppress_spec_t *)
+            hashtable_lookup(&supp_func_index[type], (void *)func);
+    }
+    if (symbolized_callstack_frame_is_module(&ecs->scs, idx)) {
+        lists[(*num_lists)++] = (suppress_spec_t *)
+            hashtable_lookup(&supp_mod_index[type],
+                             (void *)symbolized_callstack_frame_modname(&ecs->scs, idx));
+    }
+}
+
 static bool
 on_suppression_list_helper(uint type, error_callstack_t *ecs,
                            suppress_spec_t **matched OUT)
 {
     suppress_spec_t *spec;
+    suppress_spec_t *lists[SUPP_MAX_CANDIDATE_LISTS];
+    uint num_lists = 0, i;
     ASSERT(type >= 0 && type < ERROR_MAX_VAL, "invalid error type");
-    for (spec = supp_list[type]; spec != NULL; spec = spec->next) {
+    lists[num_lists++] = supp_unindexed[type];
+    add_suppression_candidates(type, ecs, 0, lists, &num_lists);
+    if (ecs->scs.num_frames > 0 && error_frame_is_replace(ecs, 0))
+        add_suppression_candidates(type, ecs, 1, lists, &num_lists);
+    ASSERT(num_lists <= SUPP_MAX_CANDIDATE_LISTS, "candidate list overflow");
+    while (true) {
+        /* Take the candidate that comes first in supp_list, i.e., highest num */
+        spec = NULL;
+        for (i = 0; i < num_lists; i++) {
+            if (lists[i] != NULL && (spec == NULL || lists[i]->num > spec->num))
+                spec = lists[i];
+        }
+        if (spec == NULL)
+            break;
+        /* The same bucket can be listed twice if two frames share a name */
+        for (i = 0; i < num_lists; i++) {
+            if (lists[i] == spec)
+                lists[i] = spec->index_next;
+        }
         DOLOG(3, {
             suppress_frame_print(LOGFILE_LOOKUP(), spec->frames,
                                  "supp: comparing error to suppression pattern");
@@ -1481,6 +1627,7 @@ void
 report_init(void)
 {
     char *c;
+    uint i;
     callstack_options_t callstack_ops = { sizeof(callstack_ops), 0 };
 
     timestamp_start = dr_get_milliseconds();
@@ -1495,12 +1642,20 @@ report_init(void)
 #endif
 
     error_lock = dr_mutex_create();
+#ifdef USE_DRSYMS
+    results_json_init();
+#endif
 
     hashtable_init_ex(&error_table, ERROR_HASH_BITS, HASH_CUSTOM,
                       false/*!str_dup*/, false/*using error_lock*/,
                       (void (*)(void*)) stored_error_free,
                       (uint (*)(void*)) stored_error_hash,
                       (bool (*)(void*, void*)) stored_error_cmp);
+    hashtable_init_ex(&dup_cache, DUP_CACHE_HASH_BITS, HASH_CUSTOM,
+                      false/*!str_dup*/, false/*using error_lock*/,
+                      (void (*)(void*)) dup_cache_entry_free,
+                      (uint (*)(void*)) dup_cache_entry_hash,
+                      (bool (*)(void*, void*)) dup_cache_entry_cmp);
 
 #ifdef USE_DRSYMS
     /* callstack.c wants these as null-separated, double-null-terminated */
@@ -1588,6 +1743,11 @@ report_init(void)
     callstack_ops.srcfile_prefix =
         (options.callstack_srcfile_prefix[0] == '\0') ? NULL :
         options.callstack_srcfile_prefix;
+    if (options.defer_symbols) {
+        /* symquery -r needs the module and offset of every frame */
+        callstack_ops.defer_symbols = true;
+        callstack_ops.print_flags |= PRINT_MODULE_OFFSETS | PRINT_MODULE_ID;
+    }
 #endif
     callstack_ops.missing_syms_cb = missing_syms_cb;
     /* i#1231: we don't zero for full mode but we want the cache */
@@ -1606,6 +1766,10 @@ report_init(void)
 # ifdef WINDOWS
     ELOGF(0, f_results, "Application cmdline: \"%S\""NL, get_app_commandline());
 # endif
+    if (options.defer_symbols) {
+        ELOGF(0, f_results, "Symbols deferred: run \"symquery -r %s\" to add them"NL,
+              logsubdir);
+    }
     ELOGF(0, f_suppress, "# File for suppressing errors found in pid %d: \"%s\""NL NL,
           dr_get_process_id(), dr_get_application_name());
     ELOGF(0, f_potential, "Dr. Memory errors that are likely to be false positives, "
@@ -1633,6 +1797,15 @@ report_init(void)
           "uninitialized reads and leaks for higher performance."NL);
 #endif
 
+    for (i = 0; i < ERROR_MAX_VAL; i++) {
+        /* Buckets are chains of specs so there is nothing to free */
+        hashtable_init_ex(&supp_func_index[i], SUPP_INDEX_HASH_BITS, HASH_STRING,
+                          true/*strdup*/, false/*!synch*/, NULL, NULL, NULL);
+        hashtable_init_ex(&supp_mod_index[i], SUPP_INDEX_HASH_BITS,
+                          IF_WINDOWS_ELSE(HASH_STRING_NOCASE, HASH_STRING),
+                          true/*strdup*/, false/*!synch*/, NULL, NULL, NULL);
+    }
+
     if (options.default_suppress) {
         /* the default suppression file must be located at
          *   dr_get_client_path()/../suppress-default.txt
@@ -1720,6 +1893,9 @@ report_fork_init(void)
     num_suppressed_leaks_default = 0;
     num_throttled_errors = 0;
     num_throttled_leaks = 0;
+    num_dup_fastpath_hits = 0;
+    /* The cache points at error_table payloads so it must go first */
+    hashtable_clear(&dup_cache);
     hashtable_clear(&error_table);
     /* Be sure to reset the error list (xref PR 519222)
      * The error list points at hashtable payloads so nothing to free
@@ -1727,6 +1903,9 @@ report_fork_init(void)
     error_head = NULL;
     error_tail = NULL;
     dr_mutex_unlock(error_lock);
+#ifdef USE_DRSYMS
+    results_json_fork_init();
+#endif
 
     if (options.show_threads && !options.show_all_threads) {
         dr_mutex_lock(thread_table_lock);
@@ -1860,6 +2039,15 @@ report_summary_to_file(file_t f, bool stderr_too, bool print_full_stats, bool po
                         potential ? POTENTIAL_PREFIX " " : "", error_name[i]);
         }
     }
+    if (!potential && options.sample_rate < 100 && INSTRUMENT_MEMREFS()) {
+        uint64 checked, skipped;
+        instrument_sample_coverage(&checked, &skipped);
+        NOTIFY_COND(notify, f, "  (-sample_rate: %u%% of "UINT64_FORMAT_STRING
+                    " instrumented memory references were checked)"NL,
+                    checked + skipped == 0 ? 0 :
+                    (uint)((checked * 100) / (checked + skipped)),
+                    checked + skipped);
+    }
     if (!potential) {
         /* -brief doesn't list the count of potential errors */
         if (!options.brief) {
@@ -1947,7 +2135,22 @@ report_exit(void)
     dr_mutex_destroy(suppress_file_lock);
 #endif
     report_summary();
+#ifdef USE_DRSYMS
+    results_json_exit();
+    if (options.defer_symbols && f_modules != INVALID_FILE) {
+        /* symquery -r reproduces the requested style, not the one we forced */
+        const char *pattern;
+        ELOGF(0, f_modules, "print_flags: 0x%x"NL, options.callstack_style);
+        /* nor could we truncate below frames we had no names for */
+        for (pattern = options.callstack_truncate_below; *pattern != '\0';
+             pattern += strlen(pattern) + 1)
+            ELOGF(0, f_modules, "truncate_below: %s"NL, pattern);
+        callstack_module_list_print(f_modules);
+    }
+#endif
 
+    LOG(1, "duplicate errors recognized early: %d\n", num_dup_fastpath_hits);
+    hashtable_delete(&dup_cache);
     hashtable_delete(&error_table);
     dr_mutex_destroy(error_lock);
 
@@ -1959,6 +2162,8 @@ report_exit(void)
             next = spec->next;
             suppress_spec_free(spec);
         }
+        hashtable_delete(&supp_func_index[i]);
+        hashtable_delete(&supp_mod_index[i]);
     }
 
     if (options.show_threads && !options.show_all_threads) {
@@ -2129,6 +2334,14 @@ record_error(uint type, packed_callstack_t *pcs, app_loc_t *loc, dr_mcontext_t *
         const char *modpath = NULL;
         uint max_frames = (type_is_leak(type) ? options.malloc_max_frames :
                            options.callstack_max_frames);
+        if (tool_memory_pressure() == TOOL_MEMORY_HARD &&
+            max_frames > PRESSURE_ERROR_MAX_FRAMES) {
+            DO_ONCE({
+                ELOGF(0, f_global, "Tool memory pressure: truncating callstacks "
+                      "of new errors to %d frames\n", PRESSURE_ERROR_MAX_FRAMES);
+            });
+            max_frames = PRESSURE_ERROR_MAX_FRAMES;
+        }
         if (options.callstack_use_top_fp_selectively && HAVE_STALE_RETADDRS()) {
             /* We need the module of the top frame for checks below */
             if (loc->type == APP_LOC_PC) {
@@ -2227,6 +2440,76 @@ record_error(uint type, packed_callstack_t *pcs, app_loc_t *loc, dr_mcontext_t *
     return err;
 }
 
+/* For -dup_fastpath_frames: if this error's type and top frames were already
+ * found to duplicate a prior error, updates that error's counts the way the
+ * duplicate path through record_error() and report_error() would and returns
+ * it.  Else returns NULL and sets *key_out to pass to dup_fastpath_add() once
+ * the error has gone through record_error().
+ */
+static stored_error_t *
+dup_fastpath_lookup(error_toprint_t *etp, dr_mcontext_t *mc,
+                    dup_cache_entry_t **key_out OUT)
+{
+    dup_cache_entry_t *key = global_alloc(sizeof(*key), HEAPSTAT_REPORT);
+    dup_cache_entry_t *entry;
+    stored_error_t *err = NULL;
+    memset(key, 0, sizeof(*key));
+    key->errtype = etp->errtype;
+    packed_callstack_record(&key->pcs, mc, etp->loc, options.dup_fastpath_frames);
+    dr_mutex_lock(error_lock);
+    entry = (dup_cache_entry_t *) hashtable_lookup(&dup_cache, (void *)key);
+    if (entry != NULL && entry->err != NULL) {
+        entry->hits++;
+        if (options.dup_fastpath_revalidate == 0 ||
+            entry->hits % options.dup_fastpath_revalidate != 0) {
+            err = entry->err;
+            err->count++;
+            if (err->suppressed) {
+                err->suppress_spec->count_used++;
+                if (err->suppressed_by_default)
+                    num_suppressions_matched_default++;
+                else
+                    num_suppressions_matched_user++;
+            } else
+                num_total[ERROR_SET(err->potential)][err->errtype]++;
+            num_dup_fastpath_hits++;
+        } else
+            LOG(3, "revalidating early duplicate of error #%d\n", entry->err->id);
+    }
+    dr_mutex_unlock(error_lock);
+    if (err != NULL) {
+        dup_cache_entry_free(key);
+        key = NULL;
+    }
+    *key_out = key;
+    return err;
+}
+
+/* Called with the error that the full walk found for key's frames, and whether
+ * it was a duplicate or a new unique error.  Only a duplicate adds an entry.
+ * If an entry (being revalidated, or added by another thread) maps the frames
+ * to a different error, they are shared by distinct errors, so we disable the
+ * entry for good rather than let it keep attributing one to the other.
+ * Caller must hold error_lock.  Takes ownership of key.
+ */
+static void
+dup_fastpath_add(dup_cache_entry_t *key, stored_error_t *err, bool is_dup)
+{
+    dup_cache_entry_t *entry = (dup_cache_entry_t *)
+        hashtable_lookup(&dup_cache, (void *)key);
+    if (entry != NULL) {
+        if (entry->err != err && entry->err != NULL) {
+            LOG(2, "early duplicate frames are shared by distinct errors: disabling\n");
+            entry->err = NULL;
+        }
+        dup_cache_entry_free(key);
+    } else if (is_dup) {
+        key->err = err;
+        hashtable_add(&dup_cache, (void *)key, (void *)key);
+    } else
+        dup_cache_entry_free(key);
+}
+
 /* PR 535568: report nearest mallocs and whether freed.
  * Stores results in etp fields which the caller must zero ahead of time.
  * The results are then printed in report_heap_info().
@@ -2577,6 +2860,309 @@ report_symbol_advice(void)
  * + f_global: for postprocessing, uses PRINT_FOR_POSTPROCESS
  * + logfile: if -thread_logs, uses PRINT_FOR_POSTPROCESS
  */
+#ifdef USE_DRSYMS
+/***************************************************************************
+ * Structured results stream (-results_json)
+ *
+ * Each record is formatted on the reporting thread into its own allocation and
+ * queued.  A client thread drains the queue to f_results_json, so the queue
+ * lock is only ever held to link or unlink records and no app thread waits on
+ * file I/O.  At exit we stop that thread and write the rest ourselves.
+ */
+
+typedef struct _json_record_t {
+    struct _json_record_t *next;
+    size_t len;
+    char *buf;
+} json_record_t;
+
+static void *json_queue_lock;
+static json_record_t *json_queue_head;
+static json_record_t *json_queue_tail;
+/* Serializes writing so records stay in queue order */
+static void *json_write_lock;
+static void *json_wakeup;
+static void *json_writer_done;
+static volatile bool json_exiting;
+static bool json_writer_running;
+
+/* Extra space for a record beyond its frames */
+#define JSON_RECORD_BASE_SIZE 512
+#define JSON_FRAME_MAX_SIZE \
+    (2*(MAX_MODULE_LEN + MAX_PFX_LEN + MAX_FUNC_LEN + MAX_FILENAME_LEN) + 128)
+
+/* Prints str as a JSON string, or null if there is no str (e.g., a frame
+ * with no symbol or no line information)
+ */
+static void
+json_print_string(char *buf, size_t bufsz, size_t *sofar, const char *str)
+{
+    ssize_t len;
+    const char *c;
+    if (str == NULL) {
+        BUFPRINT_NO_ASSERT(buf, bufsz, *sofar, len, "null");
+        return;
+    }
+    BUFPRINT_NO_ASSERT(buf, bufsz, *sofar, len, "\"");
+    for (c = str; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\')
+            BUFPRINT_NO_ASSERT(buf, bufsz, *sofar, len, "\\%c", *c);
+        else if ((byte)*c < 0x20)
+            BUFPRINT_NO_ASSERT(buf, bufsz, *sofar, len, "\\u%04x", (uint)(byte)*c);
+        else
+            BUFPRINT_NO_ASSERT(buf, bufsz, *sofar, len, "%c", *c);
+    }
+    BUFPRINT_NO_ASSERT(buf, bufsz, *sofar, len, "\"");
+}
+
+static void
+json_drain(void)
+{
+    json_record_t *rec, *next;
+    dr_mutex_lock(json_write_lock);
+    dr_mutex_lock(json_queue_lock);
+    rec = json_queue_head;
+    json_queue_head = NULL;
+    json_queue_tail = NULL;
+    dr_mutex_unlock(json_queue_lock);
+    for (; rec != NULL; rec = next) {
+        next = rec->next;
+        dr_write_file(f_results_json, rec->buf, rec->len);
+        global_free(rec->buf, rec->len, HEAPSTAT_REPORT);
+        global_free(rec, sizeof(*rec), HEAPSTAT_REPORT);
+    }
+    dr_mutex_unlock(json_write_lock);
+}
+
+static void
+json_writer_thread(void *arg)
+{
+    /* We must keep running while report_exit() waits for us */
+    dr_client_thread_set_suspendable(false);
+    while (!json_exiting) {
+        dr_event_wait(json_wakeup);
+        dr_event_reset(json_wakeup);
+        json_drain();
+    }
+    dr_event_signal(json_writer_done);
+}
+
+/* Queues the first sofar bytes of buf, which the caller keeps ownership of */
+static void
+json_enqueue(const char *buf, size_t sofar)
+{
+    json_record_t *rec;
+    if (sofar == 0 || buf[sofar-1] != '\n') {
+        /* Truncated: better to drop it than to emit invalid JSON */
+        LOG(1, "WARNING: dropping truncated JSON results record\n");
+        return;
+    }
+    rec = (json_record_t *) global_alloc(sizeof(*rec), HEAPSTAT_REPORT);
+    rec->next = NULL;
+    rec->len = sofar;
+    rec->buf = (char *) global_alloc(sofar, HEAPSTAT_REPORT);
+    memcpy(rec->buf, buf, sofar);
+    dr_mutex_lock(json_queue_lock);
+    if (json_queue_tail == NULL)
+        json_queue_head = rec;
+    else
+        json_queue_tail->next = rec;
+    json_queue_tail = rec;
+    dr_mutex_unlock(json_queue_lock);
+    if (json_writer_running)
+        dr_event_signal(json_wakeup);
+    else
+        json_drain();
+}
+
+/* Starts the writer thread with an empty queue */
+static void
+json_start_writer(void)
+{
+    json_queue_head = NULL;
+    json_queue_tail = NULL;
+    json_exiting = false;
+    /* Without a writer thread records are written synchronously */
+    json_writer_running = dr_create_client_thread(json_writer_thread, NULL);
+    if (!json_writer_running)
+        LOG(1, "WARNING: unable to create JSON results writer thread\n");
+}
+
+static void
+results_json_init(void)
+{
+    if (!options.results_json)
+        return;
+    json_queue_lock = dr_mutex_create();
+    json_write_lock = dr_mutex_create();
+    json_wakeup = dr_event_create();
+    json_writer_done = dr_event_create();
+    json_start_writer();
+}
+
+static void
+results_json_fork_init(void)
+{
+    json_record_t *rec, *next;
+    if (!options.results_json)
+        return;
+    /* The writer thread did not come with us.  As with error_lock in
+     * report_fork_init(), we keep using the parent's locks and events rather
+     * than creating (and leaking) new ones.  Records still queued belong in the
+     * parent's file, so we free them.  The child's f_results_json is already a
+     * new file in the new log dir.
+     */
+    dr_mutex_lock(json_queue_lock);
+    rec = json_queue_head;
+    json_queue_head = NULL;
+    json_queue_tail = NULL;
+    dr_mutex_unlock(json_queue_lock);
+    for (; rec != NULL; rec = next) {
+        next = rec->next;
+        global_free(rec->buf, rec->len, HEAPSTAT_REPORT);
+        global_free(rec, sizeof(*rec), HEAPSTAT_REPORT);
+    }
+    dr_event_reset(json_wakeup);
+    dr_event_reset(json_writer_done);
+    json_start_writer();
+}
+
+static void
+results_json_error(error_toprint_t *etp, stored_error_t *err, error_callstack_t *ecs)
+{
+    size_t bufsz = JSON_RECORD_BASE_SIZE + ecs->scs.num_frames * JSON_FRAME_MAX_SIZE;
+    char *buf = (char *) global_alloc(bufsz, HEAPSTAT_REPORT);
+    size_t sofar = 0;
+    ssize_t len;
+    uint i;
+    BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len,
+                       "{\"record\":\"%s\",\"id\":%d,\"potential\":%s,\"type\":",
+                       type_is_leak(etp->errtype) ? "leak" : "error",
+                       err == NULL ? 0 : err->id,
+                       (err != NULL && err->potential) ? "true" : "false");
+    json_print_string(buf, bufsz, &sofar, suppress_name[etp->errtype]);
+    if (type_is_leak(etp->errtype)) {
+        BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len,
+                           ",\"bytes\":%d,\"indirect_bytes\":%d",
+                           etp->sz, etp->indirect_size);
+    } else {
+        BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len,
+                           ",\"addr\":\""PFX"\",\"size\":%d", etp->addr, etp->sz);
+    }
+    if (ecs->instruction[0] != '\0') {
+        BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len, ",\"instruction\":");
+        json_print_string(buf, bufsz, &sofar, ecs->instruction);
+    }
+    BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len, ",\"frames\":[");
+    for (i = 0; i < ecs->scs.num_frames; i++) {
+        BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len, "%s{", i == 0 ? "" : ",");
+        if (symbolized_callstack_frame_is_module(&ecs->scs, i)) {
+            const char *file = symbolized_callstack_frame_file(&ecs->scs, i);
+            BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len, "\"module\":");
+            json_print_string(buf, bufsz, &sofar,
+                              symbolized_callstack_frame_modname(&ecs->scs, i));
+            BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len, ",\"offset\":");
+            json_print_string(buf, bufsz, &sofar,
+                              symbolized_callstack_frame_modoffs(&ecs->scs, i));
+            BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len, ",\"function\":");
+            json_print_string(buf, bufsz, &sofar,
+                              symbolized_callstack_frame_func(&ecs->scs, i));
+            if (file != NULL && file[0] != '\0') {
+                BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len, ",\"file\":");
+                json_print_string(buf, bufsz, &sofar, file);
+                BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len,
+                                   ",\"line\":"UINT64_FORMAT_STRING,
+                                   symbolized_callstack_frame_line(&ecs->scs, i));
+            }
+        } else {
+            /* "<not in a module>" or "system call ..." */
+            BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len, "\"function\":");
+            json_print_string(buf, bufsz, &sofar,
+                              symbolized_callstack_frame_func(&ecs->scs, i));
+        }
+        BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len, "}");
+    }
+    BUFPRINT_NO_ASSERT(buf, bufsz, sofar, len, "]}\n");
+    json_enqueue(buf, sofar);
+    global_free(buf, bufsz, HEAPSTAT_REPORT);
+}
+
+/* Writes the final per-error counts, the suppressions used, and the summary,
+ * and then finishes writing.
+ */
+static void
+results_json_exit(void)
+{
+    char buf[JSON_RECORD_BASE_SIZE + 2*MAX_FUNC_LEN];
+    size_t sofar;
+    ssize_t len;
+    stored_error_t *err;
+    uint i, set;
+    if (!options.results_json)
+        return;
+    for (err = error_head; err != NULL; err = err->next) {
+        if (err->id == 0)
+            continue; /* suppressed, or a leak kind we did not report */
+        sofar = 0;
+        BUFPRINT_NO_ASSERT(buf, BUFFER_SIZE_ELEMENTS(buf), sofar, len,
+                           "{\"record\":\"count\",\"id\":%d,\"potential\":%s,"
+                           "\"count\":%d}\n", err->id,
+                           err->potential ? "true" : "false", err->count);
+        json_enqueue(buf, sofar);
+    }
+    for (i = 0; i < ERROR_MAX_VAL; i++) {
+        suppress_spec_t *spec;
+        for (spec = supp_list[i]; spec != NULL; spec = spec->next) {
+            if (spec->count_used == 0)
+                continue;
+            sofar = 0;
+            BUFPRINT_NO_ASSERT(buf, BUFFER_SIZE_ELEMENTS(buf), sofar, len,
+                               "{\"record\":\"suppression\",\"num\":%d,\"name\":",
+                               spec->num);
+            json_print_string(buf, BUFFER_SIZE_ELEMENTS(buf), &sofar,
+                              spec->name == NULL ? "" : spec->name);
+            BUFPRINT_NO_ASSERT(buf, BUFFER_SIZE_ELEMENTS(buf), sofar, len,
+                               ",\"type\":\"%s\",\"default\":%s,\"count\":%d",
+                               suppress_name[i], spec->is_default ? "true" : "false",
+                               spec->count_used);
+            if (type_is_leak(i)) {
+                BUFPRINT_NO_ASSERT(buf, BUFFER_SIZE_ELEMENTS(buf), sofar, len,
+                                   ",\"bytes\":%d", spec->bytes_leaked);
+            }
+            BUFPRINT_NO_ASSERT(buf, BUFFER_SIZE_ELEMENTS(buf), sofar, len, "}\n");
+            json_enqueue(buf, sofar);
+        }
+    }
+    for (set = 0; set < ERROR_SET_NUM; set++) {
+        for (i = 0; i < ERROR_MAX_VAL; i++) {
+            sofar = 0;
+            BUFPRINT_NO_ASSERT(buf, BUFFER_SIZE_ELEMENTS(buf), sofar, len,
+                               "{\"record\":\"summary\",\"type\":\"%s\","
+                               "\"potential\":%s,\"unique\":%d,\"total\":%d",
+                               suppress_name[i], set == ERROR_POTENTIAL ? "true" : "false",
+                               num_unique[set][i], num_total[set][i]);
+            if (type_is_leak(i)) {
+                BUFPRINT_NO_ASSERT(buf, BUFFER_SIZE_ELEMENTS(buf), sofar, len,
+                                   ",\"bytes\":%d", num_bytes_leaked[set][i]);
+            }
+            BUFPRINT_NO_ASSERT(buf, BUFFER_SIZE_ELEMENTS(buf), sofar, len, "}\n");
+            json_enqueue(buf, sofar);
+        }
+    }
+    if (json_writer_running) {
+        json_exiting = true;
+        dr_event_signal(json_wakeup);
+        dr_event_wait(json_writer_done);
+        json_writer_running = false;
+    }
+    json_drain();
+    dr_event_destroy(json_wakeup);
+    dr_event_destroy(json_writer_done);
+    dr_mutex_destroy(json_write_lock);
+    dr_mutex_destroy(json_queue_lock);
+}
+#endif /* USE_DRSYMS */
+
 static void
 print_error_report(void *drcontext, char *buf, size_t bufsz, bool reporting,
                    error_toprint_t *etp, stored_error_t *err,
@@ -2593,6 +3179,8 @@ print_error_report(void *drcontext, char *buf, size_t bufsz, bool reporting,
         if (options.results_to_stderr && !potential) {
             report_error_from_buffer(STDERR, buf, true);
         }
+        if (options.results_json)
+            results_json_error(etp, err, ecs);
     }
 #endif
 
@@ -2697,6 +3285,7 @@ report_error(error_toprint_t *etp, dr_mcontext_t *mc, packed_callstack_t *pcs)
     error_callstack_t ecs;
     char  *errbuf;
     size_t errbufsz;
+    dup_cache_entry_t *dup_key = NULL;
 
 #ifdef USE_DRSYMS
     /* we do not want to use dbghelp at init time b/c that's too early so we
@@ -2742,6 +3331,19 @@ report_error(error_toprint_t *etp, dr_mcontext_t *mc, packed_callstack_t *pcs)
         goto report_error_done;
     }
 
+    /* Skip the full callstack walk for errors already seen to be duplicates.
+     * Invalid heap args pass in their callstack so there is nothing to save.
+     */
+    if (options.dup_fastpath_frames > 0 && !options.show_duplicates &&
+        pcs == NULL && mc != NULL) {
+        err = dup_fastpath_lookup(etp, mc, &dup_key);
+        if (err != NULL) {
+            /* Like below, -pause_at_un* pauses at dups */
+            reporting = !err->suppressed;
+            goto report_error_done;
+        }
+    }
+
     /* Disassemble the current instruction if its generally included in a report
      * of this type.
      */
@@ -2804,6 +3406,10 @@ report_error(error_toprint_t *etp, dr_mcontext_t *mc, packed_callstack_t *pcs)
             reporting = true;
         }
         if (!options.show_duplicates) {
+            if (dup_key != NULL) {
+                dup_fastpath_add(dup_key, err, true/*dup*/);
+                dup_key = NULL;
+            }
             dr_mutex_unlock(error_lock);
             goto report_error_done;
         }
@@ -2847,6 +3453,13 @@ report_error(error_toprint_t *etp, dr_mcontext_t *mc, packed_callstack_t *pcs)
             report_error_suppression(etp->errtype, &ecs, err->id);
             num_reported_errors[ERROR_NORMAL]++;
         }
+        if (dup_key != NULL) {
+            /* A revalidation that found a new error must not leave the entry
+             * pointing at the old one.
+             */
+            dup_fastpath_add(dup_key, err, false/*unique*/);
+            dup_key = NULL;
+        }
     }
     dr_mutex_unlock(error_lock);
 
@@ -2860,6 +3473,8 @@ report_error(error_toprint_t *etp, dr_mcontext_t *mc, packed_callstack_t *pcs)
     report_free_buf(drcontext, errbuf, errbufsz);
 
  report_error_done:
+    if (dup_key != NULL)
+        dup_cache_entry_free(dup_key);
     symbolized_callstack_free(&ecs.scs);
 #ifdef WINDOWS
     /* don't create dumps for dup errors or potential errors */
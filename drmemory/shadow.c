@@ -37,6 +37,9 @@
 
 #ifdef TOOL_DR_MEMORY /* around whole shadow table */
 
+static void
+shadow_hoist_ranges_invalidate(app_pc start, app_pc end);
+
 /***************************************************************************
  * BITMAP SUPPORT
  */
@@ -259,6 +262,18 @@ shadow_scale_app_to_shadow(ptr_uint_t value)
     return (value >> 2);
 }
 
+static void
+shadow_memory_created(umbra_map_t *map, byte *shadow_start, size_t size)
+{
+    tool_memory_external_alloc(size);
+}
+
+static void
+shadow_memory_deleted(umbra_map_t *map, byte *shadow_start, size_t size)
+{
+    tool_memory_external_free(size);
+}
+
 static void
 shadow_table_init(void)
 {
@@ -293,6 +308,9 @@ shadow_table_init(void)
     umbra_map_ops.redzone_value = SHADOW_REDZONE_VALUE;
     umbra_map_ops.redzone_value_size = 1;
 #endif
+    /* count shadow against -max_tool_memory */
+    umbra_map_ops.shadow_memory_create_cb = shadow_memory_created;
+    umbra_map_ops.shadow_memory_delete_cb = shadow_memory_deleted;
     if (umbra_create_mapping(&umbra_map_ops, &umbra_map) != DRMF_SUCCESS)
         ASSERT(false, "fail to create shadow memory mapping");
 #ifndef X64
@@ -660,6 +678,8 @@ shadow_set_range(app_pc start, app_pc end, uint val)
             pc++;
         }
     }
+    if (val == SHADOW_UNADDRESSABLE)
+        shadow_hoist_ranges_invalidate(start, end);
 }
 
 /* Copies the values for each byte in the range [old_start, old_start+size) to
@@ -735,6 +755,8 @@ shadow_copy_range(app_pc old_start, app_pc new_start, size_t size)
         for (i = 0; i < tail_bit; i++)
             shadow_set_byte(&info_dst, new_end+i, tail_val[i]);
     }
+    /* the copied shadow may include unaddressable bytes */
+    shadow_hoist_ranges_invalidate(new_start, new_start + size);
 }
 
 void
@@ -757,6 +779,8 @@ shadow_set_non_matching_range(app_pc start, size_t size, uint val, uint val_not)
             shadow_set_byte(&info, cur, val);
         }
     }
+    if (val == SHADOW_UNADDRESSABLE)
+        shadow_hoist_ranges_invalidate(start, end);
 }
 
 static uint dqword_to_val(uint dqword)
@@ -1513,6 +1537,21 @@ typedef unsigned short shadow_reg_type_t;
 typedef byte shadow_reg_type_t;
 #endif
 
+#ifdef TOOL_DR_MEMORY
+/* A range proven addressable by a hoisted loop check (-hoist_loop_checks).
+ * The fastpath reads these straight from TLS.
+ */
+typedef struct _shadow_hoist_range_t {
+    app_pc lo;
+    app_pc hi;
+    /* Only the bottom 32 bits of the pc, so we can use an immed */
+    uint site;
+    /* The range is only valid while hoist_epoch still equals this */
+    uint epoch;
+    uint retry;
+} shadow_hoist_range_t;
+#endif
+
 /* We keep our shadow register bits in TLS */
 typedef struct _shadow_registers_t {
 #ifdef TOOL_DR_MEMORY
@@ -1550,6 +1589,8 @@ typedef struct _shadow_registers_t {
      * shadow memory.
      */
     shadow_aux_registers_t *aux;
+    /* Ranges found addressable by hoisted loop checks */
+    shadow_hoist_range_t hoist[SHADOW_HOIST_SLOTS];
 #else
     /* Avoid empty struct.  FIXME: this is a waste of a tls slot */
     void *bogus;
@@ -1566,6 +1607,17 @@ static uint tls_shadow_base;
 static int tls_idx_shadow = -1;
 
 #ifdef TOOL_DR_MEMORY
+/* Incremented whenever memory inside hoist_bounds becomes unaddressable,
+ * which invalidates every thread's hoisted ranges (-hoist_loop_checks).
+ */
+static volatile int hoist_epoch;
+/* Covers every range that may have been proven at the current hoist_epoch.
+ * Empty when hoist_bounds_lo == hoist_bounds_hi.  Written under hoist_lock.
+ */
+static app_pc volatile hoist_bounds_lo;
+static app_pc volatile hoist_bounds_hi;
+static void *hoist_lock;
+
 /* For xmm this points at the shadow aux ptr: need a de-ref */
 opnd_t
 opnd_create_shadow_reg_slot(reg_id_t reg)
@@ -1646,6 +1698,37 @@ opnd_create_shadow_inheap_slot(void)
           * Core or Core2, and P4 doesn't care that much */
          false, true, false);
 }
+
+opnd_t
+opnd_create_shadow_hoist_slot(uint slot, shadow_hoist_field_t field)
+{
+    uint offs = offsetof(shadow_registers_t, hoist) + slot*sizeof(shadow_hoist_range_t);
+    opnd_size_t opsz = OPSZ_PTR;
+    ASSERT(options.shadowing && slot < SHADOW_HOIST_SLOTS, "incorrectly called");
+    if (field == SHADOW_HOIST_LO)
+        offs += offsetof(shadow_hoist_range_t, lo);
+    else if (field == SHADOW_HOIST_HI)
+        offs += offsetof(shadow_hoist_range_t, hi);
+    else {
+        if (field == SHADOW_HOIST_SITE)
+            offs += offsetof(shadow_hoist_range_t, site);
+        else if (field == SHADOW_HOIST_EPOCH)
+            offs += offsetof(shadow_hoist_range_t, epoch);
+        else
+            offs += offsetof(shadow_hoist_range_t, retry);
+        opsz = OPSZ_4;
+    }
+    return opnd_create_far_base_disp_ex
+        (tls_shadow_seg, REG_NULL, REG_NULL, 1, tls_shadow_base + offs, opsz,
+         false, true, false);
+}
+
+opnd_t
+opnd_create_shadow_hoist_epoch(void)
+{
+    ASSERT(options.hoist_loop_checks, "incorrectly called");
+    return OPND_CREATE_ABSMEM((void *)&hoist_epoch, OPSZ_4);
+}
 #endif /* TOOL_DR_MEMORY */
 
 #if defined(TOOL_DR_MEMORY) || defined(WINDOWS)
@@ -1659,6 +1742,86 @@ get_shadow_registers(void)
 }
 #endif /* TOOL_DR_MEMORY || WINDOWS */
 
+#ifdef TOOL_DR_MEMORY
+/* The fastpath skips its shadow lookup for an address inside a range cached
+ * here, so a cached range must be dropped as soon as any of its memory becomes
+ * unaddressable.  This runs on every malloc and free, so rather than visiting
+ * other threads we bump the epoch: each range records the epoch at which it
+ * was proven and the fastpath treats it as a miss once the two differ.  To
+ * avoid throwing away every thread's ranges whenever some unrelated chunk is
+ * allocated or freed, we only bump when [start, end) overlaps hoist_bounds,
+ * which covers all ranges proven since the last bump.
+ *
+ * A thread caching a range extends hoist_bounds before checking the range's
+ * shadow, and we read hoist_bounds only after writing our shadow, with a
+ * barrier on each side: so either we see the extended bounds and bump the
+ * epoch, or the other thread sees our unaddressable shadow.
+ */
+static void
+shadow_hoist_ranges_invalidate(app_pc start, app_pc end)
+{
+    if (!options.hoist_loop_checks)
+        return;
+    MEMORY_BARRIER();
+    if (start >= hoist_bounds_hi || end <= hoist_bounds_lo)
+        return;
+    dr_mutex_lock(hoist_lock);
+    if (start < hoist_bounds_hi && end > hoist_bounds_lo) {
+        LOG(3, "hoisted ranges in "PFX"-"PFX" invalidated by "PFX"-"PFX"\n",
+            hoist_bounds_lo, hoist_bounds_hi, start, end);
+        ATOMIC_INC32(hoist_epoch);
+        /* every range proven so far is now stale */
+        hoist_bounds_lo = NULL;
+        hoist_bounds_hi = NULL;
+    }
+    dr_mutex_unlock(hoist_lock);
+}
+
+uint
+shadow_hoist_epoch(app_pc lo, app_pc hi)
+{
+    uint epoch;
+    dr_mutex_lock(hoist_lock);
+    if (hoist_bounds_lo == hoist_bounds_hi) {
+        hoist_bounds_lo = lo;
+        hoist_bounds_hi = hi;
+    } else {
+        if (lo < hoist_bounds_lo)
+            hoist_bounds_lo = lo;
+        if (hi > hoist_bounds_hi)
+            hoist_bounds_hi = hi;
+    }
+    epoch = (uint) hoist_epoch;
+    dr_mutex_unlock(hoist_lock);
+    /* publish the bounds before the caller reads any shadow */
+    MEMORY_BARRIER();
+    return epoch;
+}
+
+void
+shadow_hoist_range_set(uint slot, app_pc lo, app_pc hi, uint epoch)
+{
+    shadow_registers_t *sr = get_shadow_registers();
+    ASSERT(options.hoist_loop_checks && slot < SHADOW_HOIST_SLOTS, "invalid slot");
+    /* Only this thread reads its slots, so there is no need to synchronize.
+     * If the epoch already moved the fastpath will just miss again.
+     */
+    sr->hoist[slot].lo = lo;
+    sr->hoist[slot].hi = hi;
+    sr->hoist[slot].epoch = epoch;
+    sr->hoist[slot].site = 0;
+}
+
+void
+shadow_hoist_range_decline(uint slot, uint site)
+{
+    shadow_registers_t *sr = get_shadow_registers();
+    ASSERT(options.hoist_loop_checks && slot < SHADOW_HOIST_SLOTS, "invalid slot");
+    sr->hoist[slot].site = site;
+    sr->hoist[slot].retry = SHADOW_HOIST_DECLINE_RETRY;
+}
+#endif /* TOOL_DR_MEMORY */
+
 static void
 shadow_registers_thread_init(void *drcontext)
 {
@@ -1710,6 +1873,7 @@ shadow_registers_thread_init(void *drcontext)
 #endif
     }
     sr->in_heap_routine = 0;
+    memset(sr->hoist, 0, sizeof(sr->hoist));
 #endif /* TOOL_DR_MEMORY */
 
     /* store in per-thread data struct so we can access from another thread */
@@ -1740,6 +1904,10 @@ shadow_registers_init(void)
 #ifdef X86
     ASSERT(tls_shadow_seg == EXPECTED_SEG_TLS, "unexpected tls segment");
 #endif
+#ifdef TOOL_DR_MEMORY
+    if (options.hoist_loop_checks)
+        hoist_lock = dr_mutex_create();
+#endif
 }
 
 static void
@@ -1749,6 +1917,10 @@ shadow_registers_exit(void)
         dr_raw_tls_cfree(tls_shadow_base, NUM_SHADOW_TLS_SLOTS);
     ASSERT(ok, "WARNING: unable to free tls slots");
     drmgr_unregister_tls_field(tls_idx_shadow);
+#ifdef TOOL_DR_MEMORY
+    if (hoist_lock != NULL)
+        dr_mutex_destroy(hoist_lock);
+#endif
 }
 
 #ifdef TOOL_DR_MEMORY
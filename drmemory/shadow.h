@@ -319,6 +319,49 @@ opnd_create_shadow_eflags_slot(void);
 opnd_t
 opnd_create_shadow_inheap_slot(void);
 
+/* Ranges found addressable by hoisted loop checks (-hoist_loop_checks) are
+ * cached per thread in this many TLS slots.
+ */
+#define SHADOW_HOIST_SLOTS 2
+
+typedef enum {
+    SHADOW_HOIST_LO,    /* start of the cached range */
+    SHADOW_HOIST_HI,    /* end of the cached range */
+    SHADOW_HOIST_SITE,  /* low 32 bits of the last site that declined the slot */
+    SHADOW_HOIST_EPOCH, /* shadow_hoist_epoch() at which the range was proven */
+    SHADOW_HOIST_RETRY, /* misses left before the declined site tries again */
+} shadow_hoist_field_t;
+
+/* A declined site tries to hoist again after this many misses */
+#define SHADOW_HOIST_DECLINE_RETRY 1024
+
+opnd_t
+opnd_create_shadow_hoist_slot(uint slot, shadow_hoist_field_t field);
+
+/* The current shadow_hoist_epoch(), for comparing to SHADOW_HOIST_EPOCH inline */
+opnd_t
+opnd_create_shadow_hoist_epoch(void);
+
+/* Registers [lo, hi) as about to be checked and returns a token to pass to
+ * shadow_hoist_range_set() along with any part of it found addressable.
+ * Must be called before reading the range's shadow.
+ */
+uint
+shadow_hoist_epoch(app_pc lo, app_pc hi);
+
+/* Caches [lo, hi) in the current thread's hoist slot, unless any memory
+ * in the registered range became unaddressable since epoch was obtained from
+ * shadow_hoist_epoch().
+ */
+void
+shadow_hoist_range_set(uint slot, app_pc lo, app_pc hi, uint epoch);
+
+/* Records that site should not try to hoist into slot again for the next
+ * SHADOW_HOIST_DECLINE_RETRY misses
+ */
+void
+shadow_hoist_range_decline(uint slot, uint site);
+
 /* Note that any SHADOW_UNADDRESSABLE bit pairs simply mean it's
  * a sub-register.
  * For ymm registers, returns only the shadow for the high 128 bits --
@@ -108,6 +108,16 @@ uint reg_spill_own;
 uint reg_spill_used_in_bb;
 uint reg_spill_unused_in_bb;
 uint addressable_checks_elided;
+uint redundant_checks_elided;
+uint hoisted_loop_refs;
+uint hoist_range_calls;
+uint hoist_range_proven;
+uint hoist_range_declined;
+uint adaptive_bbs_unaddr_only;
+uint adaptive_bbs_full;
+uint adaptive_upgrades;
+uint replace_bulk_fast;
+uint replace_bulk_declined;
 uint aflags_saved_at_top;
 uint xl8_shared;
 uint xl8_not_shared_reg_conflict;
@@ -122,6 +132,9 @@ uint xl8_shared_slowpath_count;
 uint slowpath_unaligned;
 uint slowpath_8_at_border;
 uint num_bbs;
+uint decode_cache_hits;
+uint decode_cache_misses;
+uint decode_cache_flushes;
 #endif
 
 /***************************************************************************
@@ -450,10 +463,12 @@ opnd_uses_nonignorable_memory(opnd_t opnd)
              opnd_is_far_memory_reference(opnd)));
 }
 
-/* Called by slow_path() after initial decode.  Expected to free inst. */
+/* Called by slow_path() after initial decode.  Expected to free inst if
+ * free_inst is set (it is not set when inst is owned by the decode cache).
+ */
 bool
 slow_path_without_uninitialized(void *drcontext, dr_mcontext_t *mc, instr_t *inst,
-                                app_loc_t *loc, size_t instr_sz)
+                                app_loc_t *loc, size_t instr_sz, bool free_inst)
 {
     opnd_t opnd, memop = opnd_create_null();
     int opc, i, num_srcs, num_dsts;
@@ -491,7 +506,8 @@ slow_path_without_uninitialized(void *drcontext, dr_mcontext_t *mc, instr_t *ins
         }
     }
 
-    instr_free(drcontext, inst);
+    if (free_inst)
+        instr_free(drcontext, inst);
 
     /* call this last after freeing inst in case it does a synchronous flush */
     slow_path_xl8_sharing(loc, instr_sz, memop, mc);
@@ -500,6 +516,210 @@ slow_path_without_uninitialized(void *drcontext, dr_mcontext_t *mc, instr_t *ins
 }
 #endif /* TOOL_DR_MEMORY */
 
+/***************************************************************************
+ * Decoded instruction cache
+ *
+ * Hot loops that cannot use the fastpath keep coming back to the slowpath
+ * for the same handful of app instrs, each time paying for a full decode
+ * plus re-deriving the same operand analysis.  We keep a small direct-mapped
+ * per-thread cache from decode pc to the decoded instr and the instr-only
+ * parts of slow_path_with_mc()'s setup.
+ *
+ * An entry is only used if the raw bytes still match, which handles
+ * non-precise flushing where a new bb for modified code can reach the
+ * slowpath before the old fragment's deletion event.  Fragment deletion and
+ * module unload log the app range going away in a small ring and bump a
+ * global epoch.  Each thread drops just its entries in the ranges logged
+ * since the epoch it last saw, so we never touch another thread's cache.  If
+ * the thread is so far behind that the ring has wrapped it drops everything.
+ */
+
+#define DECODE_CACHE_BITS 8
+#define DECODE_CACHE_SIZE (1 << DECODE_CACHE_BITS)
+#define DECODE_CACHE_IDX(pc) \
+    ((((ptr_uint_t)(pc)) ^ (((ptr_uint_t)(pc)) >> DECODE_CACHE_BITS)) & \
+     (DECODE_CACHE_SIZE - 1))
+#define DECODE_CACHE_MAX_RAW IF_X86_ELSE(17, 4)
+
+typedef struct _decode_cache_entry_t {
+    app_pc decode_pc; /* NULL if the entry is empty */
+    instr_t *inst;    /* allocated on first use; owned by the cache */
+    size_t instr_sz;
+    byte raw[DECODE_CACHE_MAX_RAW];
+#ifdef TOOL_DR_MEMORY
+    /* Results of the per-instr analysis in slow_path_with_mc() */
+    bool analyzed;
+    bool check_definedness;
+    bool always_defined;
+    bool pushpop;
+    bool check_srcs_after;
+    shadow_combine_t comb; /* template from shadow_combine_init() */
+#endif
+} decode_cache_entry_t;
+
+typedef struct _decode_cache_t {
+    uint epoch;
+    decode_cache_entry_t entry[DECODE_CACHE_SIZE];
+} decode_cache_t;
+
+#define DECODE_CACHE_RANGES 32 /* power of 2 */
+
+typedef struct _decode_cache_range_t {
+    app_pc start;
+    app_pc end;
+} decode_cache_range_t;
+
+static int tls_idx_decode_cache = -1;
+/* Protects decode_cache_range[] and writes to decode_cache_epoch */
+static void *decode_cache_lock;
+/* Range removed by the invalidation that moved the epoch to idx+1 */
+static decode_cache_range_t decode_cache_range[DECODE_CACHE_RANGES];
+static volatile uint decode_cache_epoch;
+
+void
+slowpath_init(void)
+{
+    if (!options.slowpath_decode_cache)
+        return;
+    tls_idx_decode_cache = drmgr_register_tls_field();
+    ASSERT(tls_idx_decode_cache > -1, "unable to reserve TLS slot");
+    decode_cache_lock = dr_mutex_create();
+}
+
+void
+slowpath_exit(void)
+{
+    if (tls_idx_decode_cache > -1) {
+        drmgr_unregister_tls_field(tls_idx_decode_cache);
+        dr_mutex_destroy(decode_cache_lock);
+    }
+}
+
+void
+slowpath_thread_init(void *drcontext)
+{
+    decode_cache_t *cache;
+    if (tls_idx_decode_cache < 0)
+        return;
+    cache = (decode_cache_t *) thread_alloc(drcontext, sizeof(*cache), HEAPSTAT_PERBB);
+    memset(cache, 0, sizeof(*cache));
+    cache->epoch = decode_cache_epoch;
+    drmgr_set_tls_field(drcontext, tls_idx_decode_cache, (void *)cache);
+}
+
+static void
+decode_cache_clear(void *drcontext, decode_cache_t *cache, bool free_instrs)
+{
+    uint i;
+    for (i = 0; i < DECODE_CACHE_SIZE; i++) {
+        decode_cache_entry_t *entry = &cache->entry[i];
+        entry->decode_pc = NULL;
+        if (entry->inst != NULL && free_instrs) {
+            instr_destroy(drcontext, entry->inst);
+            entry->inst = NULL;
+        }
+    }
+}
+
+void
+slowpath_thread_exit(void *drcontext)
+{
+    decode_cache_t *cache;
+    if (tls_idx_decode_cache < 0)
+        return;
+    cache = (decode_cache_t *) drmgr_get_tls_field(drcontext, tls_idx_decode_cache);
+    if (cache == NULL)
+        return;
+    decode_cache_clear(drcontext, cache, true/*free*/);
+    drmgr_set_tls_field(drcontext, tls_idx_decode_cache, NULL);
+    thread_free(drcontext, cache, sizeof(*cache), HEAPSTAT_PERBB);
+}
+
+/* Called on fragment deletion and module unload, possibly from a thread
+ * other than the cache owners: so we only log the range here.
+ */
+void
+slowpath_decode_cache_invalidate(app_pc start, app_pc end)
+{
+    decode_cache_range_t *range;
+    if (tls_idx_decode_cache < 0)
+        return;
+    dr_mutex_lock(decode_cache_lock);
+    range = &decode_cache_range[decode_cache_epoch & (DECODE_CACHE_RANGES - 1)];
+    range->start = start;
+    range->end = end;
+    decode_cache_epoch++;
+    dr_mutex_unlock(decode_cache_lock);
+}
+
+/* Drops the entries in the ranges invalidated since cache->epoch */
+static void
+decode_cache_catch_up(void *drcontext, decode_cache_t *cache)
+{
+    uint epoch, i;
+    dr_mutex_lock(decode_cache_lock);
+    epoch = decode_cache_epoch;
+    if (epoch - cache->epoch > DECODE_CACHE_RANGES) {
+        /* keep the instr_t allocations for re-use */
+        decode_cache_clear(drcontext, cache, false/*keep*/);
+        STATS_INC(decode_cache_flushes);
+    } else {
+        for (; cache->epoch != epoch; cache->epoch++) {
+            decode_cache_range_t *range =
+                &decode_cache_range[cache->epoch & (DECODE_CACHE_RANGES - 1)];
+            for (i = 0; i < DECODE_CACHE_SIZE; i++) {
+                if (cache->entry[i].decode_pc >= range->start &&
+                    cache->entry[i].decode_pc < range->end)
+                    cache->entry[i].decode_pc = NULL;
+            }
+        }
+    }
+    cache->epoch = epoch;
+    dr_mutex_unlock(decode_cache_lock);
+}
+
+/* Returns the cache entry holding the decoded instr at decode_pc, decoding
+ * and filling the entry on a miss.  Returns NULL if the cache is disabled
+ * or the instr cannot be cached, in which case the caller must decode on
+ * its own.  The returned instr remains owned by the cache.
+ */
+static decode_cache_entry_t *
+decode_cache_lookup(void *drcontext, app_pc decode_pc)
+{
+    decode_cache_t *cache;
+    decode_cache_entry_t *entry;
+    app_pc next_pc;
+    if (tls_idx_decode_cache < 0)
+        return NULL;
+    cache = (decode_cache_t *) drmgr_get_tls_field(drcontext, tls_idx_decode_cache);
+    if (cache == NULL)
+        return NULL;
+    if (cache->epoch != decode_cache_epoch)
+        decode_cache_catch_up(drcontext, cache);
+    entry = &cache->entry[DECODE_CACHE_IDX(decode_pc)];
+    if (entry->decode_pc == decode_pc &&
+        memcmp(decode_pc, entry->raw, entry->instr_sz) == 0) {
+        STATS_INC(decode_cache_hits);
+        return entry;
+    }
+    STATS_INC(decode_cache_misses);
+    entry->decode_pc = NULL;
+    if (entry->inst == NULL)
+        entry->inst = instr_create(drcontext);
+    else
+        instr_reset(drcontext, entry->inst);
+    next_pc = decode(drcontext, decode_pc, entry->inst);
+    if (next_pc == NULL || next_pc - decode_pc > sizeof(entry->raw))
+        return NULL;
+    entry->instr_sz = next_pc - decode_pc;
+    memcpy(entry->raw, decode_pc, entry->instr_sz);
+#ifdef TOOL_DR_MEMORY
+    entry->analyzed = false;
+#endif
+    entry->decode_pc = decode_pc;
+    return entry;
+}
+
 /* Does everything in C code, except for handling non-push/pop writes to esp.
  *
  * General design:
@@ -524,9 +744,12 @@ slow_path_without_uninitialized(void *drcontext, dr_mcontext_t *mc, instr_t *ins
 bool
 slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *mc)
 {
-    instr_t inst;
+    instr_t local_inst;
+    instr_t *inst;
+    decode_cache_entry_t *cached;
     int opc;
 #ifdef TOOL_DR_MEMORY
+    size_t instr_sz;
     opnd_t opnd;
     int i, num_srcs, num_dsts;
     uint sz;
@@ -535,7 +758,6 @@ slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *m
     bool check_srcs_after;
     bool always_defined;
     opnd_t memop = opnd_create_null();
-    size_t instr_sz;
     cls_drmem_t *cpt = (cls_drmem_t *) drmgr_get_cls_field(drcontext, cls_idx_drmem);
 #endif
     app_loc_t loc;
@@ -572,30 +794,37 @@ slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *m
     }
 #endif /* TOOL_DR_MEMORY */
 
-    instr_init(drcontext, &inst);
+    cached = decode_cache_lookup(drcontext, decode_pc);
+    if (cached != NULL) {
+        inst = cached->inst;
+        IF_DRMEM(instr_sz = cached->instr_sz);
+    } else {
+        inst = &local_inst;
+        instr_init(drcontext, inst);
 #ifdef TOOL_DR_MEMORY
-    instr_sz = decode(drcontext, decode_pc, &inst) - decode_pc;
+        instr_sz = decode(drcontext, decode_pc, inst) - decode_pc;
 #else
-    decode(drcontext, decode_pc, &inst);
+        decode(drcontext, decode_pc, inst);
 #endif
-    ASSERT(instr_valid(&inst), "invalid instr");
-    opc = instr_get_opcode(&inst);
+    }
+    ASSERT(instr_valid(inst), "invalid instr");
+    opc = instr_get_opcode(inst);
 
     slowpath_update_app_loc_arch(opc, decode_pc, &loc);
 
 #ifdef STATISTICS
     STATS_INC(slowpath_count[opc]);
     {
-        uint bytes = instr_memory_reference_size(&inst);
+        uint bytes = instr_memory_reference_size(inst);
         if (bytes == 0) {
-            if (instr_num_dsts(&inst) > 0 &&
-                !opnd_is_pc(instr_get_dst(&inst, 0)) &&
-                !opnd_is_instr(instr_get_dst(&inst, 0)))
-                bytes = opnd_size_in_bytes(opnd_get_size(instr_get_dst(&inst, 0)));
-            else if (instr_num_srcs(&inst) > 0 &&
-                     !opnd_is_pc(instr_get_src(&inst, 0)) &&
-                     !opnd_is_instr(instr_get_src(&inst, 0)))
-                bytes = opnd_size_in_bytes(opnd_get_size(instr_get_src(&inst, 0)));
+            if (instr_num_dsts(inst) > 0 &&
+                !opnd_is_pc(instr_get_dst(inst, 0)) &&
+                !opnd_is_instr(instr_get_dst(inst, 0)))
+                bytes = opnd_size_in_bytes(opnd_get_size(instr_get_dst(inst, 0)));
+            else if (instr_num_srcs(inst) > 0 &&
+                     !opnd_is_pc(instr_get_src(inst, 0)) &&
+                     !opnd_is_instr(instr_get_src(inst, 0)))
+                bytes = opnd_size_in_bytes(opnd_get_size(instr_get_src(inst, 0)));
             else
                 bytes = 0;
         }
@@ -618,25 +847,27 @@ slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *m
 
     DOLOG(3, {
         LOG(3, "\nslow_path "PFX": ", pc);
-        instr_disassemble(drcontext, &inst, LOGFILE_GET(drcontext));
-        if (instr_num_dsts(&inst) > 0 &&
-            opnd_is_memory_reference(instr_get_dst(&inst, 0))) {
+        instr_disassemble(drcontext, inst, LOGFILE_GET(drcontext));
+        if (instr_num_dsts(inst) > 0 &&
+            opnd_is_memory_reference(instr_get_dst(inst, 0))) {
             umbra_shadow_memory_info_t info;
             umbra_shadow_memory_info_init(&info);
             LOG(3, " | 0x%x",
                 shadow_get_byte(&info,
-                                opnd_compute_address(instr_get_dst(&inst, 0),
+                                opnd_compute_address(instr_get_dst(inst, 0),
                                                      mc)));
         }
         LOG(3, "\n");
     });
 
 #ifdef TOOL_DR_HEAPSTAT
-    return slow_path_for_staleness(drcontext, mc, &inst, &loc);
+    return slow_path_for_staleness(drcontext, mc, inst, &loc, cached == NULL);
 
 #else
-    if (!options.check_uninitialized)
-        return slow_path_without_uninitialized(drcontext, mc, &inst, &loc, instr_sz);
+    if (!options.check_uninitialized) {
+        return slow_path_without_uninitialized(drcontext, mc, inst, &loc, instr_sz,
+                                               cached == NULL);
+    }
 
     LOG(4, "shadow registers prior to instr:\n");
     DOLOG(4, { print_shadow_registers(); });
@@ -659,28 +890,47 @@ slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *m
      * definedness to.  If there are more, we can fit them side by
      * side in our 8-dword-capacity comb->dst array.
      */
-    check_definedness = instr_check_definedness(&inst);
-    always_defined = result_is_always_defined(&inst, false/*us*/);
-    pushpop = opc_is_push(opc) || opc_is_pop(opc);
-    check_srcs_after = instr_needs_all_srcs_and_vals(&inst);
-    if (check_srcs_after) {
-        /* We need to check definedness of addressing registers, and so we do
-         * our normal src loop but we do not check undefinedness or combine
-         * sources.  Below we pass pointers to later in comb->dst to
-         * check_mem_opnd() and integrate_register_shadow(), causing the 2
-         * sources to be laid out side-by-side in comb->dst.
-         */
-        ASSERT(instr_num_srcs(&inst) == 2, "and/or special handling error");
-        check_definedness = false;
-        IF_DEBUG(comb.opsz = 0;) /* for asserts below */
-    }
+    if (cached != NULL && cached->analyzed) {
+        /* None of this depends on the machine state */
+        check_definedness = cached->check_definedness;
+        always_defined = cached->always_defined;
+        pushpop = cached->pushpop;
+        check_srcs_after = cached->check_srcs_after;
+        comb = cached->comb;
+        comb.dst = comb.raw;
+    } else {
+        check_definedness = instr_check_definedness(inst);
+        always_defined = result_is_always_defined(inst, false/*us*/);
+        pushpop = opc_is_push(opc) || opc_is_pop(opc);
+        check_srcs_after = instr_needs_all_srcs_and_vals(inst);
+        if (check_srcs_after) {
+            /* We need to check definedness of addressing registers, and so we do
+             * our normal src loop but we do not check undefinedness or combine
+             * sources.  Below we pass pointers to later in comb->dst to
+             * check_mem_opnd() and integrate_register_shadow(), causing the 2
+             * sources to be laid out side-by-side in comb->dst.
+             */
+            ASSERT(instr_num_srcs(inst) == 2, "and/or special handling error");
+            check_definedness = false;
+            IF_DEBUG(comb.opsz = 0;) /* for asserts below */
+        }
 
-    shadow_combine_init(&comb, &inst, opc, OPND_SHADOW_ARRAY_LEN);
+        shadow_combine_init(&comb, inst, opc, OPND_SHADOW_ARRAY_LEN);
 
-    num_srcs = num_true_srcs(&inst, mc);
+        if (cached != NULL) {
+            cached->check_definedness = check_definedness;
+            cached->always_defined = always_defined;
+            cached->pushpop = pushpop;
+            cached->check_srcs_after = check_srcs_after;
+            cached->comb = comb;
+            cached->analyzed = true;
+        }
+    }
+
+    num_srcs = num_true_srcs(inst, mc);
 #ifdef X86
     if (opc == OP_lea)
-        num_srcs = IF_X64_ELSE(opnd_is_rel_addr(instr_get_src(&inst, 0)), false) ? 0 : 2;
+        num_srcs = IF_X64_ELSE(opnd_is_rel_addr(instr_get_src(inst, 0)), false) ? 0 : 2;
 #endif
  check_srcs:
     for (i = 0; i < num_srcs; i++) {
@@ -689,15 +939,15 @@ slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *m
              * code below can handle REG_NULL
              */
             if (i == 0)
-                opnd = opnd_create_reg(opnd_get_base(instr_get_src(&inst, 0)));
+                opnd = opnd_create_reg(opnd_get_base(instr_get_src(inst, 0)));
             else
-                opnd = opnd_create_reg(opnd_get_index(instr_get_src(&inst, 0)));
+                opnd = opnd_create_reg(opnd_get_index(instr_get_src(inst, 0)));
         } else {
-            opnd = instr_get_src(&inst, i);
+            opnd = instr_get_src(inst, i);
         }
         if (opnd_is_memory_reference(opnd)) {
             int flags = 0;
-            opnd = adjust_memop(&inst, opnd, false, &sz, &pushpop_stackop);
+            opnd = adjust_memop(inst, opnd, false, &sz, &pushpop_stackop);
             /* do not combine srcs if checking after */
             if (check_srcs_after) {
                 ASSERT(i == 0 || sz >= comb.opsz, "check-after needs >=-size srcs");
@@ -713,7 +963,7 @@ slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *m
             if (always_defined) {
                 LOG(2, "marking and/or/xor with 0/~0/self as defined @"PFX"\n", pc);
                 /* w/o MEMREF_USE_VALUES, handle_mem_ref() will use SHADOW_DEFINED */
-            } else if (check_definedness || always_check_definedness(&inst, i)) {
+            } else if (check_definedness || always_check_definedness(inst, i)) {
                 flags |= MEMREF_CHECK_DEFINEDNESS;
                 if (options.leave_uninit)
                     flags |= MEMREF_USE_VALUES;
@@ -747,8 +997,8 @@ slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *m
                 if (always_defined) {
                     /* if result defined regardless, don't propagate (is
                      * equivalent to propagating SHADOW_DEFINED) or check */
-                } else if (check_definedness || always_check_definedness(&inst, i)) {
-                    check_register_defined(drcontext, reg, &loc, sz, mc, &inst);
+                } else if (check_definedness || always_check_definedness(inst, i)) {
+                    check_register_defined(drcontext, reg, &loc, sz, mc, inst);
                     if (options.leave_uninit) {
                         integrate_register_shadow(&comb, i, reg, shadow, pushpop);
                     }
@@ -771,14 +1021,14 @@ slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *m
     }
 
     /* eflags source */
-    if (TESTANY(EFLAGS_READ_ARITH, instr_get_eflags(&inst, DR_QUERY_DEFAULT))) {
+    if (TESTANY(EFLAGS_READ_ARITH, instr_get_eflags(inst, DR_QUERY_DEFAULT))) {
         uint shadow = get_shadow_eflags();
         /* for check_srcs_after we leave comb.dst where it last was */
         if (always_defined) {
             /* if result defined regardless, don't propagate (is
              * equivalent to propagating SHADOW_DEFINED) or check */
         } else if (check_definedness) {
-            check_register_defined(drcontext, REG_EFLAGS, &loc, 1, mc, &inst);
+            check_register_defined(drcontext, REG_EFLAGS, &loc, 1, mc, inst);
             if (options.leave_uninit)
                 integrate_register_shadow(&comb, 0, REG_EFLAGS, shadow, pushpop);
         } else {
@@ -797,10 +1047,10 @@ slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *m
 
     if (check_srcs_after) {
         /* turn back on for dsts */
-        check_definedness = instr_check_definedness(&inst);
-        if (check_andor_sources(drcontext, mc, &inst, &comb, decode_pc + instr_sz)) {
+        check_definedness = instr_check_definedness(inst);
+        if (check_andor_sources(drcontext, mc, inst, &comb, decode_pc + instr_sz)) {
             if (TESTANY(EFLAGS_WRITE_ARITH,
-                        instr_get_eflags(&inst, DR_QUERY_INCLUDE_ALL))) {
+                        instr_get_eflags(inst, DR_QUERY_INCLUDE_ALL))) {
                 /* We have to redo the eflags propagation.  map_src_to_dst() combined
                  * all the laid-out sources, some of which we made defined in
                  * check_andor_sources.
@@ -837,12 +1087,12 @@ slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *m
         }
     }
 
-    num_dsts = num_true_dsts(&inst, mc);
+    num_dsts = num_true_dsts(inst, mc);
     for (i = 0; i < num_dsts; i++) {
-        opnd = instr_get_dst(&inst, i);
+        opnd = instr_get_dst(inst, i);
         if (opnd_is_memory_reference(opnd)) {
             int flags = MEMREF_WRITE;
-            opnd = adjust_memop(&inst, opnd, true, &sz, &pushpop_stackop);
+            opnd = adjust_memop(inst, opnd, true, &sz, &pushpop_stackop);
             if (pushpop_stackop)
                 flags |= MEMREF_PUSHPOP;
             if (cpt->mem2fpmm_source != NULL && cpt->mem2fpmm_pc == pc) {
@@ -884,14 +1134,29 @@ slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *m
         } else
             ASSERT(opnd_is_immed_int(opnd) || opnd_is_pc(opnd), "unexpected opnd");
     }
-    if (TESTANY(EFLAGS_WRITE_ARITH, instr_get_eflags(&inst, DR_QUERY_INCLUDE_ALL))) {
+    if (TESTANY(EFLAGS_WRITE_ARITH, instr_get_eflags(inst, DR_QUERY_INCLUDE_ALL))) {
         set_shadow_eflags(comb.eflags);
     }
 
     LOG(4, "shadow registers after instr:\n");
     DOLOG(4, { print_shadow_registers(); });
 
-    instr_free(drcontext, &inst);
+    if (cached == NULL)
+        instr_free(drcontext, inst);
+
+    if (options.adaptive_uninit && !always_defined) {
+        /* upgrade instrs that move undefined data out of the check-only tier.
+         * SHADOW_DEFINED_BITLEVEL is a placeholder for unwritten parts of a
+         * sub-reg dst, not undefined data.
+         */
+        bool saw_undefined = (comb.eflags == SHADOW_UNDEFINED);
+        for (i = 0; i < OPND_SHADOW_ARRAY_LEN && !saw_undefined; i++) {
+            if (comb.dst[i] == SHADOW_UNDEFINED)
+                saw_undefined = true;
+        }
+        if (saw_undefined)
+            slow_path_adaptive_upgrade(&loc);
+    }
 
     /* call this last after freeing inst in case it does a synchronous flush */
     slow_path_xl8_sharing(&loc, instr_sz, memop, mc);
@@ -951,6 +1216,9 @@ slow_path(app_pc pc, app_pc decode_pc)
     dr_get_mcontext(drcontext, &mc);
     res = slow_path_with_mc(drcontext, pc, decode_pc, &mc);
 #ifdef TOOL_DR_MEMORY
+    /* compute-bound code may rarely make syscalls */
+    if (options.sample_rate < 100)
+        instrument_sample_maybe_rotate();
     DODEBUG({
         cls_drmem_t *cpt = (cls_drmem_t *) drmgr_get_cls_field(drcontext, cls_idx_drmem);
         /* Try to ensure that mem2fpmm_source doesn't "escape" */
@@ -1894,6 +2162,7 @@ slowpath_module_load(void *drcontext, const module_data_t *mod, bool loaded)
 void
 slowpath_module_unload(void *drcontext, const module_data_t *mod)
 {
+    slowpath_decode_cache_invalidate(mod->start, mod->end);
 #ifdef WINDOWS
     if (_stricmp("rsaenh.dll", dr_module_preferred_name(mod)) == 0) {
         rsaenh_base = (app_pc) POINTER_MAX;
@@ -135,6 +135,16 @@ extern uint reg_spill_own;
 extern uint reg_spill_used_in_bb;
 extern uint reg_spill_unused_in_bb;
 extern uint addressable_checks_elided;
+extern uint redundant_checks_elided;
+extern uint hoisted_loop_refs;
+extern uint hoist_range_calls;
+extern uint hoist_range_proven;
+extern uint hoist_range_declined;
+extern uint adaptive_bbs_unaddr_only;
+extern uint adaptive_bbs_full;
+extern uint adaptive_upgrades;
+extern uint replace_bulk_fast;
+extern uint replace_bulk_declined;
 extern uint aflags_saved_at_top;
 extern uint num_faults;
 extern uint num_slowpath_faults;
@@ -150,6 +160,9 @@ extern uint xl8_shared_slowpath_instrs;
 extern uint xl8_shared_slowpath_count;
 extern uint slowpath_unaligned;
 extern uint slowpath_8_at_border;
+extern uint decode_cache_hits;
+extern uint decode_cache_misses;
+extern uint decode_cache_flushes;
 extern uint alloc_stack_count;
 extern uint delayed_free_bytes;
 extern uint num_bbs;
@@ -208,6 +221,22 @@ instrument_slowpath(void *drcontext, instrlist_t *bb, instr_t *inst, fastpath_in
 bool
 slow_path_with_mc(void *drcontext, app_pc pc, app_pc decode_pc, dr_mcontext_t *mc);
 
+void
+slowpath_init(void);
+
+void
+slowpath_exit(void);
+
+void
+slowpath_thread_init(void *drcontext);
+
+void
+slowpath_thread_exit(void *drcontext);
+
+/* Drops all threads' cached slowpath decodings in [start, end) (lazily) */
+void
+slowpath_decode_cache_invalidate(app_pc start, app_pc end);
+
 void
 slowpath_module_load(void *drcontext, const module_data_t *mod, bool loaded);
 
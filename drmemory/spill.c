@@ -1730,6 +1730,8 @@ fastpath_bottom_of_bb(void *drcontext, void *tag, instrlist_t *bb,
          * XXX DRi#772: could add flush callback and avoid this save
          */
         save->pattern_4byte_check_only = bi->pattern_4byte_check_only;
+        save->sample_skip = bi->sample_skip;
+        save->adaptive_unaddr_only = bi->adaptive_unaddr_only;
 
         /* we store the size and assume bbs are contiguous so we can free (i#260) */
         ASSERT(bi->first_app_pc != NULL, "first instr should have app pc");
@@ -30,6 +30,7 @@
 #include "syscall_os.h"
 #include "alloc.h"
 #include "perturb.h"
+#include "instru.h"
 #ifdef UNIX
 # include "sysnum_linux.h"
 #endif
@@ -509,6 +510,9 @@ event_pre_syscall(void *drcontext, int sysnum)
     if (options.perturb)
         res = perturb_pre_syscall(drcontext, sysnum) && res;
 
+    if (options.sample_rate < 100)
+        instrument_sample_maybe_rotate();
+
     return res;
 }
 
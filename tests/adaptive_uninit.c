@@ -0,0 +1,77 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* -adaptive_uninit: blocks start out checking only addressability, so the
+ * uninitialized read below is reported only once its block has been upgraded
+ * by loading undefined heap memory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SIZE 16
+#define ITERS 3
+
+static volatile int sink;
+
+static int
+sum_defined(int *p)
+{
+    int i, sum = 0;
+    for (i = 0; i < SIZE; i++)
+        sum += p[i];
+    return sum;
+}
+
+static int
+read_past(int *p)
+{
+    return p[SIZE]; /* error: unaddressable, found without an upgrade */
+}
+
+static int
+count_set(int *p)
+{
+    int i, count = 0;
+    for (i = 0; i < SIZE; i++) {
+        if (p[i] != 0) /* error: uninitialized, found after the upgrade */
+            count++;
+    }
+    return count;
+}
+
+int
+main()
+{
+    int *defined = malloc(SIZE * sizeof(int));
+    int *undefined = malloc(SIZE * sizeof(int));
+    int i;
+    for (i = 0; i < SIZE; i++)
+        defined[i] = i;
+    for (i = 0; i < ITERS; i++)
+        sink += sum_defined(defined);
+    sink += read_past(defined);
+    for (i = 0; i < ITERS; i++)
+        sink += count_set(undefined);
+    free(defined);
+    free(undefined);
+    printf("all done\n");
+    return 0;
+}
@@ -0,0 +1,94 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Replaced mem* and str* calls whose args are not fully defined must run
+ * the instrumented loop, which reports them, whether their size is below
+ * -replace_bulk_min and filtered out inline or above it and seen by the
+ * bulk clean call.  An undefined memset value must reach the dst shadow.
+ */
+#define SMALL 16   /* below the default -replace_bulk_min */
+#define LARGE 1024 /* above it */
+
+static char src[2 * LARGE];
+static char src2[2 * LARGE];
+static char dst[2 * LARGE];
+
+/* Returns base or base+1, undefined */
+static size_t
+undef_size(size_t base)
+{
+    char *u = malloc(1);
+    size_t res = base + (*u & 1);
+    free(u);
+    return res;
+}
+
+/* Returns 'x' or 'y', undefined */
+static int
+undef_value(void)
+{
+    char *u = malloc(1);
+    int res = 'x' + (*u & 1);
+    free(u);
+    return res;
+}
+
+int
+main()
+{
+    size_t small = undef_size(SMALL);
+    size_t large = undef_size(LARGE);
+    int val = undef_value();
+
+    memset(src, 'a', sizeof(src) - 1);
+    memset(src2, 'a', sizeof(src2) - 1);
+
+    memset(dst, 0, small);
+    memset(dst, 0, large);
+    memcpy(dst, src, small);
+    memcpy(dst, src, large);
+    memmove(dst, src, small);
+    memmove(dst, src, large);
+    if (strnlen(src, small) == 0)
+        printf("strnlen small error\n");
+    if (strnlen(src, large) == 0)
+        printf("strnlen large error\n");
+    if (strncmp(src, src2, small) != 0)
+        printf("strncmp small error\n");
+    if (strncmp(src, src2, large) != 0)
+        printf("strncmp large error\n");
+    if (strchr(src, val) != NULL)
+        printf("strchr error\n");
+
+    memset(dst, val, SMALL);
+    if (dst[SMALL / 2] == 'z')
+        printf("memset small error\n");
+    memset(dst, val, LARGE);
+    if (dst[LARGE / 2] == 'z')
+        printf("memset large error\n");
+
+    printf("all done\n");
+    return 0;
+}
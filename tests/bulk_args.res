@@ -0,0 +1,49 @@
+# **********************************************************
+# Copyright (c) 2026 Google, Inc.  All rights reserved.
+# **********************************************************
+#
+# Dr. Memory: the memory debugger
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation;
+# version 2.1 of the License, and no later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Library General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# each call below and above -replace_bulk_min with an undefined size
+UNINITIALIZED READ
+bulk_args.c:68
+UNINITIALIZED READ
+bulk_args.c:69
+UNINITIALIZED READ
+bulk_args.c:70
+UNINITIALIZED READ
+bulk_args.c:71
+UNINITIALIZED READ
+bulk_args.c:72
+UNINITIALIZED READ
+bulk_args.c:73
+UNINITIALIZED READ
+bulk_args.c:74
+UNINITIALIZED READ
+bulk_args.c:76
+UNINITIALIZED READ
+bulk_args.c:78
+UNINITIALIZED READ
+bulk_args.c:80
+# an unbounded str* call with an undefined arg
+UNINITIALIZED READ
+bulk_args.c:82
+# the undefined memset value reached dst on both sides
+UNINITIALIZED READ
+bulk_args.c:86
+UNINITIALIZED READ
+bulk_args.c:89
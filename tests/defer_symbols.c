@@ -0,0 +1,60 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Each error's top frame is a function that only has a name once symquery -r
+ * has symbolized the -defer_symbols results, so only it can tell which
+ * suppression matches which error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+int
+suppressed_by_name(int *p)
+{
+    return p[1]; /* error: suppressed by a Dr. Memory-format suppression */
+}
+
+int
+suppressed_by_valgrind(int *p)
+{
+    return p[1]; /* error: suppressed by a Valgrind-format suppression */
+}
+
+int
+reported(int *p)
+{
+    return p[1]; /* error: not suppressed */
+}
+
+int
+main()
+{
+    int *p = (int *) malloc(2 * sizeof(int));
+    /* avoid a gcc use-after-free warning */
+    int *volatile freed = p;
+    volatile int sum;
+    free(p);
+    sum = suppressed_by_name(freed);
+    sum += suppressed_by_valgrind(freed);
+    sum += reported(freed);
+    printf("all done\n");
+    return 0;
+}
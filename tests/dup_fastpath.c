@@ -0,0 +1,63 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Two errors whose callstacks share their top frame, for -dup_fastpath_frames 1:
+ * the early-recognition entry made for the first must not swallow the second.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SIZE 16
+#define ITERS 3
+
+static volatile int sink;
+
+static int
+read_past(char *p)
+{
+    return p[SIZE]; /* error: same pc for both callers */
+}
+
+static int
+caller_a(char *p)
+{
+    return read_past(p);
+}
+
+static int
+caller_b(char *p)
+{
+    return read_past(p);
+}
+
+int
+main()
+{
+    char *p = malloc(SIZE);
+    int i;
+    for (i = 0; i < ITERS; i++)
+        sink += caller_a(p);
+    for (i = 0; i < ITERS; i++)
+        sink += caller_b(p);
+    free(p);
+    printf("all done\n");
+    return 0;
+}
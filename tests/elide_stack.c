@@ -0,0 +1,61 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef ASM_CODE_ONLY /* C code ***********************************************/
+
+#include <stdio.h>
+
+/* Reads a frame slot, raises esp past it, and reads it again, all in one
+ * bb.  The second read is beyond the top of the stack, so its check must
+ * not be elided as a repeat of the first.
+ */
+void elide_stack_asm(void);
+
+int
+main()
+{
+    elide_stack_asm();
+    printf("all done\n");
+    return 0;
+}
+
+#else /* asm code *************************************************************/
+#include "cpp2asm_defines.h"
+START_FILE
+
+#define FUNCNAME elide_stack_asm
+/* void elide_stack_asm(void); */
+        DECLARE_FUNC(FUNCNAME)
+GLOBAL_LABEL(FUNCNAME:)
+        push     REG_XBP
+        mov      REG_XBP, REG_XSP
+        sub      REG_XSP, 16
+        mov      DWORD [REG_XBP - 8], 0
+        mov      eax, DWORD [REG_XBP - 8] /* checked: in the frame */
+        add      REG_XSP, 16
+        mov      eax, DWORD [REG_XBP - 8] /* error: now beyond TOS */
+        pop      REG_XBP
+        ret
+        END_FUNC(FUNCNAME)
+#undef FUNCNAME
+
+END_FILE
+#endif
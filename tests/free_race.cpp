@@ -0,0 +1,65 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Two threads race to delete the same malloc-ed chunk.  The one that finds
+ * the chunk reports the malloc/delete mismatch; the other must then see it
+ * as already freed.  Reporting the mismatch must not let the other thread
+ * in before the first is done with the chunk.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define NUM_THREADS 2
+#define ROUNDS 50
+
+/* All allocated up front so the real free of one cannot be re-used by another */
+static char *chunks[ROUNDS];
+static pthread_barrier_t barrier;
+
+static void *
+racer(void *arg)
+{
+    int i;
+    for (i = 0; i < ROUNDS; i++) {
+        pthread_barrier_wait(&barrier);
+        delete chunks[i]; /* error: mismatch in one thread, invalid in the other */
+    }
+    return NULL;
+}
+
+int
+main()
+{
+    pthread_t threads[NUM_THREADS];
+    int i;
+    printf("starting\n"); /* allocate the stdout buffer before we start */
+    for (i = 0; i < ROUNDS; i++)
+        chunks[i] = (char *)malloc(8);
+    pthread_barrier_init(&barrier, NULL, NUM_THREADS);
+    for (i = 0; i < NUM_THREADS; i++)
+        pthread_create(&threads[i], NULL, racer, NULL);
+    for (i = 0; i < NUM_THREADS; i++)
+        pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&barrier);
+    printf("all done\n");
+    return 0;
+}
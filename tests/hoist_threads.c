@@ -0,0 +1,75 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* A loop whose addressability checks are hoisted (-hoist_loop_checks) runs
+ * while another thread keeps allocating and freeing unrelated chunks.  Those
+ * must not invalidate the loop's hoisted range, while freeing the loop's own
+ * buffer must.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define NUM_INTS 1024
+#define OUTER_ITERS 2000
+#define CHURN_SIZE 64
+
+static volatile int done;
+static volatile int sink;
+
+static void *
+churn(void *arg)
+{
+    while (!done) {
+        char *p = malloc(CHURN_SIZE);
+        p[0] = 1;
+        free(p);
+    }
+    return NULL;
+}
+
+static int
+sum_ints(int *buf, int num)
+{
+    int i, sum = 0;
+    for (i = 0; i < num; i++)
+        sum += buf[i]; /* error once buf is freed */
+    return sum;
+}
+
+int
+main()
+{
+    pthread_t thread;
+    int *buf = calloc(NUM_INTS, sizeof(int));
+    int *volatile stale;
+    int i;
+    pthread_create(&thread, NULL, churn, NULL);
+    for (i = 0; i < OUTER_ITERS; i++)
+        sink += sum_ints(buf, NUM_INTS);
+    done = 1;
+    pthread_join(thread, NULL);
+    stale = buf;
+    free(buf);
+    sink += sum_ints(stale, NUM_INTS);
+    printf("all done\n");
+    return 0;
+}
@@ -0,0 +1,66 @@
+# **********************************************************
+# Copyright (c) 2026 Google, Inc.  All rights reserved.
+# **********************************************************
+
+# Dr. Memory: the memory debugger
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation;
+# version 2.1 of the License, and no later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Library General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+# Used as a runtest.cmake postcmd: validates the -results_json output next to
+# the results.txt passed as the final argument.  Each line must be a JSON
+# object on its own, so a linter that takes one document is run per line.
+#
+# arguments:
+# * jsonlint = JSON linter to run on each record; if empty, CMake's own
+#     parser is used instead (CMake 3.19+, else only the shape is checked)
+
+math(EXPR last "${CMAKE_ARGC} - 1")
+set(resfile "${CMAKE_ARGV${last}}")
+get_filename_component(logdir "${resfile}" PATH)
+set(jsonfile "${logdir}/results.jsonl")
+if (NOT EXISTS "${jsonfile}")
+  message(FATAL_ERROR "*** ${jsonfile} was not written ***\n")
+endif ()
+
+file(STRINGS "${jsonfile}" records)
+set(num_errors 0)
+set(num_summaries 0)
+foreach (record ${records})
+  if (jsonlint)
+    file(WRITE "${logdir}/record.json" "${record}\n")
+    execute_process(COMMAND ${jsonlint} "${logdir}/record.json"
+      RESULT_VARIABLE lint_result
+      ERROR_VARIABLE lint_err
+      OUTPUT_VARIABLE lint_out)
+    if (lint_result)
+      message(FATAL_ERROR "*** invalid JSON record (${lint_err}${lint_out}): ${record}***\n")
+    endif ()
+  elseif (NOT CMAKE_VERSION VERSION_LESS "3.19")
+    string(JSON kind ERROR_VARIABLE json_err GET "${record}" "record")
+    if (NOT "${json_err}" STREQUAL "NOTFOUND")
+      message(FATAL_ERROR "*** invalid JSON record (${json_err}): ${record}***\n")
+    endif ()
+  elseif (NOT "${record}" MATCHES "^{\"record\":.*}$")
+    message(FATAL_ERROR "*** invalid JSON record: ${record}***\n")
+  endif ()
+  if ("${record}" MATCHES "^{\"record\":\"error\"")
+    math(EXPR num_errors "${num_errors} + 1")
+  elseif ("${record}" MATCHES "^{\"record\":\"summary\"")
+    math(EXPR num_summaries "${num_summaries} + 1")
+  endif ()
+endforeach (record)
+if (num_errors EQUAL 0 OR num_summaries EQUAL 0)
+  message(FATAL_ERROR "*** ${jsonfile} lacks error or summary records ***\n")
+endif ()
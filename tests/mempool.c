@@ -0,0 +1,98 @@
+/* **********************************************************
+ * Copyright (c) 2020 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Tests the custom memory pool annotations. */
+
+#include "drmemory_annotations.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_SIZE 1024
+#define CHUNK_SIZE 32
+#define REDZONE 8
+
+static volatile int sink;
+
+typedef struct _pool_t {
+    char *base;
+    char *next;
+} pool_t;
+
+static char *
+pool_alloc(pool_t *pool, size_t size)
+{
+    char *res = pool->next + REDZONE;
+    pool->next = res + size + REDZONE;
+    DRMEMORY_ANNOTATE_MEMPOOL_ALLOC(pool, res, size);
+    return res;
+}
+
+int
+main(void)
+{
+    pool_t pool, pool2;
+    char *a, *b, *c, *d;
+    pool.base = (char *) malloc(POOL_SIZE);
+    pool.next = pool.base;
+    DRMEMORY_ANNOTATE_CREATE_MEMPOOL(&pool, REDZONE, 0);
+
+    a = pool_alloc(&pool, CHUNK_SIZE);
+    b = pool_alloc(&pool, CHUNK_SIZE);
+    if (a[0] == 0) /* uninit */
+        sink++;
+    a[CHUNK_SIZE] = 1; /* redzone */
+
+    DRMEMORY_ANNOTATE_MEMPOOL_FREE(&pool, b);
+    b[1] = 1; /* freed */
+    DRMEMORY_ANNOTATE_MEMPOOL_FREE(&pool, b); /* double free */
+
+    /* trimming to the first chunk frees the rest of the pool */
+    c = pool_alloc(&pool, CHUNK_SIZE);
+    DRMEMORY_ANNOTATE_MEMPOOL_TRIM(&pool, a, CHUNK_SIZE);
+    c[0] = 1; /* trimmed away */
+    a[0] = 1;
+
+    DRMEMORY_ANNOTATE_DESTROY_MEMPOOL(&pool);
+    a[0] = 1; /* destroyed */
+
+    /* a pool-less block carved out of the same memory */
+    a = pool.base + POOL_SIZE/2;
+    memset(a, 0, CHUNK_SIZE);
+    DRMEMORY_ANNOTATE_MALLOCLIKE_BLOCK(a, CHUNK_SIZE, 0, 1/*zeroed*/);
+    if (a[0] == 0) /* defined */
+        printf("zeroed block\n");
+    DRMEMORY_ANNOTATE_FREELIKE_BLOCK(a, 0);
+    a[0] = 1; /* freed */
+
+    /* a chunk left in a live pool is a leak of its own */
+    pool2.base = (char *) malloc(POOL_SIZE);
+    pool2.next = pool2.base;
+    DRMEMORY_ANNOTATE_CREATE_MEMPOOL(&pool2, REDZONE, 0);
+    pool_alloc(&pool2, CHUNK_SIZE); /* leaked */
+    d = pool_alloc(&pool2, CHUNK_SIZE);
+    DRMEMORY_ANNOTATE_MEMPOOL_ALLOC(&pool2, d, CHUNK_SIZE); /* already live */
+    DRMEMORY_ANNOTATE_MEMPOOL_FREE(&pool2, d);
+
+    free(pool.base);
+    printf("all done\n");
+    return 0;
+}
@@ -0,0 +1,40 @@
+# **********************************************************
+# Copyright (c) 2020 Google, Inc.  All rights reserved.
+# **********************************************************
+#
+# Dr. Memory: the memory debugger
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation;
+# version 2.1 of the License, and no later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Library General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+Error #1: UNINITIALIZED READ
+mempool.c:60
+Error #2: UNADDRESSABLE ACCESS
+mempool.c:62
+Error #3: UNADDRESSABLE ACCESS
+mempool.c:65
+Error #4: INVALID HEAP ARGUMENT
+mempool.c:66
+Error #5: UNADDRESSABLE ACCESS
+mempool.c:71
+Error #6: UNADDRESSABLE ACCESS
+mempool.c:75
+Error #7: UNADDRESSABLE ACCESS
+mempool.c:84
+Error #8: INVALID HEAP ARGUMENT
+mempool.c:92
+# pool chunks get their own leak reports and callstacks
+Error #9: LEAK 32 direct bytes
+mempool.c:45
+mempool.c:90
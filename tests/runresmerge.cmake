@@ -0,0 +1,50 @@
+# **********************************************************
+# Copyright (c) 2026 Google, Inc.  All rights reserved.
+# **********************************************************
+
+# Dr. Memory: the memory debugger
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation;
+# version 2.1 of the License, and no later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Library General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+# arguments:
+# * resmerge = path to the resmerge executable
+# * inputs = directory holding one results.txt subdirectory per process
+# * outdir = directory to write the merged results to
+#
+# The inputs have the same errors with different absolute addresses and
+# module ids, as with ASLR, so each must be merged into a single error.
+
+file(GLOB procs "${inputs}/*")
+file(REMOVE_RECURSE "${outdir}")
+file(MAKE_DIRECTORY "${outdir}")
+execute_process(COMMAND ${resmerge} -o ${outdir} ${procs}
+  RESULT_VARIABLE cmd_result
+  ERROR_VARIABLE cmd_err
+  OUTPUT_VARIABLE cmd_out)
+if (cmd_result)
+  message(FATAL_ERROR "*** ${resmerge} failed (${cmd_result}): ${cmd_err}***\n")
+endif (cmd_result)
+
+file(READ "${outdir}/results.txt" merged)
+list(LENGTH procs num_procs)
+foreach (expect
+    "1 unique,     6 total UNADDRESSABLE ACCESS"
+    "1 unique,     2 total UNINITIALIZED READ"
+    "${num_procs} process(es) merged")
+  string(FIND "${merged}" "${expect}" found)
+  if (found LESS 0)
+    message(FATAL_ERROR "*** merged results lack \"${expect}\":\n${merged}***\n")
+  endif ()
+endforeach (expect)
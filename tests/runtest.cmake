@@ -40,6 +40,13 @@
 #     exit code must match the value passed in order for the test to pass.
 # * path_append = string to add to PATH before running cmd
 # * timeout = timeout value for the test
+# * stalecheck = for Dr. Heapstat, "<cold>,<hot>" request sizes of two allocs
+#     whose staleness.log last access must be ordered cold before hot
+# * snapcheck = for Dr. Heapstat, "<size>,<count>" of allocs that the app makes
+#     over the run and keeps live: see the snapshot check below
+# * sampcheck = for Dr. Heapstat -sample_bytes, "<size>,<count>,<percent>" of
+#     allocs that the app makes first thing and keeps live, with the allowed
+#     error in percent of their sampled estimate: see the sampling check below
 #
 # these allow for parameterization for more portable tests (PR 544430)
 # env vars will override; else passed-in default settings will be used:
@@ -531,6 +538,218 @@ foreach (line ${lines})
   endif ()
 endforeach (line)
 
+##################################################
+# check staleness order
+
+if (TOOL_DR_HEAPSTAT AND NOT "${stalecheck}" STREQUAL "")
+  string(REGEX MATCH "log dir is ([^\r\n]+)" logdir "${cmd_err}")
+  if ("${logdir}" STREQUAL "")
+    message(FATAL_ERROR "*** cannot find log dir in output: ${cmd_err} ***\n")
+  endif ()
+  set(logdir "${CMAKE_MATCH_1}")
+  file(READ "${logdir}/staleness.log" stalelog)
+  string(REGEX REPLACE "," ";" stalecheck "${stalecheck}")
+  foreach (kind cold hot)
+    list(GET stalecheck 0 bytes)
+    list(REMOVE_AT stalecheck 0)
+    # lines are "<cstack id>,<bytes>,<last access>"
+    string(REGEX MATCHALL "\n[0-9]+,${bytes},[0-9]+" entries "${stalelog}")
+    if ("${entries}" STREQUAL "")
+      message(FATAL_ERROR "*** no ${bytes}-byte alloc in ${logdir}/staleness.log ***\n")
+    endif ()
+    set(${kind}_last 0)
+    foreach (entry ${entries})
+      string(REGEX REPLACE "^.*," "" last "${entry}")
+      if (last GREATER ${kind}_last)
+        set(${kind}_last ${last})
+      endif ()
+    endforeach (entry)
+  endforeach (kind)
+  if (NOT hot_last GREATER cold_last)
+    message(FATAL_ERROR "*** hot alloc last accessed @${hot_last} is not after "
+      "cold alloc @${cold_last} in ${logdir}/staleness.log ***\n")
+  endif ()
+endif (TOOL_DR_HEAPSTAT AND NOT "${stalecheck}" STREQUAL "")
+
+##################################################
+# check snapshots
+# Every snapshot in snapshot.log, however it was merged when others were
+# dropped, must have per-callstack usage that adds up to its totals.  The
+# callstack of the kept allocs is the one with all <count> of them in the
+# final live snapshot, and in every other snapshot but the peak it must hold
+# whole allocs and only grow from one to the next.
+
+if (TOOL_DR_HEAPSTAT AND NOT "${snapcheck}" STREQUAL "")
+  string(REGEX MATCH "log dir is ([^\r\n]+)" logdir "${cmd_err}")
+  if ("${logdir}" STREQUAL "")
+    message(FATAL_ERROR "*** cannot find log dir in output: ${cmd_err} ***\n")
+  endif ()
+  set(logdir "${CMAKE_MATCH_1}")
+  string(REGEX REPLACE "," ";" snapcheck "${snapcheck}")
+  list(GET snapcheck 0 kept_size)
+  list(GET snapcheck 1 kept_count)
+  file(STRINGS "${logdir}/snapshot.log" snaplines)
+  # a sentinel line to finish the last snapshot
+  list(APPEND snaplines "SNAPSHOT #")
+  math(EXPR kept_total "${kept_size} * ${kept_count}")
+  set(num_snaps 0)
+  set(in_snap OFF)
+  set(entries_per_snap "")
+  foreach (line ${snaplines})
+    if ("${line}" MATCHES "^SNAPSHOT #")
+      if (in_snap)
+        if (NOT sum_asked EQUAL tot_asked OR NOT sum_usable EQUAL tot_usable OR
+            NOT sum_occupied EQUAL tot_occupied)
+          message(FATAL_ERROR "*** snapshot ${snap_hdr} idx=${snap_idx}: callstacks "
+            "sum to ${sum_asked},${sum_usable},${sum_occupied} but totals are "
+            "${tot_asked},${tot_usable},${tot_occupied} in ${logdir}/snapshot.log ***\n")
+        endif ()
+        # the peak is not in stamp order with the others
+        if (NOT snap_idx EQUAL -1)
+          list(APPEND entries_per_snap "${entries}")
+        endif ()
+        math(EXPR num_snaps "${num_snaps} + 1")
+      endif ()
+      set(in_snap ON)
+      set(snap_hdr "${line}")
+      set(sum_asked 0)
+      set(sum_usable 0)
+      set(sum_occupied 0)
+      # non-empty so that list operations keep it
+      set(entries "#")
+    elseif ("${line}" MATCHES "^idx=(-?[0-9]+),")
+      set(snap_idx ${CMAKE_MATCH_1})
+    elseif ("${line}" MATCHES "^total: [0-9]+,([0-9]+),([0-9]+),([0-9]+)$")
+      set(tot_asked ${CMAKE_MATCH_1})
+      set(tot_usable ${CMAKE_MATCH_2})
+      set(tot_occupied ${CMAKE_MATCH_3})
+    elseif (in_snap AND "${line}" MATCHES "^([0-9]+),([0-9]+),([0-9]+),([0-9]+),([0-9]+)$")
+      set(id ${CMAKE_MATCH_1})
+      set(instances ${CMAKE_MATCH_2})
+      set(asked ${CMAKE_MATCH_3})
+      math(EXPR sum_asked "${sum_asked} + ${asked}")
+      math(EXPR sum_usable "${sum_usable} + ${asked} + ${CMAKE_MATCH_4}")
+      math(EXPR sum_occupied
+        "${sum_occupied} + ${asked} + ${CMAKE_MATCH_4} + ${CMAKE_MATCH_5}")
+      set(entries "${entries}:${id}=${instances},${asked}")
+    endif ()
+  endforeach (line)
+  # -snapshots retained plus the peak and the final live snapshot
+  if (num_snaps LESS 3)
+    message(FATAL_ERROR "*** only ${num_snaps} snapshots in ${logdir}/snapshot.log ***\n")
+  endif ()
+  list(GET entries_per_snap -1 final)
+  string(REGEX MATCH ":([0-9]+)=${kept_count},${kept_total}(:|$)" found "${final}")
+  if ("${found}" STREQUAL "")
+    message(FATAL_ERROR "*** no callstack with ${kept_count} ${kept_size}-byte allocs "
+      "in the final snapshot in ${logdir}/snapshot.log ***\n")
+  endif ()
+  set(kept_id ${CMAKE_MATCH_1})
+  set(prev 0)
+  foreach (entries ${entries_per_snap})
+    if ("${entries}" MATCHES ":${kept_id}=([0-9]+),([0-9]+)(:|$)")
+      set(cur ${CMAKE_MATCH_1})
+      math(EXPR cur_bytes "${kept_size} * ${cur}")
+      if (NOT CMAKE_MATCH_2 EQUAL cur_bytes)
+        message(FATAL_ERROR "*** callstack ${kept_id} has ${CMAKE_MATCH_2} bytes in "
+          "${cur} ${kept_size}-byte allocs in ${logdir}/snapshot.log ***\n")
+      endif ()
+    else ()
+      set(cur 0)
+    endif ()
+    if (cur LESS prev)
+      message(FATAL_ERROR "*** callstack ${kept_id} went from ${prev} to ${cur} "
+        "${kept_size}-byte allocs in ${logdir}/snapshot.log ***\n")
+    endif ()
+    set(prev ${cur})
+  endforeach (entries)
+endif (TOOL_DR_HEAPSTAT AND NOT "${snapcheck}" STREQUAL "")
+
+##################################################
+# check sampling
+# With -sample_bytes the snapshot totals must still be exact: between two
+# snapshots taken while the app is making its <count> allocs, -time_allocs
+# stamps and the totals must grow by exactly one <size>-byte malloc per
+# alloc.  The startup allocs come before the first quarter of the <count>.
+# The sampled callstack usage is an estimate: the kept allocs' callstack in
+# the final snapshot must be within <percent> of their real bytes.
+
+if (TOOL_DR_HEAPSTAT AND NOT "${sampcheck}" STREQUAL "")
+  string(REGEX MATCH "log dir is ([^\r\n]+)" logdir "${cmd_err}")
+  if ("${logdir}" STREQUAL "")
+    message(FATAL_ERROR "*** cannot find log dir in output: ${cmd_err} ***\n")
+  endif ()
+  set(logdir "${CMAKE_MATCH_1}")
+  string(REGEX REPLACE "," ";" sampcheck "${sampcheck}")
+  list(GET sampcheck 0 kept_size)
+  list(GET sampcheck 1 kept_count)
+  list(GET sampcheck 2 kept_pct)
+  file(STRINGS "${logdir}/snapshot.log" snaplines)
+  # a sentinel line to finish the last snapshot
+  list(APPEND snaplines "SNAPSHOT #   0 @ 0 end")
+  math(EXPR kept_total "${kept_size} * ${kept_count}")
+  math(EXPR loop_start "${kept_count} / 4")
+  set(num_pairs 0)
+  set(prev_stamp "")
+  set(snap_idx "")
+  foreach (line ${snaplines})
+    if ("${line}" MATCHES "^SNAPSHOT # *[0-9]+ @ +([0-9]+) ")
+      # the final non-peak snapshot is the live one, dumped last
+      if (NOT "${snap_idx}" STREQUAL "" AND NOT snap_idx EQUAL -1)
+        set(final_max_asked ${max_asked})
+      endif ()
+      set(cur_stamp ${CMAKE_MATCH_1})
+      set(max_asked 0)
+    elseif ("${line}" MATCHES "^idx=(-?[0-9]+),")
+      set(snap_idx ${CMAKE_MATCH_1})
+    elseif ("${line}" MATCHES "^total: ([0-9]+),([0-9]+),[0-9]+,[0-9]+$")
+      # the peak is not in stamp order with the others
+      if (NOT snap_idx EQUAL -1)
+        if (NOT "${prev_stamp}" STREQUAL "" AND NOT prev_stamp LESS loop_start AND
+            NOT cur_stamp GREATER kept_count)
+          math(EXPR allocs "${cur_stamp} - ${prev_stamp}")
+          math(EXPR mallocs "${CMAKE_MATCH_1} - ${prev_mallocs}")
+          math(EXPR asked "${CMAKE_MATCH_2} - ${prev_asked}")
+          math(EXPR expect "${kept_size} * ${allocs}")
+          if (NOT mallocs EQUAL allocs OR NOT asked EQUAL expect)
+            message(FATAL_ERROR "*** totals grew by ${mallocs} mallocs of ${asked} bytes "
+              "from stamp ${prev_stamp} to ${cur_stamp} rather than ${allocs} of "
+              "${expect} in ${logdir}/snapshot.log ***\n")
+          endif ()
+          math(EXPR num_pairs "${num_pairs} + 1")
+        endif ()
+        set(prev_stamp ${cur_stamp})
+        set(prev_mallocs ${CMAKE_MATCH_1})
+        set(prev_asked ${CMAKE_MATCH_2})
+        set(final_mallocs ${CMAKE_MATCH_1})
+        set(final_asked ${CMAKE_MATCH_2})
+      endif ()
+    elseif ("${line}" MATCHES "^[0-9]+,[0-9]+,([0-9]+),[0-9]+,[0-9]+$")
+      if (CMAKE_MATCH_1 GREATER max_asked)
+        set(max_asked ${CMAKE_MATCH_1})
+      endif ()
+    endif ()
+  endforeach (line)
+  if (num_pairs EQUAL 0)
+    message(FATAL_ERROR "*** no two snapshots while allocating in "
+      "${logdir}/snapshot.log ***\n")
+  endif ()
+  if (final_mallocs LESS kept_count OR final_asked LESS kept_total)
+    message(FATAL_ERROR "*** final totals of ${final_mallocs} mallocs of ${final_asked} "
+      "bytes are missing the ${kept_count} kept allocs in ${logdir}/snapshot.log ***\n")
+  endif ()
+  # the kept allocs' callstack is by far the largest
+  math(EXPR err "(${final_max_asked} - ${kept_total}) * 100")
+  if (err LESS 0)
+    math(EXPR err "0 - ${err}")
+  endif ()
+  math(EXPR allowed "${kept_total} * ${kept_pct}")
+  if (err GREATER allowed)
+    message(FATAL_ERROR "*** sampled estimate of ${final_max_asked} bytes is not within "
+      "${kept_pct}% of the ${kept_total} kept in ${logdir}/snapshot.log ***\n")
+  endif ()
+endif (TOOL_DR_HEAPSTAT AND NOT "${sampcheck}" STREQUAL "")
+
 ##################################################
 # check results file
 # XXX i#1688: Disable leak tests for Dr. Heapstat until the offline
@@ -0,0 +1,46 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* With -sample_bytes far above KEPT_SIZE only a few percent of the kept
+ * allocs have their callstack recorded.  runtest.cmake checks against
+ * snapshot.log that the snapshot totals still count every one of them and
+ * that the scaled-up estimate for their callstack is close to their real
+ * usage.  We allocate nothing else, and print to unbuffered stderr so that
+ * no stdio buffer is allocated either.
+ */
+#define KEPT_SIZE 64
+#define KEPT_COUNT 50000
+
+static char *kept[KEPT_COUNT];
+
+int
+main()
+{
+    int i;
+    for (i = 0; i < KEPT_COUNT; i++)
+        kept[i] = malloc(KEPT_SIZE);
+    /* kept is left live so it is all in the final snapshot */
+    fputs("all done\n", stderr);
+    return 0;
+}
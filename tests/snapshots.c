@@ -0,0 +1,53 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* With a few -snapshots and -time_allocs, most retained snapshots are
+ * dropped and their changes merged into a neighbor as the run goes on.  The
+ * kept allocs grow steadily while the churn allocs come and go between them.
+ * The size and count of the kept allocs are matched by runtest.cmake against
+ * snapshot.log.
+ */
+#define KEPT_SIZE 777
+#define KEPT_COUNT 200
+#define CHURN_SIZE 64
+#define CHURN_ITERS 10
+
+static char *kept[KEPT_COUNT];
+
+int
+main()
+{
+    int i, j;
+    for (i = 0; i < KEPT_COUNT; i++) {
+        kept[i] = malloc(KEPT_SIZE);
+        for (j = 0; j < CHURN_ITERS; j++) {
+            char *p = malloc(CHURN_SIZE);
+            p = realloc(p, CHURN_SIZE * (j + 2));
+            free(p);
+        }
+    }
+    /* kept is left live so it is all in the final snapshot */
+    printf("all done\n");
+    return 0;
+}
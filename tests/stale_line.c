@@ -0,0 +1,71 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#ifdef UNIX
+# include <unistd.h>
+# include <time.h>     /* for nanosleep */
+#else
+# include <windows.h>
+#endif
+#include <string.h>
+
+/* We touch a cold alloc once and then keep touching a hot alloc in a line
+ * that lies entirely inside it, so with -stale_line_size > 8 the hot alloc
+ * must end up with a later last access than the cold one.  The sizes are
+ * matched by runtest.cmake against staleness.log.
+ */
+#define COLD_SIZE 3000
+#define PAD_SIZE 256
+#define HOT_SIZE 1000
+#define HOT_ITERS 150
+#define SLEEP_MS 10
+
+int
+main()
+{
+    unsigned int i;
+    char *cold = malloc(COLD_SIZE);
+    /* keep the other two from sharing a line with cold */
+    char *pad = malloc(PAD_SIZE);
+    char *hot = malloc(HOT_SIZE);
+    memset(cold, 0, COLD_SIZE);
+    memset(pad, 0, PAD_SIZE);
+    memset(hot, 0, HOT_SIZE);
+
+    for (i = 0; i < HOT_ITERS; i++) {
+        hot[HOT_SIZE/2]++;
+#ifdef UNIX
+        struct timespec sleeptime;
+        sleeptime.tv_sec = 0;
+        sleeptime.tv_nsec = SLEEP_MS*1000*1000;
+        nanosleep(&sleeptime, NULL);
+#else
+        SleepEx(SLEEP_MS, 0);
+#endif
+    }
+
+    /* left live so they are in the final snapshot */
+    printf("all done\n");
+    return 0;
+}
@@ -0,0 +1,46 @@
+# **********************************************************
+# Copyright (c) 2026 Google, Inc.  All rights reserved.
+# **********************************************************
+
+# Dr. Memory: the memory debugger
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation;
+# version 2.1 of the License, and no later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Library General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+# Used as a runtest.cmake postcmd: runs "symquery -r" on the log directory of
+# the -defer_symbols results.txt passed as the final argument, so that the
+# symbolized and suppressed results are what get compared.
+#
+# arguments:
+# * symquery = path to symquery
+
+math(EXPR last "${CMAKE_ARGC} - 1")
+set(resfile "${CMAKE_ARGV${last}}")
+get_filename_component(logdir "${resfile}" PATH)
+if (NOT EXISTS "${logdir}/modules.txt")
+  message(FATAL_ERROR "*** ${logdir}/modules.txt was not written ***\n")
+endif ()
+
+execute_process(COMMAND ${symquery} -r "${logdir}"
+  RESULT_VARIABLE symquery_result
+  ERROR_VARIABLE symquery_err
+  OUTPUT_VARIABLE symquery_out)
+if (symquery_result)
+  message(FATAL_ERROR "*** symquery -r failed (${symquery_result}): ${symquery_err}***\n")
+endif ()
+# every suppression in the file must have been understood
+if ("${symquery_out}" MATCHES "WARNING")
+  message(FATAL_ERROR "*** symquery -r: ${symquery_out}***\n")
+endif ()
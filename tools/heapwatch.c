@@ -0,0 +1,446 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Reference consumer for Dr. Heapstat's -stream: listens on a Unix domain
+ * socket or named pipe, and for each snapshot received prints the total
+ * usage and the callstacks whose usage grew the most since the previous
+ * snapshot received.
+ */
+
+/* Standalone: we only get UNIX from the build */
+#if !defined(UNIX) && !defined(WINDOWS)
+# define WINDOWS
+#endif
+
+#ifdef WINDOWS
+# include <windows.h>
+#else
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <unistd.h>
+#endif
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WINDOWS
+typedef unsigned __int64 uint64;
+typedef __int64 int64;
+# define INT64_FMT "I64d"
+# define UINT64_FMT "I64u"
+#else
+typedef unsigned long long uint64;
+typedef long long int64;
+# define INT64_FMT "lld"
+# define UINT64_FMT "llu"
+#endif
+typedef unsigned int uint;
+typedef int bool;
+#define true 1
+#define false 0
+
+#define DEFAULT_TOP 10
+/* Maximum length of a callstack label */
+#define LABEL_MAX 256
+
+#define USAGE "\
+Usage: %s [options] <socket or pipe path>\n\
+Listens for a Dr. Heapstat run with -stream <path> and for each snapshot\n\
+prints the callstacks whose usage grew the most.\n\
+Options:\n\
+  -top <N>          = number of callstacks to list per snapshot (default: %d)\n\
+  -all              = print snapshots with no growth too\n"
+
+/***************************************************************************
+ * Wire format: keep in sync with drheapstat/stream.h
+ */
+
+#define STREAM_VERSION 2
+
+enum {
+    STREAM_FRAME_HELLO      = 1,
+    STREAM_FRAME_CALLSTACKS = 2,
+    STREAM_FRAME_SNAPSHOT   = 3,
+};
+
+typedef struct _stream_frame_header_t {
+    uint type;
+    uint size;
+} stream_frame_header_t;
+
+typedef struct _stream_hello_t {
+    uint version;
+    uint pid;
+} stream_hello_t;
+
+typedef struct _stream_snapshot_t {
+    uint64 stamp;
+    uint64 tot_mallocs;
+    uint64 tot_bytes_asked_for;
+    uint64 tot_bytes_usable;
+    uint64 tot_bytes_occupied;
+    uint num_entries;
+    uint dropped;
+} stream_snapshot_t;
+
+typedef struct _stream_usage_t {
+    uint cstack_id;
+    uint instances;
+    uint bytes_asked_for;
+    uint extra_usable;
+    uint extra_occupied;
+} stream_usage_t;
+
+/***************************************************************************
+ * Callstacks and usage, indexed by callstack id
+ */
+
+typedef struct _cstack_t {
+    char *label;        /* first frame */
+    uint prev_instances;
+    uint64 prev_bytes;  /* occupied bytes in the previous snapshot */
+    uint seen;          /* index of the last snapshot it appeared in */
+} cstack_t;
+
+typedef struct _grower_t {
+    uint id;
+    int64 bytes;
+    int instances;
+} grower_t;
+
+static cstack_t *cstacks;
+static uint num_cstacks;
+static uint cur_cstack;
+static bool want_label;
+/* A line split across callstacks frames */
+static char partial[LABEL_MAX];
+static size_t partial_len;
+
+static uint top = DEFAULT_TOP;
+static bool print_all;
+static uint num_snapshots;
+static uint64 prev_occupied;
+
+static cstack_t *
+get_cstack(uint id)
+{
+    if (id >= num_cstacks) {
+        uint newnum = (num_cstacks == 0) ? 1024 : num_cstacks;
+        while (newnum <= id)
+            newnum *= 2;
+        cstacks = (cstack_t *) realloc(cstacks, newnum * sizeof(*cstacks));
+        if (cstacks == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        memset(cstacks + num_cstacks, 0, (newnum - num_cstacks) * sizeof(*cstacks));
+        num_cstacks = newnum;
+    }
+    return &cstacks[id];
+}
+
+/* Callstack text is "CALLSTACK <id>" followed by frames and an end marker:
+ * we label each callstack with its first frame.
+ */
+static void
+handle_line(char *line)
+{
+    uint id;
+    while (isspace((unsigned char)*line))
+        line++;
+    if (sscanf(line, "CALLSTACK %u", &id) == 1) {
+        cur_cstack = id;
+        want_label = true;
+    } else if (want_label && *line != '\0' && strncmp(line, "error end", 9) != 0) {
+        cstack_t *cs = get_cstack(cur_cstack);
+        size_t len = strlen(line);
+        while (len > 0 && isspace((unsigned char)line[len - 1]))
+            line[--len] = '\0';
+        free(cs->label);
+        cs->label = strdup(line);
+        want_label = false;
+    }
+}
+
+static void
+handle_callstacks(char *text, size_t size)
+{
+    size_t start = 0, i;
+    for (i = 0; i < size; i++) {
+        if (text[i] != '\n')
+            continue;
+        text[i] = '\0';
+        if (partial_len > 0) {
+            /* labels are truncated, so a long line can be too */
+            size_t len = i - start;
+            if (len > sizeof(partial) - 1 - partial_len)
+                len = sizeof(partial) - 1 - partial_len;
+            memcpy(partial + partial_len, text + start, len);
+            partial[partial_len + len] = '\0';
+            handle_line(partial);
+            partial_len = 0;
+        } else
+            handle_line(text + start);
+        start = i + 1;
+    }
+    if (start < size) {
+        size_t len = size - start;
+        if (len > sizeof(partial) - 1 - partial_len)
+            len = sizeof(partial) - 1 - partial_len;
+        memcpy(partial + partial_len, text + start, len);
+        partial_len += len;
+    }
+}
+
+static int
+grower_cmp(const void *a, const void *b)
+{
+    const grower_t *ga = (const grower_t *) a;
+    const grower_t *gb = (const grower_t *) b;
+    if (ga->bytes != gb->bytes)
+        return (ga->bytes > gb->bytes) ? -1 : 1;
+    return (ga->id < gb->id) ? -1 : (ga->id > gb->id);
+}
+
+static void
+handle_snapshot(stream_snapshot_t *snap, stream_usage_t *usage)
+{
+    grower_t *growers = NULL;
+    uint num_growers = 0, i;
+    num_snapshots++;
+    if (snap->num_entries > 0) {
+        growers = (grower_t *) malloc(snap->num_entries * sizeof(*growers));
+        if (growers == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < snap->num_entries; i++) {
+        cstack_t *cs = get_cstack(usage[i].cstack_id);
+        uint64 bytes = (uint64)usage[i].bytes_asked_for + usage[i].extra_usable +
+            usage[i].extra_occupied;
+        /* absent from the previous snapshot means no usage there */
+        if (cs->seen != num_snapshots - 1) {
+            cs->prev_bytes = 0;
+            cs->prev_instances = 0;
+        }
+        if (bytes > cs->prev_bytes) {
+            growers[num_growers].id = usage[i].cstack_id;
+            growers[num_growers].bytes = (int64)(bytes - cs->prev_bytes);
+            growers[num_growers].instances =
+                (int)(usage[i].instances - cs->prev_instances);
+            num_growers++;
+        }
+        cs->prev_bytes = bytes;
+        cs->prev_instances = usage[i].instances;
+        cs->seen = num_snapshots;
+    }
+    if (num_growers > 0 || print_all) {
+        printf("snapshot @%" UINT64_FMT ": %" UINT64_FMT " bytes in %" UINT64_FMT
+               " allocs (%+" INT64_FMT " bytes)",
+               snap->stamp, snap->tot_bytes_occupied, snap->tot_mallocs,
+               (int64)(snap->tot_bytes_occupied - prev_occupied));
+        if (snap->dropped > 0)
+            printf(" [%u snapshots dropped]", snap->dropped);
+        printf("\n");
+        qsort(growers, num_growers, sizeof(*growers), grower_cmp);
+        for (i = 0; i < num_growers && i < top; i++) {
+            const char *label = (growers[i].id < num_cstacks &&
+                                 cstacks[growers[i].id].label != NULL) ?
+                cstacks[growers[i].id].label : "<unknown>";
+            printf("  %+12" INT64_FMT " bytes %+8d allocs  #%-6u %s\n",
+                   growers[i].bytes, growers[i].instances, growers[i].id, label);
+        }
+        fflush(stdout);
+    }
+    prev_occupied = snap->tot_bytes_occupied;
+    free(growers);
+}
+
+/***************************************************************************
+ * Transport
+ */
+
+#ifdef WINDOWS
+typedef HANDLE conn_t;
+#else
+typedef int conn_t;
+#endif
+
+static bool
+read_fully(conn_t conn, void *buf, size_t size)
+{
+    char *cur = (char *) buf;
+    while (size > 0) {
+#ifdef WINDOWS
+        DWORD got;
+        if (!ReadFile(conn, cur, (DWORD)size, &got, NULL) || got == 0)
+            return false;
+#else
+        ssize_t got = read(conn, cur, size);
+        if (got <= 0)
+            return false;
+#endif
+        cur += got;
+        size -= got;
+    }
+    return true;
+}
+
+static bool
+wait_for_client(const char *path, conn_t *conn)
+{
+#ifdef WINDOWS
+    HANDLE pipe = CreateNamedPipeA(path, PIPE_ACCESS_INBOUND,
+                                   PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+                                   1, 0, 64*1024, 0, NULL);
+    if (pipe == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Unable to create pipe %s\n", path);
+        return false;
+    }
+    printf("Waiting for a Dr. Heapstat run with -stream %s\n", path);
+    fflush(stdout);
+    if (!ConnectNamedPipe(pipe, NULL) && GetLastError() != ERROR_PIPE_CONNECTED) {
+        fprintf(stderr, "Unable to connect pipe %s\n", path);
+        CloseHandle(pipe);
+        return false;
+    }
+    *conn = pipe;
+#else
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        perror(path);
+        close(fd);
+        return false;
+    }
+    printf("Waiting for a Dr. Heapstat run with -stream %s\n", path);
+    fflush(stdout);
+    *conn = accept(fd, NULL, NULL);
+    close(fd);
+    unlink(path);
+    if (*conn < 0) {
+        perror("accept");
+        return false;
+    }
+#endif
+    return true;
+}
+
+static void
+close_conn(conn_t conn)
+{
+#ifdef WINDOWS
+    CloseHandle(conn);
+#else
+    close(conn);
+#endif
+}
+
+/***************************************************************************
+ * Main
+ */
+
+int
+main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    conn_t conn;
+    stream_frame_header_t hdr;
+    char *payload = NULL;
+    size_t payload_size = 0;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-top") == 0 && i + 1 < argc)
+            top = (uint) atoi(argv[++i]);
+        else if (strcmp(argv[i], "-all") == 0)
+            print_all = true;
+        else if (argv[i][0] == '-' || path != NULL) {
+            fprintf(stderr, USAGE, argv[0], DEFAULT_TOP);
+            return 1;
+        } else
+            path = argv[i];
+    }
+    if (path == NULL) {
+        fprintf(stderr, USAGE, argv[0], DEFAULT_TOP);
+        return 1;
+    }
+    if (!wait_for_client(path, &conn))
+        return 1;
+
+    while (read_fully(conn, &hdr, sizeof(hdr))) {
+        if (hdr.size > payload_size) {
+            payload_size = hdr.size;
+            payload = (char *) realloc(payload, payload_size);
+            if (payload == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+            }
+        }
+        if (!read_fully(conn, payload, hdr.size))
+            break;
+        switch (hdr.type) {
+        case STREAM_FRAME_HELLO: {
+            stream_hello_t *hello = (stream_hello_t *) payload;
+            if (hdr.size < sizeof(*hello) || hello->version != STREAM_VERSION) {
+                fprintf(stderr, "Unsupported stream version\n");
+                return 1;
+            }
+            printf("Connected to process %u\n", hello->pid);
+            break;
+        }
+        case STREAM_FRAME_CALLSTACKS:
+            handle_callstacks(payload, hdr.size);
+            break;
+        case STREAM_FRAME_SNAPSHOT: {
+            stream_snapshot_t *snap = (stream_snapshot_t *) payload;
+            if (hdr.size < sizeof(*snap) ||
+                hdr.size - sizeof(*snap) < snap->num_entries * sizeof(stream_usage_t)) {
+                fprintf(stderr, "Malformed snapshot\n");
+                return 1;
+            }
+            handle_snapshot(snap, (stream_usage_t *)(payload + sizeof(*snap)));
+            break;
+        }
+        default:
+            /* skip frames from newer versions */
+            break;
+        }
+    }
+    printf("Process exited after %u snapshots\n", num_snapshots);
+    close_conn(conn);
+    free(payload);
+    return 0;
+}
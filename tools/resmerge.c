@@ -0,0 +1,955 @@
+/* **********************************************************
+ * Copyright (c) 2026 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/* Dr. Memory: the memory debugger
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License, and no later version.
+
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Library General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Merges the results of many Dr. Memory processes, such as all the log
+ * directories of a -follow_children run of a build or test harness, into a
+ * single report in which each error appears once, with its total count and
+ * the processes it was seen in.  The suppress.txt files are merged as well.
+ *
+ * Errors are identified the same way Dr. Memory identifies duplicates within
+ * one process: by error type plus callstack.  Since results.txt is all we
+ * have, the callstack is the text of its frames, minus the absolute addresses
+ * and module ids that differ between processes.
+ */
+
+/* Standalone: we only get UNIX from the build */
+#if !defined(UNIX) && !defined(WINDOWS)
+# define WINDOWS
+#endif
+
+#ifdef WINDOWS
+# include <windows.h>
+#else
+# include <pthread.h>
+#endif
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WINDOWS
+# define DIRSEP '\\'
+typedef unsigned __int64 hash_t;
+#else
+# define DIRSEP '/'
+typedef unsigned long long hash_t;
+#endif
+
+typedef unsigned int uint;
+typedef int bool;
+#define true 1
+#define false 0
+
+#define RESULTS_FNAME "results.txt"
+#define SUPPRESS_FNAME "suppress.txt"
+#define MAX_PATH_LEN 4096
+#define DEFAULT_THREADS 8
+#define MAX_THREADS 256
+#define DEFAULT_PROCS_LISTED 5
+
+#define USAGE "\
+Usage: %s [options] <logdir or results.txt> ...\n\
+Merges the results of many Dr. Memory processes into one results.txt and\n\
+one suppress.txt, listing each unique error once.\n\
+Options:\n\
+  -o <dir>          = directory to write the merged files to (default: .)\n\
+  -f <file>         = read additional inputs from <file>, one per line\n\
+  -j <N>            = number of threads to read inputs with (default: %d)\n\
+  -list <N>         = number of processes to list per error (default: %d)\n\
+  -attrib <file>    = write every process's instance of every merged error to\n\
+                      <file> as tab-separated merged id, logdir, id, count\n"
+
+/***************************************************************************
+ * Merged error and suppression tables
+ */
+
+/* One process's instance of an error */
+typedef struct _instance_t {
+    const char *input;
+    uint id;
+    uint count;
+    struct _instance_t *next;
+} instance_t;
+
+typedef struct _merged_error_t {
+    hash_t hash;
+    char *key;   /* error type plus normalized frames */
+    char *type;
+    char *title; /* from the first instance we saw */
+    char *frames;
+    uint total;
+    uint num_procs;
+    uint merged_id;
+    instance_t *instances;
+    instance_t *instances_tail;
+    struct _merged_error_t *next;
+} merged_error_t;
+
+typedef struct _merged_supp_t {
+    hash_t hash;
+    char *key;  /* text without comments or name= */
+    char *text;
+    uint num_procs;
+    struct _merged_supp_t *next;
+} merged_supp_t;
+
+/* A chained hashtable for both kinds of entries, which start with the same
+ * hash, key, and next fields (in a different order, so we use accessors).
+ */
+typedef struct _table_t {
+    void **buckets;
+    size_t num_buckets;
+    size_t num_entries;
+    bool is_supp;
+} table_t;
+
+static hash_t
+hash_string(const char *str)
+{
+    /* 64-bit FNV-1a: the key is compared in full on a hash match, so this only
+     * needs to spread well.
+     */
+    hash_t hash = 14695981039346656037ULL;
+    for (; *str != '\0'; str++) {
+        hash ^= (unsigned char) *str;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void *
+xmalloc(size_t size)
+{
+    void *res = malloc(size);
+    if (res == NULL) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+    }
+    return res;
+}
+
+static char *
+xstrndup(const char *str, size_t len)
+{
+    char *res = (char *) xmalloc(len + 1);
+    memcpy(res, str, len);
+    res[len] = '\0';
+    return res;
+}
+
+#define ENTRY_HASH(t, e) \
+    ((t)->is_supp ? ((merged_supp_t *)(e))->hash : ((merged_error_t *)(e))->hash)
+#define ENTRY_KEY(t, e) \
+    ((t)->is_supp ? ((merged_supp_t *)(e))->key : ((merged_error_t *)(e))->key)
+#define ENTRY_NEXT(t, e) \
+    (*((t)->is_supp ? (void **)&((merged_supp_t *)(e))->next : \
+       (void **)&((merged_error_t *)(e))->next))
+
+static void
+table_init(table_t *table, bool is_supp)
+{
+    table->num_buckets = 1024;
+    table->num_entries = 0;
+    table->is_supp = is_supp;
+    table->buckets = (void **) xmalloc(table->num_buckets * sizeof(void *));
+    memset(table->buckets, 0, table->num_buckets * sizeof(void *));
+}
+
+static void *
+table_lookup(table_t *table, hash_t hash, const char *key)
+{
+    void *e;
+    for (e = table->buckets[hash % table->num_buckets]; e != NULL;
+         e = ENTRY_NEXT(table, e)) {
+        if (ENTRY_HASH(table, e) == hash && strcmp(ENTRY_KEY(table, e), key) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+static void
+table_add(table_t *table, void *entry)
+{
+    size_t idx;
+    if (table->num_entries >= table->num_buckets * 2) {
+        size_t i, new_num = table->num_buckets * 4;
+        void **new_buckets = (void **) xmalloc(new_num * sizeof(void *));
+        memset(new_buckets, 0, new_num * sizeof(void *));
+        for (i = 0; i < table->num_buckets; i++) {
+            void *e, *next;
+            for (e = table->buckets[i]; e != NULL; e = next) {
+                next = ENTRY_NEXT(table, e);
+                idx = ENTRY_HASH(table, e) % new_num;
+                ENTRY_NEXT(table, e) = new_buckets[idx];
+                new_buckets[idx] = e;
+            }
+        }
+        free(table->buckets);
+        table->buckets = new_buckets;
+        table->num_buckets = new_num;
+    }
+    idx = ENTRY_HASH(table, entry) % table->num_buckets;
+    ENTRY_NEXT(table, entry) = table->buckets[idx];
+    table->buckets[idx] = entry;
+    table->num_entries++;
+}
+
+/* Moves every entry of src into dst, combining those with equal keys */
+static void
+table_merge(table_t *dst, table_t *src)
+{
+    size_t i;
+    for (i = 0; i < src->num_buckets; i++) {
+        void *e, *next, *existing;
+        for (e = src->buckets[i]; e != NULL; e = next) {
+            next = ENTRY_NEXT(src, e);
+            existing = table_lookup(dst, ENTRY_HASH(src, e), ENTRY_KEY(src, e));
+            if (existing == NULL) {
+                table_add(dst, e);
+            } else if (dst->is_supp) {
+                merged_supp_t *s = (merged_supp_t *) e;
+                ((merged_supp_t *) existing)->num_procs += s->num_procs;
+                free(s->key);
+                free(s->text);
+                free(s);
+            } else {
+                merged_error_t *err = (merged_error_t *) e;
+                merged_error_t *ex = (merged_error_t *) existing;
+                ex->total += err->total;
+                ex->num_procs += err->num_procs;
+                ex->instances_tail->next = err->instances;
+                ex->instances_tail = err->instances_tail;
+                free(err->key);
+                free(err->type);
+                free(err->title);
+                free(err->frames);
+                free(err);
+            }
+        }
+    }
+    free(src->buckets);
+    src->buckets = NULL;
+}
+
+/***************************************************************************
+ * Parsing
+ */
+
+static char *
+read_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    long size;
+    char *buf;
+    if (f == NULL)
+        return NULL;
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 ||
+        fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return NULL;
+    }
+    buf = (char *) xmalloc(size + 1);
+    size = (long) fread(buf, 1, size, f);
+    buf[size] = '\0';
+    fclose(f);
+    return buf;
+}
+
+/* Returns the next line, null-terminated in place with any \r removed, and
+ * advances *pos past it.  Returns NULL at the end.
+ */
+static char *
+next_line(char **pos)
+{
+    char *line = *pos, *end;
+    if (*line == '\0')
+        return NULL;
+    end = strchr(line, '\n');
+    if (end == NULL) {
+        *pos = line + strlen(line);
+    } else {
+        *end = '\0';
+        *pos = end + 1;
+    }
+    end = line + strlen(line);
+    while (end > line && (end[-1] == '\r' || end[-1] == ' '))
+        *--end = '\0';
+    return line;
+}
+
+static const char *
+skip_space(const char *s)
+{
+    while (*s == ' ' || *s == '\t')
+        s++;
+    return s;
+}
+
+/* A growable string */
+typedef struct _strbuf_t {
+    char *buf;
+    size_t len;
+    size_t cap;
+} strbuf_t;
+
+static void
+strbuf_append(strbuf_t *sb, const char *str, size_t len)
+{
+    if (sb->len + len + 1 > sb->cap) {
+        size_t cap = (sb->cap == 0) ? 256 : sb->cap;
+        char *buf;
+        while (sb->len + len + 1 > cap)
+            cap *= 2;
+        buf = (char *) xmalloc(cap);
+        if (sb->buf != NULL) {
+            memcpy(buf, sb->buf, sb->len);
+            free(sb->buf);
+        }
+        sb->buf = buf;
+        sb->cap = cap;
+    }
+    memcpy(sb->buf + sb->len, str, len);
+    sb->len += len;
+    sb->buf[sb->len] = '\0';
+}
+
+static char *
+strbuf_take(strbuf_t *sb)
+{
+    char *res = (sb->buf == NULL) ? xstrndup("", 0) : sb->buf;
+    sb->buf = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+    return res;
+}
+
+/* Appends text with whitespace runs collapsed to single spaces and leading and
+ * trailing whitespace removed, so that column alignment differences do not matter.
+ */
+static void
+append_collapsed(strbuf_t *sb, const char *start, const char *end)
+{
+    bool space = false;
+    const char *c;
+    for (c = skip_space(start); c < end; c++) {
+        if (*c == ' ' || *c == '\t') {
+            space = true;
+        } else {
+            if (space)
+                strbuf_append(sb, " ", 1);
+            space = false;
+            strbuf_append(sb, c, 1);
+        }
+    }
+}
+
+/* Returns whether the symbolic part of a frame, "mod!func ..." or with
+ * -callstack_style's symbol-first "func ... mod", names a function.
+ */
+static bool
+frame_has_symbol(const char *sym, const char *end)
+{
+    const char *c;
+    if (sym == end || *sym == '<' /* "<not in a module>", "<system call>" */)
+        return false;
+    c = memchr(sym, '!', end - sym);
+    c = (c == NULL) ? sym : c + 1;
+    return !(*c == '?' && (c + 1 == end || c[1] == ' ' || c[1] == '+'));
+}
+
+/* Appends the part of a frame line that identifies it across processes.
+ * A frame is printed as "# N <symbolic> (0xABS <mod+0xoffs>) modid:M", with the
+ * address part and modid present or not depending on -callstack_style.  The
+ * absolute address and the module id vary from process to process (ASLR, load
+ * order) so they are never part of the key: a frame with a symbol is keyed on
+ * its symbolic text (mod!func plus any offsets and file:line), and one without
+ * is keyed on its mod+offs.
+ */
+static void
+append_normalized_frame(strbuf_t *sb, const char *line)
+{
+    const char *c = skip_space(line) + 1/*'#'*/;
+    const char *sym, *sym_end, *addr, *modoffs = NULL, *modoffs_end = NULL;
+    c = skip_space(c);
+    while (isdigit((unsigned char)*c))
+        c++;
+    sym = skip_space(c);
+    /* The address part is last, so take the last match in case a C++
+     * signature contains " (".
+     */
+    sym_end = sym + strlen(sym);
+    for (addr = sym; (addr = strstr(addr, " (")) != NULL; addr++) {
+        if ((addr[2] == '0' && addr[3] == 'x') || addr[2] == '<')
+            sym_end = addr;
+    }
+    if (*sym_end != '\0') {
+        modoffs = strchr(sym_end, '<');
+        if (modoffs != NULL) {
+            modoffs_end = strchr(modoffs, '>');
+            if (modoffs_end == NULL)
+                modoffs = NULL;
+            else
+                modoffs_end++;
+        }
+    }
+    if (frame_has_symbol(sym, sym_end) || modoffs == NULL)
+        append_collapsed(sb, sym, sym_end);
+    else
+        strbuf_append(sb, modoffs, modoffs_end - modoffs);
+    strbuf_append(sb, "\n", 1);
+}
+
+/* An error as read from one results.txt */
+typedef struct _file_error_t {
+    uint id;
+    uint count;
+    char *key;
+    char *type;
+    char *title;
+    char *frames;
+} file_error_t;
+
+static file_error_t *
+find_file_error(file_error_t *errs, uint num, uint id)
+{
+    /* Ids are increasing in file order */
+    uint lo = 0, hi = num;
+    while (lo < hi) {
+        uint mid = (lo + hi) / 2;
+        if (errs[mid].id == id)
+            return &errs[mid];
+        if (errs[mid].id < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+static void
+add_error_instance(table_t *table, file_error_t *fe, const char *input)
+{
+    hash_t hash = hash_string(fe->key);
+    merged_error_t *err = (merged_error_t *) table_lookup(table, hash, fe->key);
+    instance_t *inst = (instance_t *) xmalloc(sizeof(*inst));
+    inst->input = input;
+    inst->id = fe->id;
+    inst->count = fe->count;
+    inst->next = NULL;
+    if (err == NULL) {
+        err = (merged_error_t *) xmalloc(sizeof(*err));
+        memset(err, 0, sizeof(*err));
+        err->hash = hash;
+        err->key = fe->key;
+        err->type = fe->type;
+        err->title = fe->title;
+        err->frames = fe->frames;
+        err->instances = inst;
+        table_add(table, err);
+    } else {
+        err->instances_tail->next = inst;
+        free(fe->key);
+        free(fe->type);
+        free(fe->title);
+        free(fe->frames);
+    }
+    err->instances_tail = inst;
+    err->total += fe->count;
+    err->num_procs++;
+}
+
+/* Returns whether the file could be read */
+static bool
+parse_results(table_t *table, const char *path, const char *input)
+{
+    char *buf = read_file(path), *pos, *line;
+    file_error_t *errs = NULL, *cur = NULL;
+    uint num_errs = 0, cap_errs = 0, i;
+    bool in_dups = false;
+    strbuf_t key = {0}, frames = {0};
+    if (buf == NULL)
+        return false;
+    pos = buf;
+    while (true) {
+        line = next_line(&pos);
+        if (cur != NULL && (line == NULL || line[0] == '\0' ||
+                            strncmp(line, "Error #", 7) == 0)) {
+            cur->key = strbuf_take(&key);
+            cur->frames = strbuf_take(&frames);
+            cur = NULL;
+        }
+        if (line == NULL)
+            break;
+        if (strncmp(line, "Error #", 7) == 0) {
+            /* "Error #N: TYPE details" */
+            const char *title = strchr(line, ':'), *c;
+            if (title == NULL)
+                continue;
+            title = skip_space(title + 1);
+            if (num_errs == cap_errs) {
+                file_error_t *grow;
+                cap_errs = (cap_errs == 0) ? 16 : cap_errs * 2;
+                grow = (file_error_t *) xmalloc(cap_errs * sizeof(*grow));
+                if (errs != NULL) {
+                    memcpy(grow, errs, num_errs * sizeof(*grow));
+                    free(errs);
+                }
+                errs = grow;
+            }
+            cur = &errs[num_errs++];
+            memset(cur, 0, sizeof(*cur));
+            cur->id = (uint) strtoul(line + 7, NULL, 10);
+            cur->count = 1;
+            cur->title = xstrndup(title, strlen(title));
+            /* The type is the leading capitalized words: the rest has addresses
+             * and sizes that vary from process to process.
+             */
+            for (c = title; isupper((unsigned char)*c) || *c == ' '; c++)
+                ; /* empty */
+            while (c > title && c[-1] == ' ')
+                c--;
+            cur->type = xstrndup(title, c - title);
+            strbuf_append(&key, cur->type, strlen(cur->type));
+            strbuf_append(&key, "\n", 1);
+        } else if (cur != NULL) {
+            if (*skip_space(line) == '#') {
+                append_normalized_frame(&key, line);
+                strbuf_append(&frames, line, strlen(line));
+                strbuf_append(&frames, "\n", 1);
+            }
+        } else if (strcmp(line, "DUPLICATE ERROR COUNTS:") == 0) {
+            /* A nudge may have printed an earlier copy: later counts win */
+            in_dups = true;
+        } else if (in_dups) {
+            const char *c = skip_space(line);
+            if (strncmp(c, "Error #", 7) == 0) {
+                file_error_t *fe = find_file_error(errs, num_errs,
+                                                   (uint) strtoul(c + 7, NULL, 10));
+                c = strchr(c, ':');
+                if (fe != NULL && c != NULL)
+                    fe->count = (uint) strtoul(c + 1, NULL, 10);
+            } else
+                in_dups = false;
+        }
+    }
+    for (i = 0; i < num_errs; i++) {
+        if (errs[i].key != NULL)
+            add_error_instance(table, &errs[i], input);
+    }
+    free(errs);
+    free(buf);
+    return true;
+}
+
+static void
+add_suppression(table_t *table, strbuf_t *key, strbuf_t *text)
+{
+    hash_t hash;
+    merged_supp_t *supp;
+    if (key->len == 0) {
+        strbuf_take(key);
+        free(strbuf_take(text));
+        return;
+    }
+    hash = hash_string(key->buf);
+    supp = (merged_supp_t *) table_lookup(table, hash, key->buf);
+    if (supp == NULL) {
+        supp = (merged_supp_t *) xmalloc(sizeof(*supp));
+        supp->hash = hash;
+        supp->key = strbuf_take(key);
+        supp->text = strbuf_take(text);
+        supp->num_procs = 0;
+        table_add(table, supp);
+    } else {
+        free(strbuf_take(key));
+        free(strbuf_take(text));
+    }
+    supp->num_procs++;
+}
+
+static void
+parse_suppress(table_t *table, const char *path)
+{
+    char *buf = read_file(path), *pos, *line;
+    strbuf_t key = {0}, text = {0};
+    if (buf == NULL)
+        return;
+    pos = buf;
+    while ((line = next_line(&pos)) != NULL) {
+        if (line[0] == '\0') {
+            add_suppression(table, &key, &text);
+        } else if (line[0] == '#') {
+            continue;
+        } else {
+            /* Names hold per-process error numbers so we leave them out of
+             * the key.
+             */
+            if (strncmp(line, "name=", 5) != 0) {
+                strbuf_append(&key, line, strlen(line));
+                strbuf_append(&key, "\n", 1);
+            }
+            strbuf_append(&text, line, strlen(line));
+            strbuf_append(&text, "\n", 1);
+        }
+    }
+    add_suppression(table, &key, &text);
+    free(buf);
+}
+
+/***************************************************************************
+ * Worker threads
+ */
+
+typedef struct _worker_t {
+    char **inputs;
+    uint num_inputs;
+    uint first;
+    uint stride;
+    table_t errors;
+    table_t supps;
+    uint num_read;
+    uint num_failed;
+} worker_t;
+
+/* Handles both a log directory and a path to its results.txt */
+static void
+input_paths(const char *input, char *results, char *suppress)
+{
+    size_t len = strlen(input);
+    const char *base = input + len;
+    while (base > input && base[-1] != '/' && base[-1] != DIRSEP)
+        base--;
+    if (strcmp(base, RESULTS_FNAME) == 0) {
+        snprintf(results, MAX_PATH_LEN, "%s", input);
+        snprintf(suppress, MAX_PATH_LEN, "%.*s%s", (int)(base - input), input,
+                 SUPPRESS_FNAME);
+    } else {
+        snprintf(results, MAX_PATH_LEN, "%s%c%s", input, DIRSEP, RESULTS_FNAME);
+        snprintf(suppress, MAX_PATH_LEN, "%s%c%s", input, DIRSEP, SUPPRESS_FNAME);
+    }
+    results[MAX_PATH_LEN-1] = '\0';
+    suppress[MAX_PATH_LEN-1] = '\0';
+}
+
+static void
+worker_run(worker_t *w)
+{
+    char results[MAX_PATH_LEN], suppress[MAX_PATH_LEN];
+    uint i;
+    for (i = w->first; i < w->num_inputs; i += w->stride) {
+        input_paths(w->inputs[i], results, suppress);
+        if (parse_results(&w->errors, results, w->inputs[i])) {
+            w->num_read++;
+            parse_suppress(&w->supps, suppress);
+        } else {
+            fprintf(stderr, "WARNING: unable to read %s\n", results);
+            w->num_failed++;
+        }
+    }
+}
+
+#ifdef WINDOWS
+static DWORD WINAPI
+worker_main(LPVOID arg)
+{
+    worker_run((worker_t *) arg);
+    return 0;
+}
+#else
+static void *
+worker_main(void *arg)
+{
+    worker_run((worker_t *) arg);
+    return NULL;
+}
+#endif
+
+/***************************************************************************
+ * Output
+ */
+
+static int
+cmp_errors(const void *a, const void *b)
+{
+    const merged_error_t *e1 = *(const merged_error_t **) a;
+    const merged_error_t *e2 = *(const merged_error_t **) b;
+    /* Most widespread first, then most frequent */
+    if (e1->num_procs != e2->num_procs)
+        return (e1->num_procs > e2->num_procs) ? -1 : 1;
+    if (e1->total != e2->total)
+        return (e1->total > e2->total) ? -1 : 1;
+    return strcmp(e1->key, e2->key);
+}
+
+static void **
+table_to_array(table_t *table)
+{
+    void **arr = (void **) xmalloc((table->num_entries + 1) * sizeof(void *));
+    size_t i, n = 0;
+    for (i = 0; i < table->num_buckets; i++) {
+        void *e;
+        for (e = table->buckets[i]; e != NULL; e = ENTRY_NEXT(table, e))
+            arr[n++] = e;
+    }
+    return arr;
+}
+
+static FILE *
+open_output(const char *dir, const char *name)
+{
+    char path[MAX_PATH_LEN];
+    FILE *f;
+    snprintf(path, sizeof(path), "%s%c%s", dir, DIRSEP, name);
+    path[sizeof(path)-1] = '\0';
+    f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: unable to write %s\n", path);
+        exit(1);
+    }
+    return f;
+}
+
+static void
+write_results(const char *outdir, merged_error_t **errs, size_t num,
+              uint num_read, uint num_failed, uint num_listed)
+{
+    FILE *f = open_output(outdir, RESULTS_FNAME);
+    size_t i, j, num_types = 0;
+    const char **types = (const char **) xmalloc((num + 1) * sizeof(char *));
+    uint *type_unique = (uint *) xmalloc((num + 1) * sizeof(uint));
+    uint *type_total = (uint *) xmalloc((num + 1) * sizeof(uint));
+    fprintf(f, "Dr. Memory results merged from %u process(es)\n", num_read);
+    for (i = 0; i < num; i++) {
+        merged_error_t *err = errs[i];
+        instance_t *inst;
+        uint listed = 0;
+        fprintf(f, "\nError #%u: %s\n%s", err->merged_id, err->title, err->frames);
+        fprintf(f, "Note: %u total occurrence(s) in %u process(es)\n",
+                err->total, err->num_procs);
+        for (inst = err->instances; inst != NULL && listed < num_listed;
+             inst = inst->next, listed++) {
+            fprintf(f, "Note: %s Error #%u: %u occurrence(s)\n",
+                    inst->input, inst->id, inst->count);
+        }
+        if (err->num_procs > listed)
+            fprintf(f, "Note: ... and %u more process(es)\n", err->num_procs - listed);
+        /* Few distinct types so a linear search is fine */
+        for (j = 0; j < num_types && strcmp(types[j], err->type) != 0; j++)
+            ; /* empty */
+        if (j == num_types) {
+            types[num_types] = err->type;
+            type_unique[num_types] = 0;
+            type_total[num_types] = 0;
+            num_types++;
+        }
+        type_unique[j]++;
+        type_total[j] += err->total;
+    }
+    fprintf(f, "\n==========================================================================="
+            "\nMERGED SUMMARY:\n");
+    for (j = 0; j < num_types; j++) {
+        fprintf(f, "  %5u unique, %5u total %s\n", type_unique[j], type_total[j],
+                types[j]);
+    }
+    fprintf(f, "  %5u process(es) merged\n", num_read);
+    if (num_failed > 0)
+        fprintf(f, "  %5u input(s) could not be read\n", num_failed);
+    fclose(f);
+    free(types);
+    free(type_unique);
+    free(type_total);
+}
+
+static void
+write_attribution(const char *path, merged_error_t **errs, size_t num)
+{
+    FILE *f = fopen(path, "w");
+    size_t i;
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: unable to write %s\n", path);
+        exit(1);
+    }
+    for (i = 0; i < num; i++) {
+        instance_t *inst;
+        for (inst = errs[i]->instances; inst != NULL; inst = inst->next) {
+            fprintf(f, "%u\t%s\t%u\t%u\n", errs[i]->merged_id, inst->input,
+                    inst->id, inst->count);
+        }
+    }
+    fclose(f);
+}
+
+static void
+write_suppressions(const char *outdir, table_t *supps)
+{
+    FILE *f = open_output(outdir, SUPPRESS_FNAME);
+    merged_supp_t **arr = (merged_supp_t **) table_to_array(supps);
+    size_t i;
+    for (i = 0; i < supps->num_entries; i++) {
+        fprintf(f, "# Generated by %u process(es)\n%s\n",
+                arr[i]->num_procs, arr[i]->text);
+    }
+    fclose(f);
+    free(arr);
+}
+
+/***************************************************************************
+ * Main
+ */
+
+static void
+add_input(char ***inputs, uint *num, uint *cap, const char *input)
+{
+    if (*num == *cap) {
+        char **grow;
+        *cap = (*cap == 0) ? 64 : *cap * 2;
+        grow = (char **) xmalloc(*cap * sizeof(char *));
+        if (*inputs != NULL) {
+            memcpy(grow, *inputs, *num * sizeof(char *));
+            free(*inputs);
+        }
+        *inputs = grow;
+    }
+    (*inputs)[(*num)++] = xstrndup(input, strlen(input));
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *outdir = ".";
+    const char *attrib = NULL;
+    uint num_threads = DEFAULT_THREADS;
+    uint num_listed = DEFAULT_PROCS_LISTED;
+    char **inputs = NULL;
+    uint num_inputs = 0, cap_inputs = 0;
+    worker_t *workers;
+    table_t errors, supps;
+    merged_error_t **arr;
+    uint num_read = 0, num_failed = 0;
+    size_t i;
+    int argi;
+
+    for (argi = 1; argi < argc; argi++) {
+        if (strcmp(argv[argi], "-o") == 0 && argi + 1 < argc) {
+            outdir = argv[++argi];
+        } else if (strcmp(argv[argi], "-j") == 0 && argi + 1 < argc) {
+            num_threads = (uint) strtoul(argv[++argi], NULL, 10);
+        } else if (strcmp(argv[argi], "-list") == 0 && argi + 1 < argc) {
+            num_listed = (uint) strtoul(argv[++argi], NULL, 10);
+        } else if (strcmp(argv[argi], "-attrib") == 0 && argi + 1 < argc) {
+            attrib = argv[++argi];
+        } else if (strcmp(argv[argi], "-f") == 0 && argi + 1 < argc) {
+            char *list = read_file(argv[++argi]), *pos, *line;
+            if (list == NULL) {
+                fprintf(stderr, "ERROR: unable to read %s\n", argv[argi]);
+                return 1;
+            }
+            pos = list;
+            while ((line = next_line(&pos)) != NULL) {
+                if (line[0] != '\0')
+                    add_input(&inputs, &num_inputs, &cap_inputs, line);
+            }
+            free(list);
+        } else if (argv[argi][0] == '-') {
+            fprintf(stderr, USAGE, argv[0], DEFAULT_THREADS, DEFAULT_PROCS_LISTED);
+            return 1;
+        } else
+            add_input(&inputs, &num_inputs, &cap_inputs, argv[argi]);
+    }
+    if (num_inputs == 0) {
+        fprintf(stderr, USAGE, argv[0], DEFAULT_THREADS, DEFAULT_PROCS_LISTED);
+        return 1;
+    }
+    if (num_threads == 0)
+        num_threads = 1;
+    if (num_threads > MAX_THREADS)
+        num_threads = MAX_THREADS;
+    if (num_threads > num_inputs)
+        num_threads = num_inputs;
+
+    /* Each worker reads every num_threads-th input into its own tables, which
+     * we combine at the end, so the workers share nothing.
+     */
+    workers = (worker_t *) xmalloc(num_threads * sizeof(*workers));
+    for (i = 0; i < num_threads; i++) {
+        memset(&workers[i], 0, sizeof(workers[i]));
+        workers[i].inputs = inputs;
+        workers[i].num_inputs = num_inputs;
+        workers[i].first = (uint) i;
+        workers[i].stride = num_threads;
+        table_init(&workers[i].errors, false);
+        table_init(&workers[i].supps, true);
+    }
+    {
+#ifdef WINDOWS
+        HANDLE *threads = (HANDLE *) xmalloc(num_threads * sizeof(HANDLE));
+#else
+        pthread_t *threads = (pthread_t *) xmalloc(num_threads * sizeof(pthread_t));
+#endif
+        /* The main thread takes the first share itself */
+        for (i = 1; i < num_threads; i++) {
+#ifdef WINDOWS
+            threads[i] = CreateThread(NULL, 0, worker_main, &workers[i], 0, NULL);
+            if (threads[i] == NULL)
+#else
+            if (pthread_create(&threads[i], NULL, worker_main, &workers[i]) != 0)
+#endif
+            {
+                fprintf(stderr, "ERROR: unable to create thread\n");
+                return 1;
+            }
+        }
+        worker_run(&workers[0]);
+        for (i = 1; i < num_threads; i++) {
+#ifdef WINDOWS
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+#else
+            pthread_join(threads[i], NULL);
+#endif
+        }
+        free(threads);
+    }
+
+    table_init(&errors, false);
+    table_init(&supps, true);
+    for (i = 0; i < num_threads; i++) {
+        table_merge(&errors, &workers[i].errors);
+        table_merge(&supps, &workers[i].supps);
+        num_read += workers[i].num_read;
+        num_failed += workers[i].num_failed;
+    }
+
+    arr = (merged_error_t **) table_to_array(&errors);
+    qsort(arr, errors.num_entries, sizeof(*arr), cmp_errors);
+    for (i = 0; i < errors.num_entries; i++)
+        arr[i]->merged_id = (uint) i + 1;
+    write_results(outdir, arr, errors.num_entries, num_read, num_failed, num_listed);
+    if (attrib != NULL)
+        write_attribution(attrib, arr, errors.num_entries);
+    write_suppressions(outdir, &supps);
+    printf("Merged %u unique error(s) and %u unique suppression(s) from %u "
+           "process(es) into %s\n", (uint) errors.num_entries, (uint) supps.num_entries,
+           num_read, outdir);
+    /* We leave the tables to process exit */
+    free(arr);
+    return (num_read == 0) ? 1 : 0;
+}
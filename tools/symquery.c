@@ -32,12 +32,15 @@
 #include "dr_frontend.h"
 #include "dr_inject.h" /* for cross-arch support */
 #include <assert.h>
+#include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* Pull in BUFFER_SIZE_ELEMENTS, IF_WINDOWS, TESTALL, and other useful macros */
 #include "utils.h"
 #undef sscanf /* we can use sscanf */
+#include "error_types.h"
 
 #define MAX_FUNC_LEN 256
 
@@ -63,6 +66,7 @@ static void enumerate_symbols(const char *dllpath, const char *match,
                               bool search, bool searchall);
 static void enumerate_lines(const char *dllpath);
 static bool check_architecture(const char *dll, char **argv);
+static bool symbolize_results(const char *logdir);
 
 /* options */
 #define USAGE_PRE "Usage:\n\
@@ -88,6 +92,9 @@ Look up private symbols matching wildcard patterns (glob-style: *,?) for one mod
   %s -e <module> [-v] --list\n\
 List all source lines in a module:\n\
   %s -e <module> [-v] --lines\n\
+Add symbols to the results of a Dr. Memory -defer_symbols run and apply its\n\
+  suppressions:\n\
+  %s -r <logdir>\n\
 Optional parameters:\n\
   -f = show function name\n\
   -v = verbose\n\
@@ -96,7 +103,7 @@ Optional parameters:\n\
 #define PRINT_USAGE(mypath) do {\
     printf(USAGE_PRE, mypath, mypath, mypath);\
     printf(USAGE_MID, mypath, mypath);\
-    printf(USAGE_POST, mypath, mypath);\
+    printf(USAGE_POST, mypath, mypath, mypath);\
 } while (0)
 
 static bool show_func;
@@ -111,6 +118,7 @@ _tmain(int argc, TCHAR *targv[])
     int res = 1;
     char **argv;
     char dll[MAXIMUM_PATH];
+    const char *logdir = NULL;
     int i;
     /* module + address per line */
     char line[MAXIMUM_PATH*2];
@@ -176,6 +184,12 @@ _tmain(int argc, TCHAR *targv[])
             enum_lines = true;
         } else if (_stricmp(argv[i], "-q") == 0) {
             addr2sym_multi = true;
+        } else if (_stricmp(argv[i], "-r") == 0) {
+            if (i+1 >= argc) {
+                PRINT_USAGE(argv[0]);
+                goto cleanup;
+            }
+            logdir = argv[++i];
         } else if (_stricmp(argv[i], "--enum") == 0) {
             enumerate = true;
         } else if (_stricmp(argv[i], "--list") == 0) {
@@ -190,9 +204,11 @@ _tmain(int argc, TCHAR *targv[])
             goto cleanup;
         }
     }
-    if ((!addr2sym_multi && dll[0] == '\0') ||
-        (addr2sym_multi && dll[0] != '\0') ||
-        (!sym2addr && !addr2sym && !addr2sym_multi && !enumerate_all && !enum_lines)) {
+    if (logdir != NULL ? (dll[0] != '\0' || addr2sym_multi) :
+        ((!addr2sym_multi && dll[0] == '\0') ||
+         (addr2sym_multi && dll[0] != '\0') ||
+         (!sym2addr && !addr2sym && !addr2sym_multi && !enumerate_all &&
+          !enum_lines))) {
         PRINT_USAGE(argv[0]);
         goto cleanup;
     }
@@ -209,7 +225,12 @@ _tmain(int argc, TCHAR *targv[])
         goto cleanup;
     }
 
-    if (!addr2sym_multi) {
+    if (logdir != NULL) {
+        if (!symbolize_results(logdir)) {
+            drsym_exit();
+            goto cleanup;
+        }
+    } else if (!addr2sym_multi) {
         if (enum_lines)
             enumerate_lines(dll);
         else if (enumerate_all)
@@ -459,3 +480,1044 @@ enumerate_lines(const char *dllpath)
         printf("line enum error %d\n", symres);
 }
 
+
+/***************************************************************************
+ * Offline symbolization of the results of a Dr. Memory -defer_symbols run
+ */
+
+#define MODULES_FNAME "modules.txt"
+#define RESULTS_FNAME "results.txt"
+
+static const char * const deferred_fnames[] = {
+    RESULTS_FNAME,
+    "potential_errors.txt",
+};
+
+/* The -callstack_style flags, which the client records in modules.txt.
+ * Keep in sync with callstack.h.
+ */
+enum {
+    PRINT_FRAME_NUMBERS        = 0x0001,
+    PRINT_ABS_ADDRESS          = 0x0002,
+    PRINT_MODULE_OFFSETS       = 0x0004,
+    PRINT_SYMBOL_OFFSETS       = 0x0008,
+    PRINT_LINE_OFFSETS         = 0x0010,
+    PRINT_SRCFILE_NEWLINE      = 0x0020,
+    PRINT_SRCFILE_NO_COLON     = 0x0040,
+    PRINT_SYMBOL_FIRST         = 0x0080,
+    PRINT_ALIGN_COLUMNS        = 0x0100,
+    PRINT_NOSYMS_OFFSETS       = 0x0200,
+    PRINT_MODULE_ID            = 0x0400,
+    PRINT_VSTUDIO_FILE_LINE    = 0x0800,
+    PRINT_EXPAND_TEMPLATES     = 0x1000,
+};
+
+/* Line layout details from callstack.c and report.c */
+#define LINE_PREFIX "    "
+#define NO_SRCFILE_LINE LINE_PREFIX"??:0"
+#define SYSCALL_SRCFILE_LINE LINE_PREFIX"<system call>"
+#define INFO_PFX "Note: "
+#define NOT_IN_MODULE "<not in a module>"
+#define SYSCALL_PFX "system call "
+
+/* The client's -callstack_style default, for a modules.txt without print_flags */
+static uint print_flags = PRINT_FRAME_NUMBERS | PRINT_ABS_ADDRESS |
+    PRINT_ALIGN_COLUMNS | PRINT_NOSYMS_OFFSETS;
+
+/* Module paths indexed by the module ids in modules.txt */
+static char **modpaths;
+static uint num_modpaths;
+
+/* The client's -callstack_truncate_below patterns, also from modules.txt */
+static char **truncate_below;
+static uint num_truncate_below;
+
+/* A callstack frame from the results, looked up if it is in a module */
+typedef struct _frame_t {
+    size_t prefix_len;   /* the callstack prefix starting the line */
+    int num;             /* frame number within its callstack */
+    bool is_module;
+    bool symbolized;
+    bool has_symbols;
+    bool truncated;      /* below a -callstack_truncate_below frame */
+    char absaddr[32];    /* empty if not printed */
+    char modname[MAXIMUM_PATH];
+    char modoffs[32];
+    uint modid;
+    char func[MAX_FUNC_LEN];
+    size_t funcoffs;
+    char file[MAXIMUM_PATH]; /* empty if no line information */
+    uint64 line;
+    size_t lineoffs;
+    size_t max_func_len; /* longest function name in this frame's callstack */
+} frame_t;
+
+static char *
+read_entire_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    char *buf;
+    long size;
+    if (f == NULL)
+        return NULL;
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 ||
+        fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return NULL;
+    }
+    buf = (char *) malloc(size + 1);
+    if (buf != NULL) {
+        size = (long) fread(buf, 1, size, f);
+        buf[size] = '\0';
+    }
+    fclose(f);
+    return buf;
+}
+
+/* Splits buf in place into lines without their line endings.  Returns the line
+ * array, which the caller must free, and whether lines end in "\r\n".
+ */
+static char **
+split_lines(char *buf, uint *num_lines OUT, bool *crlf OUT)
+{
+    char **lines;
+    char *line, *next;
+    uint count = 1;
+    for (line = buf; (line = strchr(line, '\n')) != NULL; line++)
+        count++;
+    lines = (char **) malloc(count * sizeof(char *));
+    if (lines == NULL)
+        return NULL;
+    *crlf = false;
+    *num_lines = 0;
+    for (line = buf; *line != '\0'; line = next) {
+        next = strchr(line, '\n');
+        if (next == NULL)
+            next = line + strlen(line);
+        else {
+            *next++ = '\0';
+            if (next - 2 >= line && next[-2] == '\r') {
+                next[-2] = '\0';
+                *crlf = true;
+            }
+        }
+        lines[(*num_lines)++] = line;
+    }
+    return lines;
+}
+
+static bool
+read_module_list(const char *logdir)
+{
+    char path[MAXIMUM_PATH];
+    char *buf, *line, *next;
+    dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s/%s", logdir, MODULES_FNAME);
+    NULL_TERMINATE_BUFFER(path);
+    buf = read_entire_file(path);
+    if (buf == NULL) {
+        printf("ERROR: unable to read %s\n", path);
+        return false;
+    }
+    for (line = buf; *line != '\0'; line = next) {
+        uint id;
+        int len;
+        next = line + strcspn(line, "\r\n");
+        if (*next != '\0') {
+            *next++ = '\0';
+            next += strspn(next, "\r\n");
+        }
+        /* "print_flags: <x>" gives the -callstack_style to reproduce */
+        if (sscanf(line, "print_flags: %x", &id) == 1) {
+            print_flags = id;
+            continue;
+        }
+        /* "truncate_below: <pattern>", one per pattern */
+        if (strncmp(line, "truncate_below: ", 16) == 0) {
+            char **grow = (char **)
+                realloc(truncate_below, (num_truncate_below + 1) * sizeof(char *));
+            if (grow == NULL)
+                break;
+            truncate_below = grow;
+            truncate_below[num_truncate_below++] = strdup(line + 16);
+            continue;
+        }
+        /* "modid: <id> [checksum: <x> timestamp: <x>] <path>" */
+        if (sscanf(line, "modid: %u %n", &id, &len) != 1)
+            continue;
+        line += len;
+        if (strncmp(line, "checksum:", 9) == 0) {
+            int tokens;
+            for (tokens = 0; tokens < 4; tokens++) {
+                line += strcspn(line, " ");
+                line += strspn(line, " ");
+            }
+        }
+        if (id >= num_modpaths) {
+            uint new_num = (id + 1 > num_modpaths * 2) ? id + 1 : num_modpaths * 2;
+            char **grow = (char **) realloc(modpaths, new_num * sizeof(char *));
+            if (grow == NULL)
+                break;
+            memset(grow + num_modpaths, 0, (new_num - num_modpaths) * sizeof(char *));
+            modpaths = grow;
+            num_modpaths = new_num;
+        }
+        if (modpaths[id] == NULL)
+            modpaths[id] = strdup(line);
+    }
+    free(buf);
+    if (TEST(PRINT_EXPAND_TEMPLATES, print_flags))
+        demangle_flags |= DRSYM_DEMANGLE_PDB_TEMPLATES;
+    else
+        demangle_flags &= ~DRSYM_DEMANGLE_PDB_TEMPLATES;
+    return true;
+}
+
+/* Copies the text from start up to end, minus trailing spaces, into dst */
+static void
+copy_trimmed(char *dst, size_t dst_sz, const char *start, const char *end)
+{
+    while (end > start && end[-1] == ' ')
+        end--;
+    dr_snprintf(dst, dst_sz, "%.*s", (int)(end - start), start);
+    dst[dst_sz - 1] = '\0';
+}
+
+/* Parses a callstack frame as printed by the client without symbols, in any
+ * -callstack_style.  A module frame always ends with its module and offset and id:
+ *   # 1 foo.exe!?   +0x0   (0x00401234 <foo.exe+0x1234>) modid:1
+ *   ?+0x0 foo.exe (<foo.exe+0x1234>) modid:1
+ * Returns NULL if the line is not a frame.
+ */
+static frame_t *
+frame_parse(const char *line)
+{
+    frame_t *frame;
+    const char *body, *modid, *addrs, *c, *lt, *gt, *plus;
+    /* The callstack prefix is blank, or INFO_PFX for auxiliary callstacks */
+    body = line + strspn(line, " ");
+    if (strncmp(body, INFO_PFX, strlen(INFO_PFX)) == 0) {
+        body += strlen(INFO_PFX);
+        body += strspn(body, " ");
+    }
+    frame = (frame_t *) calloc(1, sizeof(*frame));
+    if (frame == NULL)
+        return NULL;
+    frame->prefix_len = body - line;
+    frame->num = -1;
+    if (TEST(PRINT_FRAME_NUMBERS, print_flags)) {
+        /* "#%2d " */
+        if (*body != '#' || sscanf(body + 1, "%d", &frame->num) != 1)
+            goto not_frame;
+        c = body + 1 + strspn(body + 1, " ");
+        c += strspn(c, "0123456789");
+        if (*c != ' ')
+            goto not_frame;
+        body = c + 1;
+    }
+    if (strncmp(body, NOT_IN_MODULE, strlen(NOT_IN_MODULE)) == 0) {
+        dr_snprintf(frame->func, BUFFER_SIZE_ELEMENTS(frame->func), NOT_IN_MODULE);
+        NULL_TERMINATE_BUFFER(frame->func);
+        return frame;
+    }
+    if (strncmp(body, SYSCALL_PFX, strlen(SYSCALL_PFX)) == 0) {
+        copy_trimmed(frame->func, BUFFER_SIZE_ELEMENTS(frame->func),
+                     body, body + strlen(body));
+        return frame;
+    }
+    modid = strstr(body, " modid:");
+    if (modid == NULL || sscanf(modid, " modid:%u", &frame->modid) != 1 ||
+        frame->modid >= num_modpaths || modpaths[frame->modid] == NULL)
+        goto not_frame;
+    /* The last " (" before the id starts the addresses */
+    addrs = NULL;
+    for (c = strstr(body, " ("); c != NULL && c < modid; c = strstr(c + 1, " ("))
+        addrs = c;
+    if (addrs == NULL)
+        goto not_frame;
+    lt = strchr(addrs, '<');
+    gt = (lt == NULL) ? NULL : strchr(lt, '>');
+    if (lt == NULL || gt == NULL || gt > modid)
+        goto not_frame;
+    for (plus = gt; plus > lt && *plus != '+'; plus--)
+        ; /* find the last '+' */
+    if (plus == lt)
+        goto not_frame;
+    if (lt > addrs + 2) {
+        copy_trimmed(frame->absaddr, BUFFER_SIZE_ELEMENTS(frame->absaddr),
+                     addrs + 2, lt);
+    }
+    copy_trimmed(frame->modname, BUFFER_SIZE_ELEMENTS(frame->modname), lt + 1, plus);
+    copy_trimmed(frame->modoffs, BUFFER_SIZE_ELEMENTS(frame->modoffs), plus + 1, gt);
+    frame->is_module = true;
+    /* Until looked up, as the client printed it */
+    dr_snprintf(frame->func, BUFFER_SIZE_ELEMENTS(frame->func), "?");
+    NULL_TERMINATE_BUFFER(frame->func);
+    return frame;
+
+ not_frame:
+    free(frame);
+    return NULL;
+}
+
+static void
+frame_lookup(frame_t *frame, uint idx)
+{
+    drsym_error_t symres;
+    drsym_info_t sym;
+    size_t modoffs;
+    char name[MAX_FUNC_LEN];
+    char file[MAXIMUM_PATH];
+    if (sscanf(frame->modoffs, "0x"SIZE_FMT, &modoffs) != 1)
+        return;
+    /* As at runtime, look up the call rather than the instruction after it.
+     * We do not know whether the top frame is a retaddr so we assume not.
+     */
+    if (idx > 0)
+        modoffs--;
+    sym.struct_size = sizeof(sym);
+    sym.name = name;
+    sym.name_size = BUFFER_SIZE_BYTES(name);
+    sym.file = file;
+    sym.file_size = BUFFER_SIZE_BYTES(file);
+    symres = drsym_lookup_address(modpaths[frame->modid], modoffs, &sym,
+                                  demangle_flags);
+    if (symres != DRSYM_SUCCESS && symres != DRSYM_ERROR_LINE_NOT_AVAILABLE)
+        return;
+    frame->symbolized = true;
+    frame->has_symbols = TEST(DRSYM_SYMBOLS, sym.debug_kind);
+    dr_snprintf(frame->func, BUFFER_SIZE_ELEMENTS(frame->func), "%s", sym.name);
+    NULL_TERMINATE_BUFFER(frame->func);
+    frame->funcoffs = modoffs - sym.start_offs;
+    if (symres == DRSYM_SUCCESS) {
+        dr_snprintf(frame->file, BUFFER_SIZE_ELEMENTS(frame->file), "%s", sym.file);
+        NULL_TERMINATE_BUFFER(frame->file);
+        frame->line = sym.line;
+        frame->lineoffs = sym.line_offs;
+    }
+}
+
+/* The pattern may contain '*' and '?' wildcards, as for the client */
+static bool
+pattern_matches(const char *text, const char *pattern, bool ignore_case)
+{
+    const char *text_last_asterisk = NULL, *pattern_last_asterisk = NULL;
+    while (*text != '\0') {
+        char cmp_cur = *text, cmp_pat = *pattern;
+        if (ignore_case) {
+            cmp_cur = (char) tolower(cmp_cur);
+            cmp_pat = (char) tolower(cmp_pat);
+        }
+        if (*pattern == '*') {
+            while (*++pattern == '*')
+                ; /* skip consecutive '*'s */
+            if (*pattern == '\0')
+                return true;
+            text_last_asterisk = text;
+            pattern_last_asterisk = pattern;
+        } else if (cmp_cur == cmp_pat || *pattern == '?') {
+            text++;
+            pattern++;
+        } else if (text_last_asterisk != NULL) {
+            pattern = pattern_last_asterisk;
+            text = text_last_asterisk++;
+        } else
+            return false;
+    }
+    while (*pattern == '*')
+        pattern++;
+    return *pattern == '\0';
+}
+
+static bool
+frame_truncates_below(const frame_t *frame)
+{
+    uint i;
+    for (i = 0; i < num_truncate_below; i++) {
+        if (pattern_matches(frame->func, truncate_below[i], false))
+            return true;
+    }
+    return false;
+}
+
+/* Looks up every module frame and, since the client aligns columns per callstack,
+ * records the longest function name in each one.  As the client does once it
+ * has names, it also cuts each callstack after a -callstack_truncate_below frame
+ * (i#700).
+ */
+static void
+lookup_callstacks(char **lines, frame_t **frames, uint num_lines)
+{
+    uint i, start, end, idx;
+    for (start = 0; start < num_lines; start = end) {
+        size_t max_len = 0;
+        bool truncated = false;
+        if (frames[start] == NULL) {
+            end = start + 1;
+            continue;
+        }
+        idx = 0;
+        for (end = start; end < num_lines; end++) {
+            frame_t *frame = frames[end];
+            if (frame == NULL) {
+                /* -callstack_style 0x20 puts file:line on its own line */
+                if (strcmp(lines[end], NO_SRCFILE_LINE) == 0 ||
+                    strcmp(lines[end], SYSCALL_SRCFILE_LINE) == 0)
+                    continue;
+                break;
+            }
+            if (frame->prefix_len != frames[start]->prefix_len)
+                break;
+            if (frame->is_module)
+                frame_lookup(frame, frame->num >= 0 ? (uint)frame->num : idx);
+            frame->truncated = truncated;
+            if (!truncated) {
+                if (strlen(frame->func) > max_len)
+                    max_len = strlen(frame->func);
+                truncated = frame_truncates_below(frame);
+            }
+            idx++;
+        }
+        for (i = start; i < end; i++) {
+            if (frames[i] != NULL)
+                frames[i]->max_func_len = max_len;
+        }
+    }
+}
+
+static void
+print_file_and_line(FILE *out, frame_t *frame, const char *line, uint flags,
+                    const char *eol)
+{
+    if (frame->file[0] == '\0') {
+        if (TEST(PRINT_SRCFILE_NEWLINE, flags))
+            fprintf(out, "%s"NO_SRCFILE_LINE, eol);
+        return;
+    }
+    if (TEST(PRINT_SRCFILE_NEWLINE, flags))
+        fprintf(out, "%s%.*s"LINE_PREFIX, eol, (int)frame->prefix_len, line);
+    else
+        fprintf(out, " [");
+    fprintf(out, "%s", frame->file);
+    if (TEST(PRINT_VSTUDIO_FILE_LINE, flags))
+        fprintf(out, "(");
+    else if (!TEST(PRINT_SRCFILE_NO_COLON, flags))
+        fprintf(out, ":");
+    else /* windbg format */
+        fprintf(out, " @ ");
+    fprintf(out, "%"INT64_FORMAT"u", frame->line);
+    if (TEST(PRINT_LINE_OFFSETS, flags))
+        fprintf(out, "+"SIZE_FMTX, frame->lineoffs);
+    if (TEST(PRINT_VSTUDIO_FILE_LINE, flags))
+        fprintf(out, "):");
+    if (!TEST(PRINT_SRCFILE_NEWLINE, flags))
+        fprintf(out, "]");
+}
+
+/* Prints a looked-up module frame the way the client's print_frame() would
+ * have with symbols, up to but not including the final line ending.
+ */
+static void
+print_frame(FILE *out, frame_t *frame, const char *line, const char *eol)
+{
+    uint flags = print_flags;
+    int align_sym = 0, align_mod = 0, align_moffs = 0;
+    bool print_addrs, later_info;
+    char funcoffs[32];
+
+    if (!frame->has_symbols && TEST(PRINT_NOSYMS_OFFSETS, flags))
+        flags |= PRINT_ABS_ADDRESS | PRINT_MODULE_OFFSETS | PRINT_SYMBOL_OFFSETS;
+    print_addrs = TEST(PRINT_ABS_ADDRESS | PRINT_MODULE_OFFSETS | PRINT_MODULE_ID,
+                       flags);
+    later_info = print_addrs || TEST(PRINT_SYMBOL_OFFSETS, flags) ||
+        (frame->file[0] != '\0' && !TEST(PRINT_SRCFILE_NEWLINE, flags));
+    if (TEST(PRINT_ALIGN_COLUMNS, flags)) {
+        if (TEST(PRINT_SYMBOL_FIRST, flags) || later_info) {
+            align_sym = (int)(frame->max_func_len > 0 ?
+                              (frame->max_func_len < 60 ? frame->max_func_len : 60) :
+                              35);
+        }
+        if ((TEST(PRINT_SYMBOL_OFFSETS, flags) && !TEST(PRINT_SYMBOL_FIRST, flags)) ||
+            later_info)
+            align_mod = 13;
+        if (TEST(PRINT_SYMBOL_FIRST, flags) || later_info)
+            align_moffs = 6;
+    }
+
+    fprintf(out, "%.*s", (int)frame->prefix_len, line);
+    if (TEST(PRINT_FRAME_NUMBERS, flags))
+        fprintf(out, "#%2d ", frame->num);
+    if (!TEST(PRINT_SYMBOL_FIRST, flags)) {
+        int width = align_mod + align_sym - (int)strlen(frame->modname);
+        fprintf(out, "%s!%-*s", frame->modname, width > 0 ? width : 0, frame->func);
+    } else
+        fprintf(out, "%-*s", align_sym, frame->func);
+    if (TEST(PRINT_SYMBOL_OFFSETS, flags)) {
+        dr_snprintf(funcoffs, BUFFER_SIZE_ELEMENTS(funcoffs), SIZE_FMT, frame->funcoffs);
+        NULL_TERMINATE_BUFFER(funcoffs);
+        fprintf(out, "+0x%-*s", align_moffs, funcoffs);
+    }
+    if (TEST(PRINT_SYMBOL_FIRST, flags))
+        fprintf(out, " %-*s", align_mod, frame->modname);
+    if (!TEST(PRINT_SRCFILE_NEWLINE, flags))
+        print_file_and_line(out, frame, line, flags, eol);
+
+    if (print_addrs) {
+        fprintf(out, " (");
+        if (TEST(PRINT_ABS_ADDRESS, flags) && frame->absaddr[0] != '\0') {
+            fprintf(out, "%s", frame->absaddr);
+            if (TEST(PRINT_MODULE_OFFSETS, flags))
+                fprintf(out, " ");
+        }
+        if (TEST(PRINT_MODULE_OFFSETS, flags))
+            fprintf(out, "<%s+%s>", frame->modname, frame->modoffs);
+        fprintf(out, ")");
+        if (TEST(PRINT_MODULE_ID, flags))
+            fprintf(out, " modid:%u", frame->modid);
+    }
+    if (TEST(PRINT_SRCFILE_NEWLINE, flags))
+        print_file_and_line(out, frame, line, flags, eol);
+}
+
+/***************************************************************************
+ * Offline suppression
+ *
+ * The client can only match <mod+0x1234> suppression frames while symbols are
+ * deferred, so once frames have names we match the rest here and remove the
+ * errors that turn out to be suppressed.  The error types come from
+ * error_types.h; the parsing and matching mirror report.c, which works on its
+ * own callstack structures, so keep the two in sync.
+ */
+
+typedef struct _supp_frame_t {
+    bool is_ellipsis; /* "..." wildcard, can be combined with modname */
+    bool is_star;     /* "*" wildcard */
+    bool is_module;
+    char *modname;
+    char *modoffs;
+    char *func;
+    struct _supp_frame_t *next;
+} supp_frame_t;
+
+typedef struct _supp_spec_t {
+    int type;
+    char *name;
+    char *instruction;
+    supp_frame_t *frames;
+    supp_frame_t *last_frame;
+    struct _supp_spec_t *next;
+} supp_spec_t;
+
+static supp_spec_t *supp_list;
+
+/* Mirrors report.c's get_suppress_type(), for error titles as well */
+static int
+get_error_type(const char *text)
+{
+    int i;
+    if (strncmp(text, DRMEM_VALGRIND_TOOLNAME":", strlen(DRMEM_VALGRIND_TOOLNAME) + 1)
+        == 0)
+        text += strlen(DRMEM_VALGRIND_TOOLNAME) + 1;
+    for (i = 0; i < ERROR_MAX_VAL; i++) {
+        if (strncmp(text, suppress_name[i], strlen(suppress_name[i])) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/* Maps the second line of a legacy Valgrind-format suppression to an error type,
+ * as report.c's suppress_spec_prefix_line() does.  Returns -1 for a type the
+ * client ignores, such as one for another Valgrind tool.
+ */
+static int
+get_valgrind_error_type(const char *line, bool *is_syscall OUT)
+{
+    int type = get_error_type(line);
+    *is_syscall = false;
+    if (type >= 0)
+        return type;
+    if (strncmp(line, "Memcheck:Addr", 13) == 0 || strcmp(line, "Memcheck:Jump") == 0)
+        return ERROR_UNADDRESSABLE;
+    if (strncmp(line, "Memcheck:Value", 14) == 0 || strcmp(line, "Memcheck:Cond") == 0)
+        return ERROR_UNDEFINED;
+    if (strcmp(line, "Memcheck:Param") == 0) {
+        *is_syscall = true;
+        return ERROR_UNDEFINED;
+    }
+    if (strcmp(line, "Memcheck:Leak") == 0)
+        return ERROR_LEAK;
+    if (strcmp(line, "Memcheck:Free") == 0)
+        return ERROR_INVALID_HEAP_ARG;
+    if (strcmp(line, "Memcheck:Overlap") == 0)
+        return ERROR_WARNING;
+    return -1;
+}
+
+static char *
+strdup_range(const char *start, const char *end)
+{
+    char *s = (char *) malloc(end - start + 1);
+    if (s != NULL) {
+        memcpy(s, start, end - start);
+        s[end - start] = '\0';
+    }
+    return s;
+}
+
+/* Returns false for a frame the client would have rejected */
+static bool
+supp_spec_add_frame(supp_spec_t *spec, const char *line)
+{
+    supp_frame_t *frame = (supp_frame_t *) calloc(1, sizeof(*frame));
+    const char *bang = strchr(line, '!'), *plus = strchr(line, '+');
+    if (frame == NULL)
+        return false;
+    if (line[0] == '<' && plus != NULL && strchr(line, '>') != NULL && bang == NULL) {
+        frame->is_module = true;
+        frame->modname = strdup_range(line + 1, plus);
+        frame->modoffs = strdup_range(plus + 1, strchr(line, '>'));
+    } else if (bang != NULL && line[0] != '<') {
+        frame->is_module = true;
+        frame->modname = strdup_range(line, bang);
+        if (strcmp(bang + 1, "...") == 0)
+            frame->is_ellipsis = true;
+        else
+            frame->func = strdup(bang + 1);
+    } else if (strcmp(line, NOT_IN_MODULE) == 0 || strstr(line, SYSCALL_PFX) != NULL)
+        frame->func = strdup(line);
+    else if (strcmp(line, "...") == 0)
+        frame->is_ellipsis = true;
+    else if (strcmp(line, "*") == 0)
+        frame->is_star = true;
+    else {
+        free(frame);
+        return false;
+    }
+    if (spec->last_frame != NULL)
+        spec->last_frame->next = frame;
+    else
+        spec->frames = frame;
+    spec->last_frame = frame;
+    return true;
+}
+
+/* Returns false for a frame the client would have rejected.  Valgrind frames
+ * become Dr. Memory ones as in report.c: fun:sym is *!sym and obj:mod is mod!*.
+ */
+static bool
+supp_spec_add_valgrind_frame(supp_spec_t *spec, const char *line, bool is_syscall)
+{
+    supp_frame_t *frame = (supp_frame_t *) calloc(1, sizeof(*frame));
+    if (frame == NULL)
+        return false;
+    if (strncmp(line, "fun:", 4) == 0) {
+        frame->is_module = true;
+        frame->modname = strdup("*");
+        frame->func = strdup(line + 4);
+    } else if (strncmp(line, "obj:", 4) == 0) {
+        frame->is_module = true;
+        frame->modname = strdup(line + 4);
+        frame->func = strdup("*");
+    } else if (strncmp(line, "...", 3) == 0)
+        frame->is_ellipsis = true;
+    else if (line[0] == '*')
+        frame->is_star = true;
+    else if (is_syscall && spec->frames == NULL) {
+        /* The syscall name, minus any "(param)" */
+        frame->func = strdup_range(line, line + strcspn(line, "("));
+    } else {
+        free(frame);
+        return false;
+    }
+    if (spec->last_frame != NULL)
+        spec->last_frame->next = frame;
+    else
+        spec->frames = frame;
+    spec->last_frame = frame;
+    return true;
+}
+
+static void
+supp_spec_free(supp_spec_t *spec)
+{
+    supp_frame_t *frame, *next;
+    for (frame = spec->frames; frame != NULL; frame = next) {
+        next = frame->next;
+        free(frame->modname);
+        free(frame->modoffs);
+        free(frame->func);
+        free(frame);
+    }
+    free(spec->name);
+    free(spec->instruction);
+    free(spec);
+}
+
+/* Returns false if the client would have used the suppression but we cannot */
+static bool
+supp_spec_finish(supp_spec_t *spec, bool valid)
+{
+    if (!valid || spec->type < 0 || spec->frames == NULL ||
+        spec->last_frame->is_ellipsis) {
+        supp_spec_free(spec);
+        return valid;
+    }
+    spec->next = supp_list;
+    supp_list = spec;
+    return true;
+}
+
+/* Reads a suppression file in the Dr. Memory or the legacy Valgrind format.
+ * The client already rejected malformed files, so we warn about, and skip,
+ * anything we do not understand.
+ */
+static void
+read_suppression_file(const char *path)
+{
+    char *buf, **lines;
+    uint num_lines, i, skipped = 0;
+    bool crlf, valid = false, is_syscall = false;
+    int brace_line = -1; /* line within a Valgrind-format entry, or -1 */
+    supp_spec_t *spec = NULL;
+    buf = read_entire_file(path);
+    if (buf == NULL) {
+        printf("WARNING: unable to read suppression file %s\n", path);
+        return;
+    }
+    lines = split_lines(buf, &num_lines, &crlf);
+    for (i = 0; lines != NULL && i < num_lines; i++) {
+        char *line = lines[i] + strspn(lines[i], " \t");
+        char *end = line + strlen(line);
+        int type = -1;
+        while (end > line && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+            *--end = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        if (brace_line == -1) {
+            type = get_error_type(line);
+            if (type < 0 && line[0] == '{')
+                brace_line = 0;
+        } else if (line[0] == '}') {
+            brace_line = -1;
+            continue;
+        } else
+            brace_line++;
+        if (type >= 0 || brace_line == 0) {
+            if (spec != NULL && !supp_spec_finish(spec, valid))
+                skipped++;
+            spec = (supp_spec_t *) calloc(1, sizeof(*spec));
+            if (spec == NULL)
+                break;
+            spec->type = type; /* set by the 2nd line for Valgrind format */
+            valid = true;
+        } else if (spec == NULL)
+            continue;
+        else if (brace_line == 1)
+            spec->name = strdup(line);
+        else if (brace_line == 2)
+            spec->type = get_valgrind_error_type(line, &is_syscall);
+        else if (strncmp(line, "name=", 5) == 0) {
+            free(spec->name);
+            spec->name = strdup(line + 5);
+        } else if (strncmp(line, "instruction=", 12) == 0) {
+            free(spec->instruction);
+            spec->instruction = strdup(line + 12);
+        } else if (brace_line > 0) {
+            if (!supp_spec_add_valgrind_frame(spec, line, is_syscall))
+                valid = false;
+        } else if (!supp_spec_add_frame(spec, line))
+            valid = false;
+    }
+    if (spec != NULL && !supp_spec_finish(spec, valid))
+        skipped++;
+    if (skipped > 0) {
+        printf("WARNING: skipped %u suppression(s) in %s that the client may have "
+               "applied: errors they match remain in the results\n", skipped, path);
+    }
+    free(lines);
+    free(buf);
+}
+
+/* The client lists the suppression files it read at the top of results.txt:
+ *   Recorded 42 suppression(s) from default c:\drmemory\bin\suppress-default.txt
+ */
+static void
+read_suppressions(const char *logdir)
+{
+    char path[MAXIMUM_PATH];
+    char *buf, **lines;
+    uint num_lines, i;
+    bool crlf;
+    dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s/%s", logdir, RESULTS_FNAME);
+    NULL_TERMINATE_BUFFER(path);
+    buf = read_entire_file(path);
+    if (buf == NULL)
+        return;
+    lines = split_lines(buf, &num_lines, &crlf);
+    for (i = 0; lines != NULL && i < num_lines; i++) {
+        int len = 0;
+        char label[16];
+        if (sscanf(lines[i], "Recorded %*d suppression(s) from %15s %n",
+                   label, &len) == 1 && len > 0)
+            read_suppression_file(lines[i] + len);
+    }
+    free(lines);
+    free(buf);
+}
+
+static bool
+frame_matches_modname(const frame_t *frame, const supp_frame_t *supp)
+{
+    return pattern_matches(frame->modname, supp->modname, FILESYS_CASELESS);
+}
+
+static bool
+frame_matches_supp_frame(const frame_t *frame, const supp_frame_t *supp)
+{
+    if (supp->is_ellipsis)
+        return !supp->is_module || frame_matches_modname(frame, supp);
+    if (supp->is_star)
+        return true;
+    if (!supp->is_module)
+        return !frame->is_module && pattern_matches(frame->func, supp->func, false);
+    if (!frame->is_module)
+        return false;
+    if (supp->func == NULL) {
+        return (frame_matches_modname(frame, supp) &&
+                pattern_matches(frame->modoffs, supp->modoffs, true/*ignore case*/));
+    }
+    return (frame_matches_modname(frame, supp) &&
+            pattern_matches(frame->func, supp->func, false));
+}
+
+/* Mirrors report.c's stack_matches_suppression() */
+static bool
+stack_matches_suppression(frame_t **stack, uint num_frames, const char *instruction,
+                          const supp_spec_t *spec)
+{
+    uint i;
+    int last_ellipsis = -1;
+    const supp_frame_t *cur_ellipsis = NULL;
+    const supp_frame_t *supp = spec->frames;
+    if (spec->instruction != NULL &&
+        (instruction == NULL || !pattern_matches(instruction, spec->instruction, false)))
+        return false;
+    for (i = 0; i < num_frames; i++) {
+        if (supp == NULL)
+            return true; /* a suppression is a prefix */
+        else if (frame_matches_supp_frame(stack[i], supp)) {
+            if (supp->is_ellipsis) {
+                cur_ellipsis = supp;
+                supp = supp->next;
+                last_ellipsis = i;
+                i--;
+            } else
+                supp = supp->next;
+        } else if (last_ellipsis > -1 &&
+                   (!cur_ellipsis->is_module ||
+                    frame_matches_modname(stack[i], cur_ellipsis))) {
+            last_ellipsis++;
+            i = last_ellipsis - 1;
+        } else
+            return false;
+    }
+    return supp == NULL;
+}
+
+static supp_spec_t *
+error_suppressed(int type, frame_t **stack, uint num_frames, const char *instruction)
+{
+    supp_spec_t *spec;
+    for (spec = supp_list; spec != NULL; spec = spec->next) {
+        /* qualified leaks are also checked against LEAK suppressions */
+        if ((spec->type == type ||
+             (spec->type == ERROR_LEAK && type > ERROR_LEAK && type <= ERROR_MAX_LEAK)) &&
+            stack_matches_suppression(stack, num_frames, instruction, spec))
+            return spec;
+    }
+    return NULL;
+}
+
+/* Finds the errors that match a suppression now that their frames have names.
+ * Each error report starts with a title line and its callstack and ends at a
+ * blank line.  Sets drop[] for the lines of each suppressed report and matched[]
+ * for its title.  Returns the number of suppressed errors.
+ */
+static uint
+suppress_errors(char **lines, frame_t **frames, uint num_lines, bool *drop,
+                supp_spec_t **matched)
+{
+    uint i, count = 0;
+    uint start = 0, num_frames = 0;
+    int type = -1;
+    bool in_error = false, in_stack = false;
+    const char *instruction = NULL;
+    frame_t **stack;
+    if (supp_list == NULL)
+        return 0;
+    stack = (frame_t **) malloc(num_lines * sizeof(*stack));
+    if (stack == NULL)
+        return 0;
+    for (i = 0; i <= num_lines; i++) {
+        const char *line = (i < num_lines) ? lines[i] : "";
+        const char *title = line;
+        int id;
+        int len = 0;
+        if (strncmp(title, "Potential ", 10) == 0)
+            title += 10;
+        if (i == num_lines || line[0] == '\0' ||
+            (sscanf(title, "Error #%d: %n", &id, &len) == 1 && len > 0)) {
+            if (in_error && type >= 0 && num_frames > 0) {
+                supp_spec_t *spec = error_suppressed(type, stack, num_frames,
+                                                     instruction);
+                if (spec != NULL) {
+                    uint j;
+                    /* Also drop the blank line ending it */
+                    for (j = start; j < i + (line[0] == '\0' && i < num_lines); j++)
+                        drop[j] = true;
+                    matched[start] = spec;
+                    count++;
+                }
+            }
+            in_error = (len > 0);
+            if (in_error) {
+                start = i;
+                type = get_error_type(title + len);
+                num_frames = 0;
+                instruction = NULL;
+                in_stack = true;
+            }
+            continue;
+        }
+        if (!in_error)
+            continue;
+        if (in_stack) {
+            if (frames[i] != NULL && frames[i]->prefix_len == 0) {
+                if (!frames[i]->truncated)
+                    stack[num_frames++] = frames[i];
+            }
+            else if (strncmp(line, LINE_PREFIX, strlen(LINE_PREFIX)) != 0)
+                in_stack = false;
+        }
+        if (strncmp(line, INFO_PFX"instruction: ", strlen(INFO_PFX) + 13) == 0)
+            instruction = line + strlen(INFO_PFX) + 13;
+    }
+    free(stack);
+    return count;
+}
+
+static bool
+symbolize_file(const char *logdir, const char *fname)
+{
+    char path[MAXIMUM_PATH];
+    char *buf, **lines;
+    frame_t **frames;
+    bool *drop;
+    supp_spec_t **matched;
+    FILE *out;
+    uint num_lines, i, symbolized = 0, suppressed;
+    bool crlf, res = false;
+    const char *eol;
+    dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s/%s", logdir, fname);
+    NULL_TERMINATE_BUFFER(path);
+    buf = read_entire_file(path);
+    if (buf == NULL) {
+        printf("ERROR: unable to read %s\n", path);
+        return false;
+    }
+    lines = split_lines(buf, &num_lines, &crlf);
+    frames = (frame_t **) calloc(num_lines + 1, sizeof(*frames));
+    drop = (bool *) calloc(num_lines + 1, sizeof(*drop));
+    matched = (supp_spec_t **) calloc(num_lines + 1, sizeof(*matched));
+    if (lines == NULL || frames == NULL || drop == NULL || matched == NULL) {
+        printf("ERROR: out of memory processing %s\n", path);
+        goto symbolize_file_done;
+    }
+    eol = crlf ? "\r\n" : "\n";
+    for (i = 0; i < num_lines; i++)
+        frames[i] = frame_parse(lines[i]);
+    lookup_callstacks(lines, frames, num_lines);
+    suppressed = suppress_errors(lines, frames, num_lines, drop, matched);
+
+    /* We read it all in so we can rewrite it in place */
+    out = fopen(path, "wb");
+    if (out == NULL) {
+        printf("ERROR: unable to write %s\n", path);
+        goto symbolize_file_done;
+    }
+    for (i = 0; i < num_lines; i++) {
+        if (drop[i] || strncmp(lines[i], "Symbols deferred:", 17) == 0)
+            continue;
+        if (frames[i] != NULL && frames[i]->truncated) {
+            /* including its file:line placeholder under -callstack_style 0x20 */
+            if (i + 1 < num_lines && frames[i + 1] == NULL &&
+                (strcmp(lines[i + 1], NO_SRCFILE_LINE) == 0 ||
+                 strcmp(lines[i + 1], SYSCALL_SRCFILE_LINE) == 0))
+                i++;
+            continue;
+        }
+        if (frames[i] != NULL && frames[i]->symbolized) {
+            print_frame(out, frames[i], lines[i], eol);
+            /* print_frame() already replaced the client's placeholder */
+            if (TEST(PRINT_SRCFILE_NEWLINE, print_flags) && i + 1 < num_lines &&
+                strcmp(lines[i + 1], NO_SRCFILE_LINE) == 0)
+                i++;
+            symbolized++;
+        } else
+            fprintf(out, "%s", lines[i]);
+        fprintf(out, "%s", eol);
+    }
+    if (suppressed > 0) {
+        fprintf(out, "%sSUPPRESSED AFTER SYMBOLIZING: %u error(s), still included in "
+                "the counts above%s", eol, suppressed, eol);
+        for (i = 0; i < num_lines; i++) {
+            if (matched[i] != NULL) {
+                fprintf(out, "  %s => %s%s", lines[i],
+                        matched[i]->name == NULL ? "<no name>" : matched[i]->name, eol);
+            }
+        }
+    }
+    fclose(out);
+    if (verbose) {
+        printf("symbolized %u frames and suppressed %u errors in %s\n",
+               symbolized, suppressed, path);
+    }
+    res = true;
+
+ symbolize_file_done:
+    if (frames != NULL) {
+        for (i = 0; i < num_lines; i++)
+            free(frames[i]);
+    }
+    free(frames);
+    free(drop);
+    free(matched);
+    free(lines);
+    free(buf);
+    return res;
+}
+
+static bool
+symbolize_results(const char *logdir)
+{
+    bool res = true;
+    uint i;
+    supp_spec_t *spec, *next;
+    if (!read_module_list(logdir))
+        return false;
+    read_suppressions(logdir);
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(deferred_fnames); i++) {
+        if (!symbolize_file(logdir, deferred_fnames[i]))
+            res = false;
+    }
+    for (spec = supp_list; spec != NULL; spec = next) {
+        next = spec->next;
+        supp_spec_free(spec);
+    }
+    for (i = 0; i < num_modpaths; i++)
+        free(modpaths[i]);
+    free(modpaths);
+    for (i = 0; i < num_truncate_below; i++)
+        free(truncate_below[i]);
+    free(truncate_below);
+    return res;
+}
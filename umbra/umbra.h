@@ -208,6 +208,17 @@ typedef void (*app_memory_mremap_cb_t)(umbra_map_t *map,
                                        app_pc new_base, size_t new_size);
 #endif
 
+/**
+ * Shadow memory creation/deletion callback function type.
+ * These callbacks are called when Umbra maps or unmaps shadow memory directly
+ * from the operating system, which currently only happens for 64-bit.  Shadow
+ * memory and metadata that come from DR's heap are not reported.
+ */
+typedef void (*shadow_memory_create_cb_t)(umbra_map_t *map,
+                                          byte *shadow_start, size_t size);
+typedef void (*shadow_memory_delete_cb_t)(umbra_map_t *map,
+                                          byte *shadow_start, size_t size);
+
 /** Specifies parameters controlling the behavior of umbra_create_map(). */
 typedef struct _umbra_map_options_t {
     /** For compatibility.  Set to sizeof(umbra_map_options_t). */
@@ -259,6 +270,12 @@ typedef struct _umbra_map_options_t {
     /** Application memory re-map callback. */
     app_memory_mremap_cb_t app_memory_mremap_cb;
 #endif
+
+    /** Shadow memory creation callback.  Optional. */
+    shadow_memory_create_cb_t shadow_memory_create_cb;
+
+    /** Shadow memory deletion callback.  Optional. */
+    shadow_memory_delete_cb_t shadow_memory_delete_cb;
 } umbra_map_options_t;
 
 /***************************************************************************
@@ -790,6 +790,10 @@ umbra_map_shadow_free(umbra_map_t *map,
                       void *user_data)
 {
     dr_raw_mem_free(info->shadow_base, info->shadow_size);
+    if (map->options.shadow_memory_delete_cb != NULL) {
+        map->options.shadow_memory_delete_cb(map, info->shadow_base,
+                                             info->shadow_size);
+    }
     return true;
 }
 
@@ -854,6 +858,10 @@ umbra_create_shadow_memory_arch(umbra_map_t *map,
                     umbra_set_shadow_bitmap(map, res);
                     ASSERT(umbra_shadow_block_exist(map, res),
                            "fail to set shadow bitmap");
+                    if (map->options.shadow_memory_create_cb != NULL) {
+                        map->options.shadow_memory_create_cb
+                            (map, res, map->shadow_block_size);
+                    }
                 }
             }
             umbra_map_unlock(map);